@@ -75,6 +75,16 @@ static uint8_t l3_address;
 
 status_handler_t app_status_handler = (status_handler_t)NULL;
 
+#if defined(XC16) || defined(__XC8)
+int16_t can_task = -1;
+
+static result_t can_poll(void)
+{
+	can_l2_tasks();
+	return(0);
+}
+#endif
+
 #if (defined(SYS_CAN_ISO15765) || defined(SYS_ISO11783) || defined(SYS_TEST_L3_ADDRESS))
 result_t can_init(can_baud_rate_t baudrate, uint8_t arg_l3_address, status_handler_t status_handler, ty_can_l2_mode mode)
 #else
@@ -95,6 +105,11 @@ result_t can_init(can_baud_rate_t baudrate, status_handler_t status_handler,  ty
 	 */
 	frame_dispatch_init();
 
+#if defined(XC16) || defined(__XC8)
+	can_task = libesoup_task_register(can_poll, CAN_L2_POLLED);
+	if(can_task < 0) return(can_task);
+#endif
+
 	/*
 	 * Initialise layer 2
 	 */
@@ -219,11 +219,30 @@ typedef struct
  */
 #define CAN_ISO15765_LOGGER_PROTOCOL_ID    0x01
 #define CAN_ISO15765_DCNCP_PROTOCOL_ID     0x02
+#define CAN_ISO15765_LOOP_STATS_PROTOCOL_ID 0x03
 
 
 #ifdef SYS_CAN_ISO15765_LOG
+/*
+ * Level byte flag of a binary record in a logger message, see
+ * libesoup/logger/iso15765_log.c
+ */
+#define ISO15765_LOG_BINARY     0x80
+
 extern void iso15765_log(uint8_t level, char *msg);
 
+#ifdef SYS_CAN_ISO15765_LOG_BATCH
+/*
+ * With SYS_CAN_ISO15765_LOG_BATCH log records are packed in to one ISO15765
+ * message, sent when full or SYS_CAN_ISO15765_LOG_BATCH_TIMEOUT mS after
+ * the first record. iso15765_log_binary() adds a record of up to 255 bytes
+ * of binary data, for example a binary serial log record, and
+ * iso15765_log_flush() sends the batch now.
+ */
+extern result_t iso15765_log_binary(uint8_t level, uint8_t *data, uint8_t len);
+extern result_t iso15765_log_flush(void);
+#endif
+
 /*
  * net_log_reg_as_handler
  *
@@ -231,6 +250,7 @@ extern void iso15765_log(uint8_t level, char *msg);
  * debug messages and the minimum level that we're expecting to receive.
  */
 extern result_t iso15765_logger_register_as_logger(void (*handler)(uint8_t, uint8_t, char *), uint8_t level);
+extern void     iso15765_logger_set_binary_handler(void (*handler)(uint8_t, uint8_t, uint8_t *, uint8_t));
 //extern result_t net_logger_local_register(void (*handler)(uint8_t, uint8_t, char *), uint8_t level);
 //extern result_t net_logger_local_cancel(void);
 
@@ -365,6 +385,18 @@ extern void can_l2_set_node_baudrate(can_baud_rate_t baudrate);
 
 #if defined(XC16) || defined(__XC8)
 extern void can_tasks(void);
+
+/*
+ * The dsPIC33 ECAN and MCP2515 L2 drivers flag can_task from their receive
+ * ISR. The pic18f driver isn't interrupt driven so is polled on every loop.
+ */
+#if defined(__dsPIC33EP256MU806__) || defined(BRD_CAN_BUS_MCP2515)
+#define CAN_L2_POLLED  FALSE
+#else
+#define CAN_L2_POLLED  TRUE
+#endif
+
+extern int16_t can_task;
 #endif
 
 
@@ -386,10 +418,15 @@ extern void dcncp_iso15765_init(void);
 
 #endif // ISO15765
 
-#if defined(ISO11783)
+#if defined(SYS_ISO11783)
 
 extern result_t  iso11783_init(uint8_t);
 
+extern uint32_t pgn_to_canid(uint8_t priority, uint32_t pgn, uint8_t dst);
+extern uint32_t canid_to_pgn(uint32_t canid);
+extern uint8_t  get_source_address_from_canid(uint32_t canid);
+extern uint8_t  get_destination_address_from_canid(uint32_t canid);
+
 extern result_t iso11783_tx_msg(iso11783_msg_t *msg);
 extern result_t iso11783_dispatch_reg_handler(iso11783_target_t *target);
 extern result_t iso11783_dispatch_unreg_handler(uint8_t id);
@@ -34,8 +34,8 @@
 #endif
 #endif
 
-#ifndef SYS_CAN_FRAME_HANDLER_ARRAY_SIZE
-#error libesoup_config.h file should define SYS_CAN_FRAME_HANDLER_ARRAY_SIZE (see libesoup/examples/libesoup_config.h)
+#ifndef SYS_CAN_L2_HANDLER_ARRAY_SIZE
+#error libesoup_config.h file should define SYS_CAN_L2_HANDLER_ARRAY_SIZE (see libesoup/examples/libesoup_config.h)
 #endif
 
 
@@ -59,7 +59,7 @@ typedef struct
 	can_l2_target_t target;
 } can_register_t;
 
-static can_register_t registered_handlers[SYS_CAN_FRAME_HANDLER_ARRAY_SIZE];
+static can_register_t registered_handlers[SYS_CAN_L2_HANDLER_ARRAY_SIZE];
 static can_l2_frame_handler_t unhandled_handler;
 
 result_t frame_dispatch_init(void)
@@ -71,7 +71,7 @@ result_t frame_dispatch_init(void)
         /*
          * Initialise the Handlers table
          */
-        for(loop = 0; loop < SYS_CAN_FRAME_HANDLER_ARRAY_SIZE; loop++) {
+        for(loop = 0; loop < SYS_CAN_L2_HANDLER_ARRAY_SIZE; loop++) {
 		registered_handlers[loop].used = FALSE;
 		registered_handlers[loop].target.mask = 0x00;
 		registered_handlers[loop].target.filter = 0x00;
@@ -175,6 +175,7 @@ void __attribute__((__interrupt__, __no_auto_psv__)) _C1Interrupt(void)
 		if(C1INTFbits.RBIF) {
 			C1INTFbits.RBIF = 0;
 			LOG_D("RBIF\n\r");
+			libesoup_task_pending(can_task);
 #ifdef SYS_CAN_BAUD_AUTO_DETECT
 			rx_frame_count++;
 #endif
@@ -423,6 +424,7 @@ result_t can_l2_init(can_baud_rate_t arg_baud_rate, status_handler_t arg_status_
 //        C1INTEbits.IVRIE  = 0b01;
         C1INTEbits.FIFOIE = 0b01;
         C1INTEbits.TBIE   = 0b01;
+        C1INTEbits.RBIE   = 0b01;   // Flags can_task for received frames
 
         IFS2bits.C1IF   = 0x00;
         IEC2bits.C1IE   = 0x01;
@@ -446,10 +448,6 @@ result_t can_l2_init(can_baud_rate_t arg_baud_rate, status_handler_t arg_status_
 		}
 	} else if (current_status == can_l2_detecting_baud) {
 #ifdef SYS_CAN_BAUD_AUTO_DETECT
-		/*
-		 * Enable the Rx Interrupt
-		 */
-		C1INTEbits.RBIE   = 0b01;
 		set_mode(LISTEN_ONLYMODE);
 		
 		/*
@@ -626,11 +624,6 @@ result_t can_l2_baud_found(can_baud_rate_t rate)
 {
 	result_t rc;
 
-	/*
-	 * Finished with the Rx Interrupt
-	 */
-	C1INTEbits.RBIE   = 0b00;
-	
 	baud_rate = rate;
 	current_status = can_l2_connecting;
 
@@ -211,6 +211,7 @@ void _ISR __attribute__((__no_auto_psv__)) _INT0Interrupt(void)
         LOG_E("Overlapping MCP2515 ISR\n\r");
     }
     mcp2515_isr = TRUE;
+    libesoup_task_pending(can_task);
     IFS0bits.INT0IF = 0;
 }
 
@@ -23,9 +23,10 @@
  */
 #include "libesoup_config.h"
 
-#ifdef SYS_CAN_ISO11783
+#ifdef SYS_ISO11783
 
-#include "libesoup/can/es_can.h"
+#include "libesoup/errno.h"
+#include "libesoup/comms/can/can.h"
 
 #ifdef SYS_SERIAL_LOGGING
 #define DEBUG_FILE
@@ -105,10 +106,10 @@ static const char *TAG = "ISO11783";
 
 #define TIMER_Tr                  200
 #define TIMER_Th                  500
-#define TIMER_1                   750
-#define TIMER_2                   1250
-#define TIMER_3                   1250
-#define TIMER_4                   1050
+#define TIMER_T1                  750
+#define TIMER_T2                  1250
+#define TIMER_T3                  1250
+#define TIMER_T4                  1050
 
 #define ACK                       0
 #define NACK                      1
@@ -152,24 +153,17 @@ result_t iso11783_init(uint8_t address)
 	 * Define our target for Layer 2 Frames and register it.
 	 * Looking for Extended frame with EDP Bit set to Zero
 	 */
-	target.mask   = SYS_CAN_EFF_FLAG | CAN_EDP_MASK;
-	target.filter =  SYS_CAN_EFF_FLAG;
+	target.mask   = CAN_EFF_FLAG | CAN_EDP_MASK;
+	target.filter =  CAN_EFF_FLAG;
 	target.handler = iso11783_frame_handler;
 
-	can_l2_dispatch_reg_handler(&target);
-
-	return(SUCCESS);
+	return(frame_dispatch_reg_handler(&target));
 }
 
-u32 pgn_to_canid(uint8_t priority, uint32_t pgn, u8 dst)
+uint32_t pgn_to_canid(uint8_t priority, uint32_t pgn, uint8_t dst)
 {
-//	u32 pgn;
 	uint8_t  pf;
-//	uint8_t  ps;
-//	uint8_t  sa;
-//	uint8_t  da;
-//	uint8_t  loop;
-	u32 canid = 0x00;
+	uint32_t canid = 0x00;
 
 	canid = (priority & 0x07);
 	canid = (canid << 2) | ((pgn & (PGN_EDP_MASK | PGN_DP_MASK)) >> 16);
@@ -177,59 +171,55 @@ u32 pgn_to_canid(uint8_t priority, uint32_t pgn, u8 dst)
 	pf = (uint8_t)((pgn & PGN_PF_MASK) >> 8);
 	canid = canid << 8 | pf;
 
+	/*
+	 * PDU 1 Formats are addressed, PDU 2 carry the Group Extension
+	 */
 	if(pf < PF_PDU_2_CUTOFF) {
-		canid = canid << 8 | (pgn & PGN_PS_MASK);
-	} else {
 		canid = canid << 8 | dst;
+	} else {
+		canid = canid << 8 | (pgn & PGN_PS_MASK);
 	}
 
 	canid = canid << 8 | node_address;
 
-	return(canid);
+	return(canid | CAN_EFF_FLAG);
 }
 
-u32 canid_to_pgn(u32 canid)
+uint32_t canid_to_pgn(uint32_t canid)
 {
-	u32 pgn = 0x00;
-#if 0
+	uint32_t pgn;
 	uint8_t  pf;
-	uint8_t  ps;
-
-	sa = (uint8_t)(frame->can_id & 0xff);
 
 	/*
 	 * EDP Bit is always 0! so move on to DP bit
 	 */
-	pgn = (uint8_t)((canid & (CAN_EDP_MASK | SYS_CAN_DP_MASK)) >> 24);
+	pgn = (canid & (CAN_EDP_MASK | CAN_DP_MASK)) >> 8;
 
-	pf = (uint8_t)((canid & SYS_CAN_PF_MASK) >> 16);
+	pf = (uint8_t)((canid & CAN_PF_MASK) >> 16);
+	pgn |= (uint32_t)pf << 8;
 
-	if(pf < PF_PDU_2_CUTOFF) {
-		da = (uint8_t) ((frame->can_id & PS_MASK) >> 8);
-		da_valid = 0x01;
-		ps = 0x00;
-	} else {
-		ps = (uint8_t) ((frame->can_id & PS_MASK) >> 8);
+	/*
+	 * PDU 1 Formats carry a Destination Address, not part of the PGN
+	 */
+	if(pf >= PF_PDU_2_CUTOFF) {
+		pgn |= (canid & CAN_PS_MASK) >> 8;
 	}
-	pgn = (pgn << 8) | pf;
-	pgn = (pgn << 8) | ps;
-#endif
 	return(pgn);
 }
 
-uint8_t get_source_address_from_canid(u32 canid)
+uint8_t get_source_address_from_canid(uint32_t canid)
 {
-	return((uint8_t)(canid & SYS_CAN_SA_MASK));
+	return((uint8_t)(canid & CAN_SA_MASK));
 }
 
-uint8_t get_destination_address_from_canid(u32 canid)
+uint8_t get_destination_address_from_canid(uint32_t canid)
 {
 	uint8_t  pf;
 
-	pf = (uint8_t)((canid & SYS_CAN_PF_MASK) >> 16);
+	pf = (uint8_t)((canid & CAN_PF_MASK) >> 16);
 
 	if(pf < PF_PDU_2_CUTOFF) {
-		return((uint8_t) ((canid & SYS_CAN_PS_MASK) >> 8));
+		return((uint8_t) ((canid & CAN_PS_MASK) >> 8));
 	}
 	return(0xff);
 }
@@ -244,10 +234,10 @@ result_t iso11783_tx_msg(iso11783_msg_t *msg)
 
 	can_l2_tx_frame(&frame);
 
-	return(SUCCESS);
+	return(0);
 }
 
-result_t iso11783_tx_pgn_request(uint8_t priority, u8 dst, u32 pgn)
+result_t iso11783_tx_pgn_request(uint8_t priority, uint8_t dst, uint32_t pgn)
 {
 	can_frame frame;
 	LOG_D("iso11783_tx_pgn_request()\n\r");
@@ -261,13 +251,13 @@ result_t iso11783_tx_pgn_request(uint8_t priority, u8 dst, u32 pgn)
 
 	can_l2_tx_frame(&frame);
 
-	return(SUCCESS);
+	return(0);
 }
 
-result_t iso11783_tx_ack_pgn(uint8_t priority, u8 dst, u32 pgn, iso11783_ack_t ack_value)
+result_t iso11783_tx_ack_pgn(uint8_t priority, uint8_t dst, uint32_t pgn, iso11783_ack_t ack_value)
 {
 	uint8_t        loop;
-	u32       tmp_pgn;
+	uint32_t       tmp_pgn;
 	can_frame frame;
 	LOG_D("iso11783_tx_ack_pgn()\n\r");
 
@@ -288,12 +278,12 @@ result_t iso11783_tx_ack_pgn(uint8_t priority, u8 dst, u32 pgn, iso11783_ack_t a
 
 	can_l2_tx_frame(&frame);
 
-	return(SUCCESS);
+	return(0);
 }
 
 void iso11783_frame_handler(can_frame *frame)
 {
-	u32            pgn;
+	uint32_t            pgn;
 //	uint8_t             pf;
 //	uint8_t             ps;
 	uint16_t            loop;
@@ -310,13 +300,13 @@ void iso11783_frame_handler(can_frame *frame)
 	 */
 	pgn = canid_to_pgn(frame->can_id);
 
-	LOG_D("iso11783_frame_handler received PGN %d  =  0x%lx\n\r", pgn, pgn);
-	LOG_D(" PGN %d (0x%x) [", pgn, pgn);
+	LOG_D("iso11783_frame_handler received PGN 0x%lx\n\r", pgn);
 
-	for(loop = 0; loop < frame->can_dlc; loop++) {
-		printf("%x,", frame->data[loop]);
-	}
-	printf("\n\r");
+	msg.source      = get_source_address_from_canid(frame->can_id);
+	msg.destination = get_destination_address_from_canid(frame->can_id);
+	msg.priority    = (uint8_t)((frame->can_id >> 26) & 0x07);
+	msg.pgn         = pgn;
+	msg.data        = frame->data;
 
 #if (defined(SYS_SERIAL_LOGGING) && defined(DEBUG_FILE) && (SYS_LOG_LEVEL <= LOG_DEBUG))
 	if(pgn == 126992) {
@@ -373,7 +363,7 @@ result_t iso11783_dispatch_reg_handler(iso11783_target_t *target)
 			registered[loop].pgn = target->pgn;
 			registered[loop].handler = target->handler;
 			target->handler_id = loop;
-			return(SUCCESS);
+			return(0);
 		}
 	}
 
@@ -387,7 +377,7 @@ result_t iso11783_dispatch_unreg_handler(uint8_t id)
 		registered[id].used = FALSE;
 		registered[id].pgn = 0x00;
 		registered[id].handler = (iso11783_msg_handler_t)NULL;
-		return(SUCCESS);
+		return(0);
 	}
 	return(-ERR_BAD_INPUT_PARAMETER);
 }
@@ -395,7 +385,7 @@ result_t iso11783_dispatch_unreg_handler(uint8_t id)
 result_t iso11783_dispatch_set_unhandled_handler(iso11783_msg_handler_t handler)
 {
 	unhandled_handler = (iso11783_msg_handler_t)handler;
-	return(SUCCESS);
+	return(0);
 }
 
-#endif // SYS_CAN_ISO11783
+#endif // SYS_ISO11783
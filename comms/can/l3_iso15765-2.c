@@ -101,8 +101,21 @@ typedef union
 #define ISO15765_CF 0x20
 #define ISO15765_FC 0x30
 
+/*
+ * Flow Control parameters sent to a transmitting node. libesoup_config.h can
+ * override them, for example to take a long message in fewer, faster blocks.
+ */
+#ifdef SYS_CAN_ISO15765_BLOCK_SIZE
+#define BLOCK_SIZE SYS_CAN_ISO15765_BLOCK_SIZE
+#else
 #define BLOCK_SIZE 2
+#endif
+
+#ifdef SYS_CAN_ISO15765_SEPERATION_TIME
+#define SEPERATION_TIME SYS_CAN_ISO15765_SEPERATION_TIME
+#else
 #define SEPERATION_TIME 0x25
+#endif
 
 #define ISO15765_EXTENDED TRUE
 #define ISO15765_MASK     0xfffeff00
@@ -271,6 +284,7 @@ uint8_t iso15765_initialised(void)
 
 result_t iso15765_tx_msg(iso15765_msg_t *msg)
 {
+	result_t                 rc;
 	uint8_t                 *data_ptr;
 	uint16_t          loop;
 	iso15765_id       id;
@@ -310,7 +324,6 @@ result_t iso15765_tx_msg(iso15765_msg_t *msg)
 		return(-ERR_BUSY);
 	}
 	tx_buffer = &mcp_tx_buffer;
-	mcp_transmitter_busy = TRUE;
 #elif defined(ES_LINUX)
 	/*
 	 * Check for a transmit buffer already active to the destination
@@ -324,7 +337,9 @@ result_t iso15765_tx_msg(iso15765_msg_t *msg)
 		LOG_E("Malloc Failed\n\r");
 		exit(1);
 	}
-	node_buffers[msg->address].tx_buffer = tx_buffer;
+#else
+#error Unrecognised Compiler!
+#endif
 	init_tx_buffer(tx_buffer);
 
 	/*
@@ -345,18 +360,25 @@ result_t iso15765_tx_msg(iso15765_msg_t *msg)
 			tx_buffer->frame.data[loop + 2] = *data_ptr++;
 			LOG_D("ISO15765 TX Byte 0x%x\n\r", tx_buffer->frame.data[loop + 2]);
 		}
-		can_l2_tx_frame(&(tx_buffer->frame));
-	} else {
-		/*
-		 * Copy the l3 message to be sent into the Trasmit buffer.
-		 */
-		memcpy((void*)tx_buffer->data, (void *)msg->data, msg->size);
-		tx_buffer->bytes_to_send = msg->size;
-		tx_buffer->bytes_sent = 0x00;
-		tx_buffer->destination = msg->address;
-#else
-#error Unrecognised Compiler!
+		rc = can_l2_tx_frame(&(tx_buffer->frame));
+#if defined(ES_LINUX)
+		free(tx_buffer);
+#endif
+		return(rc);
+	}
+
+#if defined(XC16) || defined(__XC8)
+	mcp_transmitter_busy = TRUE;
+#elif defined(ES_LINUX)
+	node_buffers[msg->address].tx_buffer = tx_buffer;
 #endif
+	/*
+	 * Copy the l3 message to be sent into the Trasmit buffer.
+	 */
+	memcpy((void*)tx_buffer->data, (void *)msg->data, msg->size);
+	tx_buffer->bytes_to_send = msg->size;
+	tx_buffer->bytes_sent = 0x00;
+	tx_buffer->destination = msg->address;
 
 	// Fill in the can id we're going to use for the transmission.
 	id = tx_frame_id;
@@ -427,7 +449,7 @@ void exp_sendConsecutiveFrame(timer_id timer, union sigval data)
 			/*
 			 * Free the Transmit buffer
 			 */
-			node_buffers[tx_buffer->destination].rx_buffer = NULL;
+			node_buffers[tx_buffer->destination].tx_buffer = NULL;
                         free(tx_buffer);
 #endif
 		} else {
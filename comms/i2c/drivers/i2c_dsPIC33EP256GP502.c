@@ -77,6 +77,7 @@ void __attribute__((__interrupt__, __no_auto_psv__)) _MI2C1Interrupt(void)
 {
 //	uint8_t  rx_char;
 
+	libesoup_task_pending(i2c_task);
 	serial_printf("M*\n\r");
 //	serial_printf("*%d*\n\r", current_state);
 #if 0
@@ -180,6 +181,7 @@ void __attribute__((__interrupt__, __no_auto_psv__)) _MI2C1Interrupt(void)
 #ifdef SYS_I2C_2
 void __attribute__((__interrupt__, __no_auto_psv__)) _MI2C2Interrupt(void)
 {
+	libesoup_task_pending(i2c_task);
 }
 #endif // SYS_I2C_2
 
@@ -188,6 +190,7 @@ void __attribute__((__interrupt__, __no_auto_psv__)) _SI2C1Interrupt(void)
 {
 //	uint16_t stat_reg;
 
+	libesoup_task_pending(i2c_task);
 	gpio_set(RB13, GPIO_MODE_DIGITAL_OUTPUT, 0);
 
 	serial_printf("S1* 0x%x\n\r", I2C1ADD);
@@ -209,6 +212,7 @@ void __attribute__((__interrupt__, __no_auto_psv__)) _SI2C1Interrupt(void)
 #ifdef SYS_I2C_2
 void __attribute__((__interrupt__, __no_auto_psv__)) _SI2C2Interrupt(void)
 {
+	libesoup_task_pending(i2c_task);
 	serial_printf("S");
 }
 #endif
@@ -15,6 +15,13 @@
 
 struct i2c_channel_data i2c_channels[NUM_I2C_CHANNELS];
 
+/*
+ * i2c_tasks() is only called once a driver's ISR has flagged this task
+ */
+int16_t i2c_task = -1;
+
+static result_t i2c_tasks(void);
+
 /*
  * Implemented by device specific I2C Code
  */
@@ -43,10 +50,12 @@ result_t i2c_init(void)
 		i2c_channels[1].active_device = NULL;
 		i2c_channels[i].state         = idle;
 	}
+	i2c_task = libesoup_task_register(i2c_tasks, FALSE);
+	if(i2c_task < 0) return(i2c_task);
 	return (SUCCESS);
 }
 
-result_t i2c_tasks(void)
+static result_t i2c_tasks(void)
 {
 	uint8_t  i;
         result_t rc = SUCCESS;
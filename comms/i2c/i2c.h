@@ -65,6 +65,12 @@ struct i2c_channel_data {
 	void             (*read_callback)(result_t, uint8_t);
 };
 
+/*
+ * Identifier of the I2C task, flagged by the driver ISRs with
+ * libesoup_task_pending()
+ */
+extern int16_t i2c_task;
+
 extern result_t i2c_reserve(struct i2c_device *device);
 extern result_t i2c_release(struct i2c_device *device);
 
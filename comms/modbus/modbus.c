@@ -122,9 +122,14 @@ uint16_t crc_calculate(uint8_t *data, uint16_t len)
 	uint8_t  crc_low  = 0xFF; /* low byte of CRC initialised */
 	uint16_t index;           /* will index into CRC lookup table */
 
+	/*
+	 * A frame is at most 256 bytes so one clear of the Watchdog covers
+	 * the whole calculation rather than one per byte.
+	 */
+	CLEAR_WDT
+
 	while (len--) {      /* pass through message buffer */
 		             /* calculate the CRC */
-		asm ("CLRWDT");
 		index = crc_high ^ *ptr++;
 		crc_high = crc_low ^ crc_high_bytes[index];
 		crc_low  = crc_low_bytes[index];
@@ -132,6 +137,18 @@ uint16_t crc_calculate(uint8_t *data, uint16_t len)
 	return (crc_high << 8 | crc_low);
 }
 
+/*
+ * Add one character to a running CRC, started at MODBUS_CRC_INIT. The value
+ * is the same crc_calculate() returns over the characters so far.
+ */
+uint16_t crc_update(uint16_t crc, uint8_t ch)
+{
+	uint8_t index;
+
+	index = (uint8_t)(crc >> 8) ^ ch;
+	return ((((crc & 0xff) ^ crc_high_bytes[index]) << 8) | crc_low_bytes[index]);
+}
+
 uint8_t crc_check(uint8_t *data, uint16_t len)
 {
         uint16_t crc;
@@ -247,7 +264,7 @@ static void modbus_process_rx_character(uint8_t uindex, uint8_t ch)
 	uint8_t i;
 
 	for (i = 0; i < SYS_MODBUS_NUM_CHANNELS; i++) {
-		if (channels[i].app_data && channels[i].app_data->uart_data.uindex == uindex) {
+		if (channels[i].app_data && channels[i].app_data->uart_data.channel == uindex) {
 			if(channels[i].process_rx_character) {
 				channels[i].process_rx_character(&channels[i], ch);
 			} else {
@@ -270,7 +287,7 @@ void modbus_tx_finished(struct uart_data *uart)
 	 */
 
 	for (i = 0; i < SYS_MODBUS_NUM_CHANNELS; i++) {
-		if (channels[i].app_data && channels[i].app_data->uart_data.uindex == uart->uindex) {
+		if (channels[i].app_data && channels[i].app_data->uart_data.channel == uart->channel) {
 			break;
 		}
 	}
@@ -327,6 +344,16 @@ modbus_id modbus_reserve(struct modbus_app_data *app_data)
 
 	app_data->uart_data.process_rx_char = modbus_process_rx_character;
 	app_data->uart_data.tx_finished     = modbus_tx_finished;
+#ifdef SYS_UART_ADDRESS_DETECT
+	/*
+	 * A slave on a 9 bit bus only wakes for its own and broadcast frames,
+	 * the master receives every response.
+	 */
+	app_data->uart_data.rx_address_enable   = (app_data->address != 0);
+	app_data->uart_data.rx_address          = app_data->address;
+	app_data->uart_data.rx_broadcast_enable = (app_data->address != 0);
+	app_data->uart_data.rx_broadcast        = 0;
+#endif
 
 	/*
 	 * Reserve a UART for the channel
@@ -413,6 +440,17 @@ result_t modbus_release(struct modbus_app_data *app_data)
 	return(uart_release(&app_data->uart_data));
 }
 
+/*
+ * A frame is built where it's transmitted from. With SYS_UART_TX_SEGMENTS
+ * that's the channel's tx_frame, which the UART reads without a copy. The
+ * callers check the channel is idle before building a frame in it.
+ */
+#ifdef SYS_UART_TX_SEGMENTS
+#define MODBUS_TX_FRAME(name, size)  uint8_t *name = channels[chan].tx_frame
+#else
+#define MODBUS_TX_FRAME(name, size)  uint8_t  name[size]
+#endif
+
 #if defined(SYS_MODBUS_MASTER)
 result_t  modbus_read_coils_req(modbus_id                chan,
 	                        uint8_t                  modbus_address,
@@ -420,7 +458,7 @@ result_t  modbus_read_coils_req(modbus_id                chan,
                                 uint16_t                 number_of_coils,
 				modbus_response_function callback)
 {
-	uint8_t   tx_buffer[6];
+	MODBUS_TX_FRAME(tx_buffer, 6);
 	
 	if (chan >= SYS_MODBUS_NUM_CHANNELS || !channels[chan].app_data || !callback) {
 		return(-ERR_BAD_INPUT_PARAMETER);
@@ -458,7 +496,7 @@ extern result_t  modbus_read_holding_regs_req(modbus_id                chan,
                                               uint16_t                 number_of_regs,
 				              modbus_response_function callback)
 {
-	uint8_t   tx_buffer[6];
+	MODBUS_TX_FRAME(tx_buffer, 6);
 
 	if (chan >= SYS_MODBUS_NUM_CHANNELS || !channels[chan].app_data || !callback) {
 		return(-ERR_BAD_INPUT_PARAMETER);
@@ -495,7 +533,7 @@ result_t  modbus_error_resp(modbus_id  chan,
                             uint8_t    modbus_function,
                             uint8_t    exception)
 {
-	uint8_t  response[3];
+	MODBUS_TX_FRAME(response, 3);
 	
 	if (chan >= SYS_MODBUS_NUM_CHANNELS || !channels[chan].app_data) {
 		LOG_E("Bad chan\n\r");
@@ -529,7 +567,7 @@ result_t  modbus_read_coils_resp(modbus_id   chan,
                                  uint8_t     len)
 {
 	uint8_t   i;
-	uint8_t   tx_buffer[254];
+	MODBUS_TX_FRAME(tx_buffer, MODBUS_TX_FRAME_SIZE);
 
 	/*
 	 * Maximum frame size if 256 bytes which includes an address byte and
@@ -570,7 +608,7 @@ result_t  modbus_read_registers_resp(modbus_id   chan,
                                      uint8_t     len)
 {
 	uint8_t   i;
-	uint8_t   tx_buffer[254];
+	MODBUS_TX_FRAME(tx_buffer, MODBUS_TX_FRAME_SIZE);
 
 	/*
 	 * Maximum frame size if 256 bytes which includes an address byte and
@@ -607,23 +645,71 @@ result_t  modbus_read_registers_resp(modbus_id   chan,
 
 result_t modbus_tx_data(struct modbus_channel *chan, uint8_t *data, uint16_t len)
 {
+	result_t      rc;
 	uint16_t      crc;
-	uint8_t      *ptr;
-	uint16_t      loop;
-	uint8_t       buffer[SYS_UART_TX_BUFFER_SIZE];
-
-	ptr = data;
+	uint8_t      *tx_data = data;
+	uint16_t      tx_len  = len;
+#ifndef SYS_UART_TX_SEGMENTS
+	uint8_t       crc_bytes[2];
+#endif
 
 	crc = crc_calculate(data, len);
 
-	for(loop = 0; loop < len; loop++) {
-		buffer[loop] = *ptr++;
+#ifndef SYS_UART_TX_SEGMENTS
+	/*
+	 * Queue the frame and its CRC straight from the caller's buffer, only
+	 * if the whole frame will fit so a frame is never sent truncated.
+	 */
+	rc = uart_tx_buffer_space(&chan->app_data->uart_data);
+	RC_CHECK
+	if(rc < (len + 2)) {
+		return(-ERR_NO_RESOURCES);
 	}
+#endif
 
-	buffer[loop++] = (crc >> 8) & 0xff;
-	buffer[loop++] = crc & 0xff;
+#ifdef SYS_UART_ADDRESS_DETECT
+	/*
+	 * The master starts a request on a 9 bit bus with the slave address as
+	 * an address character, responses are all ordinary characters.
+	 */
+	if(  (chan->app_data->address == 0) && (len > 0)
+	   &&((chan->app_data->uart_data.uart_mode & (PDSEL1_MASK | PDSEL0_MASK)) == (PDSEL1_MASK | PDSEL0_MASK))) {
+		rc = uart_tx_address(&chan->app_data->uart_data, data[0]);
+		RC_CHECK
+		tx_data = &data[1];
+		tx_len  = len - 1;
+	}
+#endif
+
+#ifdef SYS_UART_TX_SEGMENTS
+	/*
+	 * The frame, in the channel's tx_frame, and its CRC are transmitted in
+	 * place as two segments.
+	 */
+	chan->tx_crc[0] = (crc >> 8) & 0xff;
+	chan->tx_crc[1] = crc & 0xff;
+
+	chan->tx_segments[0].ptr  = tx_data;
+	chan->tx_segments[0].len  = tx_len;
+	chan->tx_segments[1].ptr  = chan->tx_crc;
+	chan->tx_segments[1].len  = 2;
+
+	chan->tx_request.segments = chan->tx_segments;
+	chan->tx_request.count    = 2;
+	chan->tx_request.done     = NULL;
+	rc = uart_tx_segments(&chan->app_data->uart_data, &chan->tx_request);
+	RC_CHECK
+#else
+	crc_bytes[0] = (crc >> 8) & 0xff;
+	crc_bytes[1] = crc & 0xff;
+
+	rc = uart_tx_buffer(&chan->app_data->uart_data, tx_data, tx_len);
+	RC_CHECK
+	rc = uart_tx_buffer(&chan->app_data->uart_data, crc_bytes, 2);
+	RC_CHECK
+#endif // SYS_UART_TX_SEGMENTS
 
-	return(uart_tx_buffer(&chan->app_data->uart_data, buffer, loop));
+	return(len + 2);
 }
 
 #endif // SYS_MODBUS
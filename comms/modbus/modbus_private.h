@@ -33,6 +33,11 @@
 #include "libesoup/comms/modbus/modbus.h"
 #include "libesoup/timers/sw_timers.h"
 
+/*
+ * Largest frame without its CRC, an address byte and up to 253 PDU bytes
+ */
+#define MODBUS_TX_FRAME_SIZE  254
+
 enum modbus_state {
         mb_m_starting,
         mb_m_idle,
@@ -56,7 +61,26 @@ struct modbus_channel {
         timer_id                 turnaround_timer;
         uint8_t                  rx_buffer[SYS_MODBUS_RX_BUFFER_SIZE];
         uint16_t                 rx_write_index;
+        /*
+         * Running CRCs of the received frame, updated per character, from
+         * rx_buffer[0] and from rx_buffer[1]. A frame followed by its own
+         * CRC leaves a running CRC of zero.
+         */
+        uint16_t                 rx_crc;
+        uint16_t                 rx_crc_offset;
         uint8_t                  tx_modbus_address;
+#ifdef SYS_UART_TX_SEGMENTS
+        /*
+         * Frames are built in tx_frame and handed to the UART, with the CRC
+         * in tx_crc, as segments which are read until the transmission is
+         * finished. The state machine only returns to a state which can
+         * transmit once tx_finished() has been called.
+         */
+        uint8_t                  tx_frame[MODBUS_TX_FRAME_SIZE];
+        uint8_t                  tx_crc[2];
+        struct uart_tx_segment   tx_segments[2];
+        struct uart_tx_request   tx_request;
+#endif
 
         /*
          * function to process response to sent messages
@@ -95,9 +119,16 @@ extern result_t set_slave_transmitting_state(struct modbus_channel *channel);
 extern result_t start_15_timer(struct modbus_channel *channel);
 extern result_t start_35_timer(struct modbus_channel *channel);
 
+/*
+ * With SYS_UART_TX_SEGMENTS data isn't copied so has to be the channel's
+ * tx_frame, otherwise it's copied to the UART's transmit buffer.
+ */
 extern result_t modbus_tx_data(struct modbus_channel *channel, uint8_t *data, uint16_t len);
 
+#define MODBUS_CRC_INIT  0xFFFF
+
 extern uint16_t crc_calculate(uint8_t *data, uint16_t len);
+extern uint16_t crc_update(uint16_t crc, uint8_t ch);
 extern uint8_t crc_check(uint8_t *data, uint16_t len);
 
 #endif //  SYS_MODBUS
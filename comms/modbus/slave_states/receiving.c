@@ -36,11 +36,25 @@ static void process_rx_character(struct modbus_channel *chan, uint8_t ch)
 {
 	start_35_timer(chan);
 
-	chan->rx_buffer[chan->rx_write_index++] = ch;
-
 	if (chan->rx_write_index == SYS_MODBUS_RX_BUFFER_SIZE) {
 		LOG_E("UART 2 Overflow: Line too long\n\r");
+		return;
 	}
+
+	/*
+	 * Keep the CRC of the frame up to date as it arrives so the t3.5
+	 * expiry only has to test for a zero residue. A frame may start on
+	 * index 1 so a second CRC is run from there.
+	 */
+	if (chan->rx_write_index == 0) {
+		chan->rx_crc        = crc_update(MODBUS_CRC_INIT, ch);
+		chan->rx_crc_offset = MODBUS_CRC_INIT;
+	} else {
+		chan->rx_crc        = crc_update(chan->rx_crc, ch);
+		chan->rx_crc_offset = crc_update(chan->rx_crc_offset, ch);
+	}
+
+	chan->rx_buffer[chan->rx_write_index++] = ch;
 }
 
 static void process_timer_35_expiry(struct modbus_channel *chan)
@@ -63,11 +77,12 @@ static void process_timer_35_expiry(struct modbus_channel *chan)
 	}
 
 	/*
-	 * Check if there's a valid Modbus frame starting on index 0
+	 * Check if there's a valid Modbus frame, an address, function code
+	 * and CRC at least, starting on index 0 or 1
 	 */
-        if (crc_check(&(chan->rx_buffer[0]), chan->rx_write_index)) {
+        if ((chan->rx_write_index >= 4) && (chan->rx_crc == 0)) {
 		start_index = 0;
-        } else if (crc_check(&(chan->rx_buffer[1]), chan->rx_write_index - 1)) {
+        } else if ((chan->rx_write_index >= 5) && (chan->rx_crc_offset == 0)) {
 		start_index = 1;
         } else {
 		/*
@@ -99,7 +114,7 @@ static void process_timer_35_expiry(struct modbus_channel *chan)
 		 * Strip off the destination address and CRC no point sending.
 		 */
 		start_index++;
-		len = chan->rx_write_index - 3;   // write index points after end of msg so add one
+		len = chan->rx_write_index - start_index - 2;
 		handler(chan->app_data->channel_id, &(chan->rx_buffer[start_index]), len);
 	}
 }
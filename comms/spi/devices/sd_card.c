@@ -43,6 +43,14 @@
 #include "libesoup/timers/hw_timers.h"
 #include "libesoup/comms/spi/spi.h"
 #include "libesoup/timers/delay.h"
+#include "libesoup/comms/spi/devices/sd_card.h"
+#ifdef SYS_ASYNC_INIT
+#include "libesoup/timers/sw_timers.h"
+
+#ifndef SYS_SW_TIMERS
+#error libesoup_config.h should define SYS_SW_TIMERS (SYS_ASYNC_INIT runs the SD Card init from SW timers)
+#endif
+#endif // SYS_ASYNC_INIT
 
 
 enum sd_cmd {
@@ -51,6 +59,7 @@ enum sd_cmd {
 	sd_cmd8       = 0x08,
 	sd_block_size = 0x10,
 	sd_read       = 0x11,
+	sd_write      = 0x18,
 	sd_cmd41      = 0x29,
 	sd_cmd55      = 0x37,
 };
@@ -62,9 +71,36 @@ struct  __attribute__ ((packed)) sd_card_command {
 struct spi_io_channel spi_io;
 struct spi_device spi_device;
 
+/*
+ * CMD0 is polled for a response every 200uS, ACMD41 every
+ * SD_CARD_INIT_RETRY_mS for up to the second a card is given to initialise.
+ */
+#define SD_CARD_RESET_RETRIES    100
+#define SD_CARD_INIT_RETRIES     10
+#define SD_CARD_INIT_RETRY_mS    100
+
+/*
+ * A write's busy signal is polled every 50uS for up to the 250mS write
+ * timeout of an SDHC card.
+ */
+#define SD_CARD_WRITE_BUSY_RETRIES 5000
+
 static void     init_command(struct sd_card_command *buffer, enum sd_cmd cmd);
 static void     send_command(struct sd_card_command *buffer);
 static result_t set_block_size(uint16_t size);
+static result_t write_block(uint32_t address, uint8_t *buffer);
+
+#ifdef SYS_ASYNC_INIT
+enum init_step {
+	init_cmd8,
+	init_acmd41
+};
+
+static int16_t         init_stage = -1;
+static uint8_t         init_step;
+static uint8_t         init_retries;
+static result_t        init_rc = -ERR_NOT_READY;
+#endif // SYS_ASYNC_INIT
 
 #if 0
 void toggle(timer_id timer, union sigval data)
@@ -101,17 +137,18 @@ void flush(void)
 		flush_byte = (uint8_t)rc;
 	} while (flush_byte != 0xff);
 }
-result_t sd_card_init(void)
+/*
+ * Clock the card in to SPI mode and reset it, CMD0 GO_IDLE_STATE. The card
+ * is left deselected.
+ */
+static result_t card_reset(void)
 {
 	result_t rc;
 	uint8_t  rx_byte;
-	uint8_t  flush_byte;
+	uint8_t  retry;
 	uint8_t  loop;
 	struct   sd_card_command  cmd;
 
-
-	LOG_D("sd_card_init()\n\r");
-
 	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
 	RC_CHECK;
 
@@ -159,38 +196,51 @@ result_t sd_card_init(void)
 	send_command(&cmd);
 
 	rx_byte = 0xff;
-	while (rx_byte == 0xff) {
+	retry = 0;
+	while ((rx_byte == 0xff) && (retry < SD_CARD_RESET_RETRIES)) {
+		retry++;
 		delay_uS(200);
 		rc = spi_read_byte(&spi_device);
-		RC_CHECK;
-		rx_byte = (uint8_t)rc;
-		if (rx_byte != 0xff) {
-//			serial_printf("reset rx 0x%x\n\r", rx_byte);
+		if (rc < 0) {
+			gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
+			return(rc);
 		}
+		rx_byte = (uint8_t)rc;
 	}
 	if (rx_byte != 0x01) {
+		rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
 		LOG_E("Invalid Response\n\r");
-		return(-ERR_INVALID_RESPONSE);
+		return((rx_byte == 0xff) ? -ERR_NO_RESPONSE : -ERR_INVALID_RESPONSE);
 	}
 	flush();
 
-//	serial_printf("Reset complete\n\r");
 	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
 	RC_CHECK;
-	delay_mS(1);
+	return(SUCCESS);
+}
+
+/*
+ * CMD8 SEND_IF_COND, Pg 105 R7 Response 133
+ */
+static result_t card_cmd8(void)
+{
+	result_t rc;
+	uint8_t  rx_byte;
+	struct   sd_card_command  cmd;
+
 	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 0);
 	RC_CHECK;
-	// Pg 105 R7 Response 133
 	init_command(&cmd, sd_cmd8);
 	cmd.data[3] = 0x01;
 	cmd.data[4] = 0xAA;
 	cmd.data[5] = 0x87;
 	send_command(&cmd);
 
-	rx_byte = 0xff;
-
 	rc = spi_read_byte(&spi_device);
-	RC_CHECK;
+	if (rc < 0) {
+		gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
+		return(rc);
+	}
 	rx_byte = (uint8_t)rc;
 
 	if (rx_byte != 0x01) {
@@ -202,61 +252,192 @@ result_t sd_card_init(void)
 	flush();
 
 	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
+	RC_CHECK;
+	return(SUCCESS);
+}
 
-//	serial_printf("Initialised\n\r");
+/*
+ * One attempt at CMD55 ACMD41, SD_SEND_OP_COND, returns 1 once the card has
+ * left the idle state, zero if it's still initialising.
+ * http://rjhcoding.com/avrc-sd-interface-3.php
+ */
+static result_t card_acmd41(void)
+{
+	result_t rc;
+	uint8_t  rx_byte;
+	uint8_t  flush_byte;
+	struct   sd_card_command  cmd;
 
-	delay_mS(1);
-//	serial_printf("Response 0x%x\n\r", rc);
+	rx_byte = 0xff;
+	init_command(&cmd, sd_cmd55);
 
-#if SD_INIT
-	rx_byte = (uint8_t)rc;
+	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 0);
+	RC_CHECK;
+	send_command(&cmd);
+	delay_uS(50);    // was 10
+	flush();
 
-	while (rx_byte != 0x00) {
-		delay_mS(100);
-		rc = spi_read_byte(&spi_device);
-		RC_CHECK;
-		rx_byte = (uint8_t)rc;
-	}
-	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
-#else // try cmd55 ACMD41
-	// http://rjhcoding.com/avrc-sd-interface-3.php
-	rx_byte = 0xff;
+	delay_uS(50);
 
-	while (rx_byte != 0x00) {
-		init_command(&cmd, sd_cmd55);
+	init_command(&cmd, sd_cmd41);
+	send_command(&cmd);
+	delay_uS(50);
 
-		rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 0);
-		send_command(&cmd);
-		delay_uS(50);    // was 10
-		flush();
+	do {
+		rc = spi_write_byte(&spi_device, 0xff);
+		flush_byte = (uint8_t)rc;
+		if (flush_byte == 0x00) rx_byte = 0x00;
+	} while (flush_byte != 0xff);
+	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
+	RC_CHECK;
 
-		delay_uS(50);
+	return((rx_byte == 0x00) ? 1 : 0);
+}
 
-		init_command(&cmd, sd_cmd41);
-		send_command(&cmd);
-		delay_uS(50);
+result_t sd_card_init(void)
+{
+	result_t rc;
+	uint8_t  retry;
 
-		do {
-			rc = spi_write_byte(&spi_device, 0xff);
-			flush_byte = (uint8_t)rc;
-			if (flush_byte == 0x00) rx_byte = 0x00;
-		} while (flush_byte != 0xff);
-		rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
+	LOG_D("sd_card_init()\n\r");
 
-		if(rx_byte != 0x00) delay_mS(100);
+#ifdef SYS_ASYNC_INIT
+	/*
+	 * Card is initialised by the background init stage, -ERR_NOT_READY
+	 * until that's finished
+	 */
+	if (init_stage >= 0) {
+		return(init_rc);
 	}
 #endif
+	rc = card_reset();
+	RC_CHECK;
+
+	delay_mS(1);
+
+	rc = card_cmd8();
+	RC_CHECK;
+
+	delay_mS(1);
+
+	retry = 0;
+	while ((rc = card_acmd41()) == 0) {
+		if (++retry >= SD_CARD_INIT_RETRIES) {
+			LOG_E("Card not ready\n\r");
+			return(-ERR_NO_RESPONSE);
+		}
+		delay_mS(SD_CARD_INIT_RETRY_mS);
+	}
+	RC_CHECK;
 
 	/*
 	 * Set the block size to 512
 	 */
-	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 0);
-	set_block_size(512);
-	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
+	return(set_block_size(512));
+}
+
+#ifdef SYS_ASYNC_INIT
+/*
+ * Background version of sd_card_init(). The mS waits between its steps are
+ * single shot Software timers so the main loop keeps running, each step
+ * being executed by the timer's expiry function.
+ */
+static void init_expiry(timer_id timer, union sigval data);
+
+static result_t init_next(uint16_t duration)
+{
+	struct timer_req request;
+	timer_id         timer;
+
+	request.period.units    = mSeconds;
+	request.period.duration = duration;
+	request.type            = single_shot_expiry;
+	request.exp_fn          = init_expiry;
+	request.data.sival_int  = 0;
+
+	timer = sw_timer_start(&request);
+	if (timer < 0) {
+		LOG_E("No SW Timer for SD Card init\n\r");
+		return(timer);
+	}
+	return(SUCCESS);
+}
+
+static void init_expiry(timer_id timer, union sigval data)
+{
+	result_t rc;
+
+	if (init_step == init_cmd8) {
+		rc = card_cmd8();
+		if (rc >= 0) {
+			init_step = init_acmd41;
+			init_retries = 0;
+			rc = init_next(1);
+		}
+	} else {
+		rc = card_acmd41();
+		if ((rc == 0) && (++init_retries < SD_CARD_INIT_RETRIES)) {
+			rc = init_next(SD_CARD_INIT_RETRY_mS);
+			if (rc >= 0) return;
+		} else if (rc == 0) {
+			LOG_E("Card not ready\n\r");
+			rc = -ERR_NO_RESPONSE;
+		} else if (rc > 0) {
+			rc = set_block_size(512);
+		}
+		init_rc = rc;
+		libesoup_init_stage_done((uint8_t)init_stage, rc);
+		return;
+	}
+	if (rc < 0) {
+		init_rc = rc;
+		libesoup_init_stage_done((uint8_t)init_stage, rc);
+	}
+}
+
+static result_t init_start(void)
+{
+	result_t rc;
+
+	LOG_D("SD Card init stage\n\r");
+	rc = card_reset();
+	if (rc < 0) {
+		init_rc = rc;
+		return(rc);
+	}
+
+	init_step = init_cmd8;
+	rc = init_next(1);
+	if (rc < 0) {
+		init_rc = rc;
+		return(rc);
+	}
+	return(1);
+}
+
+result_t sd_card_init_stage_add(void)
+{
+	result_t rc;
+
+	/*
+	 * Only the one stage if libesoup_init() is called again
+	 */
+	if (init_stage >= 0) {
+		return(init_stage);
+	}
+
+	rc = libesoup_init_stage_add(init_start, NULL);
 	RC_CHECK;
+	init_stage = (int16_t)rc;
 	return(rc);
 }
 
+boolean sd_card_ready(void)
+{
+	return(init_rc == SUCCESS);
+}
+#endif // SYS_ASYNC_INIT
+
 result_t sd_card_read(uint32_t sector, uint8_t *buffer)
 {
 	uint8_t  retry = 0;
@@ -277,7 +458,7 @@ result_t sd_card_read(uint32_t sector, uint8_t *buffer)
 	cmd.data[1] = (address >> 24) & 0xff;
 	cmd.data[2] = (address >> 16) & 0xff;
 	cmd.data[3] = (address>> 8) & 0xff;
-	cmd.data[1] = address & 0xff;
+	cmd.data[4] = address & 0xff;
 
 	send_command(&cmd);
 
@@ -329,6 +510,101 @@ result_t sd_card_read(uint32_t sector, uint8_t *buffer)
 	return(SUCCESS);
 }
 
+/*
+ * Write a whole sector, CMD24 Single block write. The card signals busy,
+ * holding MISO low, until the block is programmed.
+ */
+result_t sd_card_write(uint32_t sector, uint8_t *buffer)
+{
+	result_t rc;
+	result_t write_rc;
+
+	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 0);
+	RC_CHECK;
+
+	/*
+	 * Deselect the card whatever happened to the write
+	 */
+	write_rc = write_block(sector * SD_CARD_BLOCK_SIZE, buffer);
+
+	rc = gpio_set(SD_CARD_SS, GPIO_MODE_DIGITAL_OUTPUT, 1);
+	if (write_rc < 0) return(write_rc);
+	RC_CHECK;
+	return(SUCCESS);
+}
+
+/*
+ * The body of sd_card_write() with the card selected.
+ */
+static result_t write_block(uint32_t address, uint8_t *buffer)
+{
+	uint16_t retry = 0;
+	result_t rc;
+	uint16_t i;
+	uint8_t  rx_byte;
+	struct   sd_card_command  cmd;
+
+	init_command(&cmd, sd_write);
+	cmd.data[1] = (address >> 24) & 0xff;
+	cmd.data[2] = (address >> 16) & 0xff;
+	cmd.data[3] = (address >> 8) & 0xff;
+	cmd.data[4] = address & 0xff;
+
+	send_command(&cmd);
+
+	rx_byte = 0xff;
+	while ((rx_byte != 0x00) && (retry < 10)) {
+		retry++;
+		delay_uS(50);
+		rc = spi_read_byte(&spi_device);
+		RC_CHECK;
+		rx_byte = (uint8_t)rc;
+	}
+	if (rx_byte != 0x00) {
+		return(-ERR_NO_RESPONSE);
+	}
+
+	/*
+	 * Start block token, the data and a dummy CRC
+	 */
+	rc = spi_write_byte(&spi_device, 0xFE);
+	RC_CHECK;
+	for(i = 0; i < SD_CARD_BLOCK_SIZE; i++) {
+		rc = spi_write_byte(&spi_device, *buffer++);
+		RC_CHECK;
+	}
+	rc = spi_write_byte(&spi_device, 0xff);
+	RC_CHECK;
+	rc = spi_write_byte(&spi_device, 0xff);
+	RC_CHECK;
+
+	/*
+	 * Data Response token xxx0sss1, status 010 is Data accepted
+	 */
+	rc = spi_read_byte(&spi_device);
+	RC_CHECK;
+	rx_byte = (uint8_t)rc;
+	if ((rx_byte & 0x1f) != 0x05) {
+		LOG_E("Write rejected 0x%x\n\r", rx_byte);
+		return(-ERR_INVALID_RESPONSE);
+	}
+
+	retry = 0;
+	do {
+		CLEAR_WDT
+		if (retry++ == SD_CARD_WRITE_BUSY_RETRIES) {
+			LOG_E("Write busy timeout\n\r");
+			return(-ERR_NO_RESPONSE);
+		}
+		delay_uS(50);
+		rc = spi_read_byte(&spi_device);
+		RC_CHECK;
+		rx_byte = (uint8_t)rc;
+	} while (rx_byte == 0x00);
+
+	return(SUCCESS);
+}
+
 static result_t set_block_size(uint16_t size)
 {
 	result_t rc;
@@ -26,8 +26,21 @@
 
 #if defined(SYS_SD_CARD)
 
+#define SD_CARD_BLOCK_SIZE  512
+
 extern result_t sd_card_init(void);
 extern result_t sd_card_read(uint32_t sector, uint8_t *buffer);
+extern result_t sd_card_write(uint32_t sector, uint8_t *buffer);
+
+#ifdef SYS_ASYNC_INIT
+/*
+ * Add the SD Card initialisation as a background init stage, called by
+ * libesoup_init(). Returns the stage's identifier. Once added sd_card_init()
+ * returns -ERR_NOT_READY until the stage has finished, then its result.
+ */
+extern result_t sd_card_init_stage_add(void);
+extern boolean  sd_card_ready(void);
+#endif // SYS_ASYNC_INIT
 
 #endif // SYS_SD_CARD
 
@@ -0,0 +1,63 @@
+/*
+ * libesoup_config.h libesoup/comms/test/libesoup_config_protocol_bench.h
+ *
+ * cinnamonBun dsPIC33EP256MU806 configuration for benchmarking the protocol
+ * stacks on the host against the SFR simulation. Copy to a build directory
+ * as libesoup_config.h, see main_protocol_bench.c and scripts/build_host.sh
+ */
+#ifndef _LIBESOUP_CONFIG_H
+#define _LIBESOUP_CONFIG_H
+
+/*
+ * The simulated xc.h, found through -Ilibesoup/processors/dsPIC33/sim
+ */
+#include <xc.h>
+
+#define SYS_TEST_PROTOCOL_BENCH
+
+#define SYS_CLOCK_FREQ 60000000
+
+#define SYS_HW_TIMERS
+#define SYS_SW_TIMERS
+#define SYS_NUMBER_OF_SW_TIMERS    16
+#define SYS_SW_TIMER_TICK_ms       5
+
+#define SYS_JOBS
+#define SYS_NUMBER_OF_JOBS         16
+
+#define SYS_UART1
+#define SYS_UART2
+#define SYS_UART_TX_BUFFER_SIZE    1024
+
+#define SYS_SERIAL_LOGGING
+#define SYS_SERIAL_PORT_GndRxTx
+#define SYS_SERIAL_LOGGING_BAUD    115200
+#define SYS_LOG_LEVEL              LOG_ERROR
+
+#define SYS_SYSTEM_STATUS
+
+#define SYS_CAN_BUS
+#define SYS_CAN_L2_HANDLER_ARRAY_SIZE        4
+
+/*
+ * Largest message and the shortest Separation Time the transmitter honours
+ * so a benchmark message takes as little simulated time as possible
+ */
+#define SYS_CAN_ISO15765
+#define SYS_CAN_ISO15765_MAX_MSG             270
+#define SYS_CAN_ISO15765_REGISTER_ARRAY_SIZE 4
+#define SYS_CAN_ISO15765_BLOCK_SIZE          8
+#define SYS_CAN_ISO15765_SEPERATION_TIME     7
+
+#define SYS_ISO11783
+#define SYS_ISO11783_REGISTER_ARRAY_SIZE     4
+
+#define SYS_MODBUS
+#define SYS_MODBUS_NUM_CHANNELS              2
+#define SYS_MODBUS_RX_BUFFER_SIZE            256
+#define SYS_MODBUS_RESPONSE_TIMEOUT          SECONDS_TO_TICKS(1)
+#define SYS_MODBUS_RESPONSE_BROADCAST_TIMEOUT MILLI_SECONDS_TO_TICKS(500)
+
+#include "libesoup/boards/cinnamonBun/dsPIC33/cb-dsPIC33EP256MU806.h"
+
+#endif // _LIBESOUP_CONFIG_H
@@ -0,0 +1,450 @@
+/*
+ * libesoup/comms/test/main_protocol_bench.c
+ *
+ * Host micro-benchmarks of the protocol stacks, run against the SFR
+ * simulation so the real drivers sit underneath them:
+ *
+ *   crc/<n>         Modbus CRC-16 of an n byte buffer
+ *   modbus_check/<n> Modbus frame validation, crc_check(), of an n byte frame
+ *   modbus_rx/<n>   The slave's running CRC, crc_update() per received
+ *                   character, of an n byte frame
+ *   j1939_pgn       PGN to CAN ID and back, per round trip
+ *   isotp/<n>       ISO15765-2 segmentation and reassembly of an n byte
+ *                   message sent to this node through the ECAN in loopback
+ *   printf/<fmt>    serial_printf() formatting in to the UART TX buffer
+ *
+ * Only host time spent in the stacks and the main loop is counted. Time spent
+ * moving the simulation on, and so in the driver ISRs, is not. Results are
+ * printed one per line as "name ns/op bytes/s" so that scripts/build_host.sh
+ * can compare a run against a saved baseline.
+ *
+ * Build on Linux from the directory containing libesoup with
+ *
+ *     libesoup/scripts/build_host.sh
+ *
+ * or by hand:
+ *
+ *     mkdir host && cp libesoup/comms/test/libesoup_config_protocol_bench.h host/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Ihost -I. \
+ *         libesoup/comms/test/main_protocol_bench.c <library sources, see build_host.sh> -o host/protocol_bench
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_PROTOCOL_BENCH
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/comms/can/can.h"
+#include "libesoup/comms/modbus/modbus_private.h"
+#include "libesoup/logger/serial_log.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+/*
+ * Each benchmark is run this many times and the fastest run reported, to
+ * keep other load on the host out of the results
+ */
+#define BENCH_RUNS        5
+
+#define NODE_ADDRESS      0x10
+#define BENCH_PROTOCOL    0x42
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+
+static void report(const char *name, uint64_t ns, uint32_t ops, uint32_t bytes)
+{
+	double ns_per_op;
+	double bytes_per_s;
+
+	ns_per_op   = (double)ns / ops;
+	bytes_per_s = ns ? ((double)bytes * 1e9) / ns : 0.0;
+
+	printf("%-20s %12.1f %14.0f\n", name, ns_per_op, bytes_per_s);
+}
+
+/*
+ * Counter of characters leaving the serial logging UART
+ */
+static uint32_t serial_chars;
+
+static void serial_line(uint8_t uart, uint16_t ch)
+{
+	serial_chars++;
+}
+
+/*
+ * Move the simulation on, untimed, until the serial logging UART has been
+ * idle for two milliSeconds.
+ */
+static void drain_serial(void)
+{
+	uint32_t last;
+	uint8_t  idle = 0;
+
+	while(idle < 2) {
+		last = serial_chars;
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+		idle = (serial_chars == last) ? idle + 1 : 0;
+	}
+}
+
+static uint8_t frame[256];
+
+static void bench_crc(void)
+{
+	static const uint16_t sizes[] = { 8, 64, 256 };
+	uint8_t               loop;
+	uint16_t              size;
+	uint32_t              i;
+	uint32_t              iterations;
+	uint8_t               run;
+	uint64_t              start;
+	uint64_t              ns;
+	uint64_t              best = 0;
+	volatile uint16_t     crc = 0;
+	char                  name[24];
+
+	for(i = 0; i < sizeof(frame); i++) frame[i] = (uint8_t)(i * 7 + 3);
+
+	for(loop = 0; loop < sizeof(sizes) / sizeof(sizes[0]); loop++) {
+		size = sizes[loop];
+		iterations = 4000000 / size;
+
+		for(run = 0; run < BENCH_RUNS; run++) {
+			start = now_ns();
+			for(i = 0; i < iterations; i++) {
+				crc ^= crc_calculate(frame, size);
+			}
+			ns = now_ns() - start;
+			if((run == 0) || (ns < best)) best = ns;
+		}
+
+		snprintf(name, sizeof(name), "crc/%u", size);
+		report(name, best, iterations, iterations * size);
+	}
+
+	/*
+	 * Known answer, Read Holding Registers request 01 03 00 00 00 0A
+	 */
+	frame[0] = 0x01; frame[1] = 0x03; frame[2] = 0x00;
+	frame[3] = 0x00; frame[4] = 0x00; frame[5] = 0x0A;
+	crc = crc_calculate(frame, 6);
+	CHECK(crc == 0xC5CD, "Modbus CRC 0x%04x expected 0xC5CD", crc);
+}
+
+static void bench_modbus_check(void)
+{
+	static const uint16_t sizes[] = { 8, 256 };
+	uint8_t               loop;
+	uint16_t              size;
+	uint16_t              crc;
+	uint32_t              i;
+	uint32_t              iterations;
+	uint32_t              valid;
+	uint8_t               run;
+	uint64_t              start;
+	uint64_t              ns;
+	uint64_t              best = 0;
+	char                  name[24];
+
+	for(loop = 0; loop < sizeof(sizes) / sizeof(sizes[0]); loop++) {
+		size = sizes[loop];
+		iterations = 4000000 / size;
+
+		for(i = 0; i < size - 2; i++) frame[i] = (uint8_t)(i * 13 + 1);
+		crc = crc_calculate(frame, size - 2);
+		frame[size - 2] = (uint8_t)(crc >> 8);
+		frame[size - 1] = (uint8_t)(crc & 0xff);
+
+		for(run = 0; run < BENCH_RUNS; run++) {
+			valid = 0;
+			start = now_ns();
+			for(i = 0; i < iterations; i++) {
+				valid += crc_check(frame, size);
+			}
+			ns = now_ns() - start;
+			if((run == 0) || (ns < best)) best = ns;
+
+			CHECK(valid == iterations, "crc_check() passed %u of %u frames", valid, iterations);
+		}
+
+		snprintf(name, sizeof(name), "modbus_check/%u", size);
+		report(name, best, iterations, iterations * size);
+	}
+}
+
+static void bench_modbus_rx(void)
+{
+	static const uint16_t sizes[] = { 8, 256 };
+	uint8_t               loop;
+	uint16_t              size;
+	uint16_t              crc;
+	uint32_t              i;
+	uint32_t              iterations;
+	uint32_t              valid;
+	uint16_t              j;
+	uint8_t               run;
+	uint64_t              start;
+	uint64_t              ns;
+	uint64_t              best = 0;
+	char                  name[24];
+
+	/*
+	 * A zero residue has to agree with crc_check(), for good frames and
+	 * for each of them with a single bit corrupted
+	 */
+	for(size = 4; size <= sizeof(frame); size++) {
+		for(i = 0; i < size - 2; i++) frame[i] = (uint8_t)(i * 29 + size);
+		crc = crc_calculate(frame, size - 2);
+		frame[size - 2] = (uint8_t)(crc >> 8);
+		frame[size - 1] = (uint8_t)(crc & 0xff);
+
+		for(i = 0; i <= size; i++) {
+			if(i < size) frame[i] ^= (uint8_t)(1 << (i & 0x07));
+			crc = MODBUS_CRC_INIT;
+			for(j = 0; j < size; j++) crc = crc_update(crc, frame[j]);
+			CHECK((crc == 0) == crc_check(frame, size), "Running CRC 0x%04x of %u bytes disagrees with crc_check()", crc, size);
+			if(i < size) frame[i] ^= (uint8_t)(1 << (i & 0x07));
+		}
+	}
+
+	for(loop = 0; loop < sizeof(sizes) / sizeof(sizes[0]); loop++) {
+		size = sizes[loop];
+		iterations = 4000000 / size;
+
+		for(i = 0; i < size - 2; i++) frame[i] = (uint8_t)(i * 13 + 1);
+		crc = crc_calculate(frame, size - 2);
+		frame[size - 2] = (uint8_t)(crc >> 8);
+		frame[size - 1] = (uint8_t)(crc & 0xff);
+
+		for(run = 0; run < BENCH_RUNS; run++) {
+			valid = 0;
+			start = now_ns();
+			for(i = 0; i < iterations; i++) {
+				crc = MODBUS_CRC_INIT;
+				for(j = 0; j < size; j++) crc = crc_update(crc, frame[j]);
+				valid += (crc == 0);
+			}
+			ns = now_ns() - start;
+			if((run == 0) || (ns < best)) best = ns;
+
+			CHECK(valid == iterations, "Running CRC passed %u of %u frames", valid, iterations);
+		}
+
+		snprintf(name, sizeof(name), "modbus_rx/%u", size);
+		report(name, best, iterations, iterations * size);
+	}
+}
+
+static void bench_j1939(void)
+{
+	static const uint32_t pgns[] = {
+		0x00EA00,       // Request, PDU1
+		0x00EC00,       // TP Connection Management, PDU1
+		0x00EE00,       // Address Claimed, PDU1
+		0x00FECA,       // DM1, PDU2
+		0x00F004,       // Electronic Engine Controller 1, PDU2
+		0x01FEF1,       // Data Page set, PDU2
+	};
+	uint32_t          i;
+	uint32_t          iterations = 10000000;
+	uint32_t          pgn;
+	uint32_t          canid;
+	uint32_t          errors = 0;
+	uint8_t           run;
+	uint64_t          start;
+	uint64_t          ns;
+	uint64_t          best = 0;
+
+	for(run = 0; run < BENCH_RUNS; run++) {
+		start = now_ns();
+		for(i = 0; i < iterations; i++) {
+			pgn   = pgns[i % (sizeof(pgns) / sizeof(pgns[0]))];
+			canid = pgn_to_canid(6, pgn, (uint8_t)i);
+			if(canid_to_pgn(canid) != pgn) errors++;
+		}
+		ns = now_ns() - start;
+		if((run == 0) || (ns < best)) best = ns;
+	}
+
+	CHECK(errors == 0, "%u PGN round trips failed", errors);
+	report("j1939_pgn", best, iterations, 0);
+}
+
+static uint8_t  isotp_tx[SYS_CAN_ISO15765_MAX_MSG];
+static uint16_t isotp_rx_size;
+static boolean  isotp_rx_match;
+static boolean  isotp_received;
+
+static void isotp_handler(iso15765_msg_t *msg)
+{
+	isotp_rx_size  = msg->size;
+	isotp_rx_match = (memcmp(msg->data, isotp_tx, msg->size) == 0);
+	isotp_received = TRUE;
+}
+
+static void bench_isotp(void)
+{
+	static const uint16_t sizes[] = { 6, 64, SYS_CAN_ISO15765_MAX_MSG };
+	result_t              rc;
+	iso15765_target_t     target;
+	iso15765_msg_t        msg;
+	uint8_t               loop;
+	uint16_t              i;
+	uint32_t              iteration;
+	uint32_t              iterations = 10;
+	uint32_t              waited;
+	uint8_t               run;
+	uint64_t              start;
+	uint64_t              ns;
+	uint64_t              best = 0;
+	char                  name[24];
+
+	rc = can_init(baud_250K, NODE_ADDRESS, NULL, loopback);
+	CHECK(rc >= 0, "can_init() %d", rc);
+
+	rc = iso15765_init(NODE_ADDRESS);
+	CHECK(rc >= 0, "iso15765_init() %d", rc);
+
+	target.protocol = BENCH_PROTOCOL;
+	target.handler  = isotp_handler;
+	rc = iso15765_dispatch_reg_handler(&target);
+	CHECK(rc >= 0, "iso15765_dispatch_reg_handler() %d", rc);
+
+	for(i = 0; i < sizeof(isotp_tx); i++) isotp_tx[i] = (uint8_t)(i ^ 0x5a);
+
+	for(loop = 0; loop < sizeof(sizes) / sizeof(sizes[0]); loop++) {
+		for(run = 0; run < BENCH_RUNS; run++) {
+			ns = 0;
+			for(iteration = 0; iteration < iterations; iteration++) {
+				isotp_received = FALSE;
+
+				msg.address  = NODE_ADDRESS;
+				msg.protocol = BENCH_PROTOCOL;
+				msg.size     = sizes[loop];
+				msg.data     = isotp_tx;
+
+				start = now_ns();
+				rc = iso15765_tx_msg(&msg);
+				ns += now_ns() - start;
+				CHECK(rc >= 0, "iso15765_tx_msg() %d", rc);
+				if(rc < 0) return;
+
+				/*
+				 * A milliSecond at a time, as the main loop would see
+				 * a 5mS Software timer tick, for up to two Seconds
+				 */
+				for(waited = 0; !isotp_received && (waited < 2000); waited++) {
+					sfr_sim_run(CYCLES_PER_mS);
+
+					start = now_ns();
+					libesoup_tasks();
+					ns += now_ns() - start;
+				}
+				CHECK(isotp_received, "ISO15765 message of %u bytes not received", sizes[loop]);
+				if(!isotp_received) return;
+				CHECK(isotp_rx_size == sizes[loop] && isotp_rx_match, "ISO15765 received %u bytes, %s",
+				      isotp_rx_size, isotp_rx_match ? "matching" : "corrupt");
+
+				/*
+				 * Let the transmitter see its last frame go
+				 */
+				sfr_sim_run(CYCLES_PER_mS);
+				libesoup_tasks();
+			}
+			if((run == 0) || (ns < best)) best = ns;
+		}
+		snprintf(name, sizeof(name), "isotp/%u", sizes[loop]);
+		report(name, best, iterations, iterations * sizes[loop]);
+	}
+	CHECK(sfr_sim_can_overflows() == 0, "CAN FIFO overflowed");
+}
+
+static void bench_printf(void)
+{
+	uint32_t iteration;
+	uint32_t iterations = 2000;
+	uint32_t chars;
+	uint32_t expected = 0;
+	uint8_t  line;
+	uint8_t  uart;
+	char     copy[100];
+	uint64_t start;
+	uint64_t ns;
+	uint64_t best = 0;
+
+	/*
+	 * Only the serial logging UART is transmitting
+	 */
+	for(uart = 0; uart < 4; uart++) sfr_sim_uart_tx_hook(uart, serial_line);
+	drain_serial();
+	chars = serial_chars;
+
+	/*
+	 * Eight lines of under 100 characters fit in the TX buffer. The fastest
+	 * batch of eight is taken as the rate for them all.
+	 */
+	for(iteration = 0; iteration < iterations; iteration += 8) {
+		start = now_ns();
+		for(line = 0; line < 8; line++) {
+			serial_printf("%s:%d 0x%x %ld 0x%lx\n\r", "BENCH", (uint16_t)(iteration + line),
+				      (uint16_t)0xBEEF, (uint32_t)123456789UL, (uint32_t)0xDEADBEEFUL);
+		}
+		ns = now_ns() - start;
+		if((iteration == 0) || (ns < best)) best = ns;
+
+		for(line = 0; line < 8; line++) {
+			expected += snprintf(copy, sizeof(copy), "%s:%u 0x%x %u 0x%x\n\r", "BENCH",
+					     iteration + line, 0xBEEF, 123456789U, 0xDEADBEEFU);
+		}
+		drain_serial();
+	}
+	chars = serial_chars - chars;
+	CHECK(chars == expected, "serial_printf() output %u characters, expected %u", chars, expected);
+	report("printf/mixed", best * (iterations / 8), iterations, chars);
+}
+
+int main(void)
+{
+	result_t rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	printf("%-20s %12s %14s\n", "benchmark", "ns/op", "bytes/s");
+	bench_crc();
+	bench_modbus_check();
+	bench_modbus_rx();
+	bench_j1939();
+	bench_isotp();
+	bench_printf();
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_PROTOCOL_BENCH
@@ -0,0 +1,30 @@
+/*
+ * libesoup_config.h libesoup/comms/uart/test/libesoup_config_uart_linux.h
+ *
+ * Host (ES_LINUX) configuration for testing the Linux UART backend over pty
+ * pairs. Copy to a build directory as libesoup_config.h, see
+ * main_uart_linux.c
+ */
+#ifndef _LIBESOUP_CONFIG_H
+#define _LIBESOUP_CONFIG_H
+
+#ifndef ES_LINUX
+#define ES_LINUX
+#endif
+
+#define SYS_TEST_UART_LINUX
+
+#define SYS_UART1
+#define SYS_UART2
+#define SYS_UART_TX_BUFFER_SIZE    1024
+#define SYS_UART_STATS
+
+#define LOG_D(...)
+#define LOG_I(...)
+#define LOG_W(...)
+#define LOG_E(...)
+
+#include "libesoup/core.h"
+#include "libesoup/boards/rpi/rpi.h"
+
+#endif // _LIBESOUP_CONFIG_H
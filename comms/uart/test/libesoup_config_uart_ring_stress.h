@@ -0,0 +1,38 @@
+/*
+ * libesoup_config.h libesoup/comms/uart/test/libesoup_config_uart_ring_stress.h
+ *
+ * cinnamonBun dsPIC33EP256MU806 configuration for stress testing the UART
+ * rings on the host against the SFR simulation. Copy to a
+ * build directory as libesoup_config.h, see main_uart_ring_stress.c
+ */
+#ifndef _LIBESOUP_CONFIG_H
+#define _LIBESOUP_CONFIG_H
+
+/*
+ * The simulated xc.h, found through -Ilibesoup/processors/dsPIC33/sim
+ */
+#include <xc.h>
+
+#define SYS_TEST_UART_RING_STRESS
+
+#define SYS_CLOCK_FREQ 60000000
+
+#define SYS_HW_TIMERS
+#define SYS_SW_TIMERS
+#define SYS_NUMBER_OF_SW_TIMERS    4
+#define SYS_SW_TIMER_TICK_ms       5
+
+#define SYS_UART1
+#define SYS_UART_TX_BUFFER_SIZE    64
+#define SYS_UART_RX_BUFFER_SIZE    64
+#define SYS_UART_RX_BLOCK
+#define SYS_UART_TX_SEGMENTS
+
+#define LOG_D(...)
+#define LOG_I(...)
+#define LOG_W(...)
+#define LOG_E(...)
+
+#include "libesoup/boards/cinnamonBun/dsPIC33/cb-dsPIC33EP256MU806.h"
+
+#endif // _LIBESOUP_CONFIG_H
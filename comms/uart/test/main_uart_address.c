@@ -0,0 +1,259 @@
+/*
+ * libesoup/comms/uart/test/main_uart_address.c
+ *
+ * Host test of 9 bit address detect, SYS_UART_ADDRESS_DETECT, against the
+ * SFR simulation. UART 1 is the master of a simulated multidrop bus, its
+ * transmit line wired to the receive line of the three slaves on UARTs 2 to
+ * 4. Checks each slave receives only the frames to its address and the
+ * broadcasts, a frame to nobody included, and that the slaves' receive ISRs
+ * run for far fewer characters than with address detect off.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir uadr && cp libesoup/comms/uart/test/libesoup_config_uart_address.h uadr/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Iuadr -I. \
+ *         libesoup/comms/uart/test/main_uart_address.c libesoup/comms/uart/uart.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/gpio/gpio.c libesoup/gpio/peripheral.c \
+ *         -o uadr/uart_address
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_UART_ADDRESS
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/comms/uart/uart.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+#define SLAVES            3
+#define BROADCAST         0
+#define FRAME_SIZE        20
+#define ROUNDS            10
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static const uint8_t      addresses[SLAVES] = { 5, 6, 7 };
+static const enum gpio_pin slave_rx_pins[SLAVES] = { RD1, RD2, RD3 };
+
+static struct uart_data   master;
+static struct uart_data   slaves[SLAVES];
+
+static uint8_t            rx_line[NUM_UART_CHANNELS][2048];
+static uint16_t           rx_count[NUM_UART_CHANNELS];
+
+/*
+ * The bus, everything the master transmits arrives at every slave
+ */
+static void bus(uint8_t uart, uint16_t ch)
+{
+	uint8_t loop;
+
+	for(loop = 0; loop < SLAVES; loop++) {
+		sfr_sim_uart_rx(slaves[loop].channel, ch);
+	}
+}
+
+static void process_rx_char(uint8_t uart_id, uint8_t ch)
+{
+	if(rx_count[uart_id] < sizeof(rx_line[uart_id])) {
+		rx_line[uart_id][rx_count[uart_id]++] = ch;
+	}
+}
+
+static void run_mS(uint16_t mS)
+{
+	while(mS--) {
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+	}
+}
+
+#define NO_ADDRESS   -1
+
+static void reserve(struct uart_data *udata, enum gpio_pin tx_pin, enum gpio_pin rx_pin, int16_t address, int16_t broadcast)
+{
+	result_t rc;
+
+	udata->tx_pin           = tx_pin;
+	udata->rx_pin           = rx_pin;
+	udata->baud             = 115200;
+	udata->tx_finished      = NULL;
+	udata->process_rx_char  = process_rx_char;
+	udata->rx_address_enable   = (address != NO_ADDRESS);
+	udata->rx_address          = udata->rx_address_enable ? (uint8_t)address : 0;
+	udata->rx_broadcast_enable = (broadcast != NO_ADDRESS);
+	udata->rx_broadcast        = udata->rx_broadcast_enable ? (uint8_t)broadcast : 0;
+	uart_calculate_mode(&udata->uart_mode, UART_9_DATABITS, UART_PARITY_NONE, UART_ONE_STOP_BIT, UART_IDLE_HIGH);
+
+	rc = uart_reserve(udata);
+	CHECK(rc >= 0, "uart_reserve() %d", rc);
+}
+
+static void reserve_bus(boolean detect)
+{
+	uint8_t loop;
+
+	reserve(&master, RG8, INVALID_GPIO_PIN, NO_ADDRESS, NO_ADDRESS);
+	sfr_sim_uart_tx_hook(master.channel, bus);
+	for(loop = 0; loop < SLAVES; loop++) {
+		reserve(&slaves[loop], INVALID_GPIO_PIN, slave_rx_pins[loop],
+		        detect ? addresses[loop] : NO_ADDRESS,
+		        detect ? BROADCAST : NO_ADDRESS);
+	}
+	memset(rx_count, 0x00, sizeof(rx_count));
+}
+
+static void release_bus(void)
+{
+	uint8_t  loop;
+	result_t rc;
+
+	rc = uart_release(&master);
+	CHECK(rc >= 0, "uart_release() %d", rc);
+	for(loop = 0; loop < SLAVES; loop++) {
+		rc = uart_release(&slaves[loop]);
+		CHECK(rc >= 0, "uart_release() %d", rc);
+	}
+}
+
+static uint8_t payload(uint8_t address, uint16_t index)
+{
+	return((uint8_t)(address * 31 + index));
+}
+
+/*
+ * A frame, the address character then the payload, once the master's idle
+ */
+static void send(uint8_t address)
+{
+	uint8_t   data[FRAME_SIZE];
+	uint16_t  loop;
+	result_t  rc;
+
+	for(loop = 0; loop < FRAME_SIZE; loop++) {
+		data[loop] = payload(address, loop);
+	}
+	for(loop = 0; loop < 100; loop++) {
+		rc = uart_tx_address(&master, address);
+		if(rc != -ERR_BUSY) break;
+		run_mS(1);
+	}
+	CHECK(rc == SUCCESS, "uart_tx_address() %d", rc);
+	rc = uart_tx_buffer(&master, data, FRAME_SIZE);
+	CHECK(rc == FRAME_SIZE, "uart_tx_buffer() %d", rc);
+}
+
+/*
+ * Every slave, the broadcast address and an address nobody has, in turn
+ */
+static uint32_t traffic(void)
+{
+	uint32_t  interrupts;
+	uint16_t  round;
+	uint8_t   loop;
+
+	interrupts = sfr_sim_interrupts();
+	for(round = 0; round < ROUNDS; round++) {
+		for(loop = 0; loop < SLAVES; loop++) {
+			send(addresses[loop]);
+		}
+		send(BROADCAST);
+		send(99);
+	}
+	run_mS(10);
+	return(sfr_sim_interrupts() - interrupts);
+}
+
+/*
+ * A slave's frames, each its address then the payload
+ */
+static void check_slave(uint8_t slave)
+{
+	uint8_t   uart_id = slaves[slave].channel;
+	uint8_t  *ptr     = rx_line[uart_id];
+	uint8_t   frame_addresses[2] = { addresses[slave], BROADCAST };
+	uint16_t  errors  = 0;
+	uint16_t  round;
+	uint16_t  frame;
+	uint16_t  loop;
+
+	CHECK(rx_count[uart_id] == ROUNDS * 2 * (FRAME_SIZE + 1), "Slave %u received %u characters", addresses[slave], rx_count[uart_id]);
+	if(rx_count[uart_id] != ROUNDS * 2 * (FRAME_SIZE + 1)) return;
+
+	for(round = 0; round < ROUNDS; round++) {
+		for(frame = 0; frame < 2; frame++) {
+			if(*ptr++ != frame_addresses[frame]) errors++;
+			for(loop = 0; loop < FRAME_SIZE; loop++) {
+				if(*ptr++ != payload(frame_addresses[frame], loop)) errors++;
+			}
+		}
+	}
+	CHECK(errors == 0, "Slave %u received %u characters wrong", addresses[slave], errors);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t  interrupts_off;
+	uint32_t  interrupts_on;
+	uint8_t   loop;
+	result_t  rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	/*
+	 * Address detect off, every slave receives everything
+	 */
+	reserve_bus(FALSE);
+	run_mS(1);
+	interrupts_off = traffic();
+	for(loop = 0; loop < SLAVES; loop++) {
+		CHECK(rx_count[slaves[loop].channel] == ROUNDS * (SLAVES + 2) * (FRAME_SIZE + 1), "Slave %u received %u characters without address detect", addresses[loop], rx_count[slaves[loop].channel]);
+	}
+	release_bus();
+
+	/*
+	 * Address detect on, only their own frames and the broadcasts
+	 */
+	reserve_bus(TRUE);
+	run_mS(1);
+	interrupts_on = traffic();
+	for(loop = 0; loop < SLAVES; loop++) {
+		check_slave(loop);
+	}
+
+	/*
+	 * Only ever the master sends address characters, and not behind
+	 * characters still queued
+	 */
+	rc = uart_tx_buffer(&master, (uint8_t *)"queued", 6);
+	CHECK(rc == 6, "uart_tx_buffer() %d", rc);
+	rc = uart_tx_address(&master, addresses[0]);
+	CHECK(rc == -ERR_BUSY, "uart_tx_address() with characters queued %d", rc);
+	run_mS(5);
+	release_bus();
+
+	printf("Interrupts %u without address detect, %u with\n", interrupts_off, interrupts_on);
+	CHECK(interrupts_on * 3 < interrupts_off * 2, "Address detect saved only %u of %u interrupts", interrupts_off - interrupts_on, interrupts_off);
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_UART_ADDRESS
@@ -0,0 +1,273 @@
+/*
+ * libesoup/comms/uart/test/main_uart_dma.c
+ *
+ * Host test of DMA driven UARTs, SYS_UART_DMA, against the SFR simulation.
+ * Checks a transmission streams out of the SW tx buffer, wrapping included,
+ * in a handful of interrupts with tx_finished() called once at the end, that
+ * received characters are delivered in blocks as each Ping-Pong buffer
+ * fills, that a short message is delivered once the line goes idle, and
+ * that a UART without process_rx_block() still gets process_rx_char(). The
+ * second UART is UART 2, or UART 3 built with -DUART_DMA_TEST_UART3, its
+ * DMA Channels going by its position amongst the UARTs defined.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir udma && cp libesoup/comms/uart/test/libesoup_config_uart_dma.h udma/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Iudma -I. \
+ *         libesoup/comms/uart/test/main_uart_dma.c libesoup/comms/uart/uart.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/gpio/gpio.c libesoup/gpio/peripheral.c \
+ *         -o udma/uart_dma
+ *
+ * and with -DUART_DMA_TEST_UART3 added for UARTs 1 and 3.
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_UART_DMA
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/comms/uart/uart.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+/*
+ * Interrupt driven transmission takes an interrupt each time the four deep
+ * FIFO empties
+ */
+#define FIFO_SIZE         4
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static struct uart_data  udata;
+static struct uart_data  udata_char;
+
+static uint8_t   tx_line[2048];
+static uint16_t  tx_count;
+static uint16_t  tx_finished_count;
+
+static uint8_t   rx_line[512];
+static uint16_t  rx_count;
+static uint16_t  rx_blocks;
+static uint16_t  rx_largest;
+
+static uint8_t   char_line[32];
+static uint16_t  char_count;
+static uint8_t   char_tx_line[32];
+static uint16_t  char_tx_count;
+
+/*
+ * The simulation numbers every UART, UART 1 being 0, enum uart_channel only
+ * those defined
+ */
+static uint8_t sim_uart(enum uart_channel channel)
+{
+#ifdef SYS_UART3
+	if(channel == UART_3) return(2);
+#endif
+	return((uint8_t)channel);
+}
+
+static void uart_line(uint8_t uart, uint16_t ch)
+{
+	if((uart == sim_uart(udata.channel)) && (tx_count < sizeof(tx_line))) tx_line[tx_count++] = (uint8_t)ch;
+	if((uart == sim_uart(udata_char.channel)) && (char_tx_count < sizeof(char_tx_line))) char_tx_line[char_tx_count++] = (uint8_t)ch;
+}
+
+static void tx_finished(struct uart_data *uart)
+{
+	tx_finished_count++;
+}
+
+static void process_rx_block(uint8_t uart_id, uint8_t *ptr, uint16_t len)
+{
+	if(len > rx_largest) rx_largest = len;
+	rx_blocks++;
+	while(len-- && (rx_count < sizeof(rx_line))) {
+		rx_line[rx_count++] = *ptr++;
+	}
+}
+
+static void process_rx_char(uint8_t uart_id, uint8_t ch)
+{
+	if(char_count < sizeof(char_line)) char_line[char_count++] = ch;
+}
+
+static void run_mS(uint16_t mS)
+{
+	while(mS--) {
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+	}
+}
+
+static void transmit(uint16_t first, uint16_t len)
+{
+	uint8_t   buffer[1024];
+	uint32_t  start;
+	uint32_t  interrupts;
+	uint16_t  loop;
+	uint16_t  mS;
+	result_t  rc;
+
+	for(loop = 0; loop < len; loop++) {
+		buffer[loop] = (uint8_t)((first + loop) * 7);
+	}
+
+	tx_count = 0;
+	tx_finished_count = 0;
+	start = sfr_sim_interrupts();
+
+	rc = uart_tx_buffer(&udata, buffer, len);
+	CHECK(rc == len, "uart_tx_buffer() %d", rc);
+
+	/*
+	 * About 87uS a character at 115200 Baud
+	 */
+	mS = ((len * 87UL) / 1000) + 5;
+	run_mS(mS);
+
+	CHECK(tx_count == len, "%u of %u bytes transmitted", tx_count, len);
+	CHECK(memcmp(tx_line, buffer, len) == 0, "Transmitted bytes differ");
+	CHECK(tx_finished_count == 1, "tx_finished() called %u times", tx_finished_count);
+
+	/*
+	 * Timer interrupts included
+	 */
+	interrupts = sfr_sim_interrupts() - start;
+	CHECK(interrupts < (len / FIFO_SIZE) / 4, "%u interrupts", (unsigned)interrupts);
+	printf("%u bytes transmitted with %u interrupts, %u interrupt driven\n",
+	       len, (unsigned)interrupts, len / FIFO_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t  start;
+	uint32_t  interrupts;
+	uint16_t  loop;
+	boolean   in_order;
+	result_t  rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	udata.tx_pin           = RG8;
+	udata.rx_pin           = RG6;
+	udata.baud             = 115200;
+	udata.tx_finished      = tx_finished;
+	udata.process_rx_char  = NULL;
+	udata.process_rx_block = process_rx_block;
+	udata.rx_threshold     = 0;
+	udata.rx_delimiter_enable = FALSE;
+	udata.rx_timeout       = 0;
+	uart_calculate_mode(&udata.uart_mode, UART_8_DATABITS, UART_PARITY_NONE, UART_ONE_STOP_BIT, UART_IDLE_HIGH);
+
+	rc = uart_reserve(&udata);
+	CHECK(rc >= 0, "uart_reserve() %d", rc);
+	sfr_sim_uart_tx_hook(sim_uart(udata.channel), uart_line);
+	run_mS(1);
+
+	/*
+	 * The whole transmission in one DMA transfer, then one from the end
+	 * of the SW tx buffer and a second from its start.
+	 */
+	transmit(0, 1000);
+	transmit(1000, 100);
+
+	/*
+	 * A stream of characters is delivered a buffer at a time, the tail
+	 * once the line goes idle.
+	 */
+	start = sfr_sim_interrupts();
+	for(loop = 0; loop < 200; loop++) {
+		sfr_sim_uart_rx(sim_uart(udata.channel), (uint8_t)loop);
+	}
+	run_mS(19);
+	CHECK(rx_count == 6 * SYS_UART_DMA_RX_SIZE, "%u received before the line went idle", rx_count);
+	run_mS(3 * SYS_UART_DMA_RX_IDLE);
+
+	in_order = TRUE;
+	for(loop = 0; loop < rx_count; loop++) {
+		if(rx_line[loop] != (uint8_t)loop) in_order = FALSE;
+	}
+	CHECK(rx_count == 200, "%u of 200 bytes received", rx_count);
+	CHECK(in_order, "Received bytes out of order");
+	CHECK(rx_blocks == 7, "Delivered in %u blocks", rx_blocks);
+	CHECK(rx_largest == SYS_UART_DMA_RX_SIZE, "Largest block %u", rx_largest);
+	CHECK(sfr_sim_uart_overruns(sim_uart(udata.channel)) == 0, "UART overran");
+
+	interrupts = sfr_sim_interrupts() - start;
+	CHECK(interrupts < 200 / 4, "%u interrupts", (unsigned)interrupts);
+	printf("200 bytes received in %u blocks with %u interrupts, 200 interrupt driven\n",
+	       rx_blocks, (unsigned)interrupts);
+
+	/*
+	 * A short message waits for the line to go idle
+	 */
+	rx_count = 0;
+	rx_blocks = 0;
+	for(loop = 0; loop < 5; loop++) {
+		sfr_sim_uart_rx(sim_uart(udata.channel), (uint16_t)"Hello"[loop]);
+	}
+	run_mS(1);
+	CHECK(rx_count == 0, "%u delivered before the line went idle", rx_count);
+	run_mS(3 * SYS_UART_DMA_RX_IDLE);
+	CHECK((rx_count == 5) && (memcmp(rx_line, "Hello", 5) == 0), "Received \"%.*s\"", rx_count, rx_line);
+	CHECK(rx_blocks == 1, "Short message in %u blocks", rx_blocks);
+
+	/*
+	 * Without process_rx_block() characters go to process_rx_char()
+	 */
+	udata_char.tx_pin           = RD0;
+	udata_char.rx_pin           = RD1;
+	udata_char.baud             = 115200;
+	udata_char.tx_finished      = NULL;
+	udata_char.process_rx_char  = process_rx_char;
+	udata_char.process_rx_block = NULL;
+	uart_calculate_mode(&udata_char.uart_mode, UART_8_DATABITS, UART_PARITY_NONE, UART_ONE_STOP_BIT, UART_IDLE_HIGH);
+
+	rc = uart_reserve(&udata_char);
+	CHECK(rc >= 0, "uart_reserve() %d", rc);
+	sfr_sim_uart_tx_hook(sim_uart(udata_char.channel), uart_line);
+	char_tx_count = 0;
+	for(loop = 0; loop < 5; loop++) {
+		sfr_sim_uart_rx(sim_uart(udata_char.channel), (uint16_t)"World"[loop]);
+	}
+	run_mS(1 + (3 * SYS_UART_DMA_RX_IDLE));
+	CHECK((char_count == 5) && (memcmp(char_line, "World", 5) == 0), "Received \"%.*s\"", char_count, char_line);
+
+	/*
+	 * and its transmitter's DMA Channel finishes each transfer
+	 */
+	rc = uart_tx_buffer(&udata_char, (uint8_t *)"Bye", 3);
+	CHECK(rc == 3, "uart_tx_buffer() %d", rc);
+	run_mS(2);
+	rc = uart_tx_buffer(&udata_char, (uint8_t *)"Now", 3);
+	CHECK(rc == 3, "uart_tx_buffer() %d", rc);
+	run_mS(2);
+	CHECK((char_tx_count == 6) && (memcmp(char_tx_line, "ByeNow", 6) == 0), "Transmitted \"%.*s\"", char_tx_count, char_tx_line);
+
+	rc = uart_release(&udata_char);
+	CHECK(rc >= 0, "uart_release() %d", rc);
+	rc = uart_release(&udata);
+	CHECK(rc >= 0, "uart_release() %d", rc);
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_UART_DMA
@@ -0,0 +1,263 @@
+/*
+ * libesoup/comms/uart/test/main_uart_linux.c
+ *
+ * Host test of the ES_LINUX UART backend. Two UARTs are reserved on the
+ * slave ends of two ptys and a thread copies between the master ends, as
+ * socat would link them, so one UART's transmissions are the other's
+ * reception. Checks a stream far larger than the tx_buffer arrives once, in
+ * order, with tx_finished() called, that the other direction works too, and
+ * that a device whose other end closes stops accepting characters. Prints
+ * the throughput.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir ulnx && cp libesoup/comms/uart/test/libesoup_config_uart_linux.h ulnx/libesoup_config.h
+ *     gcc -O2 -pthread -Iulnx -I. \
+ *         libesoup/comms/uart/test/main_uart_linux.c libesoup/comms/uart/uart_linux.c \
+ *         -o ulnx/uart_linux
+ */
+#define _GNU_SOURCE
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_UART_LINUX
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "libesoup/errno.h"
+#include "libesoup/comms/uart/uart.h"
+
+extern result_t uart_init(void);
+
+#define TOTAL             2000000UL
+#define CHUNK             300
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static struct uart_data  first;
+static struct uart_data  second;
+
+static atomic_uint       rx_count[2];
+static atomic_uint       rx_errors;
+static atomic_uint       finished;
+static uint8_t           reply[16];
+
+static int               masters[2];
+static atomic_int        linking;
+
+static uint8_t stream(uint32_t index)
+{
+	return((uint8_t)((index * 2654435761UL) >> 13));
+}
+
+/*
+ * Second receives the stream, first the reply
+ */
+static void process_rx_char(uint8_t uart_id, uint8_t ch)
+{
+	uint32_t index;
+
+	if(uart_id == second.channel) {
+		index = atomic_fetch_add(&rx_count[1], 1);
+		if(ch != stream(index)) atomic_fetch_add(&rx_errors, 1);
+	} else {
+		index = atomic_fetch_add(&rx_count[0], 1);
+		if(index < sizeof(reply)) reply[index] = ch;
+	}
+}
+
+static void tx_finished(struct uart_data *udata)
+{
+	if(udata == &first) atomic_fetch_add(&finished, 1);
+}
+
+/*
+ * socat, what's written to one pty is read from the other
+ */
+static void *link_ptys(void *arg)
+{
+	struct pollfd  fds[2];
+	uint8_t        buffer[4096];
+	ssize_t        len;
+	ssize_t        done;
+	int            loop;
+
+	for(loop = 0; loop < 2; loop++) {
+		fds[loop].fd     = masters[loop];
+		fds[loop].events = POLLIN;
+	}
+
+	while(atomic_load(&linking)) {
+		if(poll(fds, 2, 10) <= 0) continue;
+		for(loop = 0; loop < 2; loop++) {
+			if(!(fds[loop].revents & POLLIN)) continue;
+			len = read(masters[loop], buffer, sizeof(buffer));
+			for(done = 0; (len > 0) && (done < len); ) {
+				ssize_t rc = write(masters[loop ^ 1], &buffer[done], len - done);
+				if(rc > 0) done += rc;
+				else usleep(100);
+			}
+		}
+	}
+	return(NULL);
+}
+
+static int open_pty(char *name, size_t size)
+{
+	int fd;
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if((fd < 0) || grantpt(fd) || unlockpt(fd) || ptsname_r(fd, name, size)) {
+		return(-1);
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	return(fd);
+}
+
+static void reserve(struct uart_data *udata, const char *device)
+{
+	result_t rc;
+
+	udata->tx_pin           = LINUX_UART_PIN;
+	udata->rx_pin           = LINUX_UART_PIN;
+	udata->baud             = 115200;
+	udata->tx_finished      = tx_finished;
+	udata->process_rx_char  = process_rx_char;
+	udata->device           = device;
+	rc = uart_calculate_mode(&udata->uart_mode, UART_8_DATABITS, UART_PARITY_NONE, UART_ONE_STOP_BIT, UART_IDLE_HIGH);
+	CHECK(rc == SUCCESS, "uart_calculate_mode() %d", rc);
+
+	rc = uart_reserve(udata);
+	CHECK(rc >= 0, "uart_reserve(%s) %d", device, rc);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void wait_for(atomic_uint *count, uint32_t target)
+{
+	uint16_t loop;
+
+	for(loop = 0; (loop < 5000) && (atomic_load(count) < target); loop++) {
+		usleep(1000);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	char               names[2][64];
+	uint8_t            chunk[CHUNK];
+	struct uart_stats  stats;
+	pthread_t          linker;
+	uint32_t           sent;
+	uint16_t           len;
+	uint16_t           loop;
+	uint16_t           mode;
+	double             start;
+	double             elapsed;
+	result_t           space;
+	result_t           rc;
+
+	rc = uart_init();
+	CHECK(rc == SUCCESS, "uart_init() %d", rc);
+
+	rc = uart_calculate_mode(&mode, UART_9_DATABITS, UART_PARITY_NONE, UART_ONE_STOP_BIT, UART_IDLE_HIGH);
+	CHECK(rc == -ERR_BAD_INPUT_PARAMETER, "9 data bits %d", rc);
+
+	masters[0] = open_pty(names[0], sizeof(names[0]));
+	masters[1] = open_pty(names[1], sizeof(names[1]));
+	CHECK((masters[0] >= 0) && (masters[1] >= 0), "No ptys");
+	if(failures) goto done;
+
+	reserve(&first, names[0]);
+	reserve(&second, names[1]);
+	atomic_store(&linking, 1);
+	pthread_create(&linker, NULL, link_ptys, NULL);
+
+	/*
+	 * The stream, queued whenever there's room
+	 */
+	start = now();
+	sent = 0;
+	while(sent < TOTAL) {
+		space = uart_tx_buffer_space(&first);
+		len = (space < CHUNK) ? space : CHUNK;
+		if(len > TOTAL - sent) len = TOTAL - sent;
+		if(len == 0) {
+			usleep(50);
+			continue;
+		}
+		for(loop = 0; loop < len; loop++) {
+			chunk[loop] = stream(sent + loop);
+		}
+		rc = uart_tx_buffer(&first, chunk, len);
+		CHECK(rc == len, "uart_tx_buffer() %d of %u", rc, len);
+		sent += len;
+	}
+	wait_for(&rx_count[1], TOTAL);
+	elapsed = now() - start;
+
+	CHECK(atomic_load(&rx_count[1]) == TOTAL, "%u of %lu received", atomic_load(&rx_count[1]), TOTAL);
+	CHECK(atomic_load(&rx_errors) == 0, "%u received wrong", atomic_load(&rx_errors));
+	CHECK(atomic_load(&finished) > 0, "tx_finished() not called");
+	rc = uart_get_stats(&first, &stats);
+	CHECK((rc == SUCCESS) && (stats.tx_bytes == TOTAL), "%lu bytes transmitted", (unsigned long)stats.tx_bytes);
+	CHECK(stats.tx_high_water <= SYS_UART_TX_BUFFER_SIZE, "tx high water %u", stats.tx_high_water);
+	printf("%lu bytes in %.3f Seconds, %.1f MBytes/Second, tx_finished() %u times\n",
+	       TOTAL, elapsed, TOTAL / elapsed / 1e6, atomic_load(&finished));
+
+	/*
+	 * The other way
+	 */
+	rc = uart_tx_buffer(&second, (uint8_t *)"Reply", 5);
+	CHECK(rc == 5, "uart_tx_buffer() %d", rc);
+	wait_for(&rx_count[0], 5);
+	CHECK((atomic_load(&rx_count[0]) == 5) && (memcmp(reply, "Reply", 5) == 0), "Reply \"%.*s\"", atomic_load(&rx_count[0]), reply);
+
+	/*
+	 * The other end of the first closes
+	 */
+	atomic_store(&linking, 0);
+	pthread_join(linker, NULL);
+	close(masters[0]);
+	for(loop = 0; loop < 1000; loop++) {
+		rc = uart_tx_buffer(&first, (uint8_t *)"x", 1);
+		if(rc == -ERR_NOT_READY) break;
+		usleep(1000);
+	}
+	CHECK(rc == -ERR_NOT_READY, "uart_tx_buffer() to a closed pty %d", rc);
+
+	rc = uart_release(&first);
+	CHECK(rc == SUCCESS, "uart_release() %d", rc);
+	rc = uart_release(&second);
+	CHECK(rc == SUCCESS, "uart_release() %d", rc);
+	rc = uart_release(&second);
+	CHECK(rc == -ERR_BAD_INPUT_PARAMETER, "uart_release() twice %d", rc);
+	close(masters[1]);
+
+done:
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_UART_LINUX
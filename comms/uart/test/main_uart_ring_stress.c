@@ -0,0 +1,275 @@
+/*
+ * libesoup/comms/uart/test/main_uart_ring_stress.c
+ *
+ * Host stress test of the UART tx_buffer and rx_buffer rings against the SFR
+ * simulation. Enough characters go through each ring for the free running
+ * indices to wrap a few times.
+ *
+ * Transmit queues random sized chunks with uart_tx_buffer(), and now and then
+ * a request with uart_tx_segments(), whilst the simulation runs for random
+ * times in between. Every character must appear on the line once, in order.
+ *
+ * Receive has an interval timer signal standing in for the interrupts. Its
+ * handler feeds the line and runs the simulation, so the UART's ISR, whilst
+ * the main loop delivers blocks from libesoup_tasks(). As on the device the
+ * signal arrives anywhere in the task's handling of the ring, and neither
+ * side disables interrupts. The handler never has more characters
+ * outstanding than the ring holds, counting those delivered once
+ * libesoup_tasks() has returned, so a single lost, repeated or torn
+ * character is an error.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir urs && cp libesoup/comms/uart/test/libesoup_config_uart_ring_stress.h urs/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Iurs -I. \
+ *         libesoup/comms/uart/test/main_uart_ring_stress.c libesoup/comms/uart/uart.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/gpio/gpio.c libesoup/gpio/peripheral.c \
+ *         -o urs/uart_ring_stress
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_UART_RING_STRESS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/comms/uart/uart.h"
+
+#define CHAR_CYCLES       ((SYS_CLOCK_FREQ / 115200UL) * 10)
+
+#define TX_TOTAL          150000UL
+#define RX_TOTAL          300000UL
+#define SEGMENT_SIZE      200
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static struct uart_data  udata;
+
+/*
+ * Both directions carry the same pseudo random stream, newlines included
+ */
+static uint8_t stream(uint32_t index)
+{
+	return((uint8_t)((index * 2654435761UL) >> 13));
+}
+
+/*
+ * Transmit
+ */
+static uint32_t          tx_line_count;
+static uint32_t          tx_errors;
+static uint8_t           segment_buffer[SEGMENT_SIZE];
+static struct uart_tx_segment segments[2];
+static struct uart_tx_request request;
+static boolean           request_busy;
+static uint16_t          requests_done;
+
+static void uart_line(uint8_t uart, uint16_t ch)
+{
+	if((uint8_t)ch != stream(tx_line_count)) {
+		if(tx_errors++ < 10) {
+			printf("Line character %u 0x%02x expected 0x%02x\n", tx_line_count, ch, stream(tx_line_count));
+		}
+	}
+	tx_line_count++;
+}
+
+static void done(struct uart_data *uart, struct uart_tx_request *req, result_t rc)
+{
+	if(rc == SUCCESS) requests_done++;
+	request_busy = FALSE;
+}
+
+static void transmit(void)
+{
+	uint8_t   chunk[100];
+	uint32_t  queued = 0;
+	uint32_t  loop;
+	uint16_t  requests = 0;
+	uint16_t  len;
+	uint16_t  split;
+	result_t  space;
+	result_t  rc;
+
+	srand(1);
+	while(queued < TX_TOTAL) {
+		if(((rand() % 8) == 0) && !request_busy) {
+			len = 1 + (rand() % SEGMENT_SIZE);
+			if(len > TX_TOTAL - queued) len = TX_TOTAL - queued;
+			for(loop = 0; loop < len; loop++) {
+				segment_buffer[loop] = stream(queued + loop);
+			}
+			split = rand() % (len + 1);
+			segments[0].ptr = segment_buffer;
+			segments[0].len = split;
+			segments[1].ptr = &segment_buffer[split];
+			segments[1].len = len - split;
+			request.segments = segments;
+			request.count    = 2;
+			request.done     = done;
+
+			request_busy = TRUE;
+			rc = uart_tx_segments(&udata, &request);
+			CHECK(rc == SUCCESS, "uart_tx_segments() %d", rc);
+			requests++;
+			queued += len;
+		} else {
+			len = 1 + (rand() % sizeof(chunk));
+			if(len > TX_TOTAL - queued) len = TX_TOTAL - queued;
+			space = uart_tx_buffer_space(&udata);
+			if(len > space) len = space;
+			for(loop = 0; loop < len; loop++) {
+				chunk[loop] = stream(queued + loop);
+			}
+			if(len) {
+				rc = uart_tx_buffer(&udata, chunk, len);
+				CHECK(rc == len, "uart_tx_buffer() %d of %u", rc, len);
+				queued += len;
+			}
+		}
+		sfr_sim_run(rand() % (CHAR_CYCLES * 40));
+		libesoup_tasks();
+	}
+
+	for(loop = 0; (loop < 1000) && (tx_line_count < TX_TOTAL); loop++) {
+		sfr_sim_run(CHAR_CYCLES * 10);
+		libesoup_tasks();
+	}
+
+	CHECK(tx_line_count == TX_TOTAL, "%u of %lu characters transmitted", tx_line_count, TX_TOTAL);
+	CHECK(tx_errors == 0, "%u characters transmitted out of order", tx_errors);
+	CHECK(requests_done == requests, "%u of %u requests done", requests_done, requests);
+	printf("Transmitted %u characters, %u requests\n", tx_line_count, requests);
+}
+
+/*
+ * Receive, the last character a newline so the end is delivered
+ */
+static atomic_uint       rx_delivered;
+static atomic_uint       rx_released;        // Delivered and the space handed back
+static uint32_t          rx_fed;
+static uint32_t          rx_errors;
+static uint32_t          rx_blocks;
+static unsigned int      rx_seed = 2;
+
+static uint8_t rx_stream(uint32_t index)
+{
+	return((index == RX_TOTAL - 1) ? '\n' : stream(index));
+}
+
+static void process_rx_block(uint8_t uart_id, uint8_t *ptr, uint16_t len)
+{
+	uint32_t index = atomic_load(&rx_delivered);
+
+	rx_blocks++;
+	while(len--) {
+		if(*ptr != rx_stream(index)) {
+			if(rx_errors++ < 10) {
+				printf("Received character %u 0x%02x expected 0x%02x\n", index, *ptr, rx_stream(index));
+			}
+		}
+		ptr++;
+		index++;
+	}
+	atomic_store(&rx_delivered, index);
+}
+
+/*
+ * The interrupts, a burst of characters on the line if the ring has room
+ * and the simulation run on. Not whilst the main loop's ClrWdt() is already
+ * running the simulation, nor whilst it has interrupts disabled as simulated
+ * time would run on with the receive FIFO overflowing.
+ */
+static void interrupt(int sig)
+{
+	uint16_t burst;
+
+	if(sfr_sim_busy() || !INTCON2bits.GIE) {
+		return;
+	}
+
+	burst = 1 + (rand_r(&rx_seed) % 16);
+	if(burst > RX_TOTAL - rx_fed) burst = RX_TOTAL - rx_fed;
+	if((rx_fed - atomic_load(&rx_released)) + burst <= SYS_UART_RX_BUFFER_SIZE) {
+		while(burst--) {
+			sfr_sim_uart_rx(udata.channel, rx_stream(rx_fed++));
+		}
+	}
+	sfr_sim_run(rand_r(&rx_seed) % (CHAR_CYCLES * 20));
+}
+
+static void receive(void)
+{
+	struct itimerval  interval;
+	time_t            start;
+
+	signal(SIGALRM, interrupt);
+	interval.it_interval.tv_sec  = 0;
+	interval.it_interval.tv_usec = 20;
+	interval.it_value            = interval.it_interval;
+	setitimer(ITIMER_REAL, &interval, NULL);
+
+	start = time(NULL);
+	while((atomic_load(&rx_delivered) < RX_TOTAL) && (time(NULL) - start < 60)) {
+		libesoup_tasks();
+		atomic_store(&rx_released, atomic_load(&rx_delivered));
+	}
+
+	memset(&interval, 0x00, sizeof(interval));
+	setitimer(ITIMER_REAL, &interval, NULL);
+
+	CHECK(atomic_load(&rx_delivered) == RX_TOTAL, "%u of %lu characters delivered", atomic_load(&rx_delivered), RX_TOTAL);
+	CHECK(rx_errors == 0, "%u characters delivered wrong", rx_errors);
+	printf("Received %u characters in %u blocks\n", atomic_load(&rx_delivered), rx_blocks);
+}
+
+int main(int argc, char **argv)
+{
+	result_t rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	udata.tx_pin           = RG8;
+	udata.rx_pin           = RG6;
+	udata.baud             = 115200;
+	udata.tx_finished      = NULL;
+	udata.process_rx_char  = NULL;
+	udata.process_rx_block = process_rx_block;
+	udata.rx_threshold     = 16;
+	udata.rx_delimiter_enable = TRUE;
+	udata.rx_delimiter     = '\n';
+	udata.rx_timeout       = 0;
+	uart_calculate_mode(&udata.uart_mode, UART_8_DATABITS, UART_PARITY_NONE, UART_ONE_STOP_BIT, UART_IDLE_HIGH);
+
+	rc = uart_reserve(&udata);
+	CHECK(rc >= 0, "uart_reserve() %d", rc);
+	sfr_sim_uart_tx_hook(udata.channel, uart_line);
+
+	transmit();
+	receive();
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_UART_RING_STRESS
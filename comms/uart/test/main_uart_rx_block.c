@@ -0,0 +1,220 @@
+/*
+ * libesoup/comms/uart/test/main_uart_rx_block.c
+ *
+ * Host test of block delivery of received characters, SYS_UART_RX_BLOCK,
+ * against the SFR simulation. Checks blocks are delivered from task context
+ * at the threshold, up to each delimiter and once the line has been idle for
+ * the timeout, that a block wrapping the ring comes in two spans and that a
+ * full ring drops the overflow rather than what it holds.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir urxb && cp libesoup/comms/uart/test/libesoup_config_uart_rx_block.h urxb/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Iurxb -I. \
+ *         libesoup/comms/uart/test/main_uart_rx_block.c libesoup/comms/uart/uart.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/gpio/gpio.c libesoup/gpio/peripheral.c \
+ *         -o urxb/uart_rx_block
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_UART_RX_BLOCK
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/comms/uart/uart.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static struct uart_data  udata;
+
+static uint8_t   rx_line[512];
+static uint16_t  rx_count;
+static uint16_t  rx_blocks;
+static uint16_t  rx_lengths[32];
+static boolean   in_isr;
+static boolean   from_isr;
+
+static void process_rx_block(uint8_t uart_id, uint8_t *ptr, uint16_t len)
+{
+	if(in_isr) from_isr = TRUE;
+	if(rx_blocks < 32) rx_lengths[rx_blocks] = len;
+	rx_blocks++;
+	while(len-- && (rx_count < sizeof(rx_line))) {
+		rx_line[rx_count++] = *ptr++;
+	}
+}
+
+static void run_mS(uint16_t mS)
+{
+	while(mS--) {
+		in_isr = TRUE;
+		sfr_sim_run(CYCLES_PER_mS);
+		in_isr = FALSE;
+		libesoup_tasks();
+	}
+}
+
+static void receive(const char *data, uint16_t len)
+{
+	uint16_t loop;
+
+	for(loop = 0; loop < len; loop++) {
+		sfr_sim_uart_rx(udata.channel, (uint8_t)data[loop]);
+	}
+}
+
+/*
+ * About 87uS a character at 115200 Baud
+ */
+static uint16_t line_mS(uint16_t len)
+{
+	return(((len * 87UL) / 1000) + 1);
+}
+
+/*
+ * Characters received without the task running, then the task run once
+ */
+static void arrive(const char *data, uint16_t len)
+{
+	receive(data, len);
+	in_isr = TRUE;
+	sfr_sim_run(line_mS(len) * CYCLES_PER_mS);
+	in_isr = FALSE;
+	libesoup_tasks();
+}
+
+#define NO_DELIMITER   -1
+
+static void reserve(uint16_t threshold, int16_t delimiter, uint16_t timeout)
+{
+	result_t rc;
+
+	if(udata.channel != UART_BAD) {
+		rc = uart_release(&udata);
+		CHECK(rc >= 0, "uart_release() %d", rc);
+	}
+
+	udata.tx_pin           = RG8;
+	udata.rx_pin           = RG6;
+	udata.baud             = 115200;
+	udata.tx_finished      = NULL;
+	udata.process_rx_char  = NULL;
+	udata.process_rx_block = process_rx_block;
+	udata.rx_threshold     = threshold;
+	udata.rx_delimiter_enable = (delimiter != NO_DELIMITER);
+	udata.rx_delimiter     = udata.rx_delimiter_enable ? (uint8_t)delimiter : 0;
+	udata.rx_timeout       = timeout;
+	uart_calculate_mode(&udata.uart_mode, UART_8_DATABITS, UART_PARITY_NONE, UART_ONE_STOP_BIT, UART_IDLE_HIGH);
+
+	rc = uart_reserve(&udata);
+	CHECK(rc >= 0, "uart_reserve() %d", rc);
+
+	rx_count  = 0;
+	rx_blocks = 0;
+}
+
+int main(int argc, char **argv)
+{
+	char      data[128];
+	char      nul_data[30];
+	uint16_t  loop;
+	result_t  rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	for(loop = 0; loop < sizeof(data); loop++) {
+		data[loop] = (char)('A' + (loop % 26));
+	}
+	udata.channel = UART_BAD;
+
+	/*
+	 * Threshold, the remainder waits
+	 */
+	reserve(16, NO_DELIMITER, 0);
+	arrive(data, 12);
+	run_mS(20);
+	CHECK(rx_count == 0, "%u delivered below a threshold of 16", rx_count);
+	arrive(&data[12], 8);
+	CHECK((rx_count == 20) && (rx_blocks == 1), "%u delivered in %u blocks at the threshold", rx_count, rx_blocks);
+	CHECK(memcmp(rx_line, data, 20) == 0, "Threshold block differs");
+	CHECK(!from_isr, "Block delivered from the ISR");
+
+	/*
+	 * Delimiter, each line delivered up to and including it
+	 */
+	reserve(0, '\n', 0);
+	receive("abc\nde\nf", 8);
+	run_mS(line_mS(8) + 20);
+	CHECK((rx_count == 7) && (memcmp(rx_line, "abc\nde\n", 7) == 0), "Delimited \"%.*s\"", rx_count, rx_line);
+	CHECK((rx_blocks == 2) && (rx_lengths[0] == 4) && (rx_lengths[1] == 3), "%u delimited blocks", rx_blocks);
+	receive("g\n", 2);
+	run_mS(line_mS(2));
+	CHECK((rx_count == 10) && (memcmp(&rx_line[7], "fg\n", 3) == 0), "Delimited \"%.*s\"", rx_count, rx_line);
+
+	/*
+	 * Timeout, nothing until the line has been idle. Idle is seen between
+	 * one and two timeouts after the last character. Without a delimiter
+	 * a NUL is just another character.
+	 */
+	memcpy(nul_data, data, sizeof(nul_data));
+	nul_data[10] = '\0';
+	reserve(0, NO_DELIMITER, 20);
+	receive(nul_data, 30);
+	run_mS(line_mS(30) + 10);
+	CHECK(rx_count == 0, "%u delivered before the timeout", rx_count);
+	run_mS(40);
+	CHECK((rx_count == 30) && (rx_blocks == 1), "%u delivered in %u blocks after the timeout", rx_count, rx_blocks);
+	CHECK(memcmp(rx_line, nul_data, 30) == 0, "Timed out block differs");
+
+	/*
+	 * A block wrapping the end of the ring is delivered in two spans
+	 */
+	reserve(48, NO_DELIMITER, 0);
+	arrive(data, 48);
+	arrive(&data[48], 48);
+	CHECK((rx_count == 96) && (memcmp(rx_line, data, 96) == 0), "%u delivered wrapping the ring", rx_count);
+	CHECK((rx_blocks == 3) && (rx_lengths[1] == 16) && (rx_lengths[2] == 32), "Wrapping block in %u spans", rx_blocks - 1);
+
+	/*
+	 * Nothing delivered for a while, the ring keeps what it has
+	 */
+	reserve(0, '\n', 0);
+	arrive(data, 80);
+	CHECK((rx_count == SYS_UART_RX_BUFFER_SIZE) && (memcmp(rx_line, data, rx_count) == 0), "%u delivered from a full ring", rx_count);
+
+	/*
+	 * Every character goes straight to the task without any of the three
+	 */
+	reserve(0, NO_DELIMITER, 0);
+	receive(data, 100);
+	run_mS(line_mS(100));
+	CHECK((rx_count == 100) && (memcmp(rx_line, data, 100) == 0), "%u delivered straight away", rx_count);
+	printf("100 characters delivered straight away in %u blocks\n", rx_blocks);
+
+	rc = uart_release(&udata);
+	CHECK(rc >= 0, "uart_release() %d", rc);
+	CHECK(!from_isr, "Block delivered from the ISR");
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_UART_RX_BLOCK
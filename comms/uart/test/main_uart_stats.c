@@ -0,0 +1,175 @@
+/*
+ * libesoup/comms/uart/test/main_uart_stats.c
+ *
+ * Host test of the UART statistics, SYS_UART_STATS, against the SFR
+ * simulation. The UART's transmit line is looped back to its receive line.
+ * Checks the bytes moved each way, the SW buffer high water marks, a receive
+ * FIFO overrun, characters dropped by a full receive ring, that the ISR
+ * times are measured and that uart_reset_stats() clears the lot. The
+ * simulation doesn't model framing or parity errors.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir usts && cp libesoup/comms/uart/test/libesoup_config_uart_stats.h usts/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Iusts -I. \
+ *         libesoup/comms/uart/test/main_uart_stats.c libesoup/comms/uart/uart.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/gpio/gpio.c libesoup/gpio/peripheral.c \
+ *         libesoup/utils/loop_stats.c \
+ *         -o usts/uart_stats
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_UART_STATS
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/comms/uart/uart.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+#define TOTAL             1000
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static struct uart_data  udata;
+
+static uint16_t  rx_count;
+static boolean   loopback;
+
+static void uart_line(uint8_t uart, uint16_t ch)
+{
+	if(loopback) sfr_sim_uart_rx(uart, ch);
+}
+
+static void process_rx_block(uint8_t uart_id, uint8_t *ptr, uint16_t len)
+{
+	rx_count += len;
+}
+
+static void run_mS(uint16_t mS)
+{
+	while(mS--) {
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t            data[50];
+	struct uart_stats  stats;
+	uint16_t           sent;
+	uint16_t           loop;
+	result_t           rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	for(loop = 0; loop < sizeof(data); loop++) {
+		data[loop] = (uint8_t)('A' + (loop % 26));
+	}
+
+	udata.tx_pin           = RG8;
+	udata.rx_pin           = RG6;
+	udata.baud             = 115200;
+	udata.tx_finished      = NULL;
+	udata.process_rx_char  = NULL;
+	udata.process_rx_block = process_rx_block;
+	udata.rx_threshold     = 8;
+	udata.rx_delimiter_enable = FALSE;
+	udata.rx_timeout       = 10;
+	uart_calculate_mode(&udata.uart_mode, UART_8_DATABITS, UART_PARITY_NONE, UART_ONE_STOP_BIT, UART_IDLE_HIGH);
+
+	rc = uart_reserve(&udata);
+	CHECK(rc >= 0, "uart_reserve() %d", rc);
+	sfr_sim_uart_tx_hook(udata.channel, uart_line);
+
+	rc = uart_get_stats(&udata, &stats);
+	CHECK((rc == SUCCESS) && (stats.rx_bytes == 0) && (stats.tx_bytes == 0), "Reserved with %lu/%lu bytes", (unsigned long)stats.rx_bytes, (unsigned long)stats.tx_bytes);
+
+	/*
+	 * Looped back, chunks queued whenever there's room
+	 */
+	loopback = TRUE;
+	sent = 0;
+	while(sent < TOTAL) {
+		if(uart_tx_buffer_space(&udata) >= (result_t)sizeof(data)) {
+			rc = uart_tx_buffer(&udata, data, sizeof(data));
+			CHECK(rc == sizeof(data), "uart_tx_buffer() %d", rc);
+			sent += sizeof(data);
+		}
+		run_mS(1);
+	}
+	run_mS(20);
+
+	rc = uart_get_stats(&udata, &stats);
+	CHECK(rc == SUCCESS, "uart_get_stats() %d", rc);
+	CHECK(stats.tx_bytes == TOTAL, "%lu bytes transmitted", (unsigned long)stats.tx_bytes);
+	CHECK((stats.rx_bytes == TOTAL) && (rx_count == TOTAL), "%lu bytes received, %u delivered", (unsigned long)stats.rx_bytes, rx_count);
+	CHECK((stats.tx_high_water >= sizeof(data)) && (stats.tx_high_water <= SYS_UART_TX_BUFFER_SIZE), "tx high water %u", stats.tx_high_water);
+	CHECK((stats.rx_high_water >= 8) && (stats.rx_high_water < SYS_UART_RX_BUFFER_SIZE), "rx high water %u", stats.rx_high_water);
+	CHECK((stats.rx_overruns == 0) && (stats.rx_dropped == 0), "%u overruns, %u dropped", stats.rx_overruns, stats.rx_dropped);
+	CHECK((stats.rx_framing_errors == 0) && (stats.rx_parity_errors == 0), "%u framing, %u parity errors", stats.rx_framing_errors, stats.rx_parity_errors);
+	CHECK(stats.rx_isr_max_cycles > 0, "Receive ISR not timed");
+	printf("%lu bytes each way, high water tx %u rx %u, longest ISRs tx %u rx %u cycles\n",
+	       (unsigned long)stats.tx_bytes, stats.tx_high_water, stats.rx_high_water,
+	       stats.tx_isr_max_cycles, stats.rx_isr_max_cycles);
+	loopback = FALSE;
+
+	/*
+	 * Receive ISR held off, the UART's FIFO overruns
+	 */
+	rc = uart_reset_stats(&udata);
+	CHECK(rc == SUCCESS, "uart_reset_stats() %d", rc);
+	rc = uart_get_stats(&udata, &stats);
+	CHECK((stats.rx_bytes == 0) && (stats.tx_bytes == 0) && (stats.tx_high_water == 0) && (stats.rx_isr_max_cycles == 0), "Stats not reset");
+
+	U1_RX_ISR_ENABLE = 0;
+	for(loop = 0; loop < 10; loop++) {
+		sfr_sim_uart_rx(udata.channel, data[loop]);
+	}
+	run_mS(2);
+	U1_RX_ISR_ENABLE = 1;
+	run_mS(20);
+	rc = uart_get_stats(&udata, &stats);
+	CHECK(stats.rx_overruns == 1, "%u overruns", stats.rx_overruns);
+
+	/*
+	 * The task not running, a full ring drops the rest
+	 */
+	uart_reset_stats(&udata);
+	rx_count = 0;
+	for(loop = 0; loop < 80; loop++) {
+		sfr_sim_uart_rx(udata.channel, data[loop % sizeof(data)]);
+	}
+	sfr_sim_run(10 * CYCLES_PER_mS);
+	rc = uart_get_stats(&udata, &stats);
+	CHECK((stats.rx_bytes == 80) && (stats.rx_dropped == 80 - SYS_UART_RX_BUFFER_SIZE), "%lu received, %u dropped", (unsigned long)stats.rx_bytes, stats.rx_dropped);
+	CHECK(stats.rx_high_water == SYS_UART_RX_BUFFER_SIZE, "rx high water %u", stats.rx_high_water);
+	run_mS(20);
+
+	rc = uart_release(&udata);
+	CHECK(rc >= 0, "uart_release() %d", rc);
+	rc = uart_get_stats(&udata, &stats);
+	CHECK(rc == -ERR_BAD_INPUT_PARAMETER, "uart_get_stats() once released %d", rc);
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_UART_STATS
@@ -0,0 +1,203 @@
+/*
+ * libesoup/comms/uart/test/main_uart_tx_segments.c
+ *
+ * Host test of scatter gather transmission, SYS_UART_TX_SEGMENTS, against
+ * the SFR simulation. Checks a request's segments go out in order, larger
+ * than the SW tx buffer, with done() called once, that requests keep their
+ * place amongst bytes queued with uart_tx_buffer(), that an empty request is
+ * done straight away and that releasing the UART hands queued requests back.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir utxs && cp libesoup/comms/uart/test/libesoup_config_uart_tx_segments.h utxs/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Iutxs -I. \
+ *         libesoup/comms/uart/test/main_uart_tx_segments.c libesoup/comms/uart/uart.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/gpio/gpio.c libesoup/gpio/peripheral.c \
+ *         -o utxs/uart_tx_segments
+ *
+ * Add SYS_UART_DMA to utxs/libesoup_config.h and build again to test the DMA
+ * reading straight from the segments.
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_UART_TX_SEGMENTS
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/comms/uart/uart.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static struct uart_data  udata;
+
+static uint8_t   tx_line[4096];
+static uint16_t  tx_count;
+static uint16_t  tx_finished_count;
+
+static uint16_t  done_count;
+static result_t  done_rc;
+static uint16_t  done_at;               // tx_count when done() was called
+
+static void uart_line(uint8_t uart, uint16_t ch)
+{
+	if(tx_count < sizeof(tx_line)) tx_line[tx_count++] = (uint8_t)ch;
+}
+
+static void tx_finished(struct uart_data *uart)
+{
+	tx_finished_count++;
+}
+
+static void done(struct uart_data *uart, struct uart_tx_request *request, result_t rc)
+{
+	done_count++;
+	done_rc = rc;
+	done_at = tx_count;
+}
+
+static void run_mS(uint16_t mS)
+{
+	while(mS--) {
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+	}
+}
+
+static void reset_line(void)
+{
+	tx_count = 0;
+	tx_finished_count = 0;
+	done_count = 0;
+	done_rc = 1;
+}
+
+int main(int argc, char **argv)
+{
+	/*
+	 * Static, with SYS_UART_DMA the DMA has to be able to reach them
+	 */
+	static uint8_t          payload[2000];
+	static uint8_t          header[3] = { 0x11, 0x03, 0xfa };
+	static uint8_t          crc[2]    = { 0xc5, 0xcd };
+	static uint8_t          middle[8] = { 'R', 'e', 'q', 'u', 'e', 's', 't', ' ' };
+	struct uart_tx_segment  segments[4];
+	struct uart_tx_request  request;
+	struct uart_tx_request  second;
+	uint16_t                loop;
+	result_t                rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	for(loop = 0; loop < sizeof(payload); loop++) {
+		payload[loop] = (uint8_t)(loop * 13);
+	}
+
+	udata.tx_pin           = RG8;
+	udata.rx_pin           = INVALID_GPIO_PIN;
+	udata.baud             = 115200;
+	udata.tx_finished      = tx_finished;
+	udata.process_rx_char  = NULL;
+	uart_calculate_mode(&udata.uart_mode, UART_8_DATABITS, UART_PARITY_NONE, UART_ONE_STOP_BIT, UART_IDLE_HIGH);
+
+	rc = uart_reserve(&udata);
+	CHECK(rc >= 0, "uart_reserve() %d", rc);
+	sfr_sim_uart_tx_hook(udata.channel, uart_line);
+	run_mS(1);
+
+	/*
+	 * Header, payload and CRC, with an empty segment, as one request far
+	 * larger than the SW tx buffer
+	 */
+	reset_line();
+	segments[0].ptr = header;
+	segments[0].len = sizeof(header);
+	segments[1].ptr = payload;
+	segments[1].len = sizeof(payload);
+	segments[2].ptr = NULL;
+	segments[2].len = 0;
+	segments[3].ptr = crc;
+	segments[3].len = sizeof(crc);
+	request.segments = segments;
+	request.count    = 4;
+	request.done     = done;
+
+	rc = uart_tx_segments(&udata, &request);
+	CHECK(rc == SUCCESS, "uart_tx_segments() %d", rc);
+	run_mS(((sizeof(payload) + 5) * 87UL) / 1000 + 5);
+
+	CHECK(tx_count == sizeof(payload) + 5, "%u bytes transmitted", tx_count);
+	CHECK(memcmp(tx_line, header, 3) == 0, "Header differs");
+	CHECK(memcmp(&tx_line[3], payload, sizeof(payload)) == 0, "Payload differs");
+	CHECK(memcmp(&tx_line[3 + sizeof(payload)], crc, 2) == 0, "CRC differs");
+	CHECK((done_count == 1) && (done_rc == SUCCESS), "done() called %u times, %d", done_count, done_rc);
+	CHECK(tx_finished_count == 1, "tx_finished() called %u times", tx_finished_count);
+	printf("%u bytes transmitted from 4 segments\n", tx_count);
+
+	/*
+	 * A request goes between the bytes queued before and after it
+	 */
+	reset_line();
+	rc = uart_tx_buffer(&udata, (uint8_t *)"Before ", 7);
+	CHECK(rc == 7, "uart_tx_buffer() %d", rc);
+	segments[0].ptr = middle;
+	segments[0].len = sizeof(middle);
+	request.count   = 1;
+	rc = uart_tx_segments(&udata, &request);
+	CHECK(rc == SUCCESS, "uart_tx_segments() %d", rc);
+	rc = uart_tx_buffer(&udata, (uint8_t *)"After", 5);
+	CHECK(rc == 5, "uart_tx_buffer() %d", rc);
+	run_mS(5);
+
+	CHECK((tx_count == 20) && (memcmp(tx_line, "Before Request After", 20) == 0), "Transmitted \"%.*s\"", tx_count, tx_line);
+	CHECK(done_count == 1, "done() called %u times", done_count);
+	CHECK(done_at <= 15, "done() called after %u bytes", done_at);
+
+	/*
+	 * Nothing to transmit, done straight away
+	 */
+	reset_line();
+	request.count = 0;
+	rc = uart_tx_segments(&udata, &request);
+	CHECK(rc == SUCCESS, "uart_tx_segments() %d", rc);
+	CHECK((done_count == 1) && (done_rc == SUCCESS), "Empty request done() called %u times", done_count);
+
+	/*
+	 * Released with requests queued, both handed back
+	 */
+	reset_line();
+	segments[0].ptr = payload;
+	segments[0].len = sizeof(payload);
+	request.count   = 1;
+	second.segments = segments;
+	second.count    = 1;
+	second.done     = done;
+	uart_tx_segments(&udata, &request);
+	uart_tx_segments(&udata, &second);
+	run_mS(2);
+	rc = uart_release(&udata);
+	CHECK(rc >= 0, "uart_release() %d", rc);
+	CHECK((done_count == 2) && (done_rc == -ERR_BAD_STATE), "Released, done() called %u times, %d", done_count, done_rc);
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_UART_TX_SEGMENTS
@@ -31,7 +31,10 @@
 
 #include "libesoup_config.h"
 
-#if defined(SYS_UART1) || defined(SYS_UART2)
+/*
+ * ES_LINUX builds use uart_linux.c
+ */
+#if (defined(SYS_UART1) || defined(SYS_UART2)) && !defined(ES_LINUX)
 
 #ifdef SYS_SERIAL_LOGGING
 #define DEBUG_FILE
@@ -50,9 +53,15 @@ static const char *TAG = "UART";
 #include "libesoup/utils/rand.h"
 #include "libesoup/comms/uart/uart.h"
 #include "libesoup/timers/time.h"
-#ifdef SYS_UART_TEST_RESPONSE
+#if defined(SYS_UART_TEST_RESPONSE) || defined(SYS_UART_RX_BLOCK)
 #include "libesoup/timers/sw_timers.h"
 #endif
+#ifdef SYS_UART_STATS
+#include <string.h>
+#ifdef SYS_LOOP_STATS
+#include "libesoup/utils/loop_stats.h"
+#endif
+#endif
 
 /*
  * Check required libesoup_config.h defines are found
@@ -61,6 +70,132 @@ static const char *TAG = "UART";
 #error libesoup_config.h file should define the SYS_UART_TX_BUFFER_SIZE
 #endif
 
+#if ((SYS_UART_TX_BUFFER_SIZE) & ((SYS_UART_TX_BUFFER_SIZE) - 1)) != 0
+#error SYS_UART_TX_BUFFER_SIZE must be a power of two
+#endif
+
+#if defined(SYS_UART_TX_SEGMENTS) && !defined(XC16)
+#error SYS_UART_TX_SEGMENTS is only supported on the XC16 devices
+#endif
+
+#ifdef SYS_UART_ADDRESS_DETECT
+#if !defined(XC16)
+#error SYS_UART_ADDRESS_DETECT is only supported on the XC16 devices
+#endif
+#ifdef SYS_UART_DMA
+#error SYS_UART_ADDRESS_DETECT is not supported with SYS_UART_DMA reception
+#endif
+#endif // SYS_UART_ADDRESS_DETECT
+
+#ifdef SYS_UART_RX_BLOCK
+#ifndef SYS_SW_TIMERS
+#error SYS_UART_RX_BLOCK requires SYS_SW_TIMERS for the receive timeout
+#endif
+
+#ifndef SYS_UART_RX_BUFFER_SIZE
+#define SYS_UART_RX_BUFFER_SIZE  128
+#endif
+
+#if ((SYS_UART_RX_BUFFER_SIZE) & ((SYS_UART_RX_BUFFER_SIZE) - 1)) != 0
+#error SYS_UART_RX_BUFFER_SIZE must be a power of two
+#endif
+#endif // SYS_UART_RX_BLOCK
+
+/*
+ * ISR times are read from the SYS_LOOP_STATS stopwatch, in instruction
+ * cycles. Only the low 16 bits are used, an ISR is never that long and the
+ * difference is right even if the stopwatch's overflow hasn't been counted
+ * yet, as its interrupt may not run during ours.
+ */
+#if defined(SYS_UART_STATS) && defined(SYS_LOOP_STATS)
+#define UART_ISR_START                uint16_t isr_start = (uint16_t)loop_stats_clock();
+#define UART_ISR_END(channel, max)    uart_isr_time(&uarts[channel].stats.max, isr_start);
+#else
+#define UART_ISR_START
+#define UART_ISR_END(channel, max)
+#endif
+
+#ifdef SYS_UART_DMA
+#ifndef __dsPIC33EP256MU806__
+#error SYS_UART_DMA is only supported on the dsPIC33EP256MU806
+#endif
+/*
+ * Each UART channel in use takes a pair of DMA Channels, from Channel 2, as
+ * ECAN 1 has Channels 0 & 1. enum uart_channel only numbers the UARTs which
+ * are defined, so a UART's pair goes by its position amongst them, with
+ * SYS_UART1 and SYS_UART3 UART_3 is channel 1 on DMA Channels 4 & 5.
+ * UART_DMA_PAIRS is the number of positions used.
+ */
+#ifdef SYS_UART1
+#define UART_DMA_UART1        1
+#else
+#define UART_DMA_UART1        0
+#endif
+#ifdef SYS_UART2
+#define UART_DMA_UART2        1
+#else
+#define UART_DMA_UART2        0
+#endif
+#ifdef SYS_UART3
+#define UART_DMA_UART3        1
+#else
+#define UART_DMA_UART3        0
+#endif
+#ifdef SYS_UART4
+#define UART_DMA_UART4        1
+#else
+#define UART_DMA_UART4        0
+#endif
+
+#define UART_DMA_PAIRS        (UART_DMA_UART1 + UART_DMA_UART2 + UART_DMA_UART3 + UART_DMA_UART4)
+
+#if UART_DMA_PAIRS > 3
+#error SYS_UART_DMA supports up to three UARTs, on DMA Channels 2 to 7
+#endif
+#ifndef SYS_SW_TIMERS
+#error SYS_UART_DMA requires SYS_SW_TIMERS to detect the receive line going idle
+#endif
+
+#ifndef SYS_UART_DMA_RX_SIZE
+#define SYS_UART_DMA_RX_SIZE  32
+#endif
+
+#ifndef SYS_UART_DMA_RX_IDLE
+#define SYS_UART_DMA_RX_IDLE  SYS_SW_TIMER_TICK_ms
+#endif
+
+/*
+ * Receive DMA words are pre-filled with a value UxRXREG can never read, so
+ * how far DMA has got in to a buffer can be seen in RAM, as the dsPIC33EP
+ * has no readable transfer count.
+ */
+#define UART_DMA_EMPTY        0xffff
+
+/*
+ * uart_tx_buffer() queues a buffer this many bytes at a time with interrupts
+ * disabled
+ */
+#define UART_DMA_TX_CHUNK     16
+
+/*
+ * The eight registers of a DMA Channel, DMAxCON to DMAxCNT, are contiguous
+ * and each Channel's follow on from the last's.
+ */
+struct dma_channel {
+	uint16_t  con;
+	uint16_t  req;
+	uint16_t  stal;
+	uint16_t  stah;
+	uint16_t  stbl;
+	uint16_t  stbh;
+	uint16_t  pad;
+	uint16_t  cnt;
+};
+
+#define UART_DMA_TX(channel)  (((volatile struct dma_channel *)&DMA0CON) + 2 + (2 * (channel)))
+#define UART_DMA_RX(channel)  (((volatile struct dma_channel *)&DMA0CON) + 3 + (2 * (channel)))
+#endif // SYS_UART_DMA
+
 enum uart_status {
 	UART_FREE,
 	UART_RESERVED
@@ -71,13 +206,71 @@ struct uart {
 	uint16_t               magic;
 	struct uart_data      *udata;
 	uint8_t                tx_buffer[SYS_UART_TX_BUFFER_SIZE];
-	uint16_t               tx_write_index;
-	uint16_t               tx_read_index;
-	uint16_t               tx_count;
+	volatile uint16_t      tx_write_index;      // Only written by the task
+	volatile uint16_t      tx_read_index;       // Only written by the ISR
+#ifdef SYS_UART_TX_SEGMENTS
+	struct uart_tx_request *tx_head;            // Requests waiting, oldest first
+	struct uart_tx_request *tx_tail;
+	uint8_t                tx_segment;          // Segment of tx_head being transmitted
+	uint16_t               tx_offset;           // Bytes of it already taken
+#endif
+#ifdef SYS_UART_DMA
+	uint16_t               tx_dma_count;        // Bytes in the DMA transfer
+	boolean                tx_dma_segment;      // Transfer is from a segment not tx_buffer
+	uint16_t               rx_dma[2][SYS_UART_DMA_RX_SIZE];
+	uint8_t                rx_dma_buffer;       // Ping-Pong buffer DMA is filling
+	uint16_t               rx_dma_index;        // Words of it already delivered
+	timer_id               rx_idle_timer;
+	uint16_t               rx_idle_mark;        // Words received when the timer started
+#endif
+#ifdef SYS_UART_RX_BLOCK
+	uint8_t                rx_buffer[SYS_UART_RX_BUFFER_SIZE];
+	volatile uint16_t      rx_write_index;      // Only written by the ISR
+	volatile uint16_t      rx_read_index;       // Only written by the task
+	uint16_t               rx_scan_index;       // Task has found no delimiter before this
+	uint16_t               rx_trigger;          // Characters waiting at which the ISR wakes the task
+	int16_t                rx_delimiter;        // udata's rx_delimiter, or -1 for none
+	uint16_t               rx_dropped;          // Characters lost to a full ring
+	boolean                rx_flush;            // Line idle, deliver what's waiting
+	timer_id               rx_timer;
+	uint16_t               rx_timer_mark;       // rx_write_index when the timer started
+#endif
+#ifdef SYS_UART_ADDRESS_DETECT
+	boolean                rx_address_detect;   // 9 bit mode filtering on rx_address
+	boolean                rx_addressed;        // Receiving a frame to rx_address or rx_broadcast
+#endif
+#ifdef SYS_UART_STATS
+	struct uart_stats      stats;
+#endif
 } uart;
 
 struct uart uarts[NUM_UART_CHANNELS];
 
+/*
+ * The tx_buffer and rx_buffer are single producer, single consumer rings with
+ * the task at one end and the ISR at the other. The indices run freely,
+ * wrapping at 65536, and are masked to index the power of two buffer, so
+ * their difference is the number of characters waiting. Each index is only
+ * written by one side, in a single instruction on the 16 bit devices, so
+ * neither side has to disable interrupts. RING_BARRIER() stops the compiler
+ * moving a buffer access past the index write which hands it over.
+ *
+ * The PIC18 writes an index a byte at a time, so there the task blocks
+ * interrupts around its tx_buffer index accesses.
+ */
+#define TX_RING_MASK         (SYS_UART_TX_BUFFER_SIZE - 1)
+#define RX_RING_MASK         (SYS_UART_RX_BUFFER_SIZE - 1)
+
+#if defined(__XC8)
+#define RING_BARRIER()
+#define RING_TASK_LOCK       INTERRUPTS_DISABLED
+#define RING_TASK_UNLOCK     INTERRUPTS_ENABLED
+#else
+#define RING_BARRIER()       __asm__ __volatile__("" ::: "memory")
+#define RING_TASK_LOCK
+#define RING_TASK_UNLOCK
+#endif
+
 /*
  * Local static Function prototypes
  */
@@ -93,13 +286,51 @@ extern result_t uart_set_uart_config(struct uart_data *udata);
 static result_t uart_putchar(enum uart_channel channel, uint8_t ch);
 
 static result_t tx_buffer_write(enum uart_channel channel, char ch);
-static char     tx_buffer_read (enum uart_channel channel);
+static uint8_t  tx_buffer_read (enum uart_channel channel);
+static uint16_t tx_waiting(enum uart_channel channel);
+static uint16_t tx_ring_count(enum uart_channel channel);
+
+#ifdef SYS_UART_TX_SEGMENTS
+static void     tx_segment_next(enum uart_channel channel);
+static void     tx_segments_release(enum uart_channel channel, struct uart_data *udata);
+#endif
 
 /*
  * Returns the number of bytes still waiting to be loaded in HW TX Buffer.
  */
 static uint16_t load_tx_buffer(enum uart_channel channel);
 
+#ifdef SYS_UART_RX_BLOCK
+static int16_t  rx_block_task;
+
+static void     uart_rx_put(enum uart_channel channel, uint8_t ch);
+static void     uart_rx_block_reserve(struct uart_data *udata);
+static void     uart_rx_block_release(enum uart_channel channel);
+static result_t uart_rx_block_task(void);
+#endif
+
+#ifdef SYS_UART_STATS
+static void     uart_rx_stats(enum uart_channel channel, uint8_t ferr, uint8_t perr);
+#ifdef SYS_LOOP_STATS
+static void     uart_isr_time(uint16_t *max, uint16_t start);
+#endif
+#endif
+
+#ifdef SYS_UART_ADDRESS_DETECT
+static boolean  uart_rx_address(enum uart_channel channel, uint16_t word);
+static void     uart_address_detect(enum uart_channel channel, boolean enable);
+static result_t uart_rx_address_reserve(struct uart_data *udata);
+#endif
+
+#ifdef SYS_UART_DMA
+static void     uart_dma_tx_isr(enum uart_channel channel);
+static void     uart_dma_rx_isr(enum uart_channel channel);
+static void     uart_dma_tx_start(enum uart_channel channel);
+static result_t uart_dma_reserve(struct uart_data *udata);
+static void     uart_dma_release(enum uart_channel channel);
+static result_t uart_dma_rx_task(void);
+#endif
+
 /*
  * Interrupt Service Routines
  */
@@ -110,10 +341,13 @@ void _ISR __attribute__((__no_auto_psv__)) _U1TXInterrupt(void)
 #ifdef SYS_TEST_BUILD
 //	gpio_toggle_output(RA0);
 #endif
+	UART_ISR_START
+
 	while(U1_TX_ISR_FLAG) {
 		uart_tx_isr(UART_1);
 		U1_TX_ISR_FLAG = 0;
 	}
+	UART_ISR_END(UART_1, tx_isr_max_cycles)
 }
 #endif // #if defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__) || defined(__dsPIC33EP128GS702__)
 #endif // defined(SYS_UART1)
@@ -122,10 +356,13 @@ void _ISR __attribute__((__no_auto_psv__)) _U1TXInterrupt(void)
 #if (defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__) || defined(__dsPIC33EP128GS702__)) && defined(SYS_UART2) || defined(__dsPIC33EP256GP502__)
 void _ISR __attribute__((__no_auto_psv__)) _U2TXInterrupt(void)
 {
+	UART_ISR_START
+
 	while(U2_TX_ISR_FLAG) {
 		uart_tx_isr(UART_2);
 		U2_TX_ISR_FLAG = 0;
 	}
+	UART_ISR_END(UART_2, tx_isr_max_cycles)
 }
 #endif // #if defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__) || defined(__dsPIC33EP128GS702__)
 #endif // SYS_UART_2
@@ -133,20 +370,26 @@ void _ISR __attribute__((__no_auto_psv__)) _U2TXInterrupt(void)
 #if (defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__)) && defined(SYS_UART3)
 void _ISR __attribute__((__no_auto_psv__)) _U3TXInterrupt(void)
 {
+	UART_ISR_START
+
 	while(U3_TX_ISR_FLAG) {
 		uart_tx_isr(UART_3);
 		U3_TX_ISR_FLAG = 0;
 	}
+	UART_ISR_END(UART_3, tx_isr_max_cycles)
 }
 #endif // #if defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__)
 
 #if (defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__)) && defined(SYS_UART4)
 void _ISR __attribute__((__no_auto_psv__)) _U4TXInterrupt(void)
 {
+	UART_ISR_START
+
 	while(U4_TX_ISR_FLAG) {
 		uart_tx_isr(UART_4);
 		U4_TX_ISR_FLAG = 0;
 	}
+	UART_ISR_END(UART_4, tx_isr_max_cycles)
 }
 #endif // #if defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__)
 
@@ -160,6 +403,16 @@ static void uart_tx_isr(enum uart_channel channel)
 		return;
 	}
 
+#ifdef SYS_UART_DMA
+	/*
+	 * Only enabled to signal the end of a DMA transmission, as the last
+	 * character is shifted out.
+	 */
+	if(uarts[channel].tx_dma_count) {
+		return;
+	}
+#endif
+
 	/*
 	 * If the uC TX buffer is not full load it from the SW tx buffer
 	 */
@@ -317,6 +570,10 @@ static void uart_tx_isr(enum uart_channel channel)
 void _ISR __attribute__((__no_auto_psv__)) _U1RXInterrupt(void)
 {
 	uint8_t ch;
+#ifdef SYS_UART_ADDRESS_DETECT
+	uint16_t word;
+#endif
+	UART_ISR_START
 
 	U1_RX_ISR_FLAG = 0;
 
@@ -325,12 +582,33 @@ void _ISR __attribute__((__no_auto_psv__)) _U1RXInterrupt(void)
 	if (U1STAbits.OERR) {
 		LOG_E("RX Buffer overrun\n\r");
 		U1STAbits.OERR = 0;   /* Clear the error flag */
+#ifdef SYS_UART_STATS
+		uarts[UART_1].stats.rx_overruns++;
+#endif
 	}
 
 	while (U1STAbits.URXDA) {
+#ifdef SYS_UART_STATS
+		uart_rx_stats(UART_1, U1STAbits.FERR, U1STAbits.PERR);
+#endif
+#ifdef SYS_UART_ADDRESS_DETECT
+		word = U1RXREG;
+		if (!uart_rx_address(UART_1, word)) {
+			continue;
+		}
+		ch = (uint8_t)word;
+#else
 		ch = U1RXREG;
+#endif
+#ifdef SYS_UART_RX_BLOCK
+		if (uarts[UART_1].udata->process_rx_block) {
+			uart_rx_put(UART_1, ch);
+			continue;
+		}
+#endif
 		uarts[UART_1].udata->process_rx_char(UART_1, ch);
 	}
+	UART_ISR_END(UART_1, rx_isr_max_cycles)
 }
 #endif // #if defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__) || defined(__dsPIC33EP128GS702__)
 
@@ -339,6 +617,10 @@ void _ISR __attribute__((__no_auto_psv__)) _U1RXInterrupt(void)
 void _ISR __attribute__((__no_auto_psv__)) _U2RXInterrupt(void)
 {
 	uint8_t ch;
+#ifdef SYS_UART_ADDRESS_DETECT
+	uint16_t word;
+#endif
+	UART_ISR_START
 
 	U2_RX_ISR_FLAG = 0;
 
@@ -347,14 +629,35 @@ void _ISR __attribute__((__no_auto_psv__)) _U2RXInterrupt(void)
 	if (U2STAbits.OERR) {
 		LOG_E("RX Buffer overrun\n\r");
 		U2STAbits.OERR = 0;   /* Clear the error flag */
+#ifdef SYS_UART_STATS
+		uarts[UART_2].stats.rx_overruns++;
+#endif
 	}
 
 	while (U2STAbits.URXDA) {
+#ifdef SYS_UART_STATS
+		uart_rx_stats(UART_2, U2STAbits.FERR, U2STAbits.PERR);
+#endif
+#ifdef SYS_UART_ADDRESS_DETECT
+		word = U2RXREG;
+		if (!uart_rx_address(UART_2, word)) {
+			continue;
+		}
+		ch = (uint8_t)word;
+#else
 		ch = U2RXREG;
+#endif
+#ifdef SYS_UART_RX_BLOCK
+		if (uarts[UART_2].udata->process_rx_block) {
+			uart_rx_put(UART_2, ch);
+			continue;
+		}
+#endif
 		if (uarts[UART_2].udata->process_rx_char) {
 			uarts[UART_2].udata->process_rx_char(UART_2, ch);
 		}
 	}
+	UART_ISR_END(UART_2, rx_isr_max_cycles)
 }
 #endif // #if defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__) || defined(__dsPIC33EP128GS702__)
 
@@ -363,6 +666,10 @@ void _ISR __attribute__((__no_auto_psv__)) _U2RXInterrupt(void)
 void _ISR __attribute__((__no_auto_psv__)) _U3RXInterrupt(void)
 {
 	uint8_t ch;
+#ifdef SYS_UART_ADDRESS_DETECT
+	uint16_t word;
+#endif
+	UART_ISR_START
 
 	U3_RX_ISR_FLAG = 0;
 
@@ -372,37 +679,946 @@ void _ISR __attribute__((__no_auto_psv__)) _U3RXInterrupt(void)
 	if (U3STAbits.OERR) {
 		LOG_E("RX Buffer overrun\n\r");
 		U3STAbits.OERR = 0;   /* Clear the error flag */
+#ifdef SYS_UART_STATS
+		uarts[UART_3].stats.rx_overruns++;
+#endif
+	}
+
+	while (U3STAbits.URXDA) {
+#ifdef SYS_UART_STATS
+		uart_rx_stats(UART_3, U3STAbits.FERR, U3STAbits.PERR);
+#endif
+#ifdef SYS_UART_ADDRESS_DETECT
+		word = U3RXREG;
+		if (!uart_rx_address(UART_3, word)) {
+			continue;
+		}
+		ch = (uint8_t)word;
+#else
+		ch = U3RXREG;
+#endif
+#ifdef SYS_UART_RX_BLOCK
+		if (uarts[UART_3].udata->process_rx_block) {
+			uart_rx_put(UART_3, ch);
+			continue;
+		}
+#endif
+		uarts[UART_3].udata->process_rx_char(UART_3, ch);
+	}
+	UART_ISR_END(UART_3, rx_isr_max_cycles)
+}
+#endif // #if defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__)
+
+//#if (defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__)) &&
+#if defined(SYS_UART4)
+void _ISR __attribute__((__no_auto_psv__)) _U4RXInterrupt(void)
+{
+	uint8_t ch;
+#ifdef SYS_UART_ADDRESS_DETECT
+	uint16_t word;
+#endif
+	UART_ISR_START
+
+	U4_RX_ISR_FLAG = 0;
+
+	asm ("CLRWDT");
+
+        LOG_D("U4RX\n\r");
+	if (U4STAbits.OERR) {
+		LOG_E("RX Buffer overrun\n\r");
+		U4STAbits.OERR = 0;   /* Clear the error flag */
+#ifdef SYS_UART_STATS
+		uarts[UART_4].stats.rx_overruns++;
+#endif
+	}
+
+	while (U4STAbits.URXDA) {
+#ifdef SYS_UART_STATS
+		uart_rx_stats(UART_4, U4STAbits.FERR, U4STAbits.PERR);
+#endif
+#ifdef SYS_UART_ADDRESS_DETECT
+		word = U4RXREG;
+		if (!uart_rx_address(UART_4, word)) {
+			continue;
+		}
+		ch = (uint8_t)word;
+#else
+		ch = U4RXREG;
+#endif
+#ifdef SYS_UART_RX_BLOCK
+		if (uarts[UART_4].udata->process_rx_block) {
+			uart_rx_put(UART_4, ch);
+			continue;
+		}
+#endif
+		uarts[UART_4].udata->process_rx_char(UART_4, ch);
+	}
+	UART_ISR_END(UART_4, rx_isr_max_cycles)
+}
+#endif // #if defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__)
+
+#ifdef SYS_UART_STATS
+/*
+ * Called before each character is read, UxSTA's FERR and PERR are those of
+ * the character at the top of the receive FIFO.
+ */
+static void uart_rx_stats(enum uart_channel channel, uint8_t ferr, uint8_t perr)
+{
+	struct uart_stats *stats = &uarts[channel].stats;
+
+	stats->rx_bytes++;
+	if(ferr) stats->rx_framing_errors++;
+	if(perr) stats->rx_parity_errors++;
+}
+
+#ifdef SYS_LOOP_STATS
+static void uart_isr_time(uint16_t *max, uint16_t start)
+{
+	uint16_t cycles = (uint16_t)loop_stats_clock() - start;
+
+	if(cycles > *max) {
+		*max = cycles;
+	}
+}
+#endif // SYS_LOOP_STATS
+#endif // SYS_UART_STATS
+
+#ifdef SYS_UART_ADDRESS_DETECT
+/*
+ * An address character decides whether the characters following it, up to
+ * the next address character, are received. Address detect is turned off
+ * for our frames and back on for anyone else's, so the ISR doesn't run for
+ * their characters. Any of theirs already in the receive FIFO are dropped.
+ */
+static boolean uart_rx_address(enum uart_channel channel, uint16_t word)
+{
+	struct uart *uart = &uarts[channel];
+	uint8_t      address;
+
+	if(!uart->rx_address_detect) {
+		return(TRUE);
+	}
+	if(!(word & 0x100)) {
+		return(uart->rx_addressed);
+	}
+
+	address = (uint8_t)(word & 0xff);
+	uart->rx_addressed =  (address == uart->udata->rx_address)
+	                    ||(uart->udata->rx_broadcast_enable && (address == uart->udata->rx_broadcast));
+	uart_address_detect(channel, !uart->rx_addressed);
+
+	return(uart->rx_addressed);
+}
+
+static void uart_address_detect(enum uart_channel channel, boolean enable)
+{
+	switch(channel) {
+#if defined(SYS_UART1)
+	case UART_1:
+		U1STAbits.ADDEN = enable;
+		break;
+#endif
+#if defined(SYS_UART2)
+	case UART_2:
+		U2STAbits.ADDEN = enable;
+		break;
+#endif
+#if defined(SYS_UART3)
+	case UART_3:
+		U3STAbits.ADDEN = enable;
+		break;
+#endif
+#if defined(SYS_UART4)
+	case UART_4:
+		U4STAbits.ADDEN = enable;
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+/*
+ * Only a 9 bit UART with rx_address_enable set filters, it waits for an address
+ * character from the start.
+ */
+static result_t uart_rx_address_reserve(struct uart_data *udata)
+{
+	struct uart *uart = &uarts[udata->channel];
+
+	uart->rx_addressed      = FALSE;
+	uart->rx_address_detect =  ((udata->uart_mode & (PDSEL1_MASK | PDSEL0_MASK)) == (PDSEL1_MASK | PDSEL0_MASK))
+	                         && udata->rx_address_enable;
+
+	if(uart->rx_address_detect && (udata->rx_pin == INVALID_GPIO_PIN)) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+	uart_address_detect(udata->channel, uart->rx_address_detect);
+
+	return(SUCCESS);
+}
+#endif // SYS_UART_ADDRESS_DETECT
+
+#ifdef SYS_UART_RX_BLOCK
+/*
+ * Receive ring of a UART with a process_rx_block() callback. The receive
+ * ISR, or DMA ISR, adds characters and wakes the task when a block is due,
+ * the task delivers them and frees the space.
+ */
+static void uart_rx_put(enum uart_channel channel, uint8_t ch)
+{
+	struct uart *uart  = &uarts[channel];
+	uint16_t     write = uart->rx_write_index;
+	uint16_t     count = write - uart->rx_read_index;
+
+	if(count == SYS_UART_RX_BUFFER_SIZE) {
+		uart->rx_dropped++;
+		return;
+	}
+
+	uart->rx_buffer[write & RX_RING_MASK] = ch;
+	RING_BARRIER();
+	uart->rx_write_index = write + 1;
+	count++;
+#ifdef SYS_UART_STATS
+	if(count > uart->stats.rx_high_water) {
+		uart->stats.rx_high_water = count;
+	}
+#endif
+
+	if(((int16_t)ch == uart->rx_delimiter) || (count >= uart->rx_trigger)) {
+		libesoup_task_pending(rx_block_task);
+	} else if((count == 1) && uart->udata->rx_timeout) {
+		/*
+		 * Start of a block, the task starts the receive timeout
+		 */
+		libesoup_task_pending(rx_block_task);
+	}
+}
+
+/*
+ * Characters from the read index up to and including the first delimiter
+ * before write, or zero if there isn't one. Characters already searched
+ * aren't searched again.
+ */
+static uint16_t uart_rx_delimited(enum uart_channel channel, uint16_t write)
+{
+	struct uart *uart = &uarts[channel];
+
+	while(uart->rx_scan_index != write) {
+		if((int16_t)uart->rx_buffer[uart->rx_scan_index++ & RX_RING_MASK] == uart->rx_delimiter) {
+			return(uart->rx_scan_index - uart->rx_read_index);
+		}
+	}
+	return(0);
+}
+
+/*
+ * Hand len characters from the ring's read index to process_rx_block(), in
+ * two spans if they wrap the end of the ring. The space is only handed back
+ * to the ISR once the callback has returned.
+ */
+static void uart_rx_deliver(enum uart_channel channel, uint16_t len)
+{
+	struct uart *uart = &uarts[channel];
+	uint16_t     read;
+	uint16_t     span;
+
+	while(len && (uart->status == UART_RESERVED)) {
+		read = uart->rx_read_index;
+		span = SYS_UART_RX_BUFFER_SIZE - (read & RX_RING_MASK);
+		if(span > len) {
+			span = len;
+		}
+
+		uart->udata->process_rx_block(channel, &uart->rx_buffer[read & RX_RING_MASK], span);
+
+		RING_BARRIER();
+		uart->rx_read_index = read + span;
+		len -= span;
+	}
+}
+
+static void exp_rx_timeout(timer_id timer __attribute__((unused)), union sigval data)
+{
+	enum uart_channel channel = (enum uart_channel)data.sival_int;
+
+	uarts[channel].rx_timer = BAD_TIMER_ID;
+
+	if(uarts[channel].status != UART_RESERVED) {
+		return;
+	}
+
+	/*
+	 * Nothing more received, the line is idle. Otherwise the task
+	 * restarts the timer.
+	 */
+	if(uarts[channel].rx_write_index == uarts[channel].rx_timer_mark) {
+		uarts[channel].rx_flush = TRUE;
+	}
+	libesoup_task_pending(rx_block_task);
+}
+
+static result_t uart_rx_block_task(void)
+{
+	enum uart_channel channel;
+	struct uart      *uart;
+	struct timer_req  request;
+	uint16_t          write;
+	uint16_t          len;
+	boolean           flush;
+	result_t          rc;
+
+	for(channel = 0; channel < NUM_UART_CHANNELS; channel++) {
+		uart = &uarts[channel];
+
+		if((uart->status != UART_RESERVED) || (uart->udata->process_rx_block == NULL)) {
+			continue;
+		}
+
+		/*
+		 * Anything the ISR adds from here on wakes the task again
+		 */
+		write = uart->rx_write_index;
+
+		if(uart->rx_delimiter >= 0) {
+			while(  (uart->status == UART_RESERVED)
+			      &&((len = uart_rx_delimited(channel, write)) != 0)) {
+				uart_rx_deliver(channel, len);
+			}
+		}
+
+		if(uart->status != UART_RESERVED) {
+			continue;
+		}
+
+		/*
+		 * A flush is used up even with nothing waiting, left set it
+		 * would deliver the next character without waiting.
+		 */
+		flush = uart->rx_flush;
+		uart->rx_flush = FALSE;
+
+		len = write - uart->rx_read_index;
+		if(len && (flush || (len >= uart->rx_trigger))) {
+			uart_rx_deliver(channel, len);
+			uart->rx_scan_index = write;
+		}
+
+		if(  (uart->status != UART_RESERVED)
+		   ||(uart->rx_write_index == uart->rx_read_index)
+		   ||(uart->udata->rx_timeout == 0)
+		   ||(uart->rx_timer != BAD_TIMER_ID)) {
+			continue;
+		}
+
+		uart->rx_timer_mark = uart->rx_write_index;
+
+		request.period.units    = mSeconds;
+		request.period.duration = uart->udata->rx_timeout;
+		request.type            = single_shot_expiry;
+		request.exp_fn          = exp_rx_timeout;
+		request.data.sival_int  = channel;
+
+		rc = sw_timer_start(&request);
+		if(rc >= 0) {
+			uart->rx_timer = rc;
+		}
+	}
+	return(0);
+}
+
+static void uart_rx_block_reserve(struct uart_data *udata)
+{
+	struct uart *uart = &uarts[udata->channel];
+
+	uart->rx_write_index = 0;
+	uart->rx_read_index  = 0;
+	uart->rx_scan_index  = 0;
+	uart->rx_dropped     = 0;
+	uart->rx_flush       = FALSE;
+	uart->rx_timer       = BAD_TIMER_ID;
+	uart->rx_delimiter   = udata->rx_delimiter_enable ? (int16_t)udata->rx_delimiter : -1;
+
+	/*
+	 * Without a threshold the ISR only wakes the task for a full ring, a
+	 * delimiter or the timeout, unless none are set.
+	 */
+	if(udata->rx_threshold) {
+		uart->rx_trigger = udata->rx_threshold;
+	} else if(!udata->rx_delimiter_enable && (udata->rx_timeout == 0)) {
+		uart->rx_trigger = 1;
+	} else {
+		uart->rx_trigger = SYS_UART_RX_BUFFER_SIZE;
+	}
+	if(uart->rx_trigger > SYS_UART_RX_BUFFER_SIZE) {
+		uart->rx_trigger = SYS_UART_RX_BUFFER_SIZE;
+	}
+}
+
+static void uart_rx_block_release(enum uart_channel channel)
+{
+	if(uarts[channel].rx_timer != BAD_TIMER_ID) {
+		sw_timer_cancel(&uarts[channel].rx_timer);
+	}
+	uarts[channel].rx_read_index = uarts[channel].rx_write_index;
+	uarts[channel].rx_scan_index = uarts[channel].rx_write_index;
+}
+#endif // SYS_UART_RX_BLOCK
+
+#ifdef SYS_UART_DMA
+/*
+ * DMA Interrupt Service Routines, UART channel 0 uses DMA Channels 2 & 3,
+ * channel 1 4 & 5 and channel 2 6 & 7, one pair for each position used.
+ */
+void _ISR __attribute__((__no_auto_psv__)) _DMA2Interrupt(void)
+{
+	UART_ISR_START
+
+	DMA2_ISR_FLAG = 0;
+	uart_dma_tx_isr(0);
+	UART_ISR_END(0, tx_isr_max_cycles)
+}
+
+void _ISR __attribute__((__no_auto_psv__)) _DMA3Interrupt(void)
+{
+	UART_ISR_START
+
+	DMA3_ISR_FLAG = 0;
+	uart_dma_rx_isr(0);
+	UART_ISR_END(0, rx_isr_max_cycles)
+}
+
+#if UART_DMA_PAIRS > 1
+void _ISR __attribute__((__no_auto_psv__)) _DMA4Interrupt(void)
+{
+	UART_ISR_START
+
+	DMA4_ISR_FLAG = 0;
+	uart_dma_tx_isr(1);
+	UART_ISR_END(1, tx_isr_max_cycles)
+}
+
+void _ISR __attribute__((__no_auto_psv__)) _DMA5Interrupt(void)
+{
+	UART_ISR_START
+
+	DMA5_ISR_FLAG = 0;
+	uart_dma_rx_isr(1);
+	UART_ISR_END(1, rx_isr_max_cycles)
+}
+#endif
+
+#if UART_DMA_PAIRS > 2
+void _ISR __attribute__((__no_auto_psv__)) _DMA6Interrupt(void)
+{
+	UART_ISR_START
+
+	DMA6_ISR_FLAG = 0;
+	uart_dma_tx_isr(2);
+	UART_ISR_END(2, tx_isr_max_cycles)
+}
+
+void _ISR __attribute__((__no_auto_psv__)) _DMA7Interrupt(void)
+{
+	UART_ISR_START
+
+	DMA7_ISR_FLAG = 0;
+	uart_dma_rx_isr(2);
+	UART_ISR_END(2, rx_isr_max_cycles)
+}
+#endif
+
+static volatile uint16_t *uart_sta(enum uart_channel channel)
+{
+	switch(channel) {
+#if defined(SYS_UART1)
+	case UART_1:
+		return(&U1STA);
+#endif
+#if defined(SYS_UART2)
+	case UART_2:
+		return(&U2STA);
+#endif
+#if defined(SYS_UART3)
+	case UART_3:
+		return(&U3STA);
+#endif
+#if defined(SYS_UART4)
+	case UART_4:
+		return(&U4STA);
+#endif
+	default:
+		return(NULL);
+	}
+}
+
+/*
+ * The UART's own transmit interrupt is only enabled once the last DMA
+ * transfer is made, to call tx_finished() when it's been shifted out.
+ */
+static void uart_tx_isr_enable(enum uart_channel channel, uint8_t enable)
+{
+	switch(channel) {
+#if defined(SYS_UART1)
+	case UART_1:
+		U1_TX_ISR_FLAG   = 0;
+		U1_TX_ISR_ENABLE = enable;
+		break;
+#endif
+#if defined(SYS_UART2)
+	case UART_2:
+		U2_TX_ISR_FLAG   = 0;
+		U2_TX_ISR_ENABLE = enable;
+		break;
+#endif
+#if defined(SYS_UART3)
+	case UART_3:
+		U3_TX_ISR_FLAG   = 0;
+		U3_TX_ISR_ENABLE = enable;
+		break;
+#endif
+#if defined(SYS_UART4)
+	case UART_4:
+		U4_TX_ISR_FLAG   = 0;
+		U4_TX_ISR_ENABLE = enable;
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+static void uart_dma_isr_enable(enum uart_channel channel, uint8_t enable)
+{
+	switch(channel) {
+	case 0:
+		DMA2_ISR_FLAG   = 0;
+		DMA2_ISR_ENABLE = enable;
+		DMA3_ISR_FLAG   = 0;
+		DMA3_ISR_ENABLE = enable;
+		break;
+#if UART_DMA_PAIRS > 1
+	case 1:
+		DMA4_ISR_FLAG   = 0;
+		DMA4_ISR_ENABLE = enable;
+		DMA5_ISR_FLAG   = 0;
+		DMA5_ISR_ENABLE = enable;
+		break;
+#endif
+#if UART_DMA_PAIRS > 2
+	case 2:
+		DMA6_ISR_FLAG   = 0;
+		DMA6_ISR_ENABLE = enable;
+		DMA7_ISR_FLAG   = 0;
+		DMA7_ISR_ENABLE = enable;
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+/*
+ * Raise the receive DMA Channel's interrupt, so its ISR delivers a block
+ * which hasn't filled a buffer.
+ */
+static void uart_dma_rx_flag(enum uart_channel channel)
+{
+	switch(channel) {
+	case 0:
+		DMA3_ISR_FLAG = 1;
+		break;
+#if UART_DMA_PAIRS > 1
+	case 1:
+		DMA5_ISR_FLAG = 1;
+		break;
+#endif
+#if UART_DMA_PAIRS > 2
+	case 2:
+		DMA7_ISR_FLAG = 1;
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+/*
+ * Transmit the contiguous span of the SW tx buffer from its read index in a
+ * single One-Shot DMA transfer, the UART requesting each byte as the last
+ * moves on in to its Transmit Shift Register. Called with the UART's
+ * interrupts blocked, or from its DMA ISR.
+ */
+static void uart_dma_tx_start(enum uart_channel channel)
+{
+	struct uart                 *uart = &uarts[channel];
+	volatile struct dma_channel *dma  = UART_DMA_TX(channel);
+	volatile uint16_t           *sta;
+	uint32_t                     address;
+	uint16_t                     span;
+	uint16_t                     read;
+#ifdef SYS_UART_TX_SEGMENTS
+	struct uart_tx_request      *request = uart->tx_head;
+	const struct uart_tx_segment *segment;
+#endif
+
+	if(uart->tx_dma_count || (tx_waiting(channel) == 0)) {
+		return;
+	}
+	read = uart->tx_read_index;
+
+#ifdef SYS_UART_TX_SEGMENTS
+	/*
+	 * The head request's current segment straight from the caller's
+	 * buffer, or the tx_buffer bytes queued before it
+	 */
+	if(request && (request->mark == read)) {
+		segment = &request->segments[uart->tx_segment];
+		span    = segment->len - uart->tx_offset;
+		address = (uint32_t)(uintptr_t)&segment->ptr[uart->tx_offset];
+		uart->tx_dma_segment = TRUE;
+	} else {
+		span = SYS_UART_TX_BUFFER_SIZE - (read & TX_RING_MASK);
+		if(span > (uint16_t)(uart->tx_write_index - read)) {
+			span = uart->tx_write_index - read;
+		}
+		if(request && (span > (uint16_t)(request->mark - read))) {
+			span = request->mark - read;
+		}
+		address = (uint32_t)(uintptr_t)&uart->tx_buffer[read & TX_RING_MASK];
+		uart->tx_dma_segment = FALSE;
+	}
+#else
+	span = SYS_UART_TX_BUFFER_SIZE - (read & TX_RING_MASK);
+	if(span > (uint16_t)(uart->tx_write_index - read)) {
+		span = uart->tx_write_index - read;
+	}
+	address = (uint32_t)(uintptr_t)&uart->tx_buffer[read & TX_RING_MASK];
+#endif
+	uart->tx_dma_count = span;
+
+	uart_tx_isr_enable(channel, DISABLED);
+	sta = uart_sta(channel);
+	*sta &= ~(UTXISEL1_MASK | UTXISEL0_MASK);
+
+	dma->stal = (uint16_t)(address & 0xffff);
+	dma->stah = (uint16_t)((address >> 16) & 0xff);
+	dma->cnt  = span - 1;
+	dma->con  = DMA_CHEN_MASK | DMA_SIZE_BYTE_MASK | DMA_DIR_TO_PERIPH_MASK | DMA_MODE_ONE_SHOT;
+
+	/*
+	 * Nothing is being transmitted so the UART won't request the first
+	 */
+	dma->req |= DMA_FORCE_MASK;
+}
+
+static void uart_dma_tx_isr(enum uart_channel channel)
+{
+	struct uart       *uart;
+	volatile uint16_t *sta;
+
+	if((channel >= NUM_UART_CHANNELS) || (uarts[channel].status != UART_RESERVED) || (uarts[channel].udata == NULL)) {
+		return;
+	}
+	uart = &uarts[channel];
+
+#ifdef SYS_UART_STATS
+	uart->stats.tx_bytes += uart->tx_dma_count;
+#endif
+#ifdef SYS_UART_TX_SEGMENTS
+	if(uart->tx_dma_segment) {
+		uart->tx_offset += uart->tx_dma_count;
+		uart->tx_dma_count = 0;
+	}
+#endif
+
+	/*
+	 * The span of the tx_buffer has gone, hand the space back to the task
+	 */
+	if(uart->tx_dma_count) {
+		uart->tx_read_index += uart->tx_dma_count;
+		uart->tx_dma_count = 0;
+	}
+#ifdef SYS_UART_TX_SEGMENTS
+	tx_segment_next(channel);
+#endif
+
+	if(tx_waiting(channel)) {
+		uart_dma_tx_start(channel);
+		return;
+	}
+
+	/*
+	 * Interrupt when the last character is shifted out of the Transmit
+	 * Shift Register, uart_tx_isr() then calls tx_finished()
+	 */
+	sta = uart_sta(channel);
+	*sta = (*sta & ~UTXISEL1_MASK) | UTXISEL0_MASK;
+	uart_tx_isr_enable(channel, ENABLED);
+}
+
+/*
+ * Words DMA has written in to the buffer it's filling, a binary search for
+ * the first still holding UART_DMA_EMPTY.
+ */
+static uint16_t uart_dma_rx_level(enum uart_channel channel)
+{
+	uint16_t *buffer = uarts[channel].rx_dma[uarts[channel].rx_dma_buffer];
+	uint16_t  low    = uarts[channel].rx_dma_index;
+	uint16_t  high   = SYS_UART_DMA_RX_SIZE;
+	uint16_t  mid;
+
+	while(low < high) {
+		mid = (low + high) >> 1;
+		if(buffer[mid] == UART_DMA_EMPTY) {
+			high = mid;
+		} else {
+			low = mid + 1;
+		}
+	}
+	return(low);
+}
+
+/*
+ * Called as DMA fills a Ping-Pong buffer, or forced when the line has gone
+ * idle. Passes on everything received since last time, finishing a filled
+ * buffer, and making it ready for reuse, before moving on to the other.
+ */
+static void uart_dma_rx_isr(enum uart_channel channel)
+{
+	struct uart       *uart;
+	struct uart_data  *udata;
+	volatile uint16_t *sta;
+	uint16_t          *buffer;
+	uint16_t           index;
+
+	if((channel >= NUM_UART_CHANNELS) || (uarts[channel].status != UART_RESERVED) || (uarts[channel].udata == NULL)) {
+		return;
+	}
+	uart  = &uarts[channel];
+	udata = uart->udata;
+
+	sta = uart_sta(channel);
+	if(*sta & OERR_MASK) {
+		LOG_E("RX Buffer overrun\n\r");
+		*sta &= ~OERR_MASK;
+#ifdef SYS_UART_STATS
+		uart->stats.rx_overruns++;
+#endif
+	}
+
+	while(1) {
+		buffer = uart->rx_dma[uart->rx_dma_buffer];
+		index  = uart->rx_dma_index;
+
+		while((index < SYS_UART_DMA_RX_SIZE) && (buffer[index] != UART_DMA_EMPTY)) {
+#ifdef SYS_UART_STATS
+			uart->stats.rx_bytes++;
+#endif
+			if(udata->process_rx_block) {
+				uart_rx_put(channel, (uint8_t)buffer[index]);
+			} else if(udata->process_rx_char) {
+				udata->process_rx_char(channel, (uint8_t)buffer[index]);
+			}
+			index++;
+		}
+		uart->rx_dma_index = index;
+
+		if(index < SYS_UART_DMA_RX_SIZE) {
+			break;
+		}
+
+		/*
+		 * DMA has moved on to the other buffer
+		 */
+		for(index = 0; index < SYS_UART_DMA_RX_SIZE; index++) {
+			buffer[index] = UART_DMA_EMPTY;
+		}
+		uart->rx_dma_index = 0;
+		uart->rx_dma_buffer ^= 1;
+	}
+}
+
+static void exp_rx_idle(timer_id timer __attribute__((unused)), union sigval data)
+{
+	enum uart_channel channel = (enum uart_channel)data.sival_int;
+
+	uarts[channel].rx_idle_timer = BAD_TIMER_ID;
+
+	if(uarts[channel].status != UART_RESERVED) {
+		return;
+	}
+
+	/*
+	 * Nothing more received, the line is idle
+	 */
+	if(uart_dma_rx_level(channel) == uarts[channel].rx_idle_mark) {
+		uart_dma_rx_flag(channel);
+	}
+}
+
+/*
+ * Idle line detection. Once characters are waiting in a receive buffer a
+ * timer checks if more have arrived SYS_UART_DMA_RX_IDLE mS later and, if
+ * not, has the DMA ISR deliver them. If they have the timer's restarted.
+ */
+static result_t uart_dma_rx_task(void)
+{
+	enum uart_channel channel;
+	struct uart      *uart;
+	struct timer_req  request;
+	result_t          rc;
+
+	for(channel = 0; channel < NUM_UART_CHANNELS; channel++) {
+		uart = &uarts[channel];
+
+		if(  (uart->status != UART_RESERVED)
+		   ||(uart->udata->rx_pin == INVALID_GPIO_PIN)
+		   ||(uart->rx_idle_timer != BAD_TIMER_ID)
+		   ||(uart->rx_dma_index >= SYS_UART_DMA_RX_SIZE)
+		   ||(uart->rx_dma[uart->rx_dma_buffer][uart->rx_dma_index] == UART_DMA_EMPTY)) {
+			continue;
+		}
+
+		uart->rx_idle_mark = uart_dma_rx_level(channel);
+
+		request.period.units    = mSeconds;
+		request.period.duration = SYS_UART_DMA_RX_IDLE;
+		request.type            = single_shot_expiry;
+		request.exp_fn          = exp_rx_idle;
+		request.data.sival_int  = channel;
+
+		rc = sw_timer_start(&request);
+		if(rc >= 0) {
+			uart->rx_idle_timer = rc;
+		}
+	}
+	return(0);
+}
+
+/*
+ * Called once the UART is configured, hands its receiver and transmitter
+ * over to the DMA Channels.
+ */
+static result_t uart_dma_reserve(struct uart_data *udata)
+{
+	enum uart_channel            channel = udata->channel;
+	struct uart                 *uart = &uarts[channel];
+	volatile struct dma_channel *dma;
+	uint32_t                     address;
+	uint16_t                     tx_request;
+	uint16_t                     rx_request;
+	uint16_t                     tx_pad;
+	uint16_t                     rx_pad;
+	uint16_t                     index;
+
+	/*
+	 * Only a channel with a DMA pair, and its ISRs
+	 */
+	if(channel >= UART_DMA_PAIRS) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	switch(channel) {
+#if defined(SYS_UART1)
+	case UART_1:
+		tx_request = U1_TX_DMA_REQUEST;
+		rx_request = U1_RX_DMA_REQUEST;
+		tx_pad     = (uint16_t)(uintptr_t)&U1TXREG;
+		rx_pad     = (uint16_t)(uintptr_t)&U1RXREG;
+		U1_RX_ISR_ENABLE = DISABLED;
+		break;
+#endif
+#if defined(SYS_UART2)
+	case UART_2:
+		tx_request = U2_TX_DMA_REQUEST;
+		rx_request = U2_RX_DMA_REQUEST;
+		tx_pad     = (uint16_t)(uintptr_t)&U2TXREG;
+		rx_pad     = (uint16_t)(uintptr_t)&U2RXREG;
+		U2_RX_ISR_ENABLE = DISABLED;
+		break;
+#endif
+#if defined(SYS_UART3)
+	case UART_3:
+		tx_request = U3_TX_DMA_REQUEST;
+		rx_request = U3_RX_DMA_REQUEST;
+		tx_pad     = (uint16_t)(uintptr_t)&U3TXREG;
+		rx_pad     = (uint16_t)(uintptr_t)&U3RXREG;
+		U3_RX_ISR_ENABLE = DISABLED;
+		break;
+#endif
+#if defined(SYS_UART4)
+	case UART_4:
+		tx_request = U4_TX_DMA_REQUEST;
+		rx_request = U4_RX_DMA_REQUEST;
+		tx_pad     = (uint16_t)(uintptr_t)&U4TXREG;
+		rx_pad     = (uint16_t)(uintptr_t)&U4RXREG;
+		U4_RX_ISR_ENABLE = DISABLED;
+		break;
+#endif
+	default:
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	uart->tx_dma_count   = 0;
+	uart->tx_dma_segment = FALSE;
+	uart->rx_idle_timer  = BAD_TIMER_ID;
+	uart_tx_isr_enable(channel, DISABLED);
+
+	dma = UART_DMA_TX(channel);
+	dma->con = 0x0000;
+	dma->req = tx_request;
+	dma->pad = tx_pad;
+
+	dma = UART_DMA_RX(channel);
+	dma->con = 0x0000;
+	if(udata->rx_pin != INVALID_GPIO_PIN) {
+		for(index = 0; index < SYS_UART_DMA_RX_SIZE; index++) {
+			uart->rx_dma[0][index] = UART_DMA_EMPTY;
+			uart->rx_dma[1][index] = UART_DMA_EMPTY;
+		}
+		uart->rx_dma_buffer = 0;
+		uart->rx_dma_index  = 0;
+
+		/*
+		 * Request a transfer for every character received
+		 */
+		*uart_sta(channel) &= ~URXISEL_MASK;
+
+		dma->req  = rx_request;
+		dma->pad  = rx_pad;
+		address   = (uint32_t)(uintptr_t)uart->rx_dma[0];
+		dma->stal = (uint16_t)(address & 0xffff);
+		dma->stah = (uint16_t)((address >> 16) & 0xff);
+		address   = (uint32_t)(uintptr_t)uart->rx_dma[1];
+		dma->stbl = (uint16_t)(address & 0xffff);
+		dma->stbh = (uint16_t)((address >> 16) & 0xff);
+		dma->cnt  = SYS_UART_DMA_RX_SIZE - 1;
+
+		/*
+		 * Word transfers, Peripheral to RAM, Continuous Ping-Pong mode
+		 */
+		dma->con  = DMA_CHEN_MASK | DMA_MODE_PING_PONG;
 	}
 
-	while (U3STAbits.URXDA) {
-		ch = U3RXREG;
-		uarts[UART_3].udata->process_rx_char(UART_3, ch);
-	}
+	uart_dma_isr_enable(channel, ENABLED);
+
+	return(SUCCESS);
 }
-#endif // #if defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__)
 
-//#if (defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__)) &&
-#if defined(SYS_UART4)
-void _ISR __attribute__((__no_auto_psv__)) _U4RXInterrupt(void)
+static void uart_dma_release(enum uart_channel channel)
 {
-	uint8_t ch;
-
-	U4_RX_ISR_FLAG = 0;
-
-	asm ("CLRWDT");
+	UART_DMA_TX(channel)->con = 0x0000;
+	UART_DMA_RX(channel)->con = 0x0000;
+	uart_dma_isr_enable(channel, DISABLED);
 
-        LOG_D("U4RX\n\r");
-	if (U4STAbits.OERR) {
-		LOG_E("RX Buffer overrun\n\r");
-		U4STAbits.OERR = 0;   /* Clear the error flag */
-	}
-
-	while (U4STAbits.URXDA) {
-		ch = U4RXREG;
-		uarts[UART_4].udata->process_rx_char(UART_4, ch);
+	uarts[channel].tx_dma_count = 0;
+	if(uarts[channel].rx_idle_timer != BAD_TIMER_ID) {
+		sw_timer_cancel(&uarts[channel].rx_idle_timer);
 	}
 }
-#endif // #if defined(__dsPIC33EP256MU806__) || defined (__PIC24FJ256GB106__)
+#endif // SYS_UART_DMA
 
 result_t uart_calculate_mode(uint16_t *mode, uint8_t databits, uint8_t parity, uint8_t stopbits, uint8_t rx_idle_level)
 {
@@ -485,9 +1701,25 @@ result_t uart_init(void)
 	for(channel = 0; channel < NUM_UART_CHANNELS; channel++) {
 		uarts[channel].status = UART_FREE;
 		uarts[channel].udata  = NULL;
+#ifdef SYS_UART_DMA
+		uarts[channel].rx_idle_timer = BAD_TIMER_ID;
+#endif
+#ifdef SYS_UART_RX_BLOCK
+		uarts[channel].rx_timer = BAD_TIMER_ID;
+#endif
 	}
 
+#ifdef SYS_UART_RX_BLOCK
+	rx_block_task = libesoup_task_register(uart_rx_block_task, FALSE);
+	if(rx_block_task < 0) {
+		return(rx_block_task);
+	}
+#endif
+#ifdef SYS_UART_DMA
+	return(libesoup_task_register(uart_dma_rx_task, TRUE));
+#else
         return(0);
+#endif
 }
 
 #ifdef SYS_TEST_BUILD
@@ -506,10 +1738,75 @@ result_t uart_tx_buffer_count(struct uart_data *udata)
  	if(uarts[channel].udata != udata)
  		return(-ERR_BAD_INPUT_PARAMETER);
 
-	return(uarts[channel].tx_count);
+	return(tx_ring_count(channel));
 }
 #endif // SYS_TEST_BUILD
 
+result_t uart_tx_buffer_space(struct uart_data *udata)
+{
+	enum uart_channel channel;
+
+	channel = udata->channel;
+
+ 	if(  (channel >= NUM_UART_CHANNELS)
+	   ||(uarts[channel].status != UART_RESERVED)
+	   ||(uarts[channel].udata != udata)) {
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	return(SYS_UART_TX_BUFFER_SIZE - tx_ring_count(channel));
+}
+
+#ifdef SYS_UART_STATS
+result_t uart_get_stats(struct uart_data *udata, struct uart_stats *stats)
+{
+	enum uart_channel channel;
+
+	channel = udata->channel;
+
+ 	if(  (channel >= NUM_UART_CHANNELS)
+	   ||(uarts[channel].status != UART_RESERVED)
+	   ||(uarts[channel].udata != udata)
+	   ||(stats == NULL)) {
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	/*
+	 * The ISRs update the counters, copied whole
+	 */
+	INTERRUPTS_DISABLED
+	*stats = uarts[channel].stats;
+#ifdef SYS_UART_RX_BLOCK
+	stats->rx_dropped = uarts[channel].rx_dropped;
+#endif
+	INTERRUPTS_ENABLED
+
+	return(SUCCESS);
+}
+
+result_t uart_reset_stats(struct uart_data *udata)
+{
+	enum uart_channel channel;
+
+	channel = udata->channel;
+
+ 	if(  (channel >= NUM_UART_CHANNELS)
+	   ||(uarts[channel].status != UART_RESERVED)
+	   ||(uarts[channel].udata != udata)) {
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	INTERRUPTS_DISABLED
+	memset(&uarts[channel].stats, 0x00, sizeof(struct uart_stats));
+#ifdef SYS_UART_RX_BLOCK
+	uarts[channel].rx_dropped = 0;
+#endif
+	INTERRUPTS_ENABLED
+
+	return(SUCCESS);
+}
+#endif // SYS_UART_STATS
+
 /*
  * uart_reserve - Reserve a UART Channel for future use by the caller.
  */
@@ -528,7 +1825,15 @@ result_t uart_reserve(struct uart_data *udata)
 
  			uarts[channel].tx_write_index = 0;               // Reset the counters
 			uarts[channel].tx_read_index  = 0;
-			uarts[channel].tx_count       = 0;
+#ifdef SYS_UART_TX_SEGMENTS
+			uarts[channel].tx_head        = NULL;
+			uarts[channel].tx_tail        = NULL;
+			uarts[channel].tx_segment     = 0;
+			uarts[channel].tx_offset      = 0;
+#endif
+#ifdef SYS_UART_STATS
+			memset(&uarts[channel].stats, 0x00, sizeof(struct uart_stats));
+#endif
 
  			udata->channel = channel;                         // Store the uart channel being used, for future reference.
 
@@ -551,10 +1856,22 @@ result_t uart_reserve(struct uart_data *udata)
 				RC_CHECK
 			}
 
+#ifdef SYS_UART_RX_BLOCK
+			uart_rx_block_reserve(udata);
+#endif
+#ifdef SYS_UART_ADDRESS_DETECT
+			rc = uart_rx_address_reserve(udata);
+			RC_CHECK
+#endif
+
 			rc = uart_set_uart_config(udata);
                         if (rc < 0) {
 				return(rc);
 			}
+#ifdef SYS_UART_DMA
+			rc = uart_dma_reserve(udata);
+			RC_CHECK
+#endif
 
 			return(channel);
 		}
@@ -579,6 +1896,13 @@ result_t uart_release(struct uart_data *udata)
 	uarts[channel].udata      = NULL;
 	uarts[channel].status     = UART_FREE;
 
+#ifdef SYS_UART_DMA
+	uart_dma_release(channel);
+#endif
+#ifdef SYS_UART_RX_BLOCK
+	uart_rx_block_release(channel);
+#endif
+
 	switch (channel) {
 #if defined(SYS_UART1)
         case UART_1:
@@ -594,14 +1918,14 @@ result_t uart_release(struct uart_data *udata)
                 U2_TX_ISR_ENABLE = DISABLED;
                 break;
 #endif // SYS_UART2
-#if defined(UART_3)
+#if defined(SYS_UART3)
         case UART_3:
                 U3_ENABLE        = DISABLED;
                 U3_RX_ISR_ENABLE = DISABLED;
                 U3_TX_ISR_ENABLE = DISABLED;
                 break;
 #endif // SYS_UART3
-#if defined(UART_4)
+#if defined(SYS_UART4)
         case UART_4:
                 U4_ENABLE        = DISABLED;
                 U4_RX_ISR_ENABLE = DISABLED;
@@ -612,6 +1936,9 @@ result_t uart_release(struct uart_data *udata)
 		return(-ERR_BAD_INPUT_PARAMETER);
 	}
 
+#ifdef SYS_UART_TX_SEGMENTS
+	tx_segments_release(channel, udata);
+#endif
 	udata->channel = UART_BAD;
 
 	return(SUCCESS);
@@ -650,6 +1977,9 @@ result_t uart_tx_buffer(struct uart_data *udata, uint8_t *buffer, uint16_t len)
 	uint8_t          *ptr;
 	result_t          rc = 0;
         int16_t           count = 0;
+#ifdef SYS_UART_DMA
+	uint16_t          chunk;
+#endif
 
 	channel = udata->channel;
 
@@ -662,15 +1992,189 @@ result_t uart_tx_buffer(struct uart_data *udata, uint8_t *buffer, uint16_t len)
 
 	ptr = buffer;
 
+#ifdef SYS_UART_DMA
+	/*
+	 * Queue the lot, UART_DMA_TX_CHUNK bytes each time interrupts are
+	 * disabled so they're not off for longer with a longer buffer, then
+	 * transmit it in as few DMA transfers as possible
+	 */
+	while(len && (rc >= 0)) {
+		chunk = (len < UART_DMA_TX_CHUNK) ? len : UART_DMA_TX_CHUNK;
+		len  -= chunk;
+
+		INTERRUPTS_DISABLED
+		while(chunk--) {
+			rc = tx_buffer_write(channel, *ptr++);
+			if(rc < 0) break;
+			count++;
+		}
+		if((len == 0) || (rc < 0)) {
+			uart_dma_tx_start(channel);
+		}
+		INTERRUPTS_ENABLED
+	}
+	RC_CHECK
+#else
 	while(len--) {
 		rc = uart_putchar(channel, *ptr++);
                 RC_CHECK
                 count++;
 	}
+#endif
 
 	return(count);
 }
 
+#ifdef SYS_UART_TX_SEGMENTS
+#ifndef SYS_UART_DMA
+/*
+ * Interrupt as each character moves in to the Transmit Shift Register, the
+ * transmit ISR then keeps the UART's buffer loaded.
+ */
+static void uart_tx_start(enum uart_channel channel)
+{
+	switch(channel) {
+#if defined(SYS_UART1)
+	case UART_1:
+		U1STAbits.UTXISEL1 = 1;
+		U1STAbits.UTXISEL0 = 0;
+		break;
+#endif
+#if defined(SYS_UART2)
+	case UART_2:
+		U2STAbits.UTXISEL1 = 1;
+		U2STAbits.UTXISEL0 = 0;
+		break;
+#endif
+#if defined(SYS_UART3)
+	case UART_3:
+		U3STAbits.UTXISEL1 = 1;
+		U3STAbits.UTXISEL0 = 0;
+		break;
+#endif
+#if defined(SYS_UART4)
+	case UART_4:
+		U4STAbits.UTXISEL1 = 1;
+		U4STAbits.UTXISEL0 = 0;
+		break;
+#endif
+	default:
+		return;
+	}
+	load_tx_buffer(channel);
+}
+#endif // SYS_UART_DMA
+
+result_t uart_tx_segments(struct uart_data *udata, struct uart_tx_request *request)
+{
+	enum uart_channel channel;
+	struct uart      *uart;
+
+	channel = udata->channel;
+
+ 	if(  (channel >= NUM_UART_CHANNELS)
+	   ||(uarts[channel].status != UART_RESERVED)
+	   ||(uarts[channel].udata != udata)
+	   ||(udata->tx_pin == INVALID_GPIO_PIN)
+	   ||(request == NULL)
+	   ||(request->count && (request->segments == NULL))) {
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+	uart = &uarts[channel];
+
+	request->next = NULL;
+
+	INTERRUPTS_DISABLED
+	/*
+	 * Goes after the tx_buffer bytes already queued
+	 */
+	request->mark = uart->tx_write_index;
+
+	if(uart->tx_tail) {
+		uart->tx_tail->next = request;
+	} else {
+		uart->tx_head    = request;
+		uart->tx_segment = 0;
+		uart->tx_offset  = 0;
+	}
+	uart->tx_tail = request;
+
+	tx_segment_next(channel);
+#ifdef SYS_UART_DMA
+	uart_dma_tx_start(channel);
+#else
+	uart_tx_start(channel);
+#endif
+	INTERRUPTS_ENABLED
+
+	return(SUCCESS);
+}
+#endif // SYS_UART_TX_SEGMENTS
+
+#ifdef SYS_UART_ADDRESS_DETECT
+result_t uart_tx_address(struct uart_data *udata, uint8_t address)
+{
+	enum uart_channel channel;
+	result_t          rc = SUCCESS;
+
+	channel = udata->channel;
+
+ 	if(  (channel >= NUM_UART_CHANNELS)
+	   ||(uarts[channel].status != UART_RESERVED)
+	   ||(uarts[channel].udata != udata)
+	   ||(udata->tx_pin == INVALID_GPIO_PIN)
+	   ||((udata->uart_mode & (PDSEL1_MASK | PDSEL0_MASK)) != (PDSEL1_MASK | PDSEL0_MASK))) {
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	/*
+	 * Written straight to the UART so it can't overtake what's queued
+	 */
+	INTERRUPTS_DISABLED
+	if(tx_waiting(channel)) {
+		rc = -ERR_BUSY;
+	} else {
+		switch(channel) {
+#if defined(SYS_UART1)
+		case UART_1:
+			if(U1STAbits.UTXBF) rc = -ERR_BUSY;
+			else U1TXREG = 0x100 | address;
+			break;
+#endif
+#if defined(SYS_UART2)
+		case UART_2:
+			if(U2STAbits.UTXBF) rc = -ERR_BUSY;
+			else U2TXREG = 0x100 | address;
+			break;
+#endif
+#if defined(SYS_UART3)
+		case UART_3:
+			if(U3STAbits.UTXBF) rc = -ERR_BUSY;
+			else U3TXREG = 0x100 | address;
+			break;
+#endif
+#if defined(SYS_UART4)
+		case UART_4:
+			if(U4STAbits.UTXBF) rc = -ERR_BUSY;
+			else U4TXREG = 0x100 | address;
+			break;
+#endif
+		default:
+			rc = -ERR_BAD_INPUT_PARAMETER;
+			break;
+		}
+	}
+#ifdef SYS_UART_STATS
+	if(rc == SUCCESS) {
+		uarts[channel].stats.tx_bytes++;
+	}
+#endif
+	INTERRUPTS_ENABLED
+
+	return(rc);
+}
+#endif // SYS_UART_ADDRESS_DETECT
+
 result_t uart_tx_char(struct uart_data *udata, char ch)
 {
 	enum uart_channel channel;
@@ -688,12 +2192,24 @@ result_t uart_tx_char(struct uart_data *udata, char ch)
 
 static result_t uart_putchar(enum uart_channel channel, uint8_t ch)
 {
+#ifdef SYS_UART_DMA
+	result_t rc;
+#endif
+
  	if(channel >= NUM_UART_CHANNELS)
  		return(-ERR_BAD_INPUT_PARAMETER);
  	if(uarts[channel].status != UART_RESERVED)
  		return(-ERR_BAD_INPUT_PARAMETER);
  	if(uarts[channel].udata->tx_pin == INVALID_GPIO_PIN)
  		return(-ERR_BAD_INPUT_PARAMETER);
+
+#ifdef SYS_UART_DMA
+	INTERRUPTS_DISABLED
+	rc = tx_buffer_write(channel, ch);
+	uart_dma_tx_start(channel);
+	INTERRUPTS_ENABLED
+	return(rc);
+#endif
 	/*
 	 * If the Transmitter queue is currently empty turn on chip select.
 	 */
@@ -705,8 +2221,8 @@ static result_t uart_putchar(enum uart_channel channel, uint8_t ch)
 		 * If either the TX Buffer is full OR there are already characters in
 		 * our SW Buffer then add to SW buffer
 		 */
-		if(U1STAbits.UTXBF || uarts[channel].tx_count) {
-			if (uarts[channel].tx_count == 0) {
+		if(U1STAbits.UTXBF || tx_waiting(channel)) {
+			if (tx_waiting(channel) == 0) {
 				/*
 				 * Interrupt when a character is transferred to the Transmit Shift
 				 * Register (TSR), and as a result, the transmit buffer becomes empty
@@ -720,7 +2236,7 @@ static result_t uart_putchar(enum uart_channel channel, uint8_t ch)
 			U1TXREG = ch;
 		}
 #elif defined(__18F2680) || defined(__18F4585)
-		if((uarts[channel].tx_count == 0) && PIR1bits.TXIF) {
+		if((tx_ring_count(channel) == 0) && PIR1bits.TXIF) {
 			TXREG = ch;
 			return;
 		}
@@ -739,8 +2255,8 @@ static result_t uart_putchar(enum uart_channel channel, uint8_t ch)
 		 * If either the TX Buffer is full OR there are already characters in
 		 * our SW Buffer then add to SW buffer
 		 */
-		if(U2STAbits.UTXBF || uarts[channel].tx_count) {
-			if (uarts[channel].tx_count == 0) {
+		if(U2STAbits.UTXBF || tx_waiting(channel)) {
+			if (tx_waiting(channel) == 0) {
 				/*
 				 * Interrupt when a character is transferred to the Transmit Shift
 				 * Register (TSR), and as a result, the transmit buffer becomes empty
@@ -761,8 +2277,8 @@ static result_t uart_putchar(enum uart_channel channel, uint8_t ch)
 		 * If either the TX Buffer is full OR there are already characters in
 		 * our SW Buffer then add to SW buffer
 		 */
-		if(U3STAbits.UTXBF || uarts[channel].tx_count) {
-			if (uarts[channel].tx_count == 0) {
+		if(U3STAbits.UTXBF || tx_waiting(channel)) {
+			if (tx_waiting(channel) == 0) {
 				/*
 				 * Interrupt when a character is transferred to the Transmit Shift
 				 * Register (TSR), and as a result, the transmit buffer becomes empty
@@ -777,14 +2293,14 @@ static result_t uart_putchar(enum uart_channel channel, uint8_t ch)
 		}
 		break;
 #endif // SYS_UART3
-#if defined(UART4)
+#if defined(SYS_UART4)
 	case UART_4:
 		/*
 		 * If either the TX Buffer is full OR there are already characters in
 		 * our SW Buffer then add to SW buffer
 		 */
-		if(U4STAbits.UTXBF || uarts[channel].tx_count) {
-			if (uarts[channel].tx_count == 0) {
+		if(U4STAbits.UTXBF || tx_waiting(channel)) {
+			if (tx_waiting(channel) == 0) {
 				/*
 				 * Interrupt when a character is transferred to the Transmit Shift
 				 * Register (TSR), and as a result, the transmit buffer becomes empty
@@ -806,48 +2322,166 @@ static result_t uart_putchar(enum uart_channel channel, uint8_t ch)
 		break;
 	}
 
+#ifdef SYS_UART_STATS
+	/*
+	 * Written straight to the UART
+	 */
+	INTERRUPTS_DISABLED
+	uarts[channel].stats.tx_bytes++;
+	INTERRUPTS_ENABLED
+#endif
 	return(0);
 }
 
+/*
+ * Task end of the tx_buffer ring
+ */
 static result_t tx_buffer_write(enum uart_channel channel, char ch)
 {
-	uint16_t tmp;
+	struct uart *uart  = &uarts[channel];
+	uint16_t     write = uart->tx_write_index;
+#ifdef SYS_UART_STATS
+	uint16_t     count;
+#endif
+
+	if(tx_ring_count(channel) == SYS_UART_TX_BUFFER_SIZE) {
+		return(-ERR_BUFFER_OVERFLOW);
+	}
+
+	uart->tx_buffer[write & TX_RING_MASK] = ch;
+	RING_BARRIER();
+
+	RING_TASK_LOCK
+	uart->tx_write_index = write + 1;
+	RING_TASK_UNLOCK
+#ifdef SYS_UART_STATS
+	count = tx_ring_count(channel);
+	if(count > uart->stats.tx_high_water) {
+		uart->stats.tx_high_water = count;
+	}
+#endif
+
+	return(0);
+}
+
+/*
+ * ISR end of the tx_buffer ring, and of the queued requests' segments
+ */
+static uint8_t tx_buffer_read(enum uart_channel channel)
+{
+	struct uart *uart = &uarts[channel];
+	uint16_t     read = uart->tx_read_index;
+	uint8_t      ch   = 0x00;
+#ifdef SYS_UART_TX_SEGMENTS
+	struct uart_tx_request *request = uart->tx_head;
 
 	/*
-	 * Todo - This potential buffer overflow should be handled
-	 *        Might change the function to return an error code
+	 * Once the tx_buffer bytes queued before it have gone the head request
+	 * is transmitted straight from its segments.
 	 */
-	if(uarts[channel].tx_count < SYS_UART_TX_BUFFER_SIZE) {
-		uarts[channel].tx_buffer[uarts[channel].tx_write_index] = ch;
+	if(request && (request->mark == read)) {
+		ch = request->segments[uart->tx_segment].ptr[uart->tx_offset++];
+		tx_segment_next(channel);
+#ifdef SYS_UART_STATS
+		uart->stats.tx_bytes++;
+#endif
+		return(ch);
+	}
+#endif
 
-		/*
-                 * Compiler don't like following two lines in a oner
-                 */
-		tmp = ++(uarts[channel].tx_write_index) % SYS_UART_TX_BUFFER_SIZE;
-		uarts[channel].tx_write_index = tmp;
-		uarts[channel].tx_count++;
-		return(0);
+	if(uart->tx_write_index != read) {
+		ch = uart->tx_buffer[read & TX_RING_MASK];
+		RING_BARRIER();
+		uart->tx_read_index = read + 1;
+#ifdef SYS_UART_STATS
+		uart->stats.tx_bytes++;
+#endif
+#ifdef SYS_UART_TX_SEGMENTS
+		tx_segment_next(channel);
+#endif
+	}
+	return(ch);
+}
+
+/*
+ * Characters waiting in the tx_buffer
+ */
+static uint16_t tx_ring_count(enum uart_channel channel)
+{
+	uint16_t count;
+
+	RING_TASK_LOCK
+	count = uarts[channel].tx_write_index - uarts[channel].tx_read_index;
+	RING_TASK_UNLOCK
+
+	return(count);
+}
+
+/*
+ * Anything left to transmit, in the tx_buffer or queued requests
+ */
+static uint16_t tx_waiting(enum uart_channel channel)
+{
+#ifdef SYS_UART_TX_SEGMENTS
+	if(uarts[channel].tx_head) {
+		return(1);
 	}
+#endif
+	return(uarts[channel].tx_write_index - uarts[channel].tx_read_index);
+}
 
-	return(-ERR_BUFFER_OVERFLOW);
+#ifdef SYS_UART_TX_SEGMENTS
+/*
+ * Move past the finished, and any empty, segments of the head request.
+ * Requests with nothing left are finished with and their done() called.
+ */
+static void tx_segment_next(enum uart_channel channel)
+{
+	struct uart            *uart = &uarts[channel];
+	struct uart_tx_request *request;
+
+	while(((request = uart->tx_head) != NULL) && (request->mark == uart->tx_read_index)) {
+		if(uart->tx_segment < request->count) {
+			if(uart->tx_offset < request->segments[uart->tx_segment].len) {
+				return;
+			}
+			uart->tx_segment++;
+			uart->tx_offset = 0;
+			continue;
+		}
+
+		uart->tx_head = request->next;
+		if(uart->tx_head == NULL) {
+			uart->tx_tail = NULL;
+		}
+		uart->tx_segment = 0;
+		uart->tx_offset  = 0;
+
+		if(request->done) {
+			request->done(uart->udata, request, SUCCESS);
+		}
+	}
 }
 
-static char tx_buffer_read(enum uart_channel channel)
+/*
+ * Requests still queued when the UART's released are handed back
+ */
+static void tx_segments_release(enum uart_channel channel, struct uart_data *udata)
 {
-	uint16_t tmp;
-	char     ch = 0x00;
+	struct uart            *uart = &uarts[channel];
+	struct uart_tx_request *request;
 
-	if(uarts[channel].tx_count > 0) {
-		ch = uarts[channel].tx_buffer[uarts[channel].tx_read_index];
-		/*
-	         * Compiler don't like following two lines in a oner
-	         */
-		tmp = ++(uarts[channel].tx_read_index) % SYS_UART_TX_BUFFER_SIZE;
-		uarts[channel].tx_read_index = tmp;
-		uarts[channel].tx_count--;
+	while((request = uart->tx_head) != NULL) {
+		uart->tx_head = request->next;
+		if(request->done) {
+			request->done(udata, request, -ERR_BAD_STATE);
+		}
 	}
-	return(ch);
+	uart->tx_tail    = NULL;
+	uart->tx_segment = 0;
+	uart->tx_offset  = 0;
 }
+#endif // SYS_UART_TX_SEGMENTS
 
 #if defined(__dsPIC33EP256MU806__)
 static result_t uart_set_rx_pin(enum uart_channel channel, enum gpio_pin pin)
@@ -1385,22 +3019,22 @@ static uint16_t load_tx_buffer(enum uart_channel channel)
 		/*
 		 * If the TX buffer is not full load it from the circular buffer
 		 */
-		while ((!U1STAbits.UTXBF) && (uarts[channel].tx_count)) {
+		while ((!U1STAbits.UTXBF) && tx_waiting(channel)) {
 			U1TXREG = tx_buffer_read(channel);
 		}
 
-		return(uarts[channel].tx_count);
+		return(tx_waiting(channel));
 #elif defined(__18F2680) || defined(__18F4585)
 		/*
                  * The TXIF Interrupt is cleared by writing to TXREG it
                  * cannot be cleared by SW directly.
                  */
-		if(uarts[channel].tx_count > 0) {
+		if(tx_waiting(channel) > 0) {
 			TXREG = tx_buffer_read(channel);
 		} else {
 			PIE1bits.TXIE = DISABLED;
 		}
-		return(uarts[channel].tx_count);
+		return(tx_waiting(channel));
 #endif // MicroController selection
 #ifndef __XC8
 		break;
@@ -1411,11 +3045,11 @@ static uint16_t load_tx_buffer(enum uart_channel channel)
 		/*
 		 * If the TX buffer is not full load it from the circular buffer
 		 */
-		while ((!U2STAbits.UTXBF) && (uarts[channel].tx_count)) {
+		while ((!U2STAbits.UTXBF) && tx_waiting(channel)) {
 			U2TXREG = tx_buffer_read(channel);
 		}
 
-		return(uarts[channel].tx_count);
+		return(tx_waiting(channel));
 		break;
 #endif // SYS_UART2
 #if defined(SYS_UART3)
@@ -1423,11 +3057,11 @@ static uint16_t load_tx_buffer(enum uart_channel channel)
 		/*
 		 * If the TX buffer is not full load it from the circular buffer
 		 */
-		while ((!U3STAbits.UTXBF) && (uarts[channel].tx_count)) {
+		while ((!U3STAbits.UTXBF) && tx_waiting(channel)) {
 			U3TXREG = tx_buffer_read(channel);
 		}
 
-		return(uarts[channel].tx_count);
+		return(tx_waiting(channel));
 		break;
 #endif // SYS_UART3
 #if defined(SYS_UART4)
@@ -1435,11 +3069,11 @@ static uint16_t load_tx_buffer(enum uart_channel channel)
 		/*
 		 * If the TX buffer is not full load it from the circular buffer
 		 */
-		while ((!U4STAbits.UTXBF) && (uarts[channel].tx_count)) {
+		while ((!U4STAbits.UTXBF) && tx_waiting(channel)) {
 			U4TXREG = tx_buffer_read(channel);
 		}
 
-		return(uarts[channel].tx_count);
+		return(tx_waiting(channel));
 		break;
 #endif // SYS_UART4
 	default:
@@ -1467,4 +3101,4 @@ void pic18f_uart_isr(void)
 }
 #endif // (__18F2680) || (__18F4585)
 
-#endif // defined(SYS_UART1) || defined(SYS_UART2)
+#endif // (defined(SYS_UART1) || defined(SYS_UART2)) && !defined(ES_LINUX)
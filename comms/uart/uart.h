@@ -55,6 +55,13 @@
 
 #define UART_BAD           0xff   /**< Dummy value for a bad uart identifier */
 
+/*
+ * DMA received characters are always delivered in blocks
+ */
+#if defined(SYS_UART_DMA) && !defined(SYS_UART_RX_BLOCK)
+#define SYS_UART_RX_BLOCK
+#endif
+
 /**
  * @ingroup Uart
  * @struct  uart_data
@@ -62,6 +69,32 @@
  * 
  * Applicaton code should populate this structure with the required configuration
  * of the UART before a call to reserve a UART on the target micro-controller.
+ *
+ * With SYS_UART_RX_BLOCK a UART given a process_rx_block() callback has its
+ * received characters queued in a ring by the receive ISR and delivered from
+ * task context, libesoup_tasks(), as contiguous spans of the ring. A block is
+ * delivered once rx_threshold characters are waiting, on receiving the
+ * rx_delimiter character if rx_delimiter_enable is set, or once the line's
+ * been idle for rx_timeout mS, seen up to twice that after the last
+ * character. With none of the three set characters are delivered as soon as
+ * the task runs. A block which wraps the end of the ring is delivered in two
+ * calls.
+ *
+ * With SYS_UART_ADDRESS_DETECT a uart_data with a 9 bit uart_mode and
+ * rx_address_enable set has the UART's address detect enabled by
+ * uart_reserve(), for a multidrop bus such as RS-485. The UART ignores
+ * characters without the ninth bit set, so the receive ISR only runs for
+ * address characters until one is rx_address, or rx_broadcast if
+ * rx_broadcast_enable is set. That address, as an 8 bit character, and the
+ * characters following it are then received up to the next address
+ * character. Only the bus master sends address characters, see
+ * uart_tx_address(), a 9 bit UART which isn't filtering leaves
+ * rx_address_enable clear.
+ *
+ * With ES_LINUX a UART is the serial device or pty at device, opened by
+ * uart_reserve(). process_rx_char() and tx_finished() are called from the
+ * driver's receive thread, standing in for the ISRs, so with the same
+ * caution.
  * 
  */
 struct uart_data {
@@ -72,6 +105,22 @@ struct uart_data {
 	uint32_t           baud;                                 ///< Baud rate for the connection
 	void               (*tx_finished)(struct uart_data *);               ///< Callback - transmission has finished (Possibly NULL)
 	void               (*process_rx_char)(uint8_t uart_id, uint8_t ch);          ///< Callback - Character received (If an rx_pin is defined function to process received characters)
+#ifdef SYS_UART_RX_BLOCK
+	void               (*process_rx_block)(uint8_t uart_id, uint8_t *ptr, uint16_t len); ///< Callback - Block of received characters, from task context (NULL for process_rx_char() per character)
+	uint16_t           rx_threshold;                         ///< Deliver once this many characters are waiting (0 - not used)
+	boolean            rx_delimiter_enable;                  ///< Deliver blocks on rx_delimiter (FALSE - not used)
+	uint8_t            rx_delimiter;                         ///< Deliver up to and including this character
+	uint16_t           rx_timeout;                           ///< Deliver what's waiting once the line has been idle this many mS (0 - not used)
+#endif
+#ifdef SYS_UART_ADDRESS_DETECT
+	boolean            rx_address_enable;                    ///< 9 bit mode, filter on rx_address (FALSE - receive everything)
+	uint8_t            rx_address;                           ///< Only receive frames to this address
+	boolean            rx_broadcast_enable;                  ///< And frames to rx_broadcast (FALSE - none)
+	uint8_t            rx_broadcast;                         ///< Broadcast address
+#endif
+#ifdef ES_LINUX
+	const char        *device;                               ///< Path of the serial device or pty, "/dev/ttyUSB0" say
+#endif
 };
 
 /**
@@ -112,6 +161,66 @@ extern result_t uart_calculate_mode(uint16_t *mode, uint8_t databits, uint8_t pa
 extern result_t uart_tx_buffer_count(struct uart_data *udata);
 #endif // SYS_TEST_BUILD
 
+/**
+ * @ingroup Uart
+ * @brief   free space in the Transmit buffer of a reserved UART.
+ *
+ * A caller which must never have a transmission rejected, for example the
+ * serial logging ring, can check there's room before calling uart_tx_buffer().
+ *
+ * @param udata         Pointer to uart_data structure of the reserved channel
+ * @return              Negative - Error (bad input parameter)
+ *                      Positive - Number of bytes which can be transmitted
+ */
+extern result_t uart_tx_buffer_space(struct uart_data *udata);
+
+#ifdef SYS_UART_STATS
+/**
+ * @ingroup Uart
+ * @struct  uart_stats
+ * @brief   Counters of a reserved UART, cleared by uart_reserve()
+ *
+ * The high water marks show how close the SW buffers have come to full, for
+ * sizing SYS_UART_TX_BUFFER_SIZE and SYS_UART_RX_BUFFER_SIZE. The ISR times
+ * are only measured with SYS_LOOP_STATS, whose stopwatch they're read from,
+ * otherwise they're zero. Framing and parity errors aren't seen by DMA
+ * reception.
+ */
+struct uart_stats {
+	uint32_t           rx_bytes;                             ///< Characters read from the UART
+	uint32_t           tx_bytes;                             ///< Characters written to the UART
+	uint16_t           rx_overruns;                          ///< Receive FIFO overruns, the UART lost characters
+	uint16_t           rx_framing_errors;                    ///< Characters received with a framing error
+	uint16_t           rx_parity_errors;                     ///< Characters received with a parity error
+	uint16_t           rx_dropped;                           ///< Characters lost to a full receive ring (SYS_UART_RX_BLOCK)
+	uint16_t           tx_high_water;                        ///< Most characters waiting in the SW tx buffer
+	uint16_t           rx_high_water;                        ///< Most characters waiting in the receive ring (SYS_UART_RX_BLOCK)
+	uint16_t           tx_isr_max_cycles;                    ///< Longest transmit ISR in instruction cycles
+	uint16_t           rx_isr_max_cycles;                    ///< Longest receive ISR in instruction cycles
+};
+
+/**
+ * @ingroup Uart
+ * @brief   copy the counters of a previously reserved UART
+ *
+ * @param   udata       structure containing details of the previously reserved channel \ref uart_data
+ * @param   stats       returned copy of the counters
+ * @return              Negative - Error (bad input parameter)
+ *                      Zero     - Success
+ */
+extern result_t uart_get_stats(struct uart_data *udata, struct uart_stats *stats);
+
+/**
+ * @ingroup Uart
+ * @brief   clear the counters of a previously reserved UART
+ *
+ * @param   udata       structure containing details of the previously reserved channel \ref uart_data
+ * @return              Negative - Error (bad input parameter)
+ *                      Zero     - Success
+ */
+extern result_t uart_reset_stats(struct uart_data *udata);
+#endif // SYS_UART_STATS
+
 /**
  * @ingroup Uart
  * @brief   reserve a system UARTs for use. 
@@ -150,6 +259,73 @@ extern result_t uart_release(struct uart_data *udata);
  */
 extern result_t uart_tx_buffer(struct uart_data *udata, uint8_t *buffer, uint16_t len);
 
+#ifdef SYS_UART_TX_SEGMENTS
+/**
+ * @ingroup Uart
+ * @struct  uart_tx_segment
+ * @brief   One contiguous piece of a transmission, see uart_tx_segments()
+ */
+struct uart_tx_segment {
+	const uint8_t     *ptr;                                  ///< First byte of the segment
+	uint16_t           len;                                  ///< Number of bytes (Possibly 0)
+};
+
+/**
+ * @ingroup Uart
+ * @struct  uart_tx_request
+ * @brief   Transmission of a list of segments, see uart_tx_segments()
+ *
+ * The request, its segments and the bytes they point to belong to the
+ * driver from uart_tx_segments() until done() is called.
+ */
+struct uart_tx_request {
+	const struct uart_tx_segment *segments;                  ///< Segments transmitted in order
+	uint8_t            count;                                ///< Number of segments
+	void               (*done)(struct uart_data *, struct uart_tx_request *, result_t); ///< Callback - request finished with, SUCCESS or -ERR_BAD_STATE if the UART was released (Possibly NULL)
+	struct uart_tx_request *next;                            ///< Used by the driver
+	uint16_t           mark;                                 ///< Used by the driver
+};
+
+/**
+ * @ingroup Uart
+ * @brief   transmit a list of segments without copying them
+ *
+ * The transmit ISR, or DMA, reads the bytes straight from the caller's
+ * segments so a protocol's header, payload and CRC can go out without being
+ * copied together, and without the limit of SYS_UART_TX_BUFFER_SIZE. The
+ * request is transmitted after anything already queued and before anything
+ * queued after it. done() is called, from ISR context, once the last byte
+ * has been taken, which is before it's shifted out, tx_finished() still
+ * signals the end of transmission.
+ *
+ * With SYS_UART_DMA the segments must be in data RAM, not constants left in
+ * program memory, as the DMA reads them.
+ *
+ * @param   udata       structure containing details of the previously reserved channel \ref uart_data
+ * @param   request     segments to transmit \ref uart_tx_request
+ * @return              Negative - Error
+ *                      Zero     - Success, request queued
+ */
+extern result_t uart_tx_segments(struct uart_data *udata, struct uart_tx_request *request);
+#endif // SYS_UART_TX_SEGMENTS
+
+#ifdef SYS_UART_ADDRESS_DETECT
+/**
+ * @ingroup Uart
+ * @brief   transmit an address character, ninth bit set, on a 9 bit UART
+ *
+ * Starts a frame on a multidrop bus, the rest of the frame follows with
+ * uart_tx_buffer() as ordinary characters. Only written once everything
+ * previously queued has gone in to the UART.
+ *
+ * @param   udata       structure containing details of the previously reserved channel \ref uart_data
+ * @param   address     address of the receiving node
+ * @return              Negative - Error, -ERR_BUSY whilst characters are still queued
+ *                      Zero     - Success
+ */
+extern result_t uart_tx_address(struct uart_data *udata, uint8_t address);
+#endif // SYS_UART_ADDRESS_DETECT
+
 /**
  * @ingroup Uart
  * @brief   transmit a single byte on a previously reserved system UARTs.
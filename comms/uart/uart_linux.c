@@ -0,0 +1,660 @@
+/**
+ * @file libesoup/comms/uart/uart_linux.c
+ *
+ * @author John Whitmore
+ *
+ * @brief UART functionality on Linux, each UART a serial device or pty
+ *
+ * Copyright 2017-2020 electronicSoup Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the version 2 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ *
+ * The uart.h API for ES_LINUX builds, in place of uart.c, so that Modbus and
+ * the like run unchanged on a Linux gateway or against pty pairs on a host.
+ *
+ * A reserved UART's device is opened non blocking and, if it's a terminal,
+ * set raw at the uart_data's baud rate and mode. A single thread waits on
+ * all of them with epoll, standing in for the ISRs. It reads what's been
+ * received and passes it to process_rx_char() a character at a time, and
+ * writes the tx_buffer ring to a device whenever the device will take more,
+ * calling tx_finished() once it's taken the last character. The thread
+ * holds a recursive lock whilst calling back and the API functions take it
+ * too, as interrupts are disabled on the uC, so callbacks can call the API.
+ */
+#include "libesoup_config.h"
+
+#if defined(ES_LINUX) && (defined(SYS_UART1) || defined(SYS_UART2) || defined(SYS_UART3) || defined(SYS_UART4))
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#ifdef SYS_SERIAL_LOGGING
+#define DEBUG_FILE
+static const char *TAG = "UART";
+#include "libesoup/logger/serial_log.h"
+/*
+ * Check required libesoup_config.h defines are found
+ */
+#ifndef SYS_LOG_LEVEL
+#error libesoup_config.h file should define SYS_LOG_LEVEL (see libesoup/examples/libesoup_config.h)
+#endif
+#endif
+
+#include "libesoup/errno.h"
+#include "libesoup/comms/uart/uart.h"
+
+/*
+ * Check required libesoup_config.h defines are found
+ */
+#ifndef SYS_UART_TX_BUFFER_SIZE
+#error libesoup_config.h file should define SYS_UART_TX_BUFFER_SIZE (see libesoup/examples/libesoup_config.h)
+#endif
+
+#if ((SYS_UART_TX_BUFFER_SIZE) & ((SYS_UART_TX_BUFFER_SIZE) - 1)) != 0
+#error SYS_UART_TX_BUFFER_SIZE must be a power of two
+#endif
+
+#if defined(SYS_UART_DMA) || defined(SYS_UART_RX_BLOCK) || defined(SYS_UART_TX_SEGMENTS) || defined(SYS_UART_ADDRESS_DETECT)
+#error SYS_UART_DMA, SYS_UART_RX_BLOCK, SYS_UART_TX_SEGMENTS and SYS_UART_ADDRESS_DETECT are not supported with ES_LINUX
+#endif
+
+#define TX_RING_MASK       ((SYS_UART_TX_BUFFER_SIZE) - 1)
+
+/*
+ * Most read from a device at a time
+ */
+#define RX_READ_SIZE       64
+
+/*
+ * uart_mode bits, there are no SFRs to match
+ */
+#define MODE_PARITY_MASK   0x0003      // UART_PARITY_NONE, _ODD or _EVEN
+#define MODE_TWO_STOP_BITS 0x0004
+
+enum uart_status {
+	UART_FREE,
+	UART_RESERVED
+};
+
+struct uart {
+	enum uart_status       status;
+	uint32_t               generation;          // Reservations, so a stale epoll event is spotted
+	struct uart_data      *udata;
+	int                    fd;
+	boolean                lost;                // Device hung up or failed, no longer watched
+	uint8_t                tx_buffer[SYS_UART_TX_BUFFER_SIZE];
+	uint16_t               tx_write_index;
+	uint16_t               tx_read_index;
+	boolean                tx_active;           // Waiting for the device to take the tx_buffer
+#ifdef SYS_UART_STATS
+	struct uart_stats      stats;
+#endif
+};
+
+static struct uart      uarts[NUM_UART_CHANNELS];
+static pthread_mutex_t  lock;
+static pthread_t        thread;
+static int              epoll_fd = -1;
+
+static void    *uart_thread(void *arg);
+static void     uart_event(enum uart_channel channel, uint32_t events);
+static ssize_t  uart_rx(enum uart_channel channel);
+static ssize_t  uart_tx(enum uart_channel channel);
+static void     uart_watch(enum uart_channel channel);
+static void     uart_lost(enum uart_channel channel);
+static result_t uart_set_termios(struct uart_data *udata, int fd);
+
+result_t uart_init(void)
+{
+	pthread_mutexattr_t attr;
+	enum uart_channel   channel;
+
+	if(epoll_fd >= 0) {
+		return(SUCCESS);
+	}
+
+	for(channel = 0; channel < NUM_UART_CHANNELS; channel++) {
+		uarts[channel].status = UART_FREE;
+		uarts[channel].udata  = NULL;
+		uarts[channel].fd     = -1;
+	}
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(epoll_fd < 0) {
+		LOG_E("epoll_create1()\n\r");
+		return(-ERR_GENERAL_ERROR);
+	}
+
+	if(pthread_create(&thread, NULL, uart_thread, NULL) != 0) {
+		LOG_E("pthread_create()\n\r");
+		close(epoll_fd);
+		epoll_fd = -1;
+		return(-ERR_GENERAL_ERROR);
+	}
+	pthread_detach(thread);
+
+	return(SUCCESS);
+}
+
+/*
+ * Each event carries the channel in its low byte and the reservation it was
+ * for above that.
+ */
+static void *uart_thread(void *arg __attribute__((unused)))
+{
+	struct epoll_event events[NUM_UART_CHANNELS];
+	enum uart_channel  channel;
+	uint32_t           generation;
+	int                count;
+	int                loop;
+
+	while(1) {
+		count = epoll_wait(epoll_fd, events, NUM_UART_CHANNELS, -1);
+
+		pthread_mutex_lock(&lock);
+		for(loop = 0; loop < count; loop++) {
+			channel    = (enum uart_channel)(events[loop].data.u64 & 0xff);
+			generation = (uint32_t)(events[loop].data.u64 >> 8);
+
+			if(  (channel < NUM_UART_CHANNELS)
+			   &&(uarts[channel].status == UART_RESERVED)
+			   &&(uarts[channel].generation == generation)
+			   &&(!uarts[channel].lost)) {
+				uart_event(channel, events[loop].events);
+			}
+		}
+		pthread_mutex_unlock(&lock);
+	}
+	return(NULL);
+}
+
+static void uart_event(enum uart_channel channel, uint32_t events)
+{
+	struct uart *uart = &uarts[channel];
+	uint32_t     generation = uart->generation;
+	ssize_t      rx = 0;
+	ssize_t      tx = 0;
+
+	if(events & EPOLLIN) {
+		rx = uart_rx(channel);
+	}
+
+	/*
+	 * A callback may have released the UART
+	 */
+	if((uart->status != UART_RESERVED) || (uart->generation != generation)) {
+		return;
+	}
+
+	if(events & EPOLLOUT) {
+		tx = uart_tx(channel);
+	}
+
+	/*
+	 * A pty whose other end has closed reads and writes nothing, with
+	 * EPOLLHUP reported for ever more.
+	 */
+	if((events & (EPOLLHUP | EPOLLERR)) && (rx <= 0) && (tx <= 0)) {
+		uart_lost(channel);
+	}
+}
+
+static ssize_t uart_rx(enum uart_channel channel)
+{
+	struct uart *uart = &uarts[channel];
+	uint32_t     generation = uart->generation;
+	uint8_t      buffer[RX_READ_SIZE];
+	ssize_t      len;
+	ssize_t      loop;
+
+	len = read(uart->fd, buffer, sizeof(buffer));
+	if(len <= 0) {
+		return(len);
+	}
+#ifdef SYS_UART_STATS
+	uart->stats.rx_bytes += len;
+#endif
+
+	for(loop = 0; loop < len; loop++) {
+		if((uart->status != UART_RESERVED) || (uart->generation != generation)) {
+			break;
+		}
+		if(uart->udata->process_rx_char) {
+			uart->udata->process_rx_char(channel, buffer[loop]);
+		}
+	}
+	return(len);
+}
+
+/*
+ * Write as much of the tx_buffer as the device will take, in at most two
+ * spans as the ring wraps.
+ */
+static ssize_t uart_tx(enum uart_channel channel)
+{
+	struct uart *uart = &uarts[channel];
+	uint16_t     read;
+	uint16_t     count;
+	uint16_t     span;
+	ssize_t      len = 1;
+
+	while((count = uart->tx_write_index - uart->tx_read_index) != 0) {
+		read = uart->tx_read_index & TX_RING_MASK;
+		span = SYS_UART_TX_BUFFER_SIZE - read;
+		if(span > count) span = count;
+
+		len = write(uart->fd, &uart->tx_buffer[read], span);
+		if(len <= 0) {
+			return(len);
+		}
+		uart->tx_read_index += len;
+#ifdef SYS_UART_STATS
+		uart->stats.tx_bytes += len;
+#endif
+		if(len < span) {
+			return(len);
+		}
+	}
+
+	uart->tx_active = FALSE;
+	uart_watch(channel);
+
+	if(uart->udata->tx_finished) {
+		uart->udata->tx_finished(uart->udata);
+	}
+	return(len);
+}
+
+static void uart_watch(enum uart_channel channel)
+{
+	struct uart        *uart = &uarts[channel];
+	struct epoll_event  event;
+
+	memset(&event, 0x00, sizeof(event));
+	event.events   = (uart->udata->rx_pin != INVALID_GPIO_PIN) ? EPOLLIN : 0;
+	event.events  |= uart->tx_active ? EPOLLOUT : 0;
+	event.data.u64 = ((uint64_t)uart->generation << 8) | channel;
+
+	if(!uart->lost) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, uart->fd, &event);
+	}
+}
+
+/*
+ * What's waiting to transmit is thrown away, the UART stays reserved until
+ * released.
+ */
+static void uart_lost(enum uart_channel channel)
+{
+	struct uart *uart = &uarts[channel];
+
+	LOG_E("Lost %s\n\r", uart->udata->device);
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, uart->fd, NULL);
+	uart->lost           = TRUE;
+	uart->tx_active      = FALSE;
+	uart->tx_read_index  = uart->tx_write_index;
+}
+
+static speed_t uart_speed(uint32_t baud)
+{
+	switch(baud) {
+	case 1200:   return(B1200);
+	case 2400:   return(B2400);
+	case 4800:   return(B4800);
+	case 9600:   return(B9600);
+	case 19200:  return(B19200);
+	case 38400:  return(B38400);
+	case 57600:  return(B57600);
+	case 115200: return(B115200);
+	case 230400: return(B230400);
+	case 460800: return(B460800);
+	case 921600: return(B921600);
+	default:     return(B0);
+	}
+}
+
+/*
+ * Raw, no flow control, at the uart_data's baud rate and mode
+ */
+static result_t uart_set_termios(struct uart_data *udata, int fd)
+{
+	struct termios tio;
+	speed_t        speed;
+
+	if(!isatty(fd)) {
+		return(SUCCESS);
+	}
+
+	speed = uart_speed(udata->baud);
+	if((speed == B0) || (tcgetattr(fd, &tio) != 0)) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+
+	tio.c_cflag &= ~(PARENB | PARODD | CSTOPB | CRTSCTS);
+	tio.c_cflag |= CLOCAL | CREAD;
+	if((udata->uart_mode & MODE_PARITY_MASK) == UART_PARITY_ODD) {
+		tio.c_cflag |= PARENB | PARODD;
+	} else if((udata->uart_mode & MODE_PARITY_MASK) == UART_PARITY_EVEN) {
+		tio.c_cflag |= PARENB;
+	}
+	if(udata->uart_mode & MODE_TWO_STOP_BITS) {
+		tio.c_cflag |= CSTOPB;
+	}
+	tio.c_cc[VMIN]  = 1;
+	tio.c_cc[VTIME] = 0;
+
+	if(tcsetattr(fd, TCSANOW, &tio) != 0) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+	return(SUCCESS);
+}
+
+/*
+ * The idle level is that of the device, 9 data bits aren't supported
+ */
+result_t uart_calculate_mode(uint16_t *mode, uint8_t databits, uint8_t parity, uint8_t stopbits, uint8_t rx_idle_level __attribute__((unused)))
+{
+	if((databits != UART_8_DATABITS) || (parity > UART_PARITY_EVEN)) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	*mode = parity;
+	if(stopbits == UART_TWO_STOP_BITS) {
+		*mode |= MODE_TWO_STOP_BITS;
+	}
+	return(SUCCESS);
+}
+
+/*
+ * uart_reserve - Reserve a UART Channel, opening its device
+ */
+result_t uart_reserve(struct uart_data *udata)
+{
+	struct uart        *uart;
+	struct epoll_event  event;
+	enum uart_channel   channel;
+	result_t            rc;
+	int                 fd;
+
+	if(  (udata == NULL)
+	   ||(udata->device == NULL)
+	   ||((udata->rx_pin == INVALID_GPIO_PIN) && (udata->tx_pin == INVALID_GPIO_PIN))) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+	if(epoll_fd < 0) {
+		return(-ERR_UNINITIALISED);
+	}
+
+	pthread_mutex_lock(&lock);
+	for(channel = 0; channel < NUM_UART_CHANNELS; channel++) {
+		if(uarts[channel].status == UART_FREE) {
+			break;
+		}
+	}
+	if(channel == NUM_UART_CHANNELS) {
+		pthread_mutex_unlock(&lock);
+		return(-ERR_NO_RESOURCES);
+	}
+
+	fd = open(udata->device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if(fd < 0) {
+		LOG_E("Can't open %s\n\r", udata->device);
+		pthread_mutex_unlock(&lock);
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	rc = uart_set_termios(udata, fd);
+	if(rc < 0) {
+		close(fd);
+		pthread_mutex_unlock(&lock);
+		return(rc);
+	}
+
+	uart = &uarts[channel];
+	uart->udata          = udata;
+	uart->fd             = fd;
+	uart->lost           = FALSE;
+	uart->tx_write_index = 0;
+	uart->tx_read_index  = 0;
+	uart->tx_active      = FALSE;
+	uart->generation++;
+#ifdef SYS_UART_STATS
+	memset(&uart->stats, 0x00, sizeof(struct uart_stats));
+#endif
+
+	memset(&event, 0x00, sizeof(event));
+	event.events   = (udata->rx_pin != INVALID_GPIO_PIN) ? EPOLLIN : 0;
+	event.data.u64 = ((uint64_t)uart->generation << 8) | channel;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+		close(fd);
+		uart->fd = -1;
+		pthread_mutex_unlock(&lock);
+		return(-ERR_GENERAL_ERROR);
+	}
+
+	uart->status   = UART_RESERVED;
+	udata->channel = channel;
+	pthread_mutex_unlock(&lock);
+
+	return(channel);
+}
+
+/*
+ * uart_release - Release a previously reserved UART, closing its device
+ */
+result_t uart_release(struct uart_data *udata)
+{
+	enum uart_channel channel;
+
+	pthread_mutex_lock(&lock);
+	channel = udata->channel;
+
+ 	if (  (channel >= NUM_UART_CHANNELS)
+ 	    ||(uarts[channel].status != UART_RESERVED)
+	    ||(uarts[channel].udata != udata)) {
+		pthread_mutex_unlock(&lock);
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	if(!uarts[channel].lost) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, uarts[channel].fd, NULL);
+	}
+	close(uarts[channel].fd);
+
+ 	udata->channel         = UART_BAD;
+	uarts[channel].fd      = -1;
+	uarts[channel].udata   = NULL;
+	uarts[channel].status  = UART_FREE;
+	pthread_mutex_unlock(&lock);
+
+	return(SUCCESS);
+}
+
+/*
+ * Queued in the tx_buffer and written by the thread, so tx_finished() is
+ * always called from the thread.
+ */
+result_t uart_tx_buffer(struct uart_data *udata, uint8_t *buffer, uint16_t len)
+{
+	enum uart_channel channel;
+	struct uart      *uart;
+	result_t          rc = 0;
+	int16_t           count = 0;
+
+	pthread_mutex_lock(&lock);
+	channel = udata->channel;
+
+ 	if(  (channel >= NUM_UART_CHANNELS)
+	   ||(uarts[channel].status != UART_RESERVED)
+	   ||(uarts[channel].udata != udata)
+	   ||(udata->tx_pin == INVALID_GPIO_PIN)) {
+		pthread_mutex_unlock(&lock);
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+	uart = &uarts[channel];
+
+	if(uart->lost) {
+		pthread_mutex_unlock(&lock);
+		return(-ERR_NOT_READY);
+	}
+
+	while(len--) {
+		if((uint16_t)(uart->tx_write_index - uart->tx_read_index) == SYS_UART_TX_BUFFER_SIZE) {
+			rc = -ERR_BUFFER_OVERFLOW;
+			break;
+		}
+		uart->tx_buffer[uart->tx_write_index++ & TX_RING_MASK] = *buffer++;
+		count++;
+	}
+#ifdef SYS_UART_STATS
+	if((uint16_t)(uart->tx_write_index - uart->tx_read_index) > uart->stats.tx_high_water) {
+		uart->stats.tx_high_water = uart->tx_write_index - uart->tx_read_index;
+	}
+#endif
+
+	if(count && !uart->tx_active) {
+		uart->tx_active = TRUE;
+		uart_watch(channel);
+	}
+	pthread_mutex_unlock(&lock);
+
+	return((rc < 0) ? rc : count);
+}
+
+result_t uart_tx_char(struct uart_data *udata, char ch)
+{
+	result_t rc;
+
+	rc = uart_tx_buffer(udata, (uint8_t *)&ch, 1);
+	return((rc < 0) ? rc : SUCCESS);
+}
+
+result_t uart_tx_buffer_space(struct uart_data *udata)
+{
+	enum uart_channel channel;
+	result_t          rc;
+
+	pthread_mutex_lock(&lock);
+	channel = udata->channel;
+
+ 	if(  (channel >= NUM_UART_CHANNELS)
+	   ||(uarts[channel].status != UART_RESERVED)
+	   ||(uarts[channel].udata != udata)) {
+		pthread_mutex_unlock(&lock);
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	rc = SYS_UART_TX_BUFFER_SIZE - (uint16_t)(uarts[channel].tx_write_index - uarts[channel].tx_read_index);
+	pthread_mutex_unlock(&lock);
+
+	return(rc);
+}
+
+#ifdef SYS_UART_STATS
+/*
+ * Only the bytes moved and the tx_buffer's high water mark are counted, the
+ * device's driver keeps its own error counts.
+ */
+result_t uart_get_stats(struct uart_data *udata, struct uart_stats *stats)
+{
+	enum uart_channel channel;
+
+	pthread_mutex_lock(&lock);
+	channel = udata->channel;
+
+ 	if(  (channel >= NUM_UART_CHANNELS)
+	   ||(uarts[channel].status != UART_RESERVED)
+	   ||(uarts[channel].udata != udata)
+	   ||(stats == NULL)) {
+		pthread_mutex_unlock(&lock);
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	*stats = uarts[channel].stats;
+	pthread_mutex_unlock(&lock);
+
+	return(SUCCESS);
+}
+
+result_t uart_reset_stats(struct uart_data *udata)
+{
+	enum uart_channel channel;
+
+	pthread_mutex_lock(&lock);
+	channel = udata->channel;
+
+ 	if(  (channel >= NUM_UART_CHANNELS)
+	   ||(uarts[channel].status != UART_RESERVED)
+	   ||(uarts[channel].udata != udata)) {
+		pthread_mutex_unlock(&lock);
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	memset(&uarts[channel].stats, 0x00, sizeof(struct uart_stats));
+	pthread_mutex_unlock(&lock);
+
+	return(SUCCESS);
+}
+#endif // SYS_UART_STATS
+
+#ifdef SYS_TEST_BUILD
+result_t uart_tx_buffer_count(struct uart_data *udata)
+{
+	result_t rc;
+
+	rc = uart_tx_buffer_space(udata);
+	RC_CHECK
+
+	return(SYS_UART_TX_BUFFER_SIZE - rc);
+}
+
+result_t uart_test_rx_buffer(struct uart_data *udata, uint8_t *buffer, uint16_t len)
+{
+	enum uart_channel channel;
+
+	pthread_mutex_lock(&lock);
+	channel = udata->channel;
+
+ 	if(  (channel >= NUM_UART_CHANNELS)
+	   ||(uarts[channel].status != UART_RESERVED)
+	   ||(uarts[channel].udata != udata)
+	   ||(udata->process_rx_char == NULL)) {
+		pthread_mutex_unlock(&lock);
+ 		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	while(len--) {
+		udata->process_rx_char(channel, *buffer++);
+	}
+	pthread_mutex_unlock(&lock);
+
+	return(SUCCESS);
+}
+#endif // SYS_TEST_BUILD
+
+#endif // ES_LINUX && SYS_UART
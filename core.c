@@ -42,6 +42,21 @@ static const char  *TAG = "CORE";
 extern void   hw_timer_init(void);
 #endif
 
+#ifdef SYS_ASYNC_INIT
+#include "libesoup/timers/hw_timers.h"
+#ifdef SYS_SD_CARD
+#include "libesoup/comms/spi/devices/sd_card.h"
+#endif
+#ifdef SYS_SPIN_FV1
+#include "libesoup/gpio/gpio.h"
+#include "libesoup/devices/SpinFV1/spin_fv1.h"
+#endif
+
+#ifndef SYS_HW_TIMERS
+#error libesoup_config.h file should define SYS_HW_TIMERS (SYS_ASYNC_INIT times stages with a Hardware timer)
+#endif
+#endif // SYS_ASYNC_INIT
+
 #ifdef SYS_SW_TIMERS
 #include "libesoup/timers/sw_timers.h"
 extern void   sw_timer_init(void);
@@ -56,6 +71,10 @@ extern void   uart_init(void);
 #include "libesoup/jobs/jobs.h"
 #endif
 
+#ifdef SYS_LOOP_STATS
+#include "libesoup/utils/loop_stats.h"
+#endif
+
 #ifdef SYS_HW_RTC
 #include "libesoup/timers/rtc.h"
 #endif
@@ -65,7 +84,6 @@ extern result_t      spi_init(void);
 #endif
 
 #if defined(SYS_I2C_1) || defined(SYS_I2C_2) || defined(SYS_I2C_3)
-extern result_t i2c_tasks(void);
 extern result_t i2c_init(void);
 #endif
 
@@ -79,7 +97,6 @@ extern result_t i2c_init(void);
 
 #ifdef SYS_ADC
 extern result_t adc_init(void);
-extern result_t adc_tasks(void);
 #endif
 
 #ifdef SYS_PWM
@@ -102,7 +119,6 @@ extern result_t change_notifier_init(void);
 #include "system.h"
 #include "usb.h"
 
-extern result_t usb_keyboard_tasks(void);
 extern void SYSTEM_Initialize(  SYSTEM_STATE SYSTEM_STATE_USB_START );
 #endif
 
@@ -122,6 +138,178 @@ extern result_t loppers_init(void);
  */
 uint32_t sys_clock_freq;
 
+/*
+ * Table of poll functions called by libesoup_tasks(). Tasks which aren't
+ * always polled are only called once their pending flag has been set, and
+ * tasks_pending saves scanning the table when no task has been flagged.
+ *
+ * The table is only ever added to, never reset, so tasks can be registered
+ * before libesoup_init() and an identifier stays valid for good.
+ */
+struct task {
+	libesoup_task_t   poll;
+	boolean           always;
+	volatile boolean  pending;
+};
+
+static struct task      tasks[SYS_NUMBER_OF_TASKS];
+static uint8_t          task_count = 0;
+static volatile boolean tasks_pending = FALSE;
+
+#ifdef SYS_ASYNC_INIT
+/*
+ * Initialisation stages run in the background, in the order they were
+ * added, by the init_poll() task. Stage 0 is the synchronous part of
+ * libesoup_init() itself, recorded so its duration is reported as well.
+ */
+enum stage_state {
+	stage_waiting,
+	stage_running,
+	stage_finished,     // Finished, completion callback not yet called
+	stage_reported
+};
+
+struct init_stage {
+	libesoup_stage_t     start;
+	libesoup_stage_cb_t  done;
+	volatile uint8_t     state;
+	result_t             rc;
+	uint32_t             started;
+	uint32_t             duration_us;
+};
+
+static struct init_stage stages[SYS_NUMBER_OF_INIT_STAGES + 1];
+static uint8_t           stage_count = 1;
+static int16_t           init_task = -1;
+static timer_id          init_timer = BAD_TIMER_ID;
+static uint32_t          init_cycles_per_us;
+static libesoup_stage_cb_t init_report = NULL;
+
+static uint32_t init_clock(void)
+{
+	uint32_t ticks = 0;
+
+	if(init_timer == BAD_TIMER_ID) {
+		struct timer_req request;
+
+		request.type = stopwatch;
+		request.period.units = uSeconds;
+		request.period.duration = 0;
+		request.exp_fn = NULL;
+		init_timer = hw_timer_start(&request);
+		if(init_timer < 0) {
+			LOG_E("No HW Timer for init\n\r");
+			init_timer = BAD_TIMER_ID;
+		}
+		init_cycles_per_us = sys_clock_freq / 1000000;
+		if(init_cycles_per_us == 0) init_cycles_per_us = 1;
+	}
+	if(init_timer != BAD_TIMER_ID) {
+		hw_timer_stopwatch_ticks(init_timer, &ticks);
+	}
+	return(ticks);
+}
+
+/*
+ * Task which reports finished stages and starts the next waiting stage.
+ * Only one stage is started per call to keep each main loop short.
+ */
+static result_t init_poll(void)
+{
+	struct period period;
+	uint8_t       loop;
+	result_t      rc;
+
+	for(loop = 0; loop < stage_count; loop++) {
+		if(stages[loop].state == stage_finished) {
+			stages[loop].state = stage_reported;
+			LOG_I("Init stage %d took %ld uS\n\r", loop, stages[loop].duration_us);
+			if(stages[loop].done) {
+				stages[loop].done(loop, stages[loop].rc, stages[loop].duration_us);
+			}
+			if(init_report) {
+				init_report(loop, stages[loop].rc, stages[loop].duration_us);
+			}
+		}
+		if(stages[loop].state == stage_running) {
+			return(0);
+		}
+		if(stages[loop].state == stage_waiting) {
+			stages[loop].state = stage_running;
+			stages[loop].started = init_clock();
+			rc = stages[loop].start();
+			if(rc <= 0) {
+				libesoup_init_stage_done(loop, rc);
+			}
+			return(1);
+		}
+	}
+
+	/*
+	 * Everything's reported so the stopwatch can be freed
+	 */
+	if(init_timer != BAD_TIMER_ID) {
+		hw_timer_stop(init_timer, &period);
+		init_timer = BAD_TIMER_ID;
+	}
+	return(0);
+}
+
+int16_t libesoup_init_stage_add(libesoup_stage_t start, libesoup_stage_cb_t done)
+{
+	int16_t stage;
+
+	if(stage_count > SYS_NUMBER_OF_INIT_STAGES) {
+		LOG_E("No init stage slot\n\r");
+		return(-ERR_NO_RESOURCES);
+	}
+
+	stage = stage_count;
+	stages[stage].start = start;
+	stages[stage].done = done;
+	stages[stage].rc = 0;
+	stages[stage].duration_us = 0;
+	stages[stage].state = stage_waiting;
+	stage_count++;
+
+	libesoup_task_pending(init_task);
+	return(stage);
+}
+
+void libesoup_init_stage_done(uint8_t stage, result_t rc)
+{
+	if((stage < stage_count) && (stages[stage].state == stage_running)) {
+		stages[stage].rc = rc;
+		stages[stage].duration_us = (init_clock() - stages[stage].started) / init_cycles_per_us;
+		stages[stage].state = stage_finished;
+		libesoup_task_pending(init_task);
+	}
+}
+
+void libesoup_init_report(libesoup_stage_cb_t report)
+{
+	init_report = report;
+}
+
+boolean libesoup_init_complete(void)
+{
+	uint8_t loop;
+
+	for(loop = 0; loop < stage_count; loop++) {
+		if(stages[loop].state < stage_finished) return(FALSE);
+	}
+	return(TRUE);
+}
+
+uint32_t libesoup_init_stage_duration(uint8_t stage)
+{
+	if((stage < stage_count) && (stages[stage].state >= stage_finished)) {
+		return(stages[stage].duration_us);
+	}
+	return(0);
+}
+#endif // SYS_ASYNC_INIT
+
 result_t libesoup_init(void)
 {
 //	uint32_t loop;
@@ -143,39 +331,53 @@ result_t libesoup_init(void)
 
 #if defined(SYS_UART1) || defined(SYS_UART2) || defined(SYS_UART3) || defined(SYS_UART4)
 	uart_init();
-	__asm__ ("CLRWDT");
+	CLEAR_WDT
 #endif
 
 #ifdef SYS_SERIAL_LOGGING
         rc = serial_logging_init();
 	RC_CHECK
-        __asm__ ("CLRWDT");
+        CLEAR_WDT
 #endif
 
 #ifdef SYS_HW_TIMERS
 	hw_timer_init();
-	__asm__ ("CLRWDT");
+	CLEAR_WDT
+#endif
+
+#ifdef SYS_ASYNC_INIT
+	/*
+	 * The Hardware timers have just been reset so the stopwatch is gone
+	 */
+	init_timer = BAD_TIMER_ID;
+	stages[0].state = stage_running;
+	stages[0].started = init_clock();
 #endif
 
 #ifdef SYS_SW_TIMERS
 	sw_timer_init();
-	__asm__ ("CLRWDT");
+	CLEAR_WDT
+#endif
+
+#ifdef SYS_LOOP_STATS
+	rc = loop_stats_init();
+	RC_CHECK
 #endif
 
 #ifdef SYS_HW_RTC
 	rc = rtc_init();
 	RC_CHECK
-	__asm__ ("CLRWDT");
+	CLEAR_WDT
 #endif
 
 #ifdef SYS_JOBS
 	jobs_init();
-	__asm__ ("CLRWDT");
+	CLEAR_WDT
 #endif
 
 #if defined(SYS_SPI1) || defined(SYS_SPI2) || defined(SYS_SPI3)
         spi_init();
-	__asm__ ("CLRWDT");
+	CLEAR_WDT
 #endif
 
 #if defined(SYS_I2C_1) || defined(SYS_I2C_2) || defined(SYS_I2C_3)
@@ -185,14 +387,12 @@ result_t libesoup_init(void)
 
 #ifdef SYS_RAND
 	random_init();
-	__asm__ ("CLRWDT");
 	CLEAR_WDT
 #endif
 
 #ifdef SYS_CHANGE_NOTIFICATION
 	rc = change_notifier_init();
 	RC_CHECK
-	__asm__ ("CLRWDT");
 	CLEAR_WDT
 #endif // SYS_CHANGE_NOTIFICATION
 
@@ -225,30 +425,104 @@ result_t libesoup_init(void)
 	rc = loppers_init();
 #endif // SYS_LOOPER
 	CLEAR_WDT
+
+#ifdef SYS_ASYNC_INIT
+	/*
+	 * Any stages added before libesoup_init() are started by the first
+	 * call to libesoup_tasks()
+	 */
+	rc = board_init();
+	init_task = libesoup_task_register(init_poll, FALSE);
+#ifdef SYS_SD_CARD
+	if(rc >= 0) rc = sd_card_init_stage_add();
+#endif
+#ifdef SYS_SPIN_FV1
+	if(rc >= 0) rc = spin_init_stage_add();
+#endif
+	if(rc > 0) rc = 0;
+	libesoup_init_stage_done(0, rc);
+	return(rc);
+#else
 	return(board_init());
+#endif
+}
+
+int16_t libesoup_task_register(libesoup_task_t poll, boolean always)
+{
+	uint8_t loop;
+
+	/*
+	 * A module initialised again, by a second call to libesoup_init(),
+	 * gets back the task it registered the first time.
+	 */
+	for(loop = 0; loop < task_count; loop++) {
+		if(tasks[loop].poll == poll) {
+			tasks[loop].always = always;
+			return(loop);
+		}
+	}
+
+	if(task_count >= SYS_NUMBER_OF_TASKS) {
+		LOG_E("No task slot\n\r");
+		return(-ERR_NO_RESOURCES);
+	}
+
+	tasks[task_count].poll = poll;
+	tasks[task_count].always = always;
+	tasks[task_count].pending = FALSE;
+	return(task_count++);
+}
+
+void libesoup_task_pending(int16_t task)
+{
+	if((task >= 0) && (task < task_count)) {
+		tasks[task].pending = TRUE;
+		tasks_pending = TRUE;
+	}
 }
 
 result_t libesoup_tasks(void)
 {
 	result_t   rc = 0;
-#ifdef SYS_SW_TIMERS
-	if(timer_ticked) timer_tick();
+	result_t   task_rc;
+	uint8_t    loop;
+	boolean    flagged;
+#ifdef SYS_LOOP_STATS
+	loop_stats_loop();
 #endif
-#ifdef SYS_ADC
-	rc = adc_tasks();
-	RC_CHECK
+#ifdef SYS_SW_TIMERS
+	if(timer_ticked) {
+		timer_tick();
+#ifdef SYS_LOOP_STATS
+		loop_stats_timer_tick();
 #endif
-#ifdef SYS_CAN_BUS
-	can_tasks();
+	}
 #endif
-
-#ifdef SYS_USB_KEYBOARD
-	rc = usb_keyboard_tasks();
+#if defined(SYS_JOBS) && defined(SYS_JOBS_BUDGET)
+	rc = jobs_execute_budget(SYS_JOBS_BUDGET);
+	RC_CHECK
 #endif
 
-#if defined(SYS_I2C1) || defined(SYS_I2C2) || defined(SYS_I2C3)
-        rc = i2c_tasks();
-#endif
+	/*
+	 * The pending flags are cleared before calling a task so that an ISR
+	 * flagging more work during the call isn't lost. As tasks_pending has
+	 * already been cleared every flagged task is called, even if an earlier
+	 * one fails, and the first error is returned.
+	 */
+	flagged = tasks_pending;
+	if(flagged) tasks_pending = FALSE;
+
+	for(loop = 0; loop < task_count; loop++) {
+		if(tasks[loop].always || (flagged && tasks[loop].pending)) {
+			tasks[loop].pending = FALSE;
+			task_rc = tasks[loop].poll();
+			if(task_rc > 0) {
+				libesoup_task_pending(loop);
+			} else if((task_rc < 0) && (rc >= 0)) {
+				rc = task_rc;
+			}
+		}
+	}
 	CLEAR_WDT
 	return(rc);
 }
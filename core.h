@@ -55,6 +55,8 @@
 
 #if defined(__XC8)
 #define CLEAR_WDT   CLRWDT();
+#elif defined(ES_SFR_SIM)
+#define CLEAR_WDT   ClrWdt();
 #elif defined(XC16)
 #define CLEAR_WDT   __asm__ ("CLRWDT");
 #endif
@@ -146,4 +148,145 @@ typedef uint8_t    boolean;
 extern result_t libesoup_init(void);
 extern result_t libesoup_tasks(void);
 
+/**
+ * @ingroup Core
+ * @def     SYS_NUMBER_OF_TASKS
+ * @brief   Size of the table of poll functions called by libesoup_tasks()
+ *
+ * libesoup modules register their own poll functions so the table has to
+ * allow for those as well as any the application registers.
+ */
+#ifndef SYS_NUMBER_OF_TASKS
+#define SYS_NUMBER_OF_TASKS  8
+#endif
+
+/**
+ * @ingroup Core
+ * @brief   Poll function registered with libesoup_task_register()
+ *
+ * Returns a negative error code on failure, which libesoup_tasks() returns,
+ * zero if finished or a positive value to be polled again on the next loop.
+ */
+typedef result_t (*libesoup_task_t)(void);
+
+/**
+ * @ingroup Core
+ * @fn      libesoup_task_register()
+ * @brief   Add a poll function to the table called by libesoup_tasks()
+ *
+ * @param poll    Function to be called
+ * @param always  TRUE to call the function on every loop, FALSE to only call
+ *                it once flagged by libesoup_task_pending()
+ * @return        Identifier of the task for libesoup_task_pending() or
+ *                -ERR_NO_RESOURCES if the table is full
+ *
+ * Only polling modules with work to do keeps the main loop short when the
+ * system is idle. A module's ISR flags the module's task as pending when
+ * there's work for the main loop.
+ *
+ * Tasks may be registered before or after libesoup_init() and are never
+ * removed. Registering a function already in the table returns its existing
+ * identifier.
+ */
+extern int16_t  libesoup_task_register(libesoup_task_t poll, boolean always);
+
+/**
+ * @ingroup Core
+ * @fn      libesoup_task_pending()
+ * @brief   Flag that a task has work, safe to call from an ISR
+ *
+ * @param task    Identifier returned by libesoup_task_register()
+ *
+ * A negative identifier, the error returned by a failed registration, is
+ * ignored as there's no way of reporting it from an ISR.
+ */
+extern void     libesoup_task_pending(int16_t task);
+
+#ifdef SYS_ASYNC_INIT
+/**
+ * @ingroup Core
+ * @def     SYS_NUMBER_OF_INIT_STAGES
+ * @brief   Number of background initialisation stages which can be added
+ */
+#ifndef SYS_NUMBER_OF_INIT_STAGES
+#define SYS_NUMBER_OF_INIT_STAGES  4
+#endif
+
+/**
+ * @ingroup Core
+ * @brief   Start function of a background initialisation stage
+ *
+ * Returns a negative error code on failure or zero if the stage has already
+ * finished. A positive value means the stage is continuing in the background,
+ * typically on a Software timer or job, and will call
+ * libesoup_init_stage_done() when it finishes.
+ *
+ * The start function is called from libesoup_tasks() so must only start the
+ * stage off, any waits being left to timers or jobs, not block until done.
+ */
+typedef result_t (*libesoup_stage_t)(void);
+
+/**
+ * @ingroup Core
+ * @brief   Completion callback of an initialisation stage
+ *
+ * Called from libesoup_tasks() with the stage's identifier, its result and
+ * how long it took in micro Seconds. Stage 0 is libesoup_init() itself.
+ */
+typedef void (*libesoup_stage_cb_t)(uint8_t stage, result_t rc, uint32_t duration_us);
+
+/**
+ * @ingroup Core
+ * @fn      libesoup_init_stage_add()
+ * @brief   Add a slow initialisation stage to be run in the background
+ *
+ * @param start   Function starting the stage
+ * @param done    Completion callback, may be NULL
+ * @return        Identifier of the stage or -ERR_NO_RESOURCES
+ *
+ * With SYS_ASYNC_INIT slow devices, for example an SD Card, are initialised
+ * by stages run one after another from libesoup_tasks(), so the application
+ * can get on, for example joining the CAN Bus, as soon as libesoup_init()
+ * returns. Stages can be added before or after calling libesoup_init().
+ *
+ * libesoup_init() adds stages itself for the slow devices in the build,
+ * SYS_SD_CARD then SYS_SPIN_FV1, after any the application added first.
+ */
+extern int16_t  libesoup_init_stage_add(libesoup_stage_t start, libesoup_stage_cb_t done);
+
+/**
+ * @ingroup Core
+ * @fn      libesoup_init_stage_done()
+ * @brief   Signal that a stage continuing in the background has finished
+ *
+ * Safe to call from an ISR or timer expiry function, the completion callback
+ * is called later from libesoup_tasks().
+ */
+extern void     libesoup_init_stage_done(uint8_t stage, result_t rc);
+
+/**
+ * @ingroup Core
+ * @fn      libesoup_init_report()
+ * @brief   Set a function called as every initialisation stage finishes
+ *
+ * @param report  Called, after the stage's own completion callback, for each
+ *                stage including stage 0 and those added by libesoup_init()
+ *
+ * Can be set before calling libesoup_init().
+ */
+extern void     libesoup_init_report(libesoup_stage_cb_t report);
+
+/**
+ * @ingroup Core
+ * @brief   TRUE once every initialisation stage has finished
+ */
+extern boolean  libesoup_init_complete(void);
+
+/**
+ * @ingroup Core
+ * @brief   Duration of a finished stage in micro Seconds, zero if not finished
+ */
+extern uint32_t libesoup_init_stage_duration(uint8_t stage);
+#endif // SYS_ASYNC_INIT
+
 #endif // _CORE_H
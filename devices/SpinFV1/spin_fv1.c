@@ -26,24 +26,47 @@
 #include "libesoup/gpio/gpio.h"
 #include "libesoup/devices/SpinFV1/spin_fv1.h"
 #include "libesoup/timers/delay.h"
+#if defined(SYS_ASYNC_INIT) && defined(SYS_SPIN_FV1)
+#include "libesoup/timers/sw_timers.h"
 
-result_t spin_init_device(struct spin_fv1 *device)
+#ifndef SYS_SW_TIMERS
+#error libesoup_config.h should define SYS_SW_TIMERS (SYS_ASYNC_INIT runs the FV-1 init from SW timers)
+#endif
+#ifndef SYS_SPIN_FV1_TRIGGER
+#error libesoup_config.h should define SYS_SPIN_FV1_TRIGGER
+#endif
+/*
+ * The bit banged EEPROM is wired to RB8 and RB9
+ */
+#ifndef SYS_SPIN_FV1_SCL
+#define SYS_SPIN_FV1_SCL   RB8
+#endif
+#ifndef SYS_SPIN_FV1_SDA
+#define SYS_SPIN_FV1_SDA   RB9
+#endif
+#endif // SYS_ASYNC_INIT && SYS_SPIN_FV1
+
+#define SPIN_SETTLE_mS     5
+#define SPIN_TRIGGER_mS    100
+
+/*
+ * Device initialisation is split around the SPIN_SETTLE_mS wait after
+ * releasing SCL so the background init stage can time it with a SW timer.
+ */
+static result_t init_scl(struct spin_fv1 *device)
 {
 	result_t rc;
 
-	LOG_D("spin_init_device()\n\r");
-
 	rc = gpio_set(device->i2c_scl, GPIO_MODE_DIGITAL_INPUT | GPIO_MODE_OPENDRAIN, 1);
 	if (rc < 0) {
 		LOG_E("Failed to set SCL GPIO Pin\n\r");
-		return(rc);
 	}
+	return(rc);
+}
 
-	rc =  delay_mS(5);
-	if (rc < 0) {
-		LOG_E("Failed to delay\n\r");
-		return(rc);
-	}
+static result_t init_sda(struct spin_fv1 *device)
+{
+	result_t rc;
 
 	rc = gpio_set(device->i2c_sda, GPIO_MODE_DIGITAL_INPUT | GPIO_MODE_OPENDRAIN, 1);
 	if (rc < 0) {
@@ -59,6 +82,26 @@ result_t spin_init_device(struct spin_fv1 *device)
 	return(rc);
 }
 
+result_t spin_init_device(struct spin_fv1 *device)
+{
+	result_t rc;
+
+	LOG_D("spin_init_device()\n\r");
+
+	rc = init_scl(device);
+	if (rc < 0) {
+		return(rc);
+	}
+
+	rc =  delay_mS(SPIN_SETTLE_mS);
+	if (rc < 0) {
+		LOG_E("Failed to delay\n\r");
+		return(rc);
+	}
+
+	return(init_sda(device));
+}
+
 #if defined (ISR_DRIVEN)
 result_t spin_program(struct spin_fv1 *device, uint8_t *buffer)
 {
@@ -82,12 +125,13 @@ result_t spin_program(struct spin_fv1 *device, uint8_t *buffer)
 #endif  // ISR_DRIVEN
 
 #if defined (BIT_BANG)
-result_t spin_program(struct spin_fv1 *device, uint8_t *buffer)
+/*
+ * Hold the FV-1 in reset, trigger low, for SPIN_TRIGGER_mS before
+ * program_serve() releases it.
+ */
+static result_t program_trigger(struct spin_fv1 *device)
 {
 	result_t rc;
-	uint8_t  rx_byte;
-	uint8_t  tx_byte;
-	uint8_t  master_ack;
 
 	SCL_INPUT;
 	SDA_INPUT;
@@ -95,14 +139,20 @@ result_t spin_program(struct spin_fv1 *device, uint8_t *buffer)
 	rc = gpio_set(device->trigger, GPIO_MODE_DIGITAL_OUTPUT, 0);
 	if (rc < 0) {
 		LOG_E("Failed to set GPIO\n\r");
-		return(rc);
 	}
+	return(rc);
+}
 
-	rc = delay_mS(100);
-	if (rc < 0) {
-		LOG_E("Failed to delay\n\r");
-		return(rc);
-	}
+/*
+ * Release the trigger and act as the FV-1's EEPROM, bit banged with
+ * interrupts disabled, until it has read its program.
+ */
+static result_t program_serve(struct spin_fv1 *device, uint8_t *buffer)
+{
+	result_t rc;
+	uint8_t  rx_byte;
+	uint8_t  tx_byte;
+	uint8_t  master_ack;
 
 	rc = gpio_set(device->trigger, GPIO_MODE_DIGITAL_OUTPUT, 1);
 	if (rc < 0) {
@@ -336,4 +386,120 @@ result_t spin_program(struct spin_fv1 *device, uint8_t *buffer)
 		return(-ERR_IM_A_TEAPOT);
 	}
 }
+
+result_t spin_program(struct spin_fv1 *device, uint8_t *buffer)
+{
+	result_t rc;
+
+	rc = program_trigger(device);
+	if (rc < 0) {
+		return(rc);
+	}
+
+	rc = delay_mS(SPIN_TRIGGER_mS);
+	if (rc < 0) {
+		LOG_E("Failed to delay\n\r");
+		return(rc);
+	}
+
+	return(program_serve(device, buffer));
+}
+
+#if defined(SYS_ASYNC_INIT) && defined(SYS_SPIN_FV1)
+/*
+ * Background init stage, added by libesoup_init(), initialising the FV-1 on
+ * the SYS_SPIN_FV1_ pins and loading any program set by spin_set_program().
+ * The waits are single shot SW timers whose expiry function runs the next
+ * step. Serving the program still holds the main loop whilst the FV-1 reads
+ * it, which is only as long as that takes as it's been triggered.
+ */
+enum init_step {
+	init_settle,
+	init_trigger
+};
+
+static struct spin_fv1  init_device;
+static uint8_t         *init_program = NULL;
+static int16_t          init_stage = -1;
+static uint8_t          init_step;
+
+static void init_expiry(timer_id timer, union sigval data);
+
+static result_t init_next(enum init_step step, uint16_t duration)
+{
+	struct timer_req request;
+	timer_id         timer;
+
+	init_step = step;
+
+	request.period.units    = mSeconds;
+	request.period.duration = duration;
+	request.type            = single_shot_expiry;
+	request.exp_fn          = init_expiry;
+	request.data.sival_int  = 0;
+
+	timer = sw_timer_start(&request);
+	if (timer < 0) {
+		LOG_E("No SW Timer for FV-1 init\n\r");
+		return(timer);
+	}
+	return(SUCCESS);
+}
+
+static void init_expiry(timer_id timer, union sigval data)
+{
+	result_t rc;
+
+	if (init_step == init_settle) {
+		rc = init_sda(&init_device);
+		if ((rc >= 0) && init_program) {
+			rc = program_trigger(&init_device);
+			if (rc >= 0) {
+				rc = init_next(init_trigger, SPIN_TRIGGER_mS);
+				if (rc >= 0) return;
+			}
+		}
+	} else {
+		rc = program_serve(&init_device, init_program);
+	}
+	libesoup_init_stage_done((uint8_t)init_stage, rc);
+}
+
+static result_t init_start(void)
+{
+	result_t rc;
+
+	init_device.trigger = SYS_SPIN_FV1_TRIGGER;
+	init_device.i2c_sda = SYS_SPIN_FV1_SDA;
+	init_device.i2c_scl = SYS_SPIN_FV1_SCL;
+
+	rc = init_scl(&init_device);
+	RC_CHECK
+	rc = init_next(init_settle, SPIN_SETTLE_mS);
+	RC_CHECK
+	return(1);
+}
+
+void spin_set_program(uint8_t *buffer)
+{
+	init_program = buffer;
+}
+
+result_t spin_init_stage_add(void)
+{
+	result_t rc;
+
+	/*
+	 * Only the one stage if libesoup_init() is called again
+	 */
+	if (init_stage >= 0) {
+		return(init_stage);
+	}
+
+	rc = libesoup_init_stage_add(init_start, NULL);
+	RC_CHECK
+	init_stage = (int16_t)rc;
+	return(rc);
+}
+#endif // SYS_ASYNC_INIT && SYS_SPIN_FV1
 #endif // BIT_BANG
@@ -8,3 +8,13 @@ struct spin_fv1 {
 
 extern result_t spin_init_device(struct spin_fv1 *device);
 extern result_t spin_program(struct spin_fv1 *device, uint8_t *buffer);
+
+#if defined(SYS_ASYNC_INIT) && defined(SYS_SPIN_FV1)
+/*
+ * The FV-1 on the SYS_SPIN_FV1_ pins is initialised by a background init
+ * stage which libesoup_init() adds with spin_init_stage_add(). A program set
+ * with spin_set_program() before that stage runs is loaded by it as well.
+ */
+extern void     spin_set_program(uint8_t *buffer);
+extern result_t spin_init_stage_add(void);
+#endif
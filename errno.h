@@ -68,8 +68,13 @@ extern char *error_text(result_t);
  * loop on detecting an error from a previous API call.
  *
  * Once again this MACRO assumes that the type result_t variable is called 'rc'.
+ *
+ * On XC16 the error is flushed out of the serial log ring, which is otherwise
+ * only emptied by the main loop, before halting.
  */
-#if defined(SYS_SERIAL_LOGGING)
+#if defined(SYS_SERIAL_LOGGING) && defined(XC16)
+#define RC_CHECK_STOP           if (rc <0){ LOG_E("#%d %s-%d (%d)\n\r", rc, __FILE__, __LINE__); serial_log_flush(); while (1); }
+#elif defined(SYS_SERIAL_LOGGING)
 #define RC_CHECK_STOP           if (rc <0){ LOG_E("#%d %s-%d (%d)\n\r", rc, __FILE__, __LINE__); while (1); }
 #else
 #define RC_CHECK_STOP           if (rc <0) while (1);
@@ -39,7 +39,7 @@
 //#define SYS_SERIAL_LOGGING_BAUD           38400
 //#define SYS_SERIAL_LOGGING_BAUD           76800
 //#define SYS_SERIAL_LOGGING_BAUD           115200
-#define SYS_UART_TX_BUFFER_SIZE 300
+#define SYS_UART_TX_BUFFER_SIZE 256
 
 #endif // defined(SYS_SERIAL_LOGGING)
 
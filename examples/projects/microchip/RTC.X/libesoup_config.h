@@ -36,7 +36,7 @@
 
 #ifdef SYS_SERIAL_LOGGING
 #define SYS_UART
-#define SYS_UART_TX_BUFFER_SIZE 200
+#define SYS_UART_TX_BUFFER_SIZE 256
 #define SYS_SERIAL_LOGGING_BAUD 19200
 #define SYS_LOG_LEVEL LOG_DEBUG
 #endif // SYS_SERIAL_LOGGING
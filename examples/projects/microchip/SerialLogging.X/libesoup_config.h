@@ -46,7 +46,7 @@
 #define SYS_LOG_LEVEL LOG_DEBUG
 #define SYS_UART
 #define SYS_SERIAL_LOGGING_BAUD           19200
-#define SYS_UART_TX_BUFFER_SIZE 300
+#define SYS_UART_TX_BUFFER_SIZE 256
 
 #endif // defined(SYS_SERIAL_LOGGING)
 
@@ -66,6 +66,13 @@ struct adc_channel {
 struct   adc_channel channels[SYS_ADC_MAX_CH + 1];
 uint8_t  adc_active_count = 0;
 
+/*
+ * Task polled by libesoup_tasks() once the ISR has new samples
+ */
+static int16_t adc_task = -1;
+
+result_t adc_tasks(void);
+
 #ifdef SYS_ADC_MONITOR
 #ifndef SYS_ADC_PERIOD_UNITS
 #error libesoup_config.h file should define SYS_ADC_PERIOD_UNITS (Period Units for monitoring ADC Channels)
@@ -114,6 +121,7 @@ void __attribute__((__interrupt__, __no_auto_psv__)) _AD1Interrupt(void)
 #endif // SYS_ADC_AVERAGE_SAMPLES
 		}
 	}
+	libesoup_task_pending(adc_task);
 }
 #endif // (__dsPIC33EP256MU806__)
 
@@ -257,6 +265,9 @@ result_t adc_init(void)
 
 	adc_active_count = 0;
 
+	adc_task = libesoup_task_register(adc_tasks, FALSE);
+	if(adc_task < 0) return(adc_task);
+
 	for(loop = 0; loop < (SYS_ADC_MAX_CH + 1); loop++) {
 		channels[loop].pin = INVALID_GPIO_PIN;
 		channels[loop].last_reported = 0;
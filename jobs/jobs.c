@@ -20,6 +20,27 @@
  * You should have received a copy of the GNU Lesser General Public License
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  *
+ *******************************************************************************
+ *
+ * Jobs are queued in a bounded ring, with a sequence number in each slot,
+ * so that jobs_add() can be called from the main loop and any number of ISRs
+ * without disabling interrupts for the whole enqueue. A producer claims a slot
+ * by advancing the enqueue position with a compare and swap, fills it and
+ * then publishes it by updating the slot's sequence number. Jobs are only ever
+ * executed by the main loop, the single consumer.
+ *
+ * The ring is a power of two in size so positions wrap with a mask. If
+ * SYS_NUMBER_OF_JOBS is not a power of two it is rounded up.
+ *
+ * There is a ring for each of the SYS_JOBS_PRIORITIES priority levels and
+ * jobs_execute() always takes the next job from the highest priority ring
+ * which isn't empty. With SYS_JOBS_DEADLINES a job can be given a deadline,
+ * in system ticks, by which it should have started. Jobs are still executed
+ * in priority order but any that start late are counted.
+ *
+ * With SYS_JOBS_PAYLOAD_SIZE defined each slot also has room for a small
+ * payload, copied in by jobs_add_copy(), so an ISR can defer work on data
+ * without keeping a buffer of its own alive until the job has executed.
  */
 #include "libesoup_config.h"
 
@@ -34,67 +55,356 @@ static const char *TAG = "JOBS";
 #include "libesoup/errno.h"
 #include "libesoup/jobs/jobs.h"
 
+#if defined(ES_LINUX)
+#include <stdatomic.h>
+#endif
+
+#ifdef SYS_JOBS_PAYLOAD_SIZE
+#include <string.h>
+#endif
+
+#ifdef SYS_LOOP_STATS
+#include "libesoup/utils/loop_stats.h"
+#endif
+
+#ifdef SYS_JOBS_DEADLINES
+#include "libesoup/timers/sw_timers.h"
+
+#ifndef SYS_SW_TIMER_TICKS_COUNT
+#error libesoup_config.h should define SYS_SW_TIMER_TICKS_COUNT (SYS_JOBS_DEADLINES uses the system tick count)
+#endif
+#endif // SYS_JOBS_DEADLINES
+
+#if (SYS_JOBS_PRIORITIES < 1) || (SYS_JOBS_PRIORITIES > 4)
+#error SYS_JOBS_PRIORITIES should be between 1 and 4
+#endif
+
+#ifndef SYS_NUMBER_OF_JOBS
+#error libesoup_config.h file should define SYS_NUMBER_OF_JOBS (see libesoup/examples/libesoup_config.h)
+#endif
+
+#if (SYS_NUMBER_OF_JOBS <= 2)
+#define JOBS_RING_SIZE    2
+#elif (SYS_NUMBER_OF_JOBS <= 4)
+#define JOBS_RING_SIZE    4
+#elif (SYS_NUMBER_OF_JOBS <= 8)
+#define JOBS_RING_SIZE    8
+#elif (SYS_NUMBER_OF_JOBS <= 16)
+#define JOBS_RING_SIZE    16
+#elif (SYS_NUMBER_OF_JOBS <= 32)
+#define JOBS_RING_SIZE    32
+#elif (SYS_NUMBER_OF_JOBS <= 64)
+#define JOBS_RING_SIZE    64
+#elif (SYS_NUMBER_OF_JOBS <= 128)
+#define JOBS_RING_SIZE    128
+#elif (SYS_NUMBER_OF_JOBS <= 256)
+#define JOBS_RING_SIZE    256
+#else
+#error SYS_NUMBER_OF_JOBS should be no more than 256
+#endif
+
+#define JOBS_RING_MASK    (JOBS_RING_SIZE - 1)
+
+/*
+ * Positions and sequence numbers are free running 16 bit counts. On the
+ * PIC a 16 bit load or store is a single instruction so can't be torn by an
+ * ISR, on Linux C11 atomics are used.
+ *
+ * The volatile sequence numbers don't stop the compiler moving the slot's
+ * other fields past them, so on the PIC JOBS_BARRIER() follows each load
+ * which takes a slot over and precedes each store which hands one over. On
+ * Linux the acquire and release orderings do the same job.
+ */
+#if defined(XC16)
+typedef volatile uint16_t jobs_seq_t;
+
+#define SEQ_LOAD(x)       (x)
+#define SEQ_STORE(x, v)   (x) = (v)
+#define JOBS_BARRIER()    __asm__ __volatile__("" ::: "memory")
+#elif defined(ES_LINUX)
+typedef _Atomic uint16_t  jobs_seq_t;
+
+#define SEQ_LOAD(x)       atomic_load_explicit(&(x), memory_order_acquire)
+#define SEQ_STORE(x, v)   atomic_store_explicit(&(x), (v), memory_order_release)
+#define JOBS_BARRIER()
+#endif
+
 struct job {
-    void (*function)(void *);
-    void *data;
+	jobs_seq_t  seq;
+	void      (*function)(void *);
+	void       *data;
+#ifdef SYS_JOBS_DEADLINES
+	boolean     timed;
+	uint16_t    deadline;
+#endif
+#ifdef SYS_JOBS_PAYLOAD_SIZE
+	boolean     copied;
+	uint8_t     payload[SYS_JOBS_PAYLOAD_SIZE];
+#endif
+};
+
+struct job_ring {
+	struct job  jobs[JOBS_RING_SIZE];
+	jobs_seq_t  enqueue_pos;
+	uint16_t    dequeue_pos;        // Only used by the consumer
 };
 
-struct job jobs[SYS_NUMBER_OF_JOBS];
-static uint8_t write_index;
-static uint8_t read_index;
-static uint8_t count;
+static struct job_ring rings[SYS_JOBS_PRIORITIES];
+
+#ifdef SYS_JOBS_DEADLINES
+static uint16_t        deadline_misses;
+#endif
+
+/*
+ * Claim the enqueue position pos of a ring by moving it on by one. Returns
+ * FALSE, with *pos updated, if another producer got there first.
+ */
+static boolean claim(struct job_ring *ring, uint16_t *pos)
+{
+#if defined(XC16)
+	/*
+	 * dsPIC has no compare and swap instruction. Interrupts are only held
+	 * off for the compare and store, not the whole of jobs_add().
+	 */
+	boolean claimed = FALSE;
+
+	__builtin_disi(0x3FFF); /* disable interrupts */
+	if(ring->enqueue_pos == *pos) {
+		ring->enqueue_pos = *pos + 1;
+		claimed = TRUE;
+	} else {
+		*pos = ring->enqueue_pos;
+	}
+	__builtin_disi(0x0000); /* enable interrupts */
+	return(claimed);
+#elif defined(ES_LINUX)
+	return(atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, pos, (uint16_t)(*pos + 1),
+						     memory_order_relaxed, memory_order_relaxed));
+#endif
+}
 
 void jobs_init(void)
 {
 	uint16_t loop;
+	uint8_t  priority;
 
-        write_index = 0;
-        read_index = 0;
-        count = 0;
+	for(priority = 0; priority < SYS_JOBS_PRIORITIES; priority++) {
+		SEQ_STORE(rings[priority].enqueue_pos, 0);
+		rings[priority].dequeue_pos = 0;
 
-	for(loop = 0; loop < SYS_NUMBER_OF_JOBS; loop++) {
-		jobs[loop].function = NULL;
-		jobs[loop].data = NULL;
+		for(loop = 0; loop < JOBS_RING_SIZE; loop++) {
+			rings[priority].jobs[loop].function = NULL;
+			rings[priority].jobs[loop].data = NULL;
+			SEQ_STORE(rings[priority].jobs[loop].seq, loop);
+		}
+	}
+#ifdef SYS_JOBS_DEADLINES
+	deadline_misses = 0;
+#endif
+}
+
+/*
+ * Claim a slot in the ring for the given priority. Returns NULL if the ring
+ * is full, otherwise the slot which must be published with the returned
+ * position once filled.
+ */
+static struct job *reserve(uint8_t priority, uint16_t *pos)
+{
+	struct job_ring *ring;
+	struct job      *job;
+	int16_t          diff;
+
+	if(priority >= SYS_JOBS_PRIORITIES) priority = SYS_JOBS_PRIORITIES - 1;
+	ring = &rings[priority];
+
+	*pos = SEQ_LOAD(ring->enqueue_pos);
+	while(1) {
+		job = &ring->jobs[*pos & JOBS_RING_MASK];
+		diff = (int16_t)(SEQ_LOAD(job->seq) - *pos);
+
+		if(diff == 0) {
+			/*
+			 * Slot is free, try to claim it
+			 */
+			if(claim(ring, pos)) {
+				JOBS_BARRIER();
+#ifdef SYS_LOOP_STATS
+				loop_stats_queued((uint16_t)(*pos + 1 - ring->dequeue_pos));
+#endif
+				return(job);
+			}
+		} else if(diff < 0) {
+			/*
+			 * Slot still holds a job from the last time round
+			 */
+			return(NULL);
+		} else {
+			*pos = SEQ_LOAD(ring->enqueue_pos);
+		}
 	}
 }
 
 result_t jobs_add(void (*function)(void *), void *data)
 {
-	result_t rc = 0;
-
-        __builtin_disi(0x3FFF); /* disable interrupts */
-        jobs[write_index].function = function;
-        jobs[write_index].data = data;
-        write_index = (write_index + 1) % SYS_NUMBER_OF_JOBS;
-        count++;
-        __builtin_disi(0x0000); /* enable interrupts */
-	return(rc);
+	return(jobs_add_priority(function, data, JOBS_PRIORITY_LOWEST));
+}
+
+result_t jobs_add_priority(void (*function)(void *), void *data, uint8_t priority)
+{
+	struct job *job;
+	uint16_t    pos;
+
+	job = reserve(priority, &pos);
+	if(!job) return(-ERR_NO_RESOURCES);
+
+	job->function = function;
+	job->data = data;
+#ifdef SYS_JOBS_DEADLINES
+	job->timed = FALSE;
+#endif
+#ifdef SYS_JOBS_PAYLOAD_SIZE
+	job->copied = FALSE;
+#endif
+	JOBS_BARRIER();
+	SEQ_STORE(job->seq, pos + 1);
+	return(0);
+}
+
+#ifdef SYS_JOBS_PAYLOAD_SIZE
+result_t jobs_add_copy(void (*function)(void *), const void *payload, uint8_t len)
+{
+	struct job *job;
+	uint16_t    pos;
+
+	if(len > SYS_JOBS_PAYLOAD_SIZE) return(-ERR_BAD_INPUT_PARAMETER);
+
+	job = reserve(JOBS_PRIORITY_LOWEST, &pos);
+	if(!job) return(-ERR_NO_RESOURCES);
+
+	job->function = function;
+	job->data = NULL;
+#ifdef SYS_JOBS_DEADLINES
+	job->timed = FALSE;
+#endif
+	job->copied = TRUE;
+	memcpy(job->payload, payload, len);
+	JOBS_BARRIER();
+	SEQ_STORE(job->seq, pos + 1);
+	return(0);
+}
+#endif // SYS_JOBS_PAYLOAD_SIZE
+
+#ifdef SYS_JOBS_DEADLINES
+result_t jobs_add_deadline(void (*function)(void *), void *data, uint8_t priority, uint16_t ticks)
+{
+	struct job *job;
+	uint16_t    pos;
+
+	job = reserve(priority, &pos);
+	if(!job) return(-ERR_NO_RESOURCES);
+
+	job->function = function;
+	job->data = data;
+	job->timed = TRUE;
+	job->deadline = current_system_ticks() + ticks;
+#ifdef SYS_JOBS_PAYLOAD_SIZE
+	job->copied = FALSE;
+#endif
+	JOBS_BARRIER();
+	SEQ_STORE(job->seq, pos + 1);
+	return(0);
+}
+
+uint16_t jobs_deadline_misses(void)
+{
+	return(deadline_misses);
+}
+#endif // SYS_JOBS_DEADLINES
+
+/*
+ * Remove the job at the head of the highest priority ring which has one.
+ * Returns FALSE if all the rings are empty, or the next jobs are still being
+ * written by producers.
+ */
+static boolean take(struct job *taken)
+{
+	struct job_ring *ring;
+	struct job      *job;
+	uint8_t          priority;
+
+	priority = SYS_JOBS_PRIORITIES;
+	while(priority--) {
+		ring = &rings[priority];
+		job = &ring->jobs[ring->dequeue_pos & JOBS_RING_MASK];
+		if((int16_t)(SEQ_LOAD(job->seq) - (uint16_t)(ring->dequeue_pos + 1)) < 0) {
+			continue;
+		}
+		JOBS_BARRIER();
+
+		taken->function = job->function;
+		taken->data = job->data;
+#ifdef SYS_JOBS_DEADLINES
+		taken->timed = job->timed;
+		taken->deadline = job->deadline;
+#endif
+#ifdef SYS_JOBS_PAYLOAD_SIZE
+		taken->copied = job->copied;
+		if(job->copied) {
+			memcpy(taken->payload, job->payload, SYS_JOBS_PAYLOAD_SIZE);
+		}
+#endif
+		JOBS_BARRIER();
+		SEQ_STORE(job->seq, ring->dequeue_pos + JOBS_RING_SIZE);
+		ring->dequeue_pos++;
+		return(TRUE);
+	}
+	return(FALSE);
 }
 
 result_t jobs_execute(void)
 {
-	result_t  rc = 0;
-        void    (*function)(void *);
-        void     *data;
-
-	while(count) {
-                if(jobs[read_index].function) {
-                        function = jobs[read_index].function;
-                        data     = jobs[read_index].data;
-
-                        jobs[read_index].function = NULL;
-                        jobs[read_index].data = NULL;
-                        read_index = (read_index + 1) % SYS_NUMBER_OF_JOBS;
-                        count--;
-
-                        function(data);
-                } else {
-                        LOG_E("Bad job at %d\n\r", read_index);
-                        rc = -ERR_GENERAL_ERROR;
-                }
+	return(jobs_execute_budget(0));
+}
+
+result_t jobs_execute_budget(uint16_t budget)
+{
+	result_t    rc = 0;
+	struct job  job;
+	uint16_t    executed = 0;
+#ifdef SYS_LOOP_STATS
+	uint32_t    start;
+#endif
+
+	while((!budget || (executed < budget)) && take(&job)) {
+		executed++;
+
+#ifdef SYS_JOBS_DEADLINES
+		if(job.timed && ((int16_t)(current_system_ticks() - job.deadline) > 0)) {
+			deadline_misses++;
+		}
+#endif
+#ifdef SYS_JOBS_PAYLOAD_SIZE
+		/*
+		 * The slot has been freed so the payload is passed from the
+		 * copy taken of the job.
+		 */
+		if(job.copied) job.data = job.payload;
+#endif
+		if(job.function) {
+#ifdef SYS_LOOP_STATS
+			start = loop_stats_clock();
+			job.function(job.data);
+			loop_stats_job(start);
+#else
+			job.function(job.data);
+#endif
+		} else {
+			LOG_E("Bad job\n\r");
+			rc = -ERR_GENERAL_ERROR;
+		}
 	}
 
 	return(rc);
 }
 
-#endif // SYS_JOBS
\ No newline at end of file
+#endif // SYS_JOBS
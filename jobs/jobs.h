@@ -26,12 +26,105 @@
 
 #ifdef SYS_JOBS
 
+/*
+ * Number of job priority levels, each with its own queue of
+ * SYS_NUMBER_OF_JOBS jobs. Without the switch there is a single level.
+ */
+#ifndef SYS_JOBS_PRIORITIES
+#define SYS_JOBS_PRIORITIES     1
+#endif
+
+/**
+ * \brief Lowest job priority, used by jobs_add()
+ */
+#define JOBS_PRIORITY_LOWEST    0
+
+/**
+ * \brief Highest job priority, higher priorities passed in are reduced to it.
+ */
+#define JOBS_PRIORITY_HIGHEST   (SYS_JOBS_PRIORITIES - 1)
+
 /**
  * \
  */
 extern void     jobs_init(void);
+
+/**
+ * \brief Queue a job to be executed by the main loop.
+ *
+ * \param function Function to be executed
+ * \param data     Passed to the function when executed
+ *
+ * \return 0 on success, -ERR_NO_RESOURCES if the queue is full
+ *
+ * Safe to call from ISRs as well as the main loop.
+ */
 extern result_t jobs_add(void (*function)(void *), void *data);
+
+/**
+ * \brief Queue a job at the given priority.
+ *
+ * \param function Function to be executed
+ * \param data     Passed to the function when executed
+ * \param priority JOBS_PRIORITY_LOWEST to JOBS_PRIORITY_HIGHEST
+ *
+ * \return 0 on success, -ERR_NO_RESOURCES if the priority's queue is full
+ *
+ * No job is executed whilst there is a job of higher priority queued.
+ */
+extern result_t jobs_add_priority(void (*function)(void *), void *data, uint8_t priority);
+
+#ifdef SYS_JOBS_PAYLOAD_SIZE
+/**
+ * \brief Queue a job with a copy of up to SYS_JOBS_PAYLOAD_SIZE bytes of data.
+ *
+ * \param function Function to be executed
+ * \param payload  Data copied into the job's slot in the queue
+ * \param len      Number of bytes of payload
+ *
+ * \return 0 on success, -ERR_NO_RESOURCES if the queue is full or
+ *         -ERR_BAD_INPUT_PARAMETER if the payload is too big
+ *
+ * The function is passed a pointer to a copy of the payload which is only
+ * valid for the duration of the call. The caller's buffer can be reused as
+ * soon as jobs_add_copy() returns. Queued at the lowest priority.
+ */
+extern result_t jobs_add_copy(void (*function)(void *), const void *payload, uint8_t len);
+#endif // SYS_JOBS_PAYLOAD_SIZE
+
+#ifdef SYS_JOBS_DEADLINES
+/**
+ * \brief Queue a job which should start within the given number of ticks.
+ *
+ * \param function Function to be executed
+ * \param data     Passed to the function when executed
+ * \param priority JOBS_PRIORITY_LOWEST to JOBS_PRIORITY_HIGHEST
+ * \param ticks    System ticks from now by which the job should start
+ *
+ * \return 0 on success, -ERR_NO_RESOURCES if the priority's queue is full
+ *
+ * The deadline doesn't change the order jobs are executed in, a job which
+ * starts after its deadline is still executed and counted as a miss.
+ */
+extern result_t jobs_add_deadline(void (*function)(void *), void *data, uint8_t priority, uint16_t ticks);
+
+/**
+ * \brief Number of jobs which have started after their deadline.
+ */
+extern uint16_t jobs_deadline_misses(void);
+#endif // SYS_JOBS_DEADLINES
 extern result_t jobs_execute(void);
 
+/**
+ * \brief Execute queued jobs, at most budget of them.
+ *
+ * \param budget Maximum number of jobs to execute, zero for no limit.
+ *
+ * Called by libesoup_tasks() if libesoup_config.h defines SYS_JOBS_BUDGET, so
+ * a burst of jobs, for example deferred Software timer expiries, is spread
+ * over a number of main loop iterations.
+ */
+extern result_t jobs_execute_budget(uint16_t budget);
+
 #endif // SYS_JOBS
 #endif // __JOBS_H
@@ -0,0 +1,28 @@
+/*
+ * libesoup_config.h libesoup/jobs/test/libesoup_config_jobs_stress.h
+ *
+ * Host (ES_LINUX) configuration for the jobs queue stress test. Copy to a
+ * build directory as libesoup_config.h, see main_jobs_stress.c
+ */
+#ifndef _LIBESOUP_CONFIG_H
+#define _LIBESOUP_CONFIG_H
+
+#ifndef ES_LINUX
+#define ES_LINUX
+#endif
+
+#define SYS_TEST_JOBS_STRESS
+
+#define SYS_JOBS
+#define SYS_NUMBER_OF_JOBS     64
+#define SYS_JOBS_PRIORITIES    4
+#define SYS_JOBS_PAYLOAD_SIZE  16
+
+#define LOG_D(...)
+#define LOG_I(...)
+#define LOG_W(...)
+#define LOG_E(...)
+
+#include "libesoup/core.h"
+
+#endif // _LIBESOUP_CONFIG_H
@@ -0,0 +1,152 @@
+/*
+ * libesoup/jobs/test/main_jobs_stress.c
+ *
+ * Host stress test of the jobs queue. A number of producer threads, standing
+ * in for ISRs, each queue millions of jobs whilst a single consumer thread,
+ * the main loop, executes them. Every job must be executed exactly once and
+ * each producer's jobs in the order they were queued. Producers queue at
+ * different priorities, and the first producer copies its data into the queue
+ * with jobs_add_copy().
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir stress && cp libesoup/jobs/test/libesoup_config_jobs_stress.h stress/libesoup_config.h
+ *     gcc -O2 -pthread -Istress -I. libesoup/jobs/test/main_jobs_stress.c libesoup/jobs/jobs.c -o stress/jobs_stress
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_JOBS_STRESS
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "libesoup/jobs/jobs.h"
+
+#define PRODUCERS          4
+#define JOBS_PER_PRODUCER  2000000UL
+
+static uint32_t     next_expected[PRODUCERS];
+static uint32_t     errors;
+static atomic_int   producers_done;
+static uint32_t     full_count[PRODUCERS];
+
+/*
+ * Job data encodes the producer in the top byte and its sequence number in
+ * the rest.
+ */
+static void job(void *data)
+{
+	uintptr_t value = (uintptr_t)data;
+	uint8_t   producer = (uint8_t)(value >> 24);
+	uint32_t  seq = (uint32_t)(value & 0xffffff);
+
+	if(seq != (next_expected[producer] & 0xffffff)) {
+		if(errors++ < 10) {
+			printf("Producer %u expected %u got %u\n", producer, next_expected[producer] & 0xffffff, seq);
+		}
+	}
+	next_expected[producer]++;
+}
+
+/*
+ * Job queued by jobs_add_copy(), payload is the same value as job() is given
+ */
+static void copy_job(void *data)
+{
+	uintptr_t value;
+
+	memcpy(&value, data, sizeof(value));
+	job((void *)value);
+}
+
+static void *producer(void *arg)
+{
+	uintptr_t id = (uintptr_t)arg;
+	uint32_t  loop;
+	void     *data;
+
+	for(loop = 0; loop < JOBS_PER_PRODUCER; loop++) {
+		data = (void *)((id << 24) | (loop & 0xffffff));
+		while(((id == 0) ? jobs_add_copy(copy_job, &data, sizeof(data))
+			         : jobs_add_priority(job, data, (uint8_t)(id % SYS_JOBS_PRIORITIES))) == -ERR_NO_RESOURCES) {
+			full_count[id]++;
+			sched_yield();
+		}
+	}
+	atomic_fetch_add(&producers_done, 1);
+	return(NULL);
+}
+
+/*
+ * With nothing else running jobs must come out highest priority first.
+ */
+static uint8_t order[4];
+static uint8_t order_count;
+
+static void order_job(void *data)
+{
+	order[order_count++] = (uint8_t)(uintptr_t)data;
+}
+
+static uint32_t priority_order(void)
+{
+	uintptr_t priority;
+
+	jobs_init();
+	order_count = 0;
+	for(priority = 0; priority < SYS_JOBS_PRIORITIES; priority++) {
+		jobs_add_priority(order_job, (void *)priority, (uint8_t)priority);
+	}
+	jobs_execute();
+
+	for(priority = 0; priority < SYS_JOBS_PRIORITIES; priority++) {
+		if(order[priority] != (SYS_JOBS_PRIORITIES - 1 - priority)) {
+			printf("Priority order wrong\n");
+			return(1);
+		}
+	}
+	return(0);
+}
+
+int main(void)
+{
+	pthread_t threads[PRODUCERS];
+	uintptr_t loop;
+	uint32_t  fulls = 0;
+
+	errors = priority_order();
+	jobs_init();
+
+	for(loop = 0; loop < PRODUCERS; loop++) {
+		pthread_create(&threads[loop], NULL, producer, (void *)loop);
+	}
+
+	/*
+	 * This thread is the consumer, keep going until the producers have
+	 * finished and the queue is drained.
+	 */
+	while(atomic_load(&producers_done) < PRODUCERS) {
+		jobs_execute();
+		sched_yield();
+	}
+	jobs_execute();
+
+	for(loop = 0; loop < PRODUCERS; loop++) {
+		pthread_join(threads[loop], NULL);
+		fulls += full_count[loop];
+		if(next_expected[loop] != JOBS_PER_PRODUCER) {
+			printf("Producer %u: %u of %lu jobs executed\n", (unsigned)loop, next_expected[loop], JOBS_PER_PRODUCER);
+			errors++;
+		}
+	}
+
+	printf("%d producers x %lu jobs, queue full %u times, %u errors\n",
+	       PRODUCERS, JOBS_PER_PRODUCER, fulls, errors);
+	return(errors ? 1 : 0);
+}
+
+#endif // SYS_TEST_JOBS_STRESS
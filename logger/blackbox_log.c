@@ -0,0 +1,569 @@
+/**
+ * @file libesoup/logger/blackbox_log.c
+ *
+ * @author John Whitmore
+ *
+ * @brief Persistent black box log of binary log records on an SD Card
+ *
+ * Copyright 2017-2018 electronicSoup Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the version 2 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ *
+ * The sector layout is described in libesoup/logger/blackbox_log.h.
+ *
+ * There are two RAM sectors. Records go in to the active one and when a
+ * record doesn't fit the active sector is handed to the write task and the
+ * other becomes active, so logging carries on whilst the full sector is
+ * written. Records are only dropped if the active sector fills before the
+ * full one has been written.
+ *
+ * The SD Card must be initialised, sd_card_init(), before blackbox_log_init()
+ * which reads the ring to find where to carry on from. With SYS_ASYNC_INIT
+ * that's once sd_card_ready(), for example from the init report function.
+ */
+#include <string.h>
+#include "libesoup_config.h"
+
+#ifdef SYS_BLACKBOX_LOG
+
+#ifndef SYS_SD_CARD
+#error libesoup_config.h should define SYS_SD_CARD for SYS_BLACKBOX_LOG
+#endif
+
+#ifndef SYS_SERIAL_LOGGING_BINARY
+#error libesoup_config.h should define SYS_SERIAL_LOGGING_BINARY for SYS_BLACKBOX_LOG
+#endif
+
+#ifndef SYS_SW_TIMERS
+#error libesoup_config.h should define SYS_SW_TIMERS for SYS_BLACKBOX_LOG
+#endif
+
+#if !defined(SYS_BLACKBOX_LOG_FIRST_SECTOR) || !defined(SYS_BLACKBOX_LOG_SECTORS)
+#error libesoup_config.h should define the SD Card sectors, SYS_BLACKBOX_LOG_FIRST_SECTOR and SYS_BLACKBOX_LOG_SECTORS, of the black box log
+#endif
+
+#if (SYS_BLACKBOX_LOG_SECTORS < 2)
+#error SYS_BLACKBOX_LOG_SECTORS should be at least 2
+#endif
+
+#ifndef SYS_BLACKBOX_LOG_LEVEL
+#define SYS_BLACKBOX_LOG_LEVEL          SYS_LOG_LEVEL
+#endif
+
+#ifndef SYS_BLACKBOX_LOG_FLUSH_TIMEOUT
+#define SYS_BLACKBOX_LOG_FLUSH_TIMEOUT  1000
+#endif
+
+#define DEBUG_FILE
+static const char *TAG = "BLACKBOX";
+#include "libesoup/logger/serial_log.h"
+
+#include "libesoup/errno.h"
+#include "libesoup/comms/spi/devices/sd_card.h"
+#include "libesoup/timers/sw_timers.h"
+#include "libesoup/logger/blackbox_log.h"
+
+#define RECORDS_SIZE     (SD_CARD_BLOCK_SIZE - BLACKBOX_LOG_HEADER_SIZE)
+
+struct blackbox_sector {
+	uint8_t   data[SD_CARD_BLOCK_SIZE];
+	uint32_t  sequence;
+	uint16_t  length;       ///< Header and records
+	uint16_t  dropped;
+	boolean   dirty;        ///< Records not yet written to the card
+};
+
+static struct blackbox_sector sectors[2];
+static uint8_t  active = 0;
+static boolean  full = FALSE;           ///< Other sector waiting to be written
+static boolean  flush_requested = FALSE;
+static uint16_t dropped = 0;
+static boolean  ready = FALSE;
+static int16_t  write_task = -1;
+static timer_id flush_timer = BAD_TIMER_ID;
+
+/*
+ * Read out state. The read buffer is also used to scan the ring on boot.
+ */
+static uint8_t  read_data[SD_CARD_BLOCK_SIZE];
+static boolean  dumping = FALSE;
+static int16_t  dump_task = -1;
+static uint32_t dump_sequence;
+static uint32_t dump_last;
+static uint16_t dump_offset;
+static uint16_t dump_length;
+
+static result_t blackbox_write(void);
+static result_t blackbox_dump(void);
+
+static uint32_t get_le(uint8_t *ptr, uint8_t size)
+{
+	uint32_t value = 0;
+
+	while(size--) {
+		value = (value << 8) | ptr[size];
+	}
+	return(value);
+}
+
+static void put_le(uint8_t *ptr, uint32_t value, uint8_t size)
+{
+	while(size--) {
+		*ptr++ = (uint8_t)value;
+		value = value >> 8;
+	}
+}
+
+/*
+ * Fletcher-16 checksum of the header, up to the checksum itself, and the
+ * records following it
+ */
+static uint16_t sector_checksum(uint8_t *data, uint16_t len)
+{
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	uint16_t index;
+
+	for(index = 0; index < (BLACKBOX_LOG_HEADER_SIZE + len); index++) {
+		if(index == (BLACKBOX_LOG_HEADER_SIZE - 2)) {
+			index = BLACKBOX_LOG_HEADER_SIZE;
+			if(len == 0) break;
+		}
+		sum1 = (sum1 + data[index]) % 255;
+		sum2 = (sum2 + sum1) % 255;
+	}
+	return((sum2 << 8) | sum1);
+}
+
+static uint32_t sector_address(uint32_t sequence)
+{
+	return(SYS_BLACKBOX_LOG_FIRST_SECTOR + (sequence % SYS_BLACKBOX_LOG_SECTORS));
+}
+
+/*
+ * Read a sector of the ring in to read_data, returning TRUE with its
+ * sequence number if it holds a valid black box sector.
+ */
+static result_t read_sector(uint32_t address, uint32_t *sequence)
+{
+	result_t rc;
+	uint16_t length;
+
+	rc = sd_card_read(address, read_data);
+	RC_CHECK
+
+	if(get_le(&read_data[0], 2) != BLACKBOX_LOG_MAGIC) {
+		return(FALSE);
+	}
+
+	length = (uint16_t)get_le(&read_data[6], 2);
+	if(length > RECORDS_SIZE) {
+		return(FALSE);
+	}
+
+	if(sector_checksum(read_data, length) != get_le(&read_data[10], 2)) {
+		return(FALSE);
+	}
+
+	*sequence = get_le(&read_data[2], 4);
+	return(TRUE);
+}
+
+/*
+ * Start a RAM sector, the next in the ring
+ */
+static void sector_start(struct blackbox_sector *sector, uint32_t sequence)
+{
+	memset(sector->data, 0x00, SD_CARD_BLOCK_SIZE);
+	sector->sequence = sequence;
+	sector->length   = BLACKBOX_LOG_HEADER_SIZE;
+	sector->dropped  = dropped;
+	sector->dirty    = FALSE;
+	dropped = 0;
+}
+
+/*
+ * Find the newest sector of the ring and start the next one.
+ *
+ * The sectors from the first of the ring up to the newest hold consecutive
+ * sequence numbers. Those after it are either unused or a lap older, so the
+ * newest is the last sector whose sequence is its offset from the first's,
+ * which a binary search finds. If the first sector isn't valid, a reset
+ * during its write, every sector is read instead.
+ */
+result_t blackbox_log_init(void)
+{
+	result_t  rc;
+	uint32_t  first;
+	uint32_t  sequence;
+	uint32_t  newest = 0;
+	boolean   found = FALSE;
+	uint16_t  low;
+	uint16_t  high;
+	uint16_t  middle;
+
+	ready = FALSE;
+	dumping = FALSE;
+	full = FALSE;
+	flush_requested = FALSE;
+	dropped = 0;
+	sw_timer_cancel(&flush_timer);
+
+	rc = read_sector(SYS_BLACKBOX_LOG_FIRST_SECTOR, &first);
+	RC_CHECK
+
+	if(rc) {
+		low  = 0;
+		high = SYS_BLACKBOX_LOG_SECTORS - 1;
+		while(low < high) {
+			middle = low + ((high - low + 1) / 2);
+			rc = read_sector(SYS_BLACKBOX_LOG_FIRST_SECTOR + middle, &sequence);
+			RC_CHECK
+			if(rc && ((sequence - first) == middle)) {
+				low = middle;
+			} else {
+				high = middle - 1;
+			}
+		}
+		newest = first + low;
+		found = TRUE;
+	} else {
+		for(low = 1; low < SYS_BLACKBOX_LOG_SECTORS; low++) {
+			rc = read_sector(SYS_BLACKBOX_LOG_FIRST_SECTOR + low, &sequence);
+			RC_CHECK
+			if(rc && (!found || ((int32_t)(sequence - newest) > 0))) {
+				newest = sequence;
+				found = TRUE;
+			}
+		}
+	}
+
+	active = 0;
+	sector_start(&sectors[active], found ? newest + 1 : 0);
+	LOG_D("Black box carries on at sector %ld\n\r", sectors[active].sequence);
+
+	rc = libesoup_task_register(blackbox_write, FALSE);
+	RC_CHECK
+	write_task = rc;
+
+	rc = libesoup_task_register(blackbox_dump, FALSE);
+	RC_CHECK
+	dump_task = rc;
+
+	ready = TRUE;
+	return(0);
+}
+
+static void exp_flush_timeout(timer_id timer __attribute__((unused)), union sigval data __attribute__((unused)))
+{
+	flush_timer = BAD_TIMER_ID;
+	blackbox_log_flush();
+}
+
+/*
+ * Only called from the write task, so the check of flush_timer and setting
+ * it can't be split by a log call from an ISR starting a second timer.
+ */
+static void start_flush_timer(void)
+{
+	result_t          rc;
+	struct timer_req  request;
+
+	if(flush_timer != BAD_TIMER_ID) {
+		return;
+	}
+
+	request.period.units    = mSeconds;
+	request.period.duration = SYS_BLACKBOX_LOG_FLUSH_TIMEOUT;
+	request.type            = single_shot_expiry;
+	request.exp_fn          = exp_flush_timeout;
+	request.data.sival_int  = 0;
+
+	rc = sw_timer_start(&request);
+	if(rc >= 0) {
+		flush_timer = rc;
+	}
+}
+
+/*
+ * Add a binary log record, built by serial_log_binary(), to the active RAM
+ * sector. Never waits on the SD Card so may be called from any context.
+ */
+result_t blackbox_log_put(uint8_t level, uint8_t *record, uint16_t len)
+{
+	struct blackbox_sector *sector;
+	result_t                rc = 0;
+
+	if(!ready) {
+		return(-ERR_NOT_READY);
+	}
+
+	if(level > SYS_BLACKBOX_LOG_LEVEL) {
+		return(0);
+	}
+
+	if((len == 0) || (len > 0xff) || ((1 + len) > RECORDS_SIZE)) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	INTERRUPTS_DISABLED
+	sector = &sectors[active];
+	if((sector->length + 1 + len) > SD_CARD_BLOCK_SIZE) {
+		if(full) {
+			if(dropped < 0xffff) dropped++;
+			rc = -ERR_BUFFER_OVERFLOW;
+		} else {
+			full = TRUE;
+			active = !active;
+			sector_start(&sectors[active], sector->sequence + 1);
+			sector = &sectors[active];
+		}
+	}
+	if(rc == 0) {
+		sector->data[sector->length++] = (uint8_t)len;
+		memcpy(&sector->data[sector->length], record, len);
+		sector->length += len;
+		sector->dirty = TRUE;
+		if(level == LOG_ERROR) {
+			flush_requested = TRUE;
+		}
+	}
+	INTERRUPTS_ENABLED
+
+	/*
+	 * The write task also starts the flush timeout for the first record
+	 * added since the last write.
+	 */
+	if(full || flush_requested || (flush_timer == BAD_TIMER_ID)) {
+		libesoup_task_pending(write_task);
+	}
+	return(rc);
+}
+
+/*
+ * Write the active RAM sector, as far as it's filled, to the card
+ */
+result_t blackbox_log_flush(void)
+{
+	if(!ready) {
+		return(-ERR_NOT_READY);
+	}
+
+	flush_requested = TRUE;
+	libesoup_task_pending(write_task);
+	return(0);
+}
+
+/*
+ * Sequence number of the active sector
+ */
+uint32_t blackbox_log_sequence(void)
+{
+	return(sectors[active].sequence);
+}
+
+/*
+ * Fill in the header of a RAM sector and write it to the card. Records
+ * added whilst it's being written are left dirty for the next write.
+ */
+static result_t sector_write(struct blackbox_sector *sector)
+{
+	result_t  rc;
+	uint16_t  length;
+
+	INTERRUPTS_DISABLED
+	length = sector->length;
+	sector->dirty = FALSE;
+	INTERRUPTS_ENABLED
+
+	put_le(&sector->data[0], BLACKBOX_LOG_MAGIC, 2);
+	put_le(&sector->data[2], sector->sequence, 4);
+	put_le(&sector->data[6], length - BLACKBOX_LOG_HEADER_SIZE, 2);
+	put_le(&sector->data[8], sector->dropped, 2);
+	put_le(&sector->data[10], sector_checksum(sector->data, length - BLACKBOX_LOG_HEADER_SIZE), 2);
+
+	rc = sd_card_write(sector_address(sector->sequence), sector->data);
+	if(rc < 0) {
+		sector->dirty = TRUE;
+	}
+	return(rc);
+}
+
+/*
+ * Task writing the full RAM sector, and the active one when a flush is due.
+ * A failed write is retried on the flush timeout, as are records left in
+ * the active sector.
+ */
+static result_t blackbox_write(void)
+{
+	result_t rc;
+
+	if(full) {
+		rc = sector_write(&sectors[!active]);
+		if(rc < 0) {
+			LOG_E("Write failed %d\n\r", rc);
+			start_flush_timer();
+			return(rc);
+		}
+		full = FALSE;
+	}
+
+	if(flush_requested) {
+		flush_requested = FALSE;
+		sw_timer_cancel(&flush_timer);
+		if(sectors[active].dirty) {
+			rc = sector_write(&sectors[active]);
+			if(rc < 0) {
+				LOG_E("Write failed %d\n\r", rc);
+				start_flush_timer();
+				return(rc);
+			}
+		}
+	}
+
+	if(sectors[active].dirty) {
+		start_flush_timer();
+	}
+	return(0);
+}
+
+/*
+ * Send the whole ring, oldest sector first, out the serial logging port.
+ * The RAM sectors are written first so the read out ends with the newest
+ * record. Returns -ERR_BUSY if a read out is already running.
+ */
+result_t blackbox_log_dump(void)
+{
+	if(!ready) {
+		return(-ERR_NOT_READY);
+	}
+
+	if(dumping) {
+		return(-ERR_BUSY);
+	}
+
+	blackbox_log_flush();
+
+	dump_last = sectors[active].sequence;
+	if(dump_last >= (SYS_BLACKBOX_LOG_SECTORS - 1)) {
+		dump_sequence = dump_last - (SYS_BLACKBOX_LOG_SECTORS - 1);
+	} else {
+		dump_sequence = 0;
+	}
+	dump_offset = 0;
+	dump_length = 0;
+	dumping = TRUE;
+	libesoup_task_pending(dump_task);
+	return(0);
+}
+
+/*
+ * Warning line for the count of records dropped before a sector. It's
+ * text, which es_log_decode.py passes through.
+ */
+static result_t dump_dropped(uint16_t count)
+{
+	uint8_t   line[40];
+	uint8_t   digits[5];
+	uint8_t   length = 0;
+	uint8_t   number = 0;
+	char     *text;
+
+	text = "W-BLACKBOX:";
+	while(*text) line[length++] = *text++;
+	do {
+		digits[number++] = '0' + (count % 10);
+		count = count / 10;
+	} while(count);
+	while(number) line[length++] = digits[--number];
+	text = " records dropped\n\r";
+	while(*text) line[length++] = *text++;
+
+	return(serial_log_write(line, length));
+}
+
+/*
+ * Read out task, a sector is read whenever the last has been sent. Records
+ * are only sent as the serial port has room so the task stays pending, by
+ * returning 1, until the read out is finished.
+ */
+static result_t blackbox_dump(void)
+{
+	result_t  rc;
+	uint32_t  sequence;
+	uint8_t   length;
+
+	if(!dumping) {
+		return(0);
+	}
+
+	/*
+	 * Wait for the RAM sectors to be written, the write task is first
+	 */
+	if(full || flush_requested) {
+		return(1);
+	}
+
+	while(1) {
+		if(dump_offset >= dump_length) {
+			if((int32_t)(dump_sequence - dump_last) > 0) {
+				dumping = FALSE;
+				return(0);
+			}
+
+			rc = read_sector(sector_address(dump_sequence), &sequence);
+			if(rc < 0) {
+				LOG_E("Read failed %d\n\r", rc);
+				dumping = FALSE;
+				return(rc);
+			}
+			dump_sequence++;
+
+			if(!rc || (sequence != (dump_sequence - 1))) {
+				continue;
+			}
+
+			dump_offset = BLACKBOX_LOG_HEADER_SIZE;
+			dump_length = BLACKBOX_LOG_HEADER_SIZE + (uint16_t)get_le(&read_data[6], 2);
+
+			if(get_le(&read_data[8], 2)) {
+				rc = dump_dropped((uint16_t)get_le(&read_data[8], 2));
+				if(rc == -ERR_BUSY) {
+					/*
+					 * Read it again when there's room
+					 */
+					dump_sequence--;
+					dump_length = 0;
+					return(1);
+				}
+			}
+			continue;
+		}
+
+		length = read_data[dump_offset];
+		if((length == 0) || ((dump_offset + 1 + length) > dump_length)) {
+			dump_offset = dump_length;
+			continue;
+		}
+
+		rc = serial_log_write(&read_data[dump_offset + 1], length);
+		if(rc == -ERR_BUSY) {
+			return(1);
+		}
+		dump_offset += 1 + length;
+	}
+}
+
+#endif // SYS_BLACKBOX_LOG
@@ -0,0 +1,68 @@
+/**
+ *
+ * @file libesoup/logger/blackbox_log.h
+ *
+ * @author John Whitmore
+ *
+ * @brief Persistent black box log of binary log records on an SD Card
+ *
+ * Copyright 2017-2018 electronicSoup Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the version 2 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _BLACKBOX_LOG_H
+#define _BLACKBOX_LOG_H
+
+#include "libesoup_config.h"
+
+#ifdef SYS_BLACKBOX_LOG
+
+/*
+ * Black box log, SYS_BLACKBOX_LOG
+ *
+ * Binary log records, SYS_SERIAL_LOGGING_BINARY, are also kept in a ring of
+ * SYS_BLACKBOX_LOG_SECTORS SD Card sectors starting at
+ * SYS_BLACKBOX_LOG_FIRST_SECTOR, so the log leading up to a reset survives
+ * it. Records are packed in to a RAM copy of a sector and only ever written
+ * as a whole sector, when it's full, SYS_BLACKBOX_LOG_FLUSH_TIMEOUT mS after
+ * a record went in to it, or straight away for an Error.
+ *
+ * Each sector has a header:
+ *
+ *   2 bytes     BLACKBOX_LOG_MAGIC
+ *   4 bytes     Sequence number, sector of the ring is sequence % sectors
+ *   2 bytes     Bytes of records following the header
+ *   2 bytes     Records dropped, the RAM sectors full, before the first
+ *   2 bytes     Fletcher-16 checksum of the header and the records
+ *
+ * followed by the records, each a length byte then the binary record. All
+ * fields are little endian. blackbox_log_init() binary searches the ring
+ * for the newest sector and carries on in the next, so a log of thousands
+ * of sectors is found in a handful of reads.
+ *
+ * blackbox_log_dump() sends the whole ring, oldest first, out the serial
+ * logging port for libesoup/scripts/es_log_decode.py.
+ */
+#define BLACKBOX_LOG_MAGIC        0x5842     ///< "BX"
+#define BLACKBOX_LOG_HEADER_SIZE  12
+
+extern result_t blackbox_log_init(void);
+extern result_t blackbox_log_put(uint8_t level, uint8_t *record, uint16_t len);
+extern result_t blackbox_log_flush(void);
+extern result_t blackbox_log_dump(void);
+extern uint32_t blackbox_log_sequence(void);
+
+#endif // SYS_BLACKBOX_LOG
+
+#endif // _BLACKBOX_LOG_H
@@ -26,8 +26,13 @@
 
 #if defined(SYS_CAN_ISO15765_LOG)
 
-#include "libesoup/comms/can/dcncp/dcncp_can.h"
 #include "libesoup/comms/can/can.h"
+#ifdef SYS_CAN_ISO15765_LOGGER
+#include "libesoup/comms/can/dcncp/dcncp_can.h"
+#endif
+#ifdef SYS_CAN_ISO15765_LOG_BATCH
+#include "libesoup/timers/sw_timers.h"
+#endif
 
 #ifdef SYS_SERIAL_LOGGING
 #define DEBUG_FILE
@@ -49,25 +54,98 @@ static const char *TAG = "ISO15765_LOG";
 
 /*
  * Network Logging
+ *
+ * A logger message, protocol CAN_ISO15765_LOGGER_PROTOCOL_ID, carries one or
+ * more records back to back:
+ *
+ *   Text     Level, then the NULL terminated string
+ *   Binary   Level | ISO15765_LOG_BINARY, a length byte, then that many bytes
+ *
+ * A message of a single text record is what's always been sent, so a logger
+ * which only reads the first record still gets the first of each batch.
  */
 #ifdef SYS_CAN_ISO15765_LOGGER
-static void (*iso15765_logger_handler)(uint8_t, log_level_t, char*) = NULL;
+static void (*iso15765_logger_handler)(uint8_t, uint8_t, char*) = NULL;
+static void (*iso15765_logger_binary_handler)(uint8_t, uint8_t, uint8_t *, uint8_t) = NULL;
 #endif // SYS_ISO15765_LOGGER
 
 static uint8_t iso15765_logger = FALSE;
 static uint8_t iso15765_logger_address;
 static uint8_t iso15765_logger_level = LOG_DEBUG;
 
+#ifdef SYS_CAN_ISO15765_LOG_BATCH
+/*
+ * Batched network logging, SYS_CAN_ISO15765_LOG_BATCH
+ *
+ * Each ISO15765 message costs a First Frame, a Flow Control from the logger
+ * and then the Consecutive Frames, so rather than a message per log string
+ * records are packed in to a batch. The batch is sent once it reaches
+ * SYS_CAN_ISO15765_LOG_BATCH_FLUSH bytes, when the next record won't fit, or
+ * SYS_CAN_ISO15765_LOG_BATCH_TIMEOUT mS after the first record went in to it.
+ *
+ * If the ISO15765 transmitter is still busy with the last batch the send is
+ * retried on the timeout and records which don't fit are dropped. The number
+ * dropped is sent as a Warning text record at the start of the next batch.
+ */
+#ifndef SYS_SW_TIMERS
+#error libesoup_config.h should define SYS_SW_TIMERS for SYS_CAN_ISO15765_LOG_BATCH
+#endif
+
+#ifndef SYS_CAN_ISO15765_LOG_BATCH_SIZE
+#define SYS_CAN_ISO15765_LOG_BATCH_SIZE     SYS_CAN_ISO15765_MAX_MSG
+#endif
+
+#if (SYS_CAN_ISO15765_LOG_BATCH_SIZE > SYS_CAN_ISO15765_MAX_MSG)
+#error SYS_CAN_ISO15765_LOG_BATCH_SIZE should not exceed SYS_CAN_ISO15765_MAX_MSG
+#endif
+
+#ifndef SYS_CAN_ISO15765_LOG_BATCH_FLUSH
+#define SYS_CAN_ISO15765_LOG_BATCH_FLUSH    ((SYS_CAN_ISO15765_LOG_BATCH_SIZE * 3) / 4)
+#endif
+
+#ifndef SYS_CAN_ISO15765_LOG_BATCH_TIMEOUT
+#define SYS_CAN_ISO15765_LOG_BATCH_TIMEOUT  100
+#endif
+
+static uint8_t  batch[SYS_CAN_ISO15765_LOG_BATCH_SIZE];
+static uint16_t batch_length = 0;
+static uint16_t batch_dropped = 0;
+static boolean  batch_waiting = FALSE;   ///< Send failed, retried on timeout
+static timer_id batch_timer = BAD_TIMER_ID;
+
+static result_t batch_add(uint8_t *header, uint8_t header_len, uint8_t *data, uint16_t len);
+#endif // SYS_CAN_ISO15765_LOG_BATCH
+
 #ifdef SYS_CAN_ISO15765_LOGGER
 static void iso15765_log_handler(iso15765_msg_t *message)
 {
-	log_level_t level;
-	char        string[SYS_ISO15765_MAX_MSG];
+	uint8_t   level;
+	uint8_t  *ptr;
+	uint8_t  *end;
+	uint8_t   len;
 
-	level = message->data[0];
-	if ((level >= iso15765_logger_level) && iso15765_logger_handler) {
-		strcpy(string, (char *) &(message->data[1]));
-		iso15765_logger_handler(message->address, level, string);
+	ptr = message->data;
+	end = message->data + message->size;
+
+	while(ptr < end) {
+		level = *ptr++;
+
+		if(level & ISO15765_LOG_BINARY) {
+			level &= ~ISO15765_LOG_BINARY;
+			if(ptr >= end) break;
+			len = *ptr++;
+			if((ptr + len) > end) break;
+			if ((level <= iso15765_logger_level) && iso15765_logger_binary_handler) {
+				iso15765_logger_binary_handler(message->address, level, ptr, len);
+			}
+			ptr += len;
+		} else {
+			if(memchr(ptr, '\0', end - ptr) == NULL) break;
+			if ((level <= iso15765_logger_level) && iso15765_logger_handler) {
+				iso15765_logger_handler(message->address, level, (char *)ptr);
+			}
+			ptr += strlen((char *)ptr) + 1;
+		}
 	}
 }
 #endif // SYS_CAN_ISO15765_LOGGER
@@ -76,7 +154,7 @@ static void iso15765_log_handler(iso15765_msg_t *message)
  * Register this node on the Network as the logger
  */
 #ifdef SYS_CAN_ISO15765_LOGGER
-result_t iso15765_logger_register_as_logger(void (*handler)(uint8_t, log_level_t, char *), log_level_t level)
+result_t iso15765_logger_register_as_logger(void (*handler)(uint8_t, uint8_t, char *), uint8_t level)
 {
 	iso15765_target_t target;
 
@@ -86,7 +164,7 @@ result_t iso15765_logger_register_as_logger(void (*handler)(uint8_t, log_level_t
 			iso15765_logger_handler = handler;
 			iso15765_logger_level = level;
 
-			target.protocol = ISO15765_LOGGER_PROTOCOL_ID;
+			target.protocol = CAN_ISO15765_LOGGER_PROTOCOL_ID;
 			target.handler = iso15765_log_handler;
 			iso15765_dispatch_reg_handler(&target);
 
@@ -101,6 +179,16 @@ result_t iso15765_logger_register_as_logger(void (*handler)(uint8_t, log_level_t
 }
 #endif // SYS_CAN_ISO15765_LOGGER
 
+/*
+ * Handler for the binary records of a batch, SYS_CAN_ISO15765_LOG_BATCH
+ */
+#ifdef SYS_CAN_ISO15765_LOGGER
+void iso15765_logger_set_binary_handler(void (*handler)(uint8_t, uint8_t, uint8_t *, uint8_t))
+{
+	iso15765_logger_binary_handler = handler;
+}
+#endif // SYS_CAN_ISO15765_LOGGER
+
 /*
  * Unregister this node as the Network Logger!
  */
@@ -114,6 +202,155 @@ result_t iso15765_logger_unregister_as_logger(void)
 }
 #endif // SYS_CAN_ISO15765_LOGGER
 
+#ifdef SYS_CAN_ISO15765_LOG_BATCH
+void iso15765_log(uint8_t level, char *string)
+{
+	if(iso15765_logger && (level <= iso15765_logger_level)) {
+		batch_add(&level, 1, (uint8_t *)string, strlen(string) + 1);
+	}
+}
+
+result_t iso15765_log_binary(uint8_t level, uint8_t *data, uint8_t len)
+{
+	uint8_t header[2];
+
+	if(!iso15765_logger) {
+		return(-ERR_NOT_READY);
+	}
+
+	if(level > iso15765_logger_level) {
+		return(0);
+	}
+
+	header[0] = level | ISO15765_LOG_BINARY;
+	header[1] = len;
+	return(batch_add(header, 2, data, len));
+}
+
+static void exp_batch_timeout(timer_id timer __attribute__((unused)), union sigval data __attribute__((unused)))
+{
+	batch_timer = BAD_TIMER_ID;
+	iso15765_log_flush();
+}
+
+static void start_batch_timer(void)
+{
+	result_t          rc;
+	struct timer_req  request;
+
+	if(batch_timer != BAD_TIMER_ID) {
+		return;
+	}
+
+	request.period.units    = mSeconds;
+	request.period.duration = SYS_CAN_ISO15765_LOG_BATCH_TIMEOUT;
+	request.type            = single_shot_expiry;
+	request.exp_fn          = exp_batch_timeout;
+	request.data.sival_int  = 0;
+
+	rc = sw_timer_start(&request);
+	RC_CHECK_PRINT_VOID("Failed to start batch Timer\n\r");
+	batch_timer = rc;
+}
+
+/*
+ * Add the count of dropped records, as a Warning text record, to the empty
+ * batch
+ */
+static void batch_add_dropped(void)
+{
+	uint8_t   digits[5];
+	uint8_t   count = 0;
+	uint16_t  dropped;
+	char     *text = " log records dropped";
+
+	dropped = batch_dropped;
+	batch_dropped = 0;
+
+	batch[batch_length++] = LOG_WARNING;
+	do {
+		digits[count++] = '0' + (dropped % 10);
+		dropped = dropped / 10;
+	} while(dropped);
+	while(count) batch[batch_length++] = digits[--count];
+	while(*text) batch[batch_length++] = *text++;
+	batch[batch_length++] = '\0';
+}
+
+static result_t batch_add(uint8_t *header, uint8_t header_len, uint8_t *data, uint16_t len)
+{
+	result_t rc;
+
+	if((header_len + len) > SYS_CAN_ISO15765_LOG_BATCH_SIZE) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	if(batch_dropped || ((batch_length + header_len + len) > SYS_CAN_ISO15765_LOG_BATCH_SIZE)) {
+		/*
+		 * Once a record has been dropped every record is, until the
+		 * count can follow the batch. A successful flush leaves the
+		 * count in the batch, so check the fit again.
+		 */
+		rc = batch_waiting ? -ERR_BUSY : iso15765_log_flush();
+		if((rc < 0) || ((batch_length + header_len + len) > SYS_CAN_ISO15765_LOG_BATCH_SIZE)) {
+			if(batch_dropped < 0xffff) batch_dropped++;
+			return(-ERR_BUFFER_OVERFLOW);
+		}
+	}
+
+	memcpy(&batch[batch_length], header, header_len);
+	batch_length += header_len;
+	memcpy(&batch[batch_length], data, len);
+	batch_length += len;
+
+	if(!batch_waiting && (batch_length >= SYS_CAN_ISO15765_LOG_BATCH_FLUSH)) {
+		return(iso15765_log_flush());
+	}
+	start_batch_timer();
+	return(0);
+}
+
+/*
+ * Send the batch. If the ISO15765 transmitter is busy the batch is kept and
+ * the send retried on the batch timeout.
+ */
+result_t iso15765_log_flush(void)
+{
+	result_t        rc;
+	iso15765_msg_t  msg;
+
+	if(!iso15765_logger) {
+		batch_length = 0;
+		return(-ERR_NOT_READY);
+	}
+
+	if(batch_length == 0) {
+		return(0);
+	}
+
+	msg.address  = iso15765_logger_address;
+	msg.protocol = CAN_ISO15765_LOGGER_PROTOCOL_ID;
+	msg.size     = batch_length;
+	msg.data     = batch;
+
+	rc = iso15765_tx_msg(&msg);
+	if(rc < 0) {
+		batch_waiting = TRUE;
+		start_batch_timer();
+		return(rc);
+	}
+
+	batch_waiting = FALSE;
+	sw_timer_cancel(&batch_timer);
+	batch_length = 0;
+
+	if(batch_dropped) {
+		batch_add_dropped();
+		start_batch_timer();
+	}
+	return(0);
+}
+#else
 void iso15765_log(uint8_t level, char *string)
 {
 	uint8_t loop;
@@ -151,6 +388,7 @@ void iso15765_log(uint8_t level, char *string)
 		LOG_D("no Logger Registered\n\r");
 	}
 }
+#endif // SYS_CAN_ISO15765_LOG_BATCH
 
 /*
  * Another network node has registered as the system
@@ -167,8 +405,15 @@ void iso15765_logger_register_remote(uint8_t address, uint8_t level)
  */
 void iso15765_logger_unregister_remote(uint8_t address)
 {
-	if(iso15765_logger_address == address)
+	if(iso15765_logger_address == address) {
 		iso15765_logger = FALSE;
+#ifdef SYS_CAN_ISO15765_LOG_BATCH
+		sw_timer_cancel(&batch_timer);
+		batch_length = 0;
+		batch_dropped = 0;
+		batch_waiting = FALSE;
+#endif
+	}
 }
 
 #endif // SYS_CAN_ISO15765_LOG
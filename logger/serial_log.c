@@ -33,6 +33,12 @@ static const char  __attribute__((unused)) *TAG ="SERIAL_LOG";
 #include "libesoup/errno.h"
 #include "libesoup/comms/uart/uart.h"
 #include "libesoup/logger/serial_log.h"
+#if defined(SYS_SERIAL_LOGGING_BINARY) && defined(SYS_SW_TIMER_TICKS_COUNT)
+#include "libesoup/timers/sw_timers.h"
+#endif
+#ifdef SYS_BLACKBOX_LOG
+#include "libesoup/logger/blackbox_log.h"
+#endif
 
 /*
  * Check required libesoup_config.h defines are found
@@ -78,14 +84,27 @@ static const char error_string[LEVEL_STRING_LEN + 1]   = "E-";
  * Local helper functions
  */
 #ifdef XC16
-static result_t es_printf(const char * fmt, va_list args);
+/*
+ * A log line being formatted in to a buffer, for the log ring, rather than
+ * being sent straight to the UART. The line is truncated at its size.
+ */
+struct log_line {
+	uint8_t  *buffer;
+	uint16_t  size;
+	uint16_t  length;
+};
+
+static result_t es_printf(struct log_line *line, const char * fmt, va_list args);
+static result_t log_tx_buffer(struct log_line *line, uint8_t *buffer, uint16_t len);
+static result_t log_header(struct log_line *line, uint8_t level, const char *tag);
+static result_t log_decimal(struct log_line *line, uint32_t value);
+static result_t log_hex(struct log_line *line, uint32_t value);
 #endif // #ifdef XC16
+#ifdef __XC8
 static uint8_t *itoa(uint16_t num, uint8_t *str, uint8_t base);
-#ifdef XC16
-static uint8_t *itoa32bit(uint32_t num, uint8_t *str, uint8_t base);
+static void reverse(uint8_t str[], uint16_t length);
 #endif
 static uint16_t strlen(char *string);
-static void reverse(uint8_t str[], uint16_t length);
 
 /*
  * Declaration of the data structure being used to manage UART connection.
@@ -93,6 +112,81 @@ static void reverse(uint8_t str[], uint16_t length);
  */
 static struct uart_data serial_uart;
 
+#if defined(XC16) && defined(SYS_SERIAL_LOGGING_RING_SIZE)
+/*
+ * Log ring, SYS_SERIAL_LOGGING_RING_SIZE
+ *
+ * Log calls add whole records to the ring and return, they never wait on the
+ * UART and never have part of a record rejected by it. A task moves records
+ * from the ring to the UART whenever the UART has room for the longest one.
+ *
+ * Each record is a length byte followed by that many bytes for the UART. When
+ * the ring is full either the new record is dropped, the default, or with
+ * SYS_SERIAL_LOGGING_DROP_OLDEST the oldest records are dropped to make room.
+ * Either way the number dropped is sent as a single Warning line, in place of
+ * the records lost:
+ *
+ *   W-SERIAL_LOG:<n> log records dropped
+ *
+ * Dropping the oldest only ever drops the record at the head of the ring so
+ * the count goes out ahead of the head record. Dropping the newest has to
+ * remember where the records went missing, so a zero length record holding
+ * the two byte count is added to the ring in front of the next record
+ * accepted, or the count is sent once the ring has emptied.
+ */
+#ifndef SYS_SERIAL_LOGGING_LINE_SIZE
+#define SYS_SERIAL_LOGGING_LINE_SIZE   128
+#endif
+
+#if (SYS_SERIAL_LOGGING_LINE_SIZE > 255) || (SYS_SERIAL_LOGGING_LINE_SIZE < 64)
+#error SYS_SERIAL_LOGGING_LINE_SIZE should be between 64 and 255 bytes
+#endif
+
+#if (SYS_SERIAL_LOGGING_RING_SIZE < (2 * SYS_SERIAL_LOGGING_LINE_SIZE))
+#error SYS_SERIAL_LOGGING_RING_SIZE should hold at least two lines of SYS_SERIAL_LOGGING_LINE_SIZE
+#endif
+
+#if (SYS_UART_TX_BUFFER_SIZE < SYS_SERIAL_LOGGING_LINE_SIZE)
+#error SYS_UART_TX_BUFFER_SIZE should hold a line of SYS_SERIAL_LOGGING_LINE_SIZE
+#endif
+
+#define LOG_MARKER_SIZE   3          ///< Zero length byte and the count
+
+static uint8_t  log_ring[SYS_SERIAL_LOGGING_RING_SIZE];
+static uint16_t log_ring_head = 0;
+static uint16_t log_ring_count = 0;
+static uint16_t log_dropped = 0;
+static int16_t  log_drain_task = -1;
+
+static result_t log_ring_put(uint8_t *record, uint16_t len);
+static result_t log_ring_drain(void);
+#endif // XC16 && SYS_SERIAL_LOGGING_RING_SIZE
+
+#if defined(XC16) && defined(SYS_SERIAL_LOGGING_TAG_LEVELS)
+/*
+ * Runtime log levels, SYS_SERIAL_LOGGING_TAG_LEVELS
+ *
+ * The log calls compiled in by SYS_LOG_LEVEL and DEBUG_FILE are filtered at
+ * runtime by the level set for their TAG, or failing that the default level.
+ * A table entry is matched on the TAG pointer, or the TAG string, so that a
+ * level can be set from a name received over a comms channel.
+ */
+#ifndef SYS_SERIAL_LOGGING_RUNTIME_LEVEL
+#define SYS_SERIAL_LOGGING_RUNTIME_LEVEL   SYS_LOG_LEVEL
+#endif
+
+struct tag_level {
+	const char *tag;
+	uint8_t     level;
+};
+
+static struct tag_level tag_levels[SYS_SERIAL_LOGGING_TAG_LEVELS];
+static uint8_t          default_level = SYS_SERIAL_LOGGING_RUNTIME_LEVEL;
+
+static struct tag_level *find_tag_level(const char *tag);
+static boolean           tag_level_enabled(const char *tag, uint8_t level);
+#endif // XC16 && SYS_SERIAL_LOGGING_TAG_LEVELS
+
 //#if defined(__18F2680) || defined(__18F4585)
 ///*
 // * Definitions for the Transmit Circular buffer. Calls to putchar will load
@@ -149,6 +243,11 @@ result_t serial_logging_init(void)
 	 * first character on the channel
 	 */
 	for (delay = 0; delay < 0x100; delay++) Nop();
+#if defined(XC16) && defined(SYS_SERIAL_LOGGING_RING_SIZE)
+	rc = libesoup_task_register(log_ring_drain, FALSE);
+	RC_CHECK
+	log_drain_task = rc;
+#endif
 #ifdef XC16
 	rc = serial_printf("\n\r\n\r");
 	RC_CHECK
@@ -164,49 +263,432 @@ uint16_t serial_buffer_count(void)
 #endif
 
 #if defined(XC16)
+#ifdef SYS_SERIAL_LOGGING_BINARY
+/*
+ * Send a complete record to the log ring, or straight to the UART
+ */
+static result_t log_output(uint8_t *record, uint16_t len)
+{
+#ifdef SYS_SERIAL_LOGGING_RING_SIZE
+	return(log_ring_put(record, len));
+#else
+	return(uart_tx_buffer(&serial_uart, record, len));
+#endif
+}
+#endif // SYS_SERIAL_LOGGING_BINARY
+
 result_t serial_log(uint8_t level, const char *tag, const char *fmt, ...)
 {
-	result_t  rc;
-	va_list   args;
+	result_t         rc;
+	va_list          args;
+	struct log_line *line = NULL;
+#ifdef SYS_SERIAL_LOGGING_RING_SIZE
+	uint8_t          record[SYS_SERIAL_LOGGING_LINE_SIZE];
+	struct log_line  ring_line;
+
+	ring_line.buffer = record;
+	ring_line.size   = SYS_SERIAL_LOGGING_LINE_SIZE;
+	ring_line.length = 0;
+	line = &ring_line;
+#endif
+
+#ifdef SYS_SERIAL_LOGGING_TAG_LEVELS
+	if(!tag_level_enabled(tag, level)) {
+		return(0);
+	}
+#endif
+	rc = log_header(line, level, tag);
+	RC_CHECK
 
 	va_start(args, fmt);
+	rc = es_printf(line, fmt, args);
+	va_end(args);
+	RC_CHECK
+
+#ifdef SYS_SERIAL_LOGGING_RING_SIZE
+	rc = log_ring_put(record, ring_line.length);
+#endif
+	return(rc);
+}
+
+/*
+ * Print the log level and tag field
+ */
+static result_t log_header(struct log_line *line, uint8_t level, const char *tag)
+{
+	result_t  rc;
 
-	/*
-	 * Print the log level
-	 */
 	switch(level) {
 	case LOG_DEBUG:
-		rc = serial_printf(debug_string);
-		RC_CHECK
+		rc = log_tx_buffer(line, (uint8_t *)debug_string, LEVEL_STRING_LEN);
 		break;
 
 	case LOG_INFO:
-		rc = serial_printf(info_string);
-		RC_CHECK
+		rc = log_tx_buffer(line, (uint8_t *)info_string, LEVEL_STRING_LEN);
 		break;
 
 	case LOG_WARNING:
-		rc = serial_printf(warning_string);
-		RC_CHECK
+		rc = log_tx_buffer(line, (uint8_t *)warning_string, LEVEL_STRING_LEN);
 		break;
 
 	case LOG_ERROR:
-		rc = serial_printf(error_string);
-		RC_CHECK
+	default:
+		rc = log_tx_buffer(line, (uint8_t *)error_string, LEVEL_STRING_LEN);
 		break;
 	}
+	RC_CHECK
+
+	rc = log_tx_buffer(line, (uint8_t *)tag, strlen((char *)tag));
+	RC_CHECK
+
+	return(log_tx_buffer(line, (uint8_t *)":", 1));
+}
+
+#ifdef SYS_SERIAL_LOGGING_TAG_LEVELS
+static struct tag_level *find_tag_level(const char *tag)
+{
+	uint16_t    loop;
+	const char *a;
+	const char *b;
+
+	if(!tag) {
+		return(NULL);
+	}
+
+	for(loop = 0; loop < SYS_SERIAL_LOGGING_TAG_LEVELS; loop++) {
+		if(tag_levels[loop].tag == tag) {
+			return(&tag_levels[loop]);
+		}
+	}
+
+	for(loop = 0; loop < SYS_SERIAL_LOGGING_TAG_LEVELS; loop++) {
+		if(tag_levels[loop].tag) {
+			a = tag_levels[loop].tag;
+			b = tag;
+			while(*a && (*a == *b)) {
+				a++;
+				b++;
+			}
+			if(*a == *b) {
+				return(&tag_levels[loop]);
+			}
+		}
+	}
+	return(NULL);
+}
+
+result_t serial_log_set_level(const char *tag, uint8_t level)
+{
+	struct tag_level *entry;
+	uint16_t          loop;
+
+	if(level > NO_LOGGING) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
 
+	if(!tag) {
+		default_level = level;
+		return(0);
+	}
+
+	entry = find_tag_level(tag);
+	for(loop = 0; !entry && (loop < SYS_SERIAL_LOGGING_TAG_LEVELS); loop++) {
+		if(!tag_levels[loop].tag) {
+			entry = &tag_levels[loop];
+			entry->tag = tag;
+		}
+	}
+
+	if(!entry) {
+		return(-ERR_NO_RESOURCES);
+	}
+	entry->level = level;
+	return(0);
+}
+
+result_t serial_log_clear_level(const char *tag)
+{
+	struct tag_level *entry;
+
+	entry = find_tag_level(tag);
+	if(!entry) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+	entry->tag = NULL;
+	return(0);
+}
+
+uint8_t serial_log_get_level(const char *tag)
+{
+	struct tag_level *entry;
+
+	entry = find_tag_level(tag);
+	return(entry ? entry->level : default_level);
+}
+
+/*
+ * NO_LOGGING is numerically above LOG_DEBUG so has to be checked for itself
+ */
+static boolean tag_level_enabled(const char *tag, uint8_t level)
+{
+	uint8_t tag_level;
+
+	tag_level = serial_log_get_level(tag);
+	return((tag_level != NO_LOGGING) && (level <= tag_level));
+}
+#endif // SYS_SERIAL_LOGGING_TAG_LEVELS
+
+#ifdef SYS_SERIAL_LOGGING_BINARY
+/*
+ * Build a log record, see serial_log.h for the layout, returning its length
+ */
+static uint16_t log_binary_record(uint8_t *record, uint8_t level, const char *tag, const char *fmt, const struct es_log_arg *args, uint8_t count)
+{
+	uint8_t  *ptr;
+	uint8_t   id_size;
+	uint8_t   loop;
+	uint8_t   byte;
+	uint32_t  value;
+	uint16_t  ticks;
+
+	id_size = (sizeof(int) > 2) ? 4 : 2;
+
+	ptr = record;
+	*ptr++ = ES_LOG_SYNC;
+	*ptr++ = ((level & 0x03) << 6) | ((id_size == 4) ? ES_LOG_WIDE : 0) | count;
+
+	value = (uint32_t)(uintmax_t)tag;
+	for(byte = 0; byte < id_size; byte++) {
+		*ptr++ = (uint8_t)value;
+		value = value >> 8;
+	}
+
+	value = (uint32_t)(uintmax_t)fmt;
+	for(byte = 0; byte < id_size; byte++) {
+		*ptr++ = (uint8_t)value;
+		value = value >> 8;
+	}
+
+#ifdef SYS_SW_TIMER_TICKS_COUNT
+	ticks = current_system_ticks();
+#else
+	ticks = 0;
+#endif
+	*ptr++ = (uint8_t)ticks;
+	*ptr++ = (uint8_t)(ticks >> 8);
+
+	for(loop = 0; loop < count; loop++) {
+		value = args[loop].value;
+		for(byte = 0; byte < args[loop].size; byte++) {
+			*ptr++ = (uint8_t)value;
+			value = value >> 8;
+		}
+	}
+
+	return((uint16_t)(ptr - record));
+}
+
+/*
+ * Send a log record with one call to the UART, or log ring, so that a record
+ * is never split by another caller.
+ */
+result_t serial_log_binary(uint8_t level, const char *tag, const char *fmt, const struct es_log_arg *args, uint8_t count)
+{
+	uint8_t   record[2 + 4 + 4 + 2 + (ES_LOG_MAX_ARGS * 4)];
+	uint16_t  length;
+
+	if(count > ES_LOG_MAX_ARGS) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	length = log_binary_record(record, level, tag, fmt, args, count);
+
+#ifdef SYS_BLACKBOX_LOG
 	/*
-	 * Print the tag field
+	 * The black box keeps records whatever the runtime level of the TAG
 	 */
-	rc = serial_printf("%s:", tag);
-	RC_CHECK
+	blackbox_log_put(level, record, length);
+#endif
+#ifdef SYS_SERIAL_LOGGING_TAG_LEVELS
+	if(!tag_level_enabled(tag, level)) {
+		return(0);
+	}
+#endif
+	return(log_output(record, length));
+}
+#endif // SYS_SERIAL_LOGGING_BINARY
 
-	rc = es_printf(fmt, args);
-	RC_CHECK
-	va_end(args);
+#ifdef SYS_SERIAL_LOGGING_RING_SIZE
+static void log_ring_write(uint16_t index, uint8_t *data, uint16_t len)
+{
+	while(len--) {
+		if(index >= SYS_SERIAL_LOGGING_RING_SIZE) index -= SYS_SERIAL_LOGGING_RING_SIZE;
+		log_ring[index++] = *data++;
+	}
+}
+
+static void log_ring_read(uint8_t *data, uint16_t len)
+{
+	while(len--) {
+		*data++ = log_ring[log_ring_head++];
+		if(log_ring_head == SYS_SERIAL_LOGGING_RING_SIZE) log_ring_head = 0;
+		log_ring_count--;
+	}
+}
+
+static result_t log_ring_put(uint8_t *record, uint16_t len)
+{
+	uint8_t   length;
+	uint16_t  tail;
+	result_t  rc = 0;
+#ifdef SYS_SERIAL_LOGGING_DROP_OLDEST
+	uint16_t  oldest;
+#else
+	uint8_t   marker[LOG_MARKER_SIZE];
+#endif
+
+	if((len == 0) || (len > SYS_SERIAL_LOGGING_LINE_SIZE)) {
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+	length = (uint8_t)len;
+
+	INTERRUPTS_DISABLED
+#ifdef SYS_SERIAL_LOGGING_DROP_OLDEST
+	while((SYS_SERIAL_LOGGING_RING_SIZE - log_ring_count) < (len + 1)) {
+		oldest = log_ring[log_ring_head] + 1;
+		log_ring_head += oldest;
+		if(log_ring_head >= SYS_SERIAL_LOGGING_RING_SIZE) log_ring_head -= SYS_SERIAL_LOGGING_RING_SIZE;
+		log_ring_count -= oldest;
+		if(log_dropped < 0xffff) log_dropped++;
+	}
+#else
+	if((SYS_SERIAL_LOGGING_RING_SIZE - log_ring_count) < (len + 1 + (log_dropped ? LOG_MARKER_SIZE : 0))) {
+		if(log_dropped < 0xffff) log_dropped++;
+		rc = -ERR_BUFFER_OVERFLOW;
+	} else if(log_dropped) {
+		marker[0] = 0;
+		marker[1] = (uint8_t)log_dropped;
+		marker[2] = (uint8_t)(log_dropped >> 8);
+		tail = log_ring_head + log_ring_count;
+		log_ring_write(tail, marker, LOG_MARKER_SIZE);
+		log_ring_count += LOG_MARKER_SIZE;
+		log_dropped = 0;
+	}
+	if(rc == 0)
+#endif
+	{
+		tail = log_ring_head + log_ring_count;
+		log_ring_write(tail, &length, 1);
+		log_ring_write(tail + 1, record, len);
+		log_ring_count += len + 1;
+	}
+	INTERRUPTS_ENABLED
+
+	libesoup_task_pending(log_drain_task);
+	return(rc);
+}
+
+/*
+ * Build the Warning line, or record, for a count of dropped log records
+ */
+static uint16_t log_marker(uint8_t *record, uint16_t dropped)
+{
+#ifdef SYS_SERIAL_LOGGING_BINARY
+	static const char ES_LOG_FMT_SECTION dropped_fmt[] = "%d log records dropped\n\r";
+	struct es_log_arg arg;
+
+	arg.value = dropped;
+	arg.size  = sizeof(int);
+	return(log_binary_record(record, LOG_WARNING, TAG, dropped_fmt, &arg, 1));
+#else
+	struct log_line line;
+
+	line.buffer = record;
+	line.size   = SYS_SERIAL_LOGGING_LINE_SIZE;
+	line.length = 0;
+
+	log_header(&line, LOG_WARNING, TAG);
+	log_decimal(&line, dropped);
+	log_tx_buffer(&line, (uint8_t *)" log records dropped\n\r", 22);
+	return(line.length);
+#endif
+}
+
+/*
+ * Task moving records from the log ring to the UART. A record is only taken
+ * from the ring when the UART has room for the longest so none are ever
+ * rejected. Returns 1, staying pending, while records remain.
+ */
+static result_t log_ring_drain(void)
+{
+	result_t  rc;
+	uint8_t   record[SYS_SERIAL_LOGGING_LINE_SIZE];
+	uint8_t   marker[LOG_MARKER_SIZE];
+	uint16_t  length;
+	uint16_t  dropped;
+
+	while(1) {
+		rc = uart_tx_buffer_space(&serial_uart);
+		RC_CHECK
+		if(rc < SYS_SERIAL_LOGGING_LINE_SIZE) {
+			return(1);
+		}
+
+		length  = 0;
+		dropped = 0;
+
+		INTERRUPTS_DISABLED
+#ifdef SYS_SERIAL_LOGGING_DROP_OLDEST
+		if(log_dropped) {
+			dropped = log_dropped;
+			log_dropped = 0;
+		} else if(log_ring_count) {
+#else
+		if(log_ring_count && (log_ring[log_ring_head] == 0)) {
+			log_ring_read(marker, LOG_MARKER_SIZE);
+			dropped = marker[1] | (marker[2] << 8);
+		} else if(!log_ring_count && log_dropped) {
+			dropped = log_dropped;
+			log_dropped = 0;
+		} else if(log_ring_count) {
+#endif
+			log_ring_read(marker, 1);
+			length = marker[0];
+			log_ring_read(record, length);
+		}
+		INTERRUPTS_ENABLED
 
+		if(dropped) {
+			length = log_marker(record, dropped);
+		}
+
+		if(length == 0) {
+			return(0);
+		}
+
+		rc = uart_tx_buffer(&serial_uart, record, length);
+		RC_CHECK
+	}
+}
+#endif // SYS_SERIAL_LOGGING_RING_SIZE
+
+/*
+ * Move everything in the log ring to the UART now, waiting for the UART's
+ * ISR to make room, rather than leaving it to the main loop. The UART sends
+ * it on from its ISR even if the caller then never returns.
+ */
+result_t serial_log_flush(void)
+{
+#ifdef SYS_SERIAL_LOGGING_RING_SIZE
+	result_t rc;
+
+	while((rc = log_ring_drain()) > 0) {
+		CLEAR_WDT
+	}
+	return(rc);
+#else
 	return(0);
+#endif
 }
 #elif defined(__XC8)
 result_t serial_log(const char* fmt, ...)
@@ -240,7 +722,7 @@ result_t serial_log(const char* fmt, ...)
 				break;
 
 			case 'd':
-				i = va_arg(args, uint16_t);
+				i = (uint16_t)va_arg(args, int);     // Promoted when passed
 				string = itoa(i, buf, 10);
 				rc = uart_tx_buffer(&serial_uart, string, strlen((char*)string));
 				RC_CHECK
@@ -253,7 +735,7 @@ result_t serial_log(const char* fmt, ...)
 				break;
 
 			case 'x':
-				i = va_arg(args, uint16_t);
+				i = (uint16_t)va_arg(args, int);     // Promoted when passed
 				string = itoa(i, buf, 16);
 				rc = uart_tx_buffer(&serial_uart, string, strlen((char*)string));
 				RC_CHECK
@@ -282,102 +764,88 @@ result_t serial_log(const char* fmt, ...)
 	}
 }
 #endif // defined(XC16) || defined(__XC8)
-
 #if defined(XC16)
 result_t serial_printf(const char * fmt, ...)
 {
-	result_t  rc;
-	char     *ptr;
-	va_list   args;
-	uint16_t  i;
-	uint32_t  li;
-	uint8_t   buf[256];
-	uint8_t  *string;
+	result_t         rc;
+	va_list          args;
+	struct log_line *line = NULL;
+#ifdef SYS_SERIAL_LOGGING_RING_SIZE
+	uint8_t          record[SYS_SERIAL_LOGGING_LINE_SIZE];
+	struct log_line  ring_line;
+
+	ring_line.buffer = record;
+	ring_line.size   = SYS_SERIAL_LOGGING_LINE_SIZE;
+	ring_line.length = 0;
+	line = &ring_line;
+#endif
 
 	va_start(args, fmt);
+	rc = es_printf(line, fmt, args);
+	va_end(args);
+	RC_CHECK
 
-	ptr = (char *)fmt;
-
-	while(*ptr) {
-
-		if(*ptr != '%') {
-			rc = uart_tx_char(&serial_uart, *ptr);
-			RC_CHECK
-		} else {
-			/*
-			 * Format specifier
-			 */
-			switch(*++ptr) {
-			case '%' :
-				rc = uart_tx_char(&serial_uart, *ptr);
-				RC_CHECK
-				break;
-
-			case 'd':
-				i = va_arg(args, uint16_t);
-				string = itoa((uint32_t)i, buf, 10);
-				rc = uart_tx_buffer(&serial_uart, string, strlen((char*)string));
-				RC_CHECK
-				break;
-
-			case 's':
-				string = va_arg(args, uint8_t *);
-				rc = uart_tx_buffer(&serial_uart, string, strlen((char*)string));
-				RC_CHECK
-				break;
+#ifdef SYS_SERIAL_LOGGING_RING_SIZE
+	if(ring_line.length) {
+		rc = log_ring_put(record, ring_line.length);
+	}
+#endif
+	return(rc);
+}
 
-			case 'x':
-				i = va_arg(args, uint16_t);
-				string = itoa(i, buf, 16);
-				rc = uart_tx_buffer(&serial_uart, string, strlen((char*)string));
-				RC_CHECK
-				break;
+/*
+ * Send data which is already formatted, such as log records read back from
+ * storage, straight to the UART but only if it has room for all of it.
+ * Returns -ERR_BUSY if not, so the caller can try again later.
+ */
+result_t serial_log_write(uint8_t *data, uint16_t len)
+{
+	result_t rc;
 
-			case 'l':
-				switch(*++ptr) {
-				case 'd':
-					li = va_arg(args, uint32_t);
-					*buf = 0;
-					string = itoa32bit(li, buf, 10);
-					rc = uart_tx_buffer(&serial_uart, buf, strlen((char*)buf));
-					RC_CHECK
-					break;
+	rc = uart_tx_buffer_space(&serial_uart);
+	RC_CHECK
+	if(rc < len) {
+		return(-ERR_BUSY);
+	}
+	return(uart_tx_buffer(&serial_uart, data, len));
+}
+#endif // #if defined(XC16)
 
-				case 'x':
-					li = va_arg(args, uint32_t);
-					*buf = 0;
-					string = itoa32bit(li, buf, 16);
-					rc = uart_tx_buffer(&serial_uart, buf, strlen((char*)buf));
-					RC_CHECK
-					break;
-				}
-				break;
-			}
-		}
-		ptr++;
+#ifdef XC16
+/*
+ * Send to the UART, or if given a line add to it
+ */
+static result_t log_tx_buffer(struct log_line *line, uint8_t *buffer, uint16_t len)
+{
+	if(!line) {
+		return(uart_tx_buffer(&serial_uart, buffer, len));
 	}
 
-	va_end(args);
+	while(len-- && (line->length < line->size)) {
+		line->buffer[line->length++] = *buffer++;
+	}
 	return(0);
 }
-#endif // #if defined(XC16)
 
-#ifdef XC16
-static result_t es_printf(const char * fmt, va_list args)
+static result_t es_printf(struct log_line *line, const char * fmt, va_list args)
 {
 	result_t  rc;
 	char     *ptr;
-	uint16_t  i;
-	uint32_t  li;
-	uint8_t   buf[256];
-	uint8_t  *string = NULL;
+	char     *text;
+	uint8_t   ch;
+	uint8_t  *string;
 
 	ptr = (char *)fmt;
 
 	while(*ptr) {
 
 		if(*ptr != '%') {
-			rc = uart_tx_char(&serial_uart, *ptr);
+			/*
+			 * Send a run of plain text in one go
+			 */
+			text = ptr;
+			while(*ptr && (*ptr != '%')) ptr++;
+			rc = log_tx_buffer(line, (uint8_t *)text, (uint16_t)(ptr - text));
 			RC_CHECK
 		} else {
 			/*
@@ -385,125 +853,162 @@ static result_t es_printf(const char * fmt, va_list args)
 			 */
 			switch(*++ptr) {
 			case '%' :
-				rc = uart_tx_char(&serial_uart, *ptr);
+				rc = log_tx_buffer(line, (uint8_t *)ptr, 1);
 				RC_CHECK
 				break;
 
 			case 'c':
-				i = va_arg(args, uint8_t);
-				string[0] = i;
-				string[1] = 0;
-				rc = uart_tx_buffer(&serial_uart, string, 1);
+				ch = (uint8_t)va_arg(args, int);     // Promoted when passed
+				rc = log_tx_buffer(line, &ch, 1);
 				RC_CHECK
 				break;
 
 			case 'd':
-				i = va_arg(args, uint16_t);
-				string = itoa((uint32_t)i, buf, 10);
-				rc = uart_tx_buffer(&serial_uart, string, strlen((char*)string));
+				rc = log_decimal(line, (uint16_t)va_arg(args, int));     // Promoted when passed
 				RC_CHECK
 				break;
 
 			case 's':
 				string = va_arg(args, uint8_t *);
-				rc = uart_tx_buffer(&serial_uart, string, strlen((char*)string));
+				rc = log_tx_buffer(line, string, strlen((char*)string));
 				RC_CHECK
 				break;
 
 			case 'x':
-				i = va_arg(args, uint16_t);
-				string = itoa(i, buf, 16);
-				rc = uart_tx_buffer(&serial_uart, string, strlen((char*)string));
+				rc = log_hex(line, (uint16_t)va_arg(args, int));         // Promoted when passed
 				RC_CHECK
 				break;
 
 			case 'l':
 				switch(*++ptr) {
 				case 'd':
-					li = va_arg(args, uint32_t);
-					*buf = 0;
-					string = itoa32bit(li, buf, 10);
-					rc = uart_tx_buffer(&serial_uart, buf, strlen((char*)buf));
+					rc = log_decimal(line, va_arg(args, uint32_t));
 					RC_CHECK
 					break;
 
 				case 'x':
-					li = va_arg(args, uint32_t);
-					*buf = 0;
-					string = itoa32bit(li, buf, 16);
-					rc = uart_tx_buffer(&serial_uart, buf, strlen((char*)buf));
+					rc = log_hex(line, va_arg(args, uint32_t));
 					RC_CHECK
 					break;
 				}
 				break;
 			}
+			if(*ptr) ptr++;
 		}
-		ptr++;
 	}
 	return(0);
 }
-#endif // #if defined(XC16)
 
-result_t serial_logging_exit(void)
+/*
+ * Integer formatting without division, which the 16 bit dsPIC does in a
+ * library call, 32 bit division particularly slowly. Digits are generated
+ * least significant first in to the end of a small array, so there's no
+ * reversing, and sent with a single call to the UART or log line.
+ */
+#define DECIMAL_DIGITS   10          ///< Digits of the largest 32 bit value
+#define HEX_DIGITS        8
+
+static result_t log_decimal(struct log_line *line, uint32_t value)
 {
-        return(uart_release(&serial_uart));
+	uint8_t   digits[DECIMAL_DIGITS];
+	uint8_t  *ptr = &digits[DECIMAL_DIGITS];
+	uint32_t  quotient;
+	uint32_t  remainder;
+	uint16_t  small;
+	uint16_t  small_quotient;
+
+	/*
+	 * Above 16 bits divide by 10 by multiplying by the reciprocal 0.8 / 8
+	 * with shifts and adds, Hacker's Delight divu10(). The estimate can be
+	 * one low, which the remainder shows.
+	 */
+	while(value > 0xffff) {
+		quotient  = (value >> 1) + (value >> 2);
+		quotient += quotient >> 4;
+		quotient += quotient >> 8;
+		quotient += quotient >> 16;
+		quotient  = quotient >> 3;
+		remainder = value - ((quotient << 3) + (quotient << 1));
+		if(remainder > 9) {
+			quotient++;
+			remainder -= 10;
+		}
+		*--ptr = (uint8_t)('0' + remainder);
+		value = quotient;
+	}
+
+	/*
+	 * 16 bit values multiply by the reciprocal 0xCCCD / 2^19, a single
+	 * 16 x 16 bit hardware multiply, exact for all 16 bit values.
+	 */
+	small = (uint16_t)value;
+	do {
+		small_quotient = (uint16_t)(((uint32_t)small * 0xCCCDUL) >> 19);
+		*--ptr = (uint8_t)('0' + (small - (small_quotient * 10)));
+		small = small_quotient;
+	} while(small);
+
+	return(log_tx_buffer(line, ptr, (uint16_t)(&digits[DECIMAL_DIGITS] - ptr)));
 }
 
-static uint8_t *itoa(uint16_t num, uint8_t *str, uint8_t base)
+static result_t log_hex(struct log_line *line, uint32_t value)
 {
-	uint16_t rem;                 // successive remainder
-	uint16_t i = 0;               // Index into the resulting string
-	boolean isNegative = FALSE;
+	static const uint8_t hex_digits[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+						'8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+	uint8_t   digits[HEX_DIGITS];
+	uint8_t  *ptr = &digits[HEX_DIGITS];
 
-	/* Handle 0 explicitely, otherwise empty string is printed for 0 */
-	if (num == 0) {
-		str[i++] = '0';
-		str[i] = '\0';
-		return str;
-	}
+	do {
+		*--ptr = hex_digits[value & 0x0f];
+		value = value >> 4;
+	} while(value);
 
-	// Negative numbers are handled only with base 10.
-	if (num < 0 && base == 10) {
-		isNegative = TRUE;
-		num = -num;          // Process number as positive add negative at the end.
-	}
+	return(log_tx_buffer(line, ptr, (uint16_t)(&digits[HEX_DIGITS] - ptr)));
+}
 
-	// Process individual digits
-	while (num != 0) {
-		rem = num % base;
-		str[i++] = (rem > 9)? (rem-10) + 'a' : rem + '0';
-		num = num/base;
-	}
+#ifdef SYS_TEST_BUILD
+uint16_t serial_log_format(uint8_t *buffer, uint16_t size, const char *fmt, ...)
+{
+	va_list          args;
+	struct log_line  line;
 
-	// If number is negative, append '-'
-	if (isNegative)
-		str[i++] = '-';
+	line.buffer = buffer;
+	line.size   = size;
+	line.length = 0;
 
-	str[i] = '\0'; // Append string terminator
+	va_start(args, fmt);
+	es_printf(&line, fmt, args);
+	va_end(args);
 
-	// Reverse the string
-	reverse(str, i);
+	return(line.length);
+}
+#endif // SYS_TEST_BUILD
+#endif // #if defined(XC16)
 
-	return str;
+
+result_t serial_logging_exit(void)
+{
+        return(uart_release(&serial_uart));
 }
 
-#ifdef XC16
-static uint8_t *itoa32bit(uint32_t num, uint8_t *str, uint8_t base)
+#ifdef __XC8
+static uint8_t *itoa(uint16_t num, uint8_t *str, uint8_t base)
 {
-	uint32_t rem;                // successive remainder
-	uint16_t i = 0;              // Index into the output string
+	uint16_t rem;                 // successive remainder
+	uint16_t i = 0;               // Index into the resulting string
 	boolean isNegative = FALSE;
 
+	/* Handle 0 explicitely, otherwise empty string is printed for 0 */
 	if (num == 0) {
 		str[i++] = '0';
 		str[i] = '\0';
 		return str;
 	}
 
-	// Negative numbers are handled only in base 10.
+	// Negative numbers are handled only with base 10.
 	if (num < 0 && base == 10) {
 		isNegative = TRUE;
-		num = -num;            // Process as positive add negative at the end.
+		num = -num;          // Process number as positive add negative at the end.
 	}
 
 	// Process individual digits
@@ -524,7 +1029,7 @@ static uint8_t *itoa32bit(uint32_t num, uint8_t *str, uint8_t base)
 
 	return str;
 }
-#endif // XC16
+#endif // __XC8
 
 static uint16_t strlen(char *string)
 {
@@ -534,6 +1039,7 @@ static uint16_t strlen(char *string)
 	return(len);
 }
 
+#ifdef __XC8
 static void reverse(uint8_t str[], uint16_t length)
 {
 	uint8_t tmp;
@@ -547,6 +1053,7 @@ static void reverse(uint8_t str[], uint16_t length)
 		end--;
 	}
 }
+#endif // __XC8
 
 #if defined(__18F2680) || defined(__18F4585)
 /**
@@ -55,6 +55,30 @@ extern uint16_t serial_buffer_count(void);
 #if defined(XC16)
 extern result_t serial_log(uint8_t level, const char * tag, const char * f, ...);
 extern result_t serial_printf(const char * f, ...);
+extern result_t serial_log_write(uint8_t *data, uint16_t len);
+extern result_t serial_log_flush(void);
+#ifdef SYS_TEST_BUILD
+extern uint16_t serial_log_format(uint8_t *buffer, uint16_t size, const char *fmt, ...);
+#endif
+#ifdef SYS_SERIAL_LOGGING_BINARY
+struct es_log_arg;
+extern result_t serial_log_binary(uint8_t level, const char *tag, const char *fmt, const struct es_log_arg *args, uint8_t count);
+#endif
+#ifdef SYS_SERIAL_LOGGING_TAG_LEVELS
+/*
+ * Runtime log levels, SYS_SERIAL_LOGGING_TAG_LEVELS
+ *
+ * Log calls compiled in by SYS_LOG_LEVEL are only sent if their level is
+ * within the level set for their TAG, or the default level for a TAG not in
+ * the table. A NULL tag sets the default, which starts as
+ * SYS_SERIAL_LOGGING_RUNTIME_LEVEL, or SYS_LOG_LEVEL. NO_LOGGING silences a
+ * TAG. The table holds SYS_SERIAL_LOGGING_TAG_LEVELS TAGs, a set level
+ * returns -ERR_NO_RESOURCES if it's full.
+ */
+extern result_t serial_log_set_level(const char *tag, uint8_t level);
+extern result_t serial_log_clear_level(const char *tag);
+extern uint8_t  serial_log_get_level(const char *tag);
+#endif
 #elif defined(__XC8)
 extern void     serial_log(const char* fmt, ...);
 #endif
@@ -70,7 +94,94 @@ extern result_t serial_logging_exit(void);
 //extern void putch(char);
 #endif // (__18F2680) || (__18F4585)
 
-#ifdef XC16
+#if defined(XC16) && defined(SYS_SERIAL_LOGGING_BINARY)
+/*
+ * Binary logging, SYS_SERIAL_LOGGING_BINARY
+ *
+ * Rather than formatting text on the uC each log call sends a short record
+ * which the host tool libesoup/scripts/es_log_decode.py turns back in to the
+ * text using the format and tag strings found in the ELF file of the build.
+ * Text sent with serial_printf() passes through the decoder unchanged.
+ *
+ *   byte 0      ES_LOG_SYNC, never found in the 7 bit text of a log
+ *   byte 1      bits 7-6 Level, bit 5 ES_LOG_WIDE, bits 3-0 Argument count
+ *   id          Address of the TAG string
+ *   id          Address of the format string
+ *   2 bytes     Timestamp, SW Timer ticks if SYS_SW_TIMER_TICKS_COUNT else 0
+ *   args        Each argument in its promoted size
+ *
+ * All fields are little endian. Ids and int arguments are 16 bits on XC16
+ * and 32 bits, flagged by ES_LOG_WIDE, on a 32 or 64 bit host. Long
+ * arguments are 32 bits. A %s argument sends the string's address so only
+ * strings found in the ELF file, such as literals, can be decoded.
+ *
+ * Format strings go in their own section, ES_LOG_FMT_SECTION, which the
+ * linker script can make a non-loaded section so that the strings take up
+ * no Flash at all. A log call takes at most eight arguments.
+ */
+#define ES_LOG_SYNC              0xA5
+#define ES_LOG_WIDE              0x20
+#define ES_LOG_MAX_ARGS          8
+
+#define ES_LOG_FMT_SECTION       __attribute__((section("es_log_fmt")))
+
+struct es_log_arg {
+	uint32_t value;
+	uint8_t  size;     ///< Size in bytes, 1 to 4
+};
+
+/*
+ * Size an argument is promoted to, with pointers sent as 32 bit ids
+ */
+#define ES_LOG_SIZE(a)   ((sizeof((a) + 0) > 4) ? 4 : sizeof((a) + 0))
+#define ES_LOG_ARG(a)    { (uint32_t)(uintmax_t)(a), ES_LOG_SIZE(a) }
+
+#define ES_LOG_A0()
+#define ES_LOG_A1(a)                      ES_LOG_ARG(a)
+#define ES_LOG_A2(a, b)                   ES_LOG_ARG(a), ES_LOG_A1(b)
+#define ES_LOG_A3(a, b, c)                ES_LOG_ARG(a), ES_LOG_A2(b, c)
+#define ES_LOG_A4(a, b, c, d)             ES_LOG_ARG(a), ES_LOG_A3(b, c, d)
+#define ES_LOG_A5(a, b, c, d, e)          ES_LOG_ARG(a), ES_LOG_A4(b, c, d, e)
+#define ES_LOG_A6(a, b, c, d, e, f)       ES_LOG_ARG(a), ES_LOG_A5(b, c, d, e, f)
+#define ES_LOG_A7(a, b, c, d, e, f, g)    ES_LOG_ARG(a), ES_LOG_A6(b, c, d, e, f, g)
+#define ES_LOG_A8(a, b, c, d, e, f, g, h) ES_LOG_ARG(a), ES_LOG_A7(b, c, d, e, f, g, h)
+
+#define ES_LOG_SELECT(_0, _1, _2, _3, _4, _5, _6, _7, _8, name, ...) name
+#define ES_LOG_ARGS(...) \
+	ES_LOG_SELECT(_0, ##__VA_ARGS__, ES_LOG_A8, ES_LOG_A7, ES_LOG_A6, ES_LOG_A5, \
+		      ES_LOG_A4, ES_LOG_A3, ES_LOG_A2, ES_LOG_A1, ES_LOG_A0)(__VA_ARGS__)
+
+#define ES_LOG_BINARY(level, fmt, ...)                                                \
+	do {                                                                           \
+		static const char ES_LOG_FMT_SECTION es_log_fmt[] = fmt;               \
+		const struct es_log_arg es_log_args[] = { { 0, 0 }, ES_LOG_ARGS(__VA_ARGS__) }; \
+		serial_log_binary(level, TAG, es_log_fmt, &es_log_args[1],             \
+				  (sizeof(es_log_args) / sizeof(es_log_args[0])) - 1); \
+	} while(0);
+
+#if defined(DEBUG_FILE) && (SYS_LOG_LEVEL >= LOG_DEBUG)
+#define LOG_D(fmt, ...)  ES_LOG_BINARY(LOG_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOG_D(...)
+#endif
+
+#if defined(DEBUG_FILE) && (SYS_LOG_LEVEL >= LOG_INFO)
+#define LOG_I(fmt, ...)  ES_LOG_BINARY(LOG_INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOG_I(...)
+#endif
+
+#if defined(DEBUG_FILE) && (SYS_LOG_LEVEL >= LOG_WARNING)
+#define LOG_W(fmt, ...)  ES_LOG_BINARY(LOG_WARNING, fmt, ##__VA_ARGS__)
+#else
+#define LOG_W(...)
+#endif
+
+#if (SYS_LOG_LEVEL >= LOG_ERROR)
+#define LOG_E(fmt, ...)  ES_LOG_BINARY(LOG_ERROR, fmt, ##__VA_ARGS__)
+#endif
+
+#elif defined(XC16)
 /*
  * XC16 Compiler does support Variadic Macros see:
  * https://gcc.gnu.org/onlinedocs/cpp/Variadic-Macros.html
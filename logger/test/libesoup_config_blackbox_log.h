@@ -0,0 +1,46 @@
+/*
+ * libesoup_config.h libesoup/logger/test/libesoup_config_blackbox_log.h
+ *
+ * cinnamonBun dsPIC33EP256MU806 configuration for testing the black box log
+ * on the host against the SFR simulation. Copy to a build directory as
+ * libesoup_config.h, see main_blackbox_log.c
+ */
+#ifndef _LIBESOUP_CONFIG_H
+#define _LIBESOUP_CONFIG_H
+
+/*
+ * The simulated xc.h, found through -Ilibesoup/processors/dsPIC33/sim
+ */
+#include <xc.h>
+
+#define SYS_TEST_BLACKBOX_LOG
+
+#define SYS_CLOCK_FREQ 60000000
+
+#define SYS_HW_TIMERS
+#define SYS_SW_TIMERS
+#define SYS_NUMBER_OF_SW_TIMERS    4
+#define SYS_SW_TIMER_TICK_ms       5
+#define SYS_SW_TIMER_TICKS_COUNT
+
+#define SYS_UART1
+#define SYS_UART_TX_BUFFER_SIZE    1024
+
+#define SYS_SERIAL_LOGGING
+#define SYS_SERIAL_LOGGING_BINARY
+#define SYS_SERIAL_PORT_GndRxTx
+#define SYS_SERIAL_LOGGING_BAUD    115200
+#define SYS_LOG_LEVEL              LOG_INFO
+
+/*
+ * The test supplies a RAM SD Card rather than building sd_card.c
+ */
+#define SYS_SD_CARD
+#define SYS_BLACKBOX_LOG
+#define SYS_BLACKBOX_LOG_FIRST_SECTOR   8
+#define SYS_BLACKBOX_LOG_SECTORS        5
+#define SYS_BLACKBOX_LOG_FLUSH_TIMEOUT  100
+
+#include "libesoup/boards/cinnamonBun/dsPIC33/cb-dsPIC33EP256MU806.h"
+
+#endif // _LIBESOUP_CONFIG_H
@@ -0,0 +1,49 @@
+/*
+ * libesoup_config.h libesoup/logger/test/libesoup_config_iso15765_log.h
+ *
+ * cinnamonBun dsPIC33EP256MU806 configuration for testing batched ISO15765
+ * network logging on the host against the SFR simulation. Copy to a build
+ * directory as libesoup_config.h, see main_iso15765_log.c
+ */
+#ifndef _LIBESOUP_CONFIG_H
+#define _LIBESOUP_CONFIG_H
+
+/*
+ * The simulated xc.h, found through -Ilibesoup/processors/dsPIC33/sim
+ */
+#include <xc.h>
+
+#define SYS_TEST_ISO15765_LOG
+
+#define SYS_CLOCK_FREQ 60000000
+
+#define SYS_HW_TIMERS
+#define SYS_SW_TIMERS
+#define SYS_NUMBER_OF_SW_TIMERS    16
+#define SYS_SW_TIMER_TICK_ms       5
+
+#define SYS_UART1
+#define SYS_UART_TX_BUFFER_SIZE    1024
+
+#define SYS_SERIAL_LOGGING
+#define SYS_SERIAL_PORT_GndRxTx
+#define SYS_SERIAL_LOGGING_BAUD    115200
+#define SYS_LOG_LEVEL              LOG_ERROR
+
+#define SYS_SYSTEM_STATUS
+#define SYS_CAN_BUS
+#define SYS_CAN_L2_HANDLER_ARRAY_SIZE        4
+#define SYS_CAN_ISO15765
+#define SYS_CAN_ISO15765_MAX_MSG             270
+#define SYS_CAN_ISO15765_REGISTER_ARRAY_SIZE 4
+#define SYS_CAN_ISO15765_BLOCK_SIZE          8
+#define SYS_CAN_ISO15765_SEPERATION_TIME     7
+
+#define SYS_CAN_ISO15765_LOG
+#define SYS_CAN_ISO15765_LOG_BATCH
+#define SYS_CAN_ISO15765_LOG_BATCH_SIZE      256
+#define SYS_CAN_ISO15765_LOG_BATCH_TIMEOUT   250
+
+#include "libesoup/boards/cinnamonBun/dsPIC33/cb-dsPIC33EP256MU806.h"
+
+#endif // _LIBESOUP_CONFIG_H
@@ -0,0 +1,183 @@
+/*
+ * libesoup/logger/test/main_binary_log.c
+ *
+ * Host test of binary serial logging, SYS_SERIAL_LOGGING_BINARY, against the
+ * SFR simulation. Checks the records sent for each log level and argument
+ * type, and compares the bytes sent with the same logs formatted as text.
+ *
+ * The records are also written to the file given as the first argument,
+ * which can be decoded with the test's own ELF file:
+ *
+ *     libesoup/scripts/es_log_decode.py -t 5 log/binary_log log/binary.log
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir log && cp libesoup/logger/test/libesoup_config_binary_log.h log/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Ilog -I. \
+ *         libesoup/logger/test/main_binary_log.c libesoup/logger/serial_log.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/comms/uart/uart.c libesoup/gpio/gpio.c \
+ *         libesoup/gpio/peripheral.c -o log/binary_log
+ *
+ * The -no-pie keeps addresses within the 32 bits of a record's ids.
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_BINARY_LOG
+
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG_FILE
+static const char *TAG = "BIN_TEST";
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/logger/serial_log.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static uint8_t  line[4096];
+static uint16_t line_count;
+
+static void serial_line(uint8_t uart, uint16_t ch)
+{
+	if(line_count < sizeof(line)) line[line_count++] = (uint8_t)ch;
+}
+
+/*
+ * Move the simulation on until the serial logging UART has been idle for
+ * two milliSeconds.
+ */
+static void drain_serial(void)
+{
+	uint16_t last;
+	uint8_t  idle = 0;
+
+	while(idle < 2) {
+		last = line_count;
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+		idle = (line_count == last) ? idle + 1 : 0;
+	}
+}
+
+static uint32_t get_le(const uint8_t *ptr, uint8_t size)
+{
+	uint32_t value = 0;
+
+	while(size--) {
+		value = (value << 8) | ptr[size];
+	}
+	return(value);
+}
+
+/*
+ * Check the record at *index, moving the index past it
+ */
+static void check_record(uint16_t *index, uint8_t level, const char *fmt, uint8_t count, const uint32_t *values)
+{
+	const uint8_t *ptr = &line[*index];
+	uint8_t        loop;
+	uint32_t       fmt_id;
+
+	CHECK(ptr[0] == ES_LOG_SYNC, "Record at %u starts 0x%02x", *index, ptr[0]);
+	CHECK(ptr[1] == ((level << 6) | ES_LOG_WIDE | count), "Record control 0x%02x", ptr[1]);
+	CHECK(get_le(&ptr[2], 4) == (uint32_t)(uintmax_t)TAG, "Record TAG id 0x%x", get_le(&ptr[2], 4));
+
+	fmt_id = get_le(&ptr[6], 4);
+	CHECK(strcmp((const char *)(uintmax_t)fmt_id, fmt) == 0, "Record format \"%s\"", (const char *)(uintmax_t)fmt_id);
+
+	ptr += 12;
+	for(loop = 0; loop < count; loop++) {
+		CHECK(get_le(ptr, 4) == values[loop], "Argument %u 0x%x expected 0x%x", loop, get_le(ptr, 4), values[loop]);
+		ptr += 4;
+	}
+	*index = (uint16_t)(ptr - line);
+}
+
+static const char *state = "Connected";
+
+static void log_all(void)
+{
+	LOG_D("Started\n\r");
+	LOG_I("Frame 0x%x from %d\n\r", (uint16_t)0x1f3, (uint16_t)42);
+	LOG_W("Lag %ld uS, %c\n\r", (uint32_t)123456UL, 'Z');
+	LOG_E("Bus %s\n\r", state);
+}
+
+static void text_all(void)
+{
+	serial_log(LOG_DEBUG, TAG, "Started\n\r");
+	serial_log(LOG_INFO, TAG, "Frame 0x%x from %d\n\r", (uint16_t)0x1f3, (uint16_t)42);
+	serial_log(LOG_WARNING, TAG, "Lag %ld uS, %c\n\r", (uint32_t)123456UL, 'Z');
+	serial_log(LOG_ERROR, TAG, "Bus %s\n\r", state);
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t info_args[] = { 0x1f3, 42 };
+	static const uint32_t warning_args[] = { 123456, 'Z' };
+	uint32_t              error_args[1];
+	result_t              rc;
+	uint8_t               uart;
+	uint16_t              index;
+	uint16_t              binary_bytes;
+	uint16_t              text_bytes;
+	FILE                 *file;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	for(uart = 0; uart < 4; uart++) sfr_sim_uart_tx_hook(uart, serial_line);
+	drain_serial();
+	line_count = 0;
+
+	log_all();
+	drain_serial();
+	binary_bytes = line_count;
+
+	index = 0;
+	check_record(&index, LOG_DEBUG, "Started\n\r", 0, NULL);
+	check_record(&index, LOG_INFO, "Frame 0x%x from %d\n\r", 2, info_args);
+	check_record(&index, LOG_WARNING, "Lag %ld uS, %c\n\r", 2, warning_args);
+	error_args[0] = (uint32_t)(uintmax_t)state;
+	check_record(&index, LOG_ERROR, "Bus %s\n\r", 1, error_args);
+	CHECK(index == binary_bytes, "%u bytes of records, %u sent", index, binary_bytes);
+
+	if(argc > 1) {
+		file = fopen(argv[1], "wb");
+		CHECK(file != NULL, "Can't open %s", argv[1]);
+		if(file) {
+			fwrite(line, 1, binary_bytes, file);
+			fclose(file);
+		}
+	}
+
+	line_count = 0;
+	text_all();
+	drain_serial();
+	text_bytes = line_count;
+
+	CHECK(binary_bytes < text_bytes, "Binary log %u bytes, text %u", binary_bytes, text_bytes);
+	printf("%u bytes of binary log, %u of text\n", binary_bytes, text_bytes);
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_BINARY_LOG
@@ -0,0 +1,306 @@
+/*
+ * libesoup/logger/test/main_blackbox_log.c
+ *
+ * Host test of the black box log, SYS_BLACKBOX_LOG, against the SFR
+ * simulation with a RAM SD Card. Checks records are only written as whole
+ * sectors, in batches, that an Error is written straight away, that the
+ * newest sector is found on boot, with the ring wrapped to every position
+ * and with its first sector corrupt, and that the read out sends every
+ * record kept, oldest first, with a count of any dropped.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir bblog && cp libesoup/logger/test/libesoup_config_blackbox_log.h bblog/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Ibblog -I. \
+ *         libesoup/logger/test/main_blackbox_log.c libesoup/logger/blackbox_log.c \
+ *         libesoup/logger/serial_log.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/comms/uart/uart.c libesoup/gpio/gpio.c \
+ *         libesoup/gpio/peripheral.c -o bblog/blackbox_log
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_BLACKBOX_LOG
+
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG_FILE
+static const char *TAG = "BB_TEST";
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/logger/serial_log.h"
+#include "libesoup/logger/blackbox_log.h"
+#include "libesoup/comms/spi/devices/sd_card.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+/*
+ * A record of one int argument is 16 bytes, 17 with its length byte, so 29
+ * fit in the 500 bytes of a sector after its header
+ */
+#define RECORDS_PER_SECTOR  29
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+/*
+ * RAM SD Card
+ */
+#define CARD_SECTORS  (SYS_BLACKBOX_LOG_FIRST_SECTOR + SYS_BLACKBOX_LOG_SECTORS + 1)
+
+static uint8_t  card[CARD_SECTORS][SD_CARD_BLOCK_SIZE];
+static uint16_t card_reads;
+static uint16_t card_writes;
+
+result_t sd_card_read(uint32_t sector, uint8_t *buffer)
+{
+	if(sector >= CARD_SECTORS) return(-ERR_ADDRESS_RANGE);
+	memcpy(buffer, card[sector], SD_CARD_BLOCK_SIZE);
+	card_reads++;
+	return(SUCCESS);
+}
+
+result_t sd_card_write(uint32_t sector, uint8_t *buffer)
+{
+	CHECK((sector >= SYS_BLACKBOX_LOG_FIRST_SECTOR) && (sector < SYS_BLACKBOX_LOG_FIRST_SECTOR + SYS_BLACKBOX_LOG_SECTORS),
+	      "Write to sector %u outside the ring", (unsigned)sector);
+	if(sector >= CARD_SECTORS) return(-ERR_ADDRESS_RANGE);
+	memcpy(card[sector], buffer, SD_CARD_BLOCK_SIZE);
+	card_writes++;
+	return(SUCCESS);
+}
+
+static uint8_t  line[8192];
+static uint16_t line_count;
+
+static void serial_line(uint8_t uart, uint16_t ch)
+{
+	if(line_count < sizeof(line)) line[line_count++] = (uint8_t)ch;
+}
+
+static void run_mS(uint16_t mS)
+{
+	while(mS--) {
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+	}
+}
+
+/*
+ * Move the simulation on until the serial logging UART has been idle for
+ * two milliSeconds.
+ */
+static void drain_serial(void)
+{
+	uint16_t last;
+	uint8_t  idle = 0;
+
+	while(idle < 2) {
+		last = line_count;
+		run_mS(1);
+		idle = (line_count == last) ? idle + 1 : 0;
+	}
+}
+
+/*
+ * Reset the node, as far as the black box is concerned, and find the ring's
+ * newest sector again, returning the sector it carries on in
+ */
+static uint32_t reboot(uint16_t *reads)
+{
+	result_t rc;
+	uint8_t  uart;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+	for(uart = 0; uart < 4; uart++) sfr_sim_uart_tx_hook(uart, serial_line);
+
+	card_reads = 0;
+	rc = blackbox_log_init();
+	CHECK(rc >= 0, "blackbox_log_init() %d", rc);
+	if(reads) *reads = card_reads;
+	drain_serial();
+	return(blackbox_log_sequence());
+}
+
+static uint32_t get_le(const uint8_t *ptr, uint8_t size)
+{
+	uint32_t value = 0;
+
+	while(size--) {
+		value = (value << 8) | ptr[size];
+	}
+	return(value);
+}
+
+/*
+ * Collect the argument of each "Count" record in the serial output, and
+ * the number of records reported dropped
+ */
+static uint16_t parse_dump(uint32_t *values, uint16_t size, unsigned *dropped)
+{
+	uint16_t     index = 0;
+	uint16_t     count = 0;
+	uint8_t      args;
+	const char  *fmt;
+	unsigned     number;
+
+	*dropped = 0;
+	while(index < line_count) {
+		if(line[index] != ES_LOG_SYNC) {
+			if(sscanf((char *)&line[index], "W-BLACKBOX:%u records dropped", &number) == 1) {
+				*dropped += number;
+			}
+			while((index < line_count) && (line[index] != '\r')) index++;
+			index++;
+			continue;
+		}
+
+		args = line[index + 1] & 0x0f;
+		fmt = (const char *)(uintmax_t)get_le(&line[index + 6], 4);
+		if((strcmp(fmt, "Count %d\n\r") == 0) && (count < size)) {
+			values[count++] = get_le(&line[index + 12], 4);
+		}
+		index += 12 + (4 * args);
+	}
+	return(count);
+}
+
+static void log_counts(uint16_t first, uint16_t count)
+{
+	while(count--) {
+		LOG_I("Count %d\n\r", first++);
+		run_mS(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t  sequence;
+	uint32_t  values[400];
+	uint16_t  reads;
+	uint16_t  count;
+	uint16_t  loop;
+	unsigned  dropped;
+	boolean   in_order;
+
+	/*
+	 * Empty card, the log starts at the beginning of the ring
+	 */
+	sequence = reboot(NULL);
+	CHECK(sequence == 0, "Empty card starts at sector %u", (unsigned)sequence);
+
+	/*
+	 * 70 records fill two sectors, the rest are written on the flush
+	 * timeout. Nothing is written before then.
+	 */
+	card_writes = 0;
+	log_counts(0, 70);
+	CHECK(card_writes == 2, "%u writes for 2 full sectors", card_writes);
+	run_mS(SYS_BLACKBOX_LOG_FLUSH_TIMEOUT + 20);
+	CHECK(card_writes == 3, "%u writes after the flush timeout", card_writes);
+	printf("70 records in %u sector writes\n", card_writes);
+
+	/*
+	 * An Error goes to the card straight away
+	 */
+	LOG_E("Fault %d\n\r", 1);
+	libesoup_tasks();
+	CHECK(card_writes == 4, "Error not written, %u writes", card_writes);
+	drain_serial();
+
+	sequence = reboot(&reads);
+	CHECK(sequence == 3, "Carries on at sector %u, not 3", (unsigned)sequence);
+	printf("Newest found in %u reads\n", reads);
+
+	/*
+	 * Wrap the ring a few times, then read it all out
+	 */
+	log_counts(1000, 400);
+	blackbox_log_flush();
+	run_mS(5);
+	drain_serial();
+
+	line_count = 0;
+	CHECK(blackbox_log_dump() == 0, "Dump didn't start");
+	CHECK(blackbox_log_dump() == -ERR_BUSY, "Second dump started");
+	drain_serial();
+
+	count = parse_dump(values, 400, &dropped);
+	in_order = TRUE;
+	for(loop = 1; loop < count; loop++) {
+		if(values[loop] != values[loop - 1] + 1) in_order = FALSE;
+	}
+	CHECK(in_order, "Read out records out of order");
+	CHECK(count && (values[count - 1] == 1399), "Read out ends with %u", count ? (unsigned)values[count - 1] : 0);
+	CHECK(count > ((SYS_BLACKBOX_LOG_SECTORS - 1) * RECORDS_PER_SECTOR), "Only %u records read out", count);
+	CHECK(dropped == 0, "%u dropped", dropped);
+	printf("Read out %u records, %u to %u\n", count, count ? (unsigned)values[0] : 0, count ? (unsigned)values[count - 1] : 0);
+
+	/*
+	 * Newest sector at every position of the ring
+	 */
+	for(loop = 0; loop < (2 * SYS_BLACKBOX_LOG_SECTORS); loop++) {
+		sequence = blackbox_log_sequence();
+		log_counts(2000 + loop, 1);
+		blackbox_log_flush();
+		libesoup_tasks();
+
+		CHECK(reboot(&reads) == sequence + 1, "Sector %u written, carries on at %u", (unsigned)sequence, (unsigned)blackbox_log_sequence());
+		CHECK(reads <= 4, "%u reads to find the newest", reads);
+	}
+
+	/*
+	 * Corrupt first sector of the ring, the newest is found by reading all
+	 */
+	sequence = blackbox_log_sequence();
+	if((sequence % SYS_BLACKBOX_LOG_SECTORS) == 1) {
+		log_counts(3000, 1);
+		blackbox_log_flush();
+		libesoup_tasks();
+		sequence = reboot(NULL);
+	}
+	card[SYS_BLACKBOX_LOG_FIRST_SECTOR][20] ^= 0xff;
+	CHECK(reboot(&reads) == sequence, "First sector corrupt, carries on at %u not %u", (unsigned)blackbox_log_sequence(), (unsigned)sequence);
+	CHECK(reads == SYS_BLACKBOX_LOG_SECTORS, "%u reads with the first sector corrupt", reads);
+
+	/*
+	 * A burst faster than the sectors are written drops records, which
+	 * the read out counts
+	 */
+	for(loop = 0; loop < 80; loop++) {
+		LOG_I("Count %d\n\r", 4000 + loop);
+	}
+	run_mS(2);
+	LOG_I("Count %d\n\r", 4080);
+	blackbox_log_flush();
+	run_mS(5);
+	drain_serial();
+
+	line_count = 0;
+	blackbox_log_dump();
+	drain_serial();
+
+	count = parse_dump(values, 400, &dropped);
+	CHECK(dropped == 80 - (2 * RECORDS_PER_SECTOR), "%u records dropped", dropped);
+	CHECK(count && (values[count - 1] == 4080), "Read out ends with %u", count ? (unsigned)values[count - 1] : 0);
+	CHECK((count > 1) && (values[count - 2] == 4000 + (2 * RECORDS_PER_SECTOR) - 1), "Last of the burst kept %u", (count > 1) ? (unsigned)values[count - 2] : 0);
+	printf("Burst of 80 records, %u dropped\n", dropped);
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_BLACKBOX_LOG
@@ -0,0 +1,332 @@
+/*
+ * libesoup/logger/test/main_format_bench.c
+ *
+ * Host benchmark of the integer formatting of serial logging, es_printf(),
+ * against the implementation it replaced, which divided by the base for
+ * each digit and then reversed the string. Both format in to a buffer, the
+ * new one through serial_log_format(), so only the formatting is timed:
+ *
+ *   format/<conversion>       es_printf()
+ *   format_old/<conversion>   the division based itoa() and itoa32bit()
+ *
+ * The output of both is checked against the C library for edge values and
+ * a spread of random values first. On the host division is a single
+ * instruction so the gain here understates the gain on the dsPIC, where a
+ * 32 bit division is a library call of around 500 cycles.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir fmt && cp libesoup/logger/test/libesoup_config_format_bench.h fmt/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Ifmt -I. \
+ *         libesoup/logger/test/main_format_bench.c libesoup/logger/serial_log.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/comms/uart/uart.c libesoup/gpio/gpio.c \
+ *         libesoup/gpio/peripheral.c -o fmt/format_bench
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_FORMAT_BENCH
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/logger/serial_log.h"
+
+#define BENCH_RUNS        5
+#define BENCH_VALUES      1024
+#define RANDOM_CHECKS     100000
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+
+/*
+ * The replaced implementation, as it was in serial_log.c, formatting one
+ * conversion in to a buffer as es_printf() did in to the UART.
+ */
+static void old_reverse(uint8_t str[], uint16_t length)
+{
+	uint8_t tmp;
+	uint16_t start = 0;
+	uint16_t end = length -1;
+	while (start < end) {
+		tmp = str[end];
+		str[end] = str[start];
+		str[start] = tmp;
+		start++;
+		end--;
+	}
+}
+
+static uint8_t *old_itoa(uint16_t num, uint8_t *str, uint8_t base)
+{
+	uint16_t rem;
+	uint16_t i = 0;
+
+	if (num == 0) {
+		str[i++] = '0';
+		str[i] = '\0';
+		return str;
+	}
+
+	while (num != 0) {
+		rem = num % base;
+		str[i++] = (rem > 9)? (rem-10) + 'a' : rem + '0';
+		num = num/base;
+	}
+	str[i] = '\0';
+	old_reverse(str, i);
+	return str;
+}
+
+static uint8_t *old_itoa32bit(uint32_t num, uint8_t *str, uint8_t base)
+{
+	uint32_t rem;
+	uint16_t i = 0;
+
+	if (num == 0) {
+		str[i++] = '0';
+		str[i] = '\0';
+		return str;
+	}
+
+	while (num != 0) {
+		rem = num % base;
+		str[i++] = (rem > 9)? (rem-10) + 'a' : rem + '0';
+		num = num/base;
+	}
+	str[i] = '\0';
+	old_reverse(str, i);
+	return str;
+}
+
+/*
+ * es_printf() as it was, with the UART calls replaced by a copy in to the
+ * buffer, as serial_log_format() does now.
+ */
+static uint16_t old_tx_buffer(uint8_t *buffer, uint16_t length, uint8_t *data, uint16_t len)
+{
+	memcpy(&buffer[length], data, len);
+	return(length + len);
+}
+
+static uint16_t old_printf(uint8_t *buffer, const char * fmt, ...)
+{
+	va_list   args;
+	char     *ptr;
+	uint16_t  i;
+	uint32_t  li;
+	uint8_t   buf[256];
+	uint8_t  *string = NULL;
+	uint16_t  length = 0;
+
+	va_start(args, fmt);
+	ptr = (char *)fmt;
+
+	while(*ptr) {
+
+		if(*ptr != '%') {
+			length = old_tx_buffer(buffer, length, (uint8_t *)ptr, 1);
+		} else {
+			switch(*++ptr) {
+			case 'd':
+				i = (uint16_t)va_arg(args, int);
+				string = old_itoa((uint32_t)i, buf, 10);
+				length = old_tx_buffer(buffer, length, string, strlen((char*)string));
+				break;
+
+			case 'x':
+				i = (uint16_t)va_arg(args, int);
+				string = old_itoa(i, buf, 16);
+				length = old_tx_buffer(buffer, length, string, strlen((char*)string));
+				break;
+
+			case 'l':
+				switch(*++ptr) {
+				case 'd':
+					li = va_arg(args, uint32_t);
+					*buf = 0;
+					string = old_itoa32bit(li, buf, 10);
+					length = old_tx_buffer(buffer, length, buf, strlen((char*)buf));
+					break;
+
+				case 'x':
+					li = va_arg(args, uint32_t);
+					*buf = 0;
+					string = old_itoa32bit(li, buf, 16);
+					length = old_tx_buffer(buffer, length, buf, strlen((char*)buf));
+					break;
+				}
+				break;
+			}
+		}
+		ptr++;
+	}
+	va_end(args);
+	return(length);
+}
+
+static uint16_t old_format(uint8_t *buffer, char conversion, uint32_t value)
+{
+	uint16_t length;
+
+	switch(conversion) {
+	case 'd':
+		length = old_printf(buffer, "%d", (uint16_t)value);
+		break;
+	case 'x':
+		length = old_printf(buffer, "%x", (uint16_t)value);
+		break;
+	case 'D':
+		length = old_printf(buffer, "%ld", value);
+		break;
+	default:
+		length = old_printf(buffer, "%lx", value);
+		break;
+	}
+	buffer[length] = '\0';
+	return(length);
+}
+
+static uint16_t new_format(uint8_t *buffer, char conversion, uint32_t value)
+{
+	uint16_t length;
+
+	switch(conversion) {
+	case 'd':
+		length = serial_log_format(buffer, 16, "%d", (uint16_t)value);
+		break;
+	case 'x':
+		length = serial_log_format(buffer, 16, "%x", (uint16_t)value);
+		break;
+	case 'D':
+		length = serial_log_format(buffer, 16, "%ld", value);
+		break;
+	default:
+		length = serial_log_format(buffer, 16, "%lx", value);
+		break;
+	}
+	buffer[length] = '\0';
+	return(length);
+}
+
+static void check_value(char conversion, uint32_t value)
+{
+	uint8_t new_buffer[16];
+	uint8_t old_buffer[16];
+	char    expected[16];
+
+	switch(conversion) {
+	case 'd': sprintf(expected, "%u", (unsigned)(uint16_t)value); break;
+	case 'x': sprintf(expected, "%x", (unsigned)(uint16_t)value); break;
+	case 'D': sprintf(expected, "%u", (unsigned)value); break;
+	default:  sprintf(expected, "%x", (unsigned)value); break;
+	}
+
+	new_format(new_buffer, conversion, value);
+	old_format(old_buffer, conversion, value);
+	CHECK(strcmp((char *)new_buffer, expected) == 0, "%c 0x%x formatted \"%s\"", conversion, value, new_buffer);
+	CHECK(strcmp((char *)old_buffer, expected) == 0, "%c 0x%x old formatted \"%s\"", conversion, value, old_buffer);
+}
+
+static uint32_t values[BENCH_VALUES];
+
+/*
+ * Time formatting every value, the fastest of BENCH_RUNS runs
+ */
+static double bench(uint16_t (*format)(uint8_t *, char, uint32_t), char conversion)
+{
+	uint8_t  buffer[16];
+	uint32_t chars;
+	uint64_t start;
+	uint64_t ns;
+	uint64_t best = 0;
+	uint16_t run;
+	uint16_t loop;
+
+	for(run = 0; run < BENCH_RUNS; run++) {
+		chars = 0;
+		start = now_ns();
+		for(loop = 0; loop < BENCH_VALUES; loop++) {
+			chars += format(buffer, conversion, values[loop]);
+		}
+		ns = now_ns() - start;
+		if((run == 0) || (ns < best)) best = ns;
+		CHECK(chars > 0, "Nothing formatted");
+	}
+	return((double)best / BENCH_VALUES);
+}
+
+int main(void)
+{
+	static const char        conversions[] = { 'd', 'x', 'D', 'X' };
+	static const char       *names[] = { "d", "x", "ld", "lx" };
+	static const uint32_t    edges[] = { 0, 1, 9, 10, 99, 100, 9999, 10000, 65535, 65536,
+					     81919, 81920, 99999, 100000, 999999999UL, 1000000000UL,
+					     0x7fffffffUL, 0x80000000UL, 0xfffffff9UL, 0xffffffffUL };
+	result_t                 rc;
+	uint32_t                 loop;
+	uint8_t                  conversion;
+	char                     name[32];
+	double                   old_ns;
+	double                   new_ns;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	srand(1);
+	for(conversion = 0; conversion < sizeof(conversions); conversion++) {
+		for(loop = 0; loop < sizeof(edges) / sizeof(edges[0]); loop++) {
+			check_value(conversions[conversion], edges[loop]);
+		}
+		for(loop = 0; loop < RANDOM_CHECKS; loop++) {
+			check_value(conversions[conversion], ((uint32_t)rand() << 16) ^ (uint32_t)rand());
+		}
+	}
+
+	/*
+	 * CAN IDs and counters, a spread of digit counts
+	 */
+	for(loop = 0; loop < BENCH_VALUES; loop++) {
+		values[loop] = ((uint32_t)rand() << 16 ^ (uint32_t)rand()) >> (loop % 29);
+	}
+
+	printf("%-20s %12s %12s\n", "benchmark", "ns/op", "speedup");
+	for(conversion = 0; conversion < sizeof(conversions); conversion++) {
+		old_ns = bench(old_format, conversions[conversion]);
+		new_ns = bench(new_format, conversions[conversion]);
+
+		snprintf(name, sizeof(name), "format_old/%s", names[conversion]);
+		printf("%-20s %12.1f\n", name, old_ns);
+		snprintf(name, sizeof(name), "format/%s", names[conversion]);
+		printf("%-20s %12.1f %11.2fx\n", name, new_ns, old_ns / new_ns);
+	}
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_FORMAT_BENCH
@@ -0,0 +1,246 @@
+/*
+ * libesoup/logger/test/main_iso15765_log.c
+ *
+ * Host test of batched ISO15765 network logging, SYS_CAN_ISO15765_LOG_BATCH,
+ * against the SFR simulation. The node registers itself as the network logger
+ * and the ECAN runs in loopback, so the batches come back to this node's own
+ * handler. Checks every record arrives in order, that batches are flushed on
+ * size and on timeout, that records dropped while the transmitter is busy
+ * are counted in a marker record, and compares the CAN frames used with
+ * sending each record in its own message.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir netlog && cp libesoup/logger/test/libesoup_config_iso15765_log.h netlog/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Inetlog -I. \
+ *         libesoup/logger/test/main_iso15765_log.c libesoup/logger/iso15765_log.c \
+ *         libesoup/comms/can/can.c libesoup/comms/can/frame_dispatch.c \
+ *         libesoup/comms/can/l3_iso15765-2.c libesoup/comms/can/l2_dsPIC33EP256MU806.c \
+ *         libesoup/status/status.c libesoup/logger/serial_log.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/comms/uart/uart.c libesoup/gpio/gpio.c \
+ *         libesoup/gpio/peripheral.c -o netlog/iso15765_log
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_ISO15765_LOG
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/comms/can/can.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+#define NODE_ADDRESS      0x10
+#define RECORDS           40
+
+/*
+ * With a 7mS separation time ISO15765 moves a Consecutive Frame, 7 bytes,
+ * every 7mS, so records are logged no faster than it can send them
+ */
+#define RECORD_PERIOD_mS  40
+#define MAX_RECEIVED      (2 * RECORDS)
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+struct record {
+	uint8_t  level;
+	uint8_t  binary;
+	uint8_t  len;
+	char     data[64];
+};
+
+static struct record received[MAX_RECEIVED];
+static uint16_t      received_count;
+static uint16_t      messages;
+static uint32_t      frames;
+
+static void frame_counter(uint32_t can_id, uint8_t dlc, const uint8_t *data)
+{
+	frames++;
+}
+
+/*
+ * The logger's end, unpacking each batch
+ */
+static void logger_handler(iso15765_msg_t *msg)
+{
+	uint8_t *ptr = msg->data;
+	uint8_t *end = msg->data + msg->size;
+	struct record *record;
+
+	messages++;
+	while((ptr < end) && (received_count < MAX_RECEIVED)) {
+		record = &received[received_count++];
+		record->level  = *ptr & ~ISO15765_LOG_BINARY;
+		record->binary = (*ptr++ & ISO15765_LOG_BINARY) != 0;
+		if(record->binary) {
+			record->len = *ptr++;
+			memcpy(record->data, ptr, record->len);
+			ptr += record->len;
+		} else {
+			strncpy(record->data, (char *)ptr, sizeof(record->data) - 1);
+			record->len = (uint8_t)strlen(record->data);
+			ptr += strlen((char *)ptr) + 1;
+		}
+	}
+	CHECK(ptr == end, "Message of %u bytes has %d bytes left over", msg->size, (int)(end - ptr));
+}
+
+static void run_ms(uint16_t ms)
+{
+	while(ms--) {
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+	}
+}
+
+static void reset_counts(void)
+{
+	received_count = 0;
+	messages = 0;
+	frames = 0;
+}
+
+static void log_record(uint16_t index)
+{
+	char    text[40];
+	uint8_t data[8];
+
+	if((index % 10) == 9) {
+		memset(data, (uint8_t)index, sizeof(data));
+		iso15765_log_binary(LOG_INFO, data, sizeof(data));
+	} else {
+		sprintf(text, "Node 0x10 temperature %u ok", index);
+		iso15765_log(LOG_INFO, text);
+	}
+}
+
+static void check_record(uint16_t position, uint16_t index)
+{
+	char            text[40];
+	struct record  *record = &received[position];
+
+	CHECK(record->level == LOG_INFO, "Record %u level %u", position, record->level);
+	if((index % 10) == 9) {
+		CHECK(record->binary && (record->len == 8) && ((uint8_t)record->data[7] == (uint8_t)index),
+		      "Record %u not binary record %u", position, index);
+	} else {
+		sprintf(text, "Node 0x10 temperature %u ok", index);
+		CHECK(!record->binary && (strcmp(record->data, text) == 0), "Record %u \"%s\" expected \"%s\"",
+		      position, record->data, text);
+	}
+}
+
+int main(void)
+{
+	result_t           rc;
+	iso15765_target_t  target;
+	uint16_t           index;
+	uint16_t           last;
+	uint16_t           waited;
+	uint32_t           batched_frames;
+	uint32_t           single_frames;
+	unsigned           dropped;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	rc = can_init(baud_250K, NODE_ADDRESS, NULL, loopback);
+	CHECK(rc >= 0, "can_init() %d", rc);
+
+	rc = iso15765_init(NODE_ADDRESS);
+	CHECK(rc >= 0, "iso15765_init() %d", rc);
+
+	target.protocol = CAN_ISO15765_LOGGER_PROTOCOL_ID;
+	target.handler  = logger_handler;
+	rc = iso15765_dispatch_reg_handler(&target);
+	CHECK(rc >= 0, "iso15765_dispatch_reg_handler() %d", rc);
+
+	iso15765_logger_register_remote(NODE_ADDRESS, LOG_DEBUG);
+	sfr_sim_can_tx_hook(frame_counter);
+	run_ms(100);
+
+	/*
+	 * A steady stream of records, batched
+	 */
+	reset_counts();
+	for(index = 0; index < RECORDS; index++) {
+		log_record(index);
+		run_ms(RECORD_PERIOD_mS);
+	}
+	run_ms(2000);
+	batched_frames = frames;
+
+	CHECK(received_count == RECORDS, "%u of %u batched records received", received_count, RECORDS);
+	for(index = 0; index < received_count && index < RECORDS; index++) check_record(index, index);
+	CHECK(messages < RECORDS / 4, "%u messages for %u records", messages, RECORDS);
+
+	/*
+	 * The same records each sent in its own message, as before batching
+	 */
+	reset_counts();
+	for(index = 0; index < RECORDS; index++) {
+		last = received_count;
+		log_record(index);
+		rc = iso15765_log_flush();
+		CHECK(rc >= 0, "iso15765_log_flush() %d", rc);
+		for(waited = 0; (received_count == last) && (waited < 1000); waited++) run_ms(1);
+		run_ms(1);
+	}
+	single_frames = frames;
+	CHECK(received_count == RECORDS, "%u of %u single records received", received_count, RECORDS);
+	CHECK(messages == RECORDS, "%u messages for %u single records", messages, RECORDS);
+	CHECK(batched_frames < single_frames, "Batched %u frames, single %u", batched_frames, single_frames);
+	printf("%u records: %u CAN frames batched, %u sent singly\n", RECORDS, batched_frames, single_frames);
+
+	/*
+	 * A lone record waits for the timeout
+	 */
+	reset_counts();
+	log_record(0);
+	run_ms(SYS_CAN_ISO15765_LOG_BATCH_TIMEOUT / 2);
+	CHECK(received_count == 0, "Record sent before the timeout");
+	run_ms(SYS_CAN_ISO15765_LOG_BATCH_TIMEOUT / 2 + 100);
+	CHECK(received_count == 1, "Record not sent on timeout");
+
+	/*
+	 * A burst while the transmitter is busy drops records, then reports
+	 * the number dropped
+	 */
+	reset_counts();
+	for(index = 0; index < RECORDS; index++) log_record(index);
+	run_ms(2000);
+
+	CHECK(received_count > 1, "%u records of the burst received", received_count);
+	if(received_count > 1) {
+		for(index = 0; index < received_count - 1; index++) check_record(index, index);
+		CHECK(sscanf(received[received_count - 1].data, "%u log records dropped", &dropped) == 1,
+		      "Last record \"%s\"", received[received_count - 1].data);
+		CHECK(received[received_count - 1].level == LOG_WARNING, "Dropped record level %u",
+		      received[received_count - 1].level);
+		CHECK((received_count - 1) + dropped == RECORDS, "%u received, %u dropped of %u",
+		      received_count - 1, dropped, RECORDS);
+	}
+	CHECK(sfr_sim_can_overflows() == 0, "CAN FIFO overflowed");
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_ISO15765_LOG
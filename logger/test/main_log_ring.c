@@ -0,0 +1,289 @@
+/*
+ * libesoup/logger/test/main_log_ring.c
+ *
+ * Host test of the serial log ring, SYS_SERIAL_LOGGING_RING_SIZE, and the
+ * runtime log levels, SYS_SERIAL_LOGGING_TAG_LEVELS, against the SFR
+ * simulation. Checks that log calls never wait on the UART, that a burst
+ * too big for the ring drops records by the configured policy and reports
+ * them in a single marker line, that TAG levels filter log calls, and that
+ * serial_log_flush() empties the ring without the main loop.
+ *
+ * Build on Linux from the directory containing libesoup, once for each drop
+ * policy, dropping the newest record:
+ *
+ *     mkdir ring && cp libesoup/logger/test/libesoup_config_log_ring.h ring/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Iring -I. \
+ *         libesoup/logger/test/main_log_ring.c libesoup/logger/serial_log.c libesoup/core.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/comms/uart/uart.c libesoup/gpio/gpio.c \
+ *         libesoup/gpio/peripheral.c -o ring/log_ring
+ *
+ * and with -DSYS_SERIAL_LOGGING_DROP_OLDEST added, dropping the oldest.
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_LOG_RING
+
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG_FILE
+static const char *TAG = "RING_TEST";
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/logger/serial_log.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+#define BURST             40
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static char     line[8192];
+static uint16_t line_count;
+
+static void serial_line(uint8_t uart, uint16_t ch)
+{
+	if(line_count < sizeof(line) - 1) line[line_count++] = (char)ch;
+	line[line_count] = '\0';
+}
+
+/*
+ * Move the simulation on until the serial logging UART has been idle for
+ * two milliSeconds.
+ */
+static void drain_serial(void)
+{
+	uint16_t last;
+	uint8_t  idle = 0;
+
+	while(idle < 2) {
+		last = line_count;
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+		idle = (line_count == last) ? idle + 1 : 0;
+	}
+}
+
+/*
+ * Return the next "\n\r" terminated line of the output, from *index
+ */
+static char *next_line(uint16_t *index, char *buffer, uint16_t size)
+{
+	char     *end;
+	uint16_t  len;
+
+	end = strstr(&line[*index], "\n\r");
+	if(!end) return(NULL);
+
+	len = (uint16_t)(end - &line[*index]);
+	if(len >= size) len = size - 1;
+	memcpy(buffer, &line[*index], len);
+	buffer[len] = '\0';
+	*index = (uint16_t)(end - line) + 2;
+	return(buffer);
+}
+
+static void test_burst(void)
+{
+	char      buffer[80];
+	char      expected[80];
+	uint16_t  index = 0;
+	uint16_t  record;
+	uint16_t  sent;
+	uint16_t  first;
+	unsigned  dropped = 0;
+
+	line_count = 0;
+	for(record = 0; record < BURST; record++) {
+		LOG_I("Record %d\n\r", record);
+	}
+	CHECK(line_count == 0, "%u bytes sent before the ring was drained", line_count);
+
+	/*
+	 * Move a few records to the UART, then log one more which has to
+	 * follow all the records dropped, and their marker.
+	 */
+	libesoup_tasks();
+	LOG_I("After\n\r");
+	drain_serial();
+
+	/*
+	 * The ring holds SYS_SERIAL_LOGGING_RING_SIZE bytes of 23 byte lines
+	 * and their length bytes.
+	 */
+	sent = SYS_SERIAL_LOGGING_RING_SIZE / 24;
+
+#ifdef SYS_SERIAL_LOGGING_DROP_OLDEST
+	CHECK(next_line(&index, buffer, sizeof(buffer)) != NULL, "No marker line");
+	CHECK(sscanf(buffer, "W-SERIAL_LOG:%u log records dropped", &dropped) == 1, "Marker \"%s\"", buffer);
+	first = BURST - sent;
+#else
+	first = 0;
+#endif
+	for(record = first; record < first + sent; record++) {
+		sprintf(expected, "I-%s:Record %u", TAG, record);
+		if(!next_line(&index, buffer, sizeof(buffer))) {
+			CHECK(0, "Record %u missing", record);
+			break;
+		}
+		CHECK(strcmp(buffer, expected) == 0, "\"%s\" expected \"%s\"", buffer, expected);
+	}
+#ifndef SYS_SERIAL_LOGGING_DROP_OLDEST
+	CHECK(next_line(&index, buffer, sizeof(buffer)) != NULL, "No marker line");
+	CHECK(sscanf(buffer, "W-SERIAL_LOG:%u log records dropped", &dropped) == 1, "Marker \"%s\"", buffer);
+#endif
+	CHECK(dropped == BURST - sent, "%u dropped, expected %u", dropped, BURST - sent);
+
+	sprintf(expected, "I-%s:After", TAG);
+	CHECK(next_line(&index, buffer, sizeof(buffer)) != NULL, "No line after the burst");
+	CHECK(strcmp(buffer, expected) == 0, "\"%s\" after the burst", buffer);
+	CHECK(index == line_count, "%u bytes after the records", line_count - index);
+}
+
+static void test_truncation(void)
+{
+	static const char *digits = "0123456789012345678901234567890123456789";
+	char               expected[128];
+
+	line_count = 0;
+	LOG_E("%s%s\n\r", digits, digits);
+	drain_serial();
+
+	sprintf(expected, "E-%s:%s%s", TAG, digits, digits);
+	expected[SYS_SERIAL_LOGGING_LINE_SIZE] = '\0';
+	CHECK(line_count == SYS_SERIAL_LOGGING_LINE_SIZE, "Long line sent as %u bytes", line_count);
+	CHECK(strcmp(line, expected) == 0, "Long line \"%s\"", line);
+}
+
+static void test_levels(void)
+{
+	char     tag_copy[16];
+	char     expected[80];
+	result_t rc;
+
+	CHECK(serial_log_get_level(TAG) == SYS_LOG_LEVEL, "Default level %u", serial_log_get_level(TAG));
+
+	rc = serial_log_set_level(TAG, LOG_WARNING);
+	CHECK(rc == 0, "Set level %d", rc);
+
+	line_count = 0;
+	LOG_D("Debug\n\r");
+	LOG_I("Info\n\r");
+	LOG_W("Warning\n\r");
+	serial_log(LOG_INFO, "OTHER", "Other\n\r");
+	drain_serial();
+	sprintf(expected, "W-%s:Warning\n\rI-OTHER:Other\n\r", TAG);
+	CHECK(strcmp(line, expected) == 0, "TAG at Warning sent \"%s\"", line);
+
+	/*
+	 * A TAG given by name, rather than pointer, as from a comms channel
+	 */
+	strcpy(tag_copy, "RING_TEST");
+	rc = serial_log_set_level(tag_copy, NO_LOGGING);
+	CHECK(rc == 0, "Set level by name %d", rc);
+	CHECK(serial_log_get_level(TAG) == NO_LOGGING, "Level by name %u", serial_log_get_level(TAG));
+
+	rc = serial_log_set_level(NULL, LOG_ERROR);
+	CHECK(rc == 0, "Set default level %d", rc);
+
+	line_count = 0;
+	LOG_E("Error\n\r");
+	serial_log(LOG_WARNING, "OTHER", "Other\n\r");
+	serial_log(LOG_ERROR, "OTHER", "Other\n\r");
+	drain_serial();
+	CHECK(strcmp(line, "E-OTHER:Other\n\r") == 0, "Default Error level sent \"%s\"", line);
+
+	/*
+	 * The table holds SYS_SERIAL_LOGGING_TAG_LEVELS TAGs
+	 */
+	rc = serial_log_set_level("SECOND", LOG_DEBUG);
+	CHECK(rc == 0, "Set second TAG %d", rc);
+	rc = serial_log_set_level("THIRD", LOG_DEBUG);
+	CHECK(rc == -ERR_NO_RESOURCES, "Set TAG in full table %d", rc);
+	rc = serial_log_set_level(TAG, NO_LOGGING + 1);
+	CHECK(rc == -ERR_BAD_INPUT_PARAMETER, "Set bad level %d", rc);
+
+	rc = serial_log_clear_level(TAG);
+	CHECK(rc == 0, "Clear level %d", rc);
+	CHECK(serial_log_get_level(TAG) == LOG_ERROR, "Cleared TAG level %u", serial_log_get_level(TAG));
+	rc = serial_log_set_level(NULL, SYS_LOG_LEVEL);
+	CHECK(rc == 0, "Restore default level %d", rc);
+}
+
+/*
+ * serial_log_flush(), as called by RC_CHECK_STOP, has to get a ring's worth
+ * of records out without the main loop ever running again.
+ */
+static void test_flush(void)
+{
+	char      buffer[80];
+	char      expected[80];
+	uint16_t  index = 0;
+	uint16_t  record;
+	uint16_t  records;
+	uint16_t  last;
+	uint8_t   idle = 0;
+	result_t  rc;
+
+	records = SYS_SERIAL_LOGGING_RING_SIZE / 24;
+	line_count = 0;
+	for(record = 0; record < records; record++) {
+		LOG_E("Record %d\n\r", record);
+	}
+	rc = serial_log_flush();
+	CHECK(rc == 0, "serial_log_flush() %d", rc);
+
+	while(idle < 2) {
+		last = line_count;
+		sfr_sim_run(CYCLES_PER_mS);
+		idle = (line_count == last) ? idle + 1 : 0;
+	}
+
+	for(record = 0; record < records; record++) {
+		sprintf(expected, "E-%s:Record %u", TAG, record);
+		CHECK(next_line(&index, buffer, sizeof(buffer)) != NULL, "Record %u not flushed", record);
+		CHECK(strcmp(buffer, expected) == 0, "\"%s\" expected \"%s\"", buffer, expected);
+	}
+	CHECK(index == line_count, "%u bytes after the flushed records", line_count - index);
+}
+
+int main(int argc, char **argv)
+{
+	result_t rc;
+	uint8_t  uart;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	for(uart = 0; uart < 4; uart++) sfr_sim_uart_tx_hook(uart, serial_line);
+	drain_serial();
+
+	test_burst();
+	test_truncation();
+	test_levels();
+	test_flush();
+
+#ifdef SYS_SERIAL_LOGGING_DROP_OLDEST
+	printf("Drop oldest ");
+#else
+	printf("Drop newest ");
+#endif
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_LOG_RING
@@ -149,6 +149,47 @@ enum uart_channel {
 #define U4_TX_ISR_PRIOTITY IPC22bits.U4TXIP    ///< UART 4 Transmit Interrupt Priority SFR
 #define U4_TX_ISR_ENABLE   IEC5bits.U4TXIE     ///< UART 4 Transmit Interrupt Enable SFR Bit
 
+#define U1_RX_DMA_REQUEST  0x0b                ///< UART 1 Receive DMAxREQ IRQSEL
+#define U1_TX_DMA_REQUEST  0x0c                ///< UART 1 Transmit DMAxREQ IRQSEL
+#define U2_RX_DMA_REQUEST  0x1e                ///< UART 2 Receive DMAxREQ IRQSEL
+#define U2_TX_DMA_REQUEST  0x1f                ///< UART 2 Transmit DMAxREQ IRQSEL
+#define U3_RX_DMA_REQUEST  0x52                ///< UART 3 Receive DMAxREQ IRQSEL
+#define U3_TX_DMA_REQUEST  0x53                ///< UART 3 Transmit DMAxREQ IRQSEL
+#define U4_RX_DMA_REQUEST  0x59                ///< UART 4 Receive DMAxREQ IRQSEL
+#define U4_TX_DMA_REQUEST  0x5a                ///< UART 4 Transmit DMAxREQ IRQSEL
+
+/**
+ * @brief DMA Channels 2 to 7, used by the UARTs with SYS_UART_DMA
+ */
+#define DMA2_ISR_FLAG      IFS1bits.DMA2IF     ///< DMA Channel 2 Interrupt Flag SFR Bit
+#define DMA2_ISR_PRIOTITY  IPC6bits.DMA2IP     ///< DMA Channel 2 Interrupt Priority SFR
+#define DMA2_ISR_ENABLE    IEC1bits.DMA2IE     ///< DMA Channel 2 Interrupt Enable SFR Bit
+#define DMA3_ISR_FLAG      IFS2bits.DMA3IF     ///< DMA Channel 3 Interrupt Flag SFR Bit
+#define DMA3_ISR_PRIOTITY  IPC9bits.DMA3IP     ///< DMA Channel 3 Interrupt Priority SFR
+#define DMA3_ISR_ENABLE    IEC2bits.DMA3IE     ///< DMA Channel 3 Interrupt Enable SFR Bit
+#define DMA4_ISR_FLAG      IFS2bits.DMA4IF     ///< DMA Channel 4 Interrupt Flag SFR Bit
+#define DMA4_ISR_PRIOTITY  IPC11bits.DMA4IP    ///< DMA Channel 4 Interrupt Priority SFR
+#define DMA4_ISR_ENABLE    IEC2bits.DMA4IE     ///< DMA Channel 4 Interrupt Enable SFR Bit
+#define DMA5_ISR_FLAG      IFS3bits.DMA5IF     ///< DMA Channel 5 Interrupt Flag SFR Bit
+#define DMA5_ISR_PRIOTITY  IPC15bits.DMA5IP    ///< DMA Channel 5 Interrupt Priority SFR
+#define DMA5_ISR_ENABLE    IEC3bits.DMA5IE     ///< DMA Channel 5 Interrupt Enable SFR Bit
+#define DMA6_ISR_FLAG      IFS4bits.DMA6IF     ///< DMA Channel 6 Interrupt Flag SFR Bit
+#define DMA6_ISR_PRIOTITY  IPC17bits.DMA6IP    ///< DMA Channel 6 Interrupt Priority SFR
+#define DMA6_ISR_ENABLE    IEC4bits.DMA6IE     ///< DMA Channel 6 Interrupt Enable SFR Bit
+#define DMA7_ISR_FLAG      IFS4bits.DMA7IF     ///< DMA Channel 7 Interrupt Flag SFR Bit
+#define DMA7_ISR_PRIOTITY  IPC17bits.DMA7IP    ///< DMA Channel 7 Interrupt Priority SFR
+#define DMA7_ISR_ENABLE    IEC4bits.DMA7IE     ///< DMA Channel 7 Interrupt Enable SFR Bit
+
+/**
+ * @brief DMAxCON and DMAxREQ bits
+ */
+#define DMA_CHEN_MASK            0x8000   ///< Channel Enable bit
+#define DMA_SIZE_BYTE_MASK       0x4000   ///< Byte, rather than Word, transfers
+#define DMA_DIR_TO_PERIPH_MASK   0x2000   ///< Read from RAM, write to the peripheral
+#define DMA_MODE_ONE_SHOT        0x0001   ///< One-Shot, rather than Continuous, mode
+#define DMA_MODE_PING_PONG       0x0002   ///< Ping-Pong mode, DMAxSTA then DMAxSTB
+#define DMA_FORCE_MASK           0x8000   ///< DMAxREQ Force a single transfer
+
 /**
  * @brief UART Modes of operation bit field for the UxMODE SFR
  */
@@ -185,6 +226,15 @@ enum uart_channel {
 #define PDSEL0_MASK      0x0002
 #define STSEL_MASK       0x0001   ///< Stop Bit Selection bit
 
+/**
+ * @brief UART Status bits of the UxSTA SFR
+ */
+#define UTXISEL1_MASK    0x8000   ///< Transmission Interrupt Mode Selection bit 1
+#define UTXISEL0_MASK    0x2000   ///< Transmission Interrupt Mode Selection bit 0
+#define TRMT_MASK        0x0100   ///< Transmit Shift Register Empty bit
+#define URXISEL_MASK     0x00c0   ///< Receive Interrupt Mode Selection bits
+#define OERR_MASK        0x0002   ///< Receive Buffer Overrun Error Status bit
+
 /*
  * I2C Channels
  */
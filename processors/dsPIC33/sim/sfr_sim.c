@@ -0,0 +1,1537 @@
+/**
+ * @file libesoup/processors/dsPIC33/sim/sfr_sim.c
+ *
+ * @author John Whitmore
+ *
+ * @brief Host simulation of the dsPIC33EP256MU806 peripherals
+ *
+ * Copyright 2017-2020 electronicSoup Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the version 2 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ *
+ * Each peripheral model has an advance function, moving it on a number of
+ * instruction cycles, and a next event function giving the number of cycles
+ * until it next changes something the CPU can see. sfr_sim_run() steps all
+ * the models from event to event and takes any pending interrupts after each
+ * step, so a long run costs little more than the events in it.
+ */
+#include <stddef.h>
+#include <string.h>
+
+#include <xc.h>
+
+#include "sfr_sim.h"
+
+#define NO_EVENT          0xffffffffUL
+
+#define NUM_TIMERS        5
+#define NUM_UARTS         4
+#define UART_FIFO_SIZE    4
+#define UART_UNWRITTEN    0xfe00
+#define NUM_CAN_TX        8
+#define NUM_DMA_CHANNELS  8
+#define CAN_BUFFER_WORDS  8
+#define ADC_CHANNELS      32
+
+/*
+ * \cond
+ * Register storage
+ */
+volatile sim_SR_t       sim_SR;
+volatile sim_INTCON1_t  sim_INTCON1;
+volatile sim_INTCON2_t  sim_INTCON2;
+
+volatile sim_IFS0_t     sim_IFS0;
+volatile sim_IFS1_t     sim_IFS1;
+volatile sim_IFS2_t     sim_IFS2;
+volatile sim_IFS3_t     sim_IFS3;
+volatile sim_IFS4_t     sim_IFS4;
+volatile sim_IFS5_t     sim_IFS5;
+volatile sim_IEC0_t     sim_IEC0;
+volatile sim_IEC1_t     sim_IEC1;
+volatile sim_IEC2_t     sim_IEC2;
+volatile sim_IEC3_t     sim_IEC3;
+volatile sim_IEC4_t     sim_IEC4;
+volatile sim_IEC5_t     sim_IEC5;
+volatile sim_IPC0_t     sim_IPC0;
+volatile sim_IPC1_t     sim_IPC1;
+volatile sim_IPC2_t     sim_IPC2;
+volatile sim_IPC3_t     sim_IPC3;
+volatile sim_IPC4_t     sim_IPC4;
+volatile sim_IPC6_t     sim_IPC6;
+volatile sim_IPC7_t     sim_IPC7;
+volatile sim_IPC8_t     sim_IPC8;
+volatile sim_IPC9_t     sim_IPC9;
+volatile sim_IPC11_t    sim_IPC11;
+volatile sim_IPC15_t    sim_IPC15;
+volatile sim_IPC17_t    sim_IPC17;
+volatile sim_IPC20_t    sim_IPC20;
+volatile sim_IPC22_t    sim_IPC22;
+
+volatile sim_OSCCON_t   sim_OSCCON;
+volatile sim_CLKDIV_t   sim_CLKDIV;
+volatile sim_PLLFBD_t   sim_PLLFBD;
+volatile sim_ACLKCON3_t sim_ACLKCON3;
+volatile sim_ACLKDIV3_t sim_ACLKDIV3;
+
+volatile sim_txcon_t    sim_T1CON;
+volatile sim_txcon_t    sim_T2CON;
+volatile sim_txcon_t    sim_T3CON;
+volatile sim_txcon_t    sim_T4CON;
+volatile sim_txcon_t    sim_T5CON;
+volatile uint16_t       sim_TMR1;
+volatile uint16_t       sim_TMR2;
+volatile uint16_t       sim_TMR3;
+volatile uint16_t       sim_TMR4;
+volatile uint16_t       sim_TMR5;
+volatile uint16_t       sim_PR1;
+volatile uint16_t       sim_PR2;
+volatile uint16_t       sim_PR3;
+volatile uint16_t       sim_PR4;
+volatile uint16_t       sim_PR5;
+
+volatile sim_uxmode_t   sim_UMODE[NUM_UARTS];
+volatile sim_uxsta_t    sim_USTA[NUM_UARTS];
+volatile uint16_t       sim_UBRG[NUM_UARTS];
+
+volatile sim_AD1CON1_t  sim_AD1CON1;
+volatile sim_AD1CON2_t  sim_AD1CON2;
+volatile sim_AD1CON3_t  sim_AD1CON3;
+volatile sim_AD1CON4_t  sim_AD1CON4;
+volatile sim_AD1CHS0_t  sim_AD1CHS0;
+volatile sim_AD1CSSL_t  sim_AD1CSSL;
+volatile sim_AD1CSSH_t  sim_AD1CSSH;
+volatile uint16_t       sim_ADC1BUF[16];
+
+#define SIM_PORT_STORAGE(x)                                                    \
+	volatile sim_TRIS##x##_t  sim_TRIS##x;                                 \
+	volatile sim_PORT##x##_t  sim_PORT##x;                                 \
+	volatile sim_LAT##x##_t   sim_LAT##x;                                  \
+	volatile sim_ODC##x##_t   sim_ODC##x;                                  \
+	volatile sim_ANSEL##x##_t sim_ANSEL##x;                                \
+	volatile sim_CNEN##x##_t  sim_CNEN##x;                                 \
+	volatile sim_CNPU##x##_t  sim_CNPU##x;                                 \
+	volatile sim_CNPD##x##_t  sim_CNPD##x;
+
+SIM_PORT_STORAGE(B)
+SIM_PORT_STORAGE(C)
+SIM_PORT_STORAGE(D)
+SIM_PORT_STORAGE(E)
+SIM_PORT_STORAGE(F)
+SIM_PORT_STORAGE(G)
+
+volatile sim_RPINR18_t  sim_RPINR18;
+volatile sim_RPINR19_t  sim_RPINR19;
+volatile sim_RPINR26_t  sim_RPINR26;
+volatile sim_RPINR27_t  sim_RPINR27;
+volatile sim_RPINR28_t  sim_RPINR28;
+volatile sim_RPOR0_t    sim_RPOR0;
+volatile sim_RPOR1_t    sim_RPOR1;
+volatile sim_RPOR2_t    sim_RPOR2;
+volatile sim_RPOR3_t    sim_RPOR3;
+volatile sim_RPOR4_t    sim_RPOR4;
+volatile sim_RPOR5_t    sim_RPOR5;
+volatile sim_RPOR6_t    sim_RPOR6;
+volatile sim_RPOR7_t    sim_RPOR7;
+volatile sim_RPOR8_t    sim_RPOR8;
+volatile sim_RPOR9_t    sim_RPOR9;
+volatile sim_RPOR10_t   sim_RPOR10;
+volatile sim_RPOR11_t   sim_RPOR11;
+volatile sim_RPOR12_t   sim_RPOR12;
+volatile sim_RPOR13_t   sim_RPOR13;
+volatile sim_RPOR14_t   sim_RPOR14;
+
+volatile sim_dma_t      sim_DMA[NUM_DMA_CHANNELS];
+
+volatile sim_C1CTRL1_t  sim_C1CTRL1;
+volatile sim_C1CTRL2_t  sim_C1CTRL2;
+volatile sim_C1VEC_t    sim_C1VEC;
+volatile sim_C1FCTRL_t  sim_C1FCTRL;
+volatile sim_C1FIFO_t   sim_C1FIFO;
+volatile sim_C1INTF_t   sim_C1INTF;
+volatile sim_C1INTE_t   sim_C1INTE;
+volatile sim_C1EC_t     sim_C1EC;
+volatile sim_C1CFG1_t   sim_C1CFG1;
+volatile sim_C1CFG2_t   sim_C1CFG2;
+volatile uint16_t       sim_C1BUFPNT1;
+volatile uint16_t       sim_C1BUFPNT2;
+volatile uint16_t       sim_C1BUFPNT3;
+volatile uint16_t       sim_C1BUFPNT4;
+volatile uint16_t       sim_C1FMSKSEL1;
+volatile uint16_t       sim_C1FMSKSEL2;
+volatile uint16_t       sim_C1RXM0SID;
+volatile uint16_t       sim_C1RXM0EID;
+volatile uint16_t       sim_C1RXM1SID;
+volatile uint16_t       sim_C1RXM1EID;
+volatile uint16_t       sim_C1RXM2SID;
+volatile uint16_t       sim_C1RXM2EID;
+volatile uint16_t       sim_C1FEN1;
+volatile uint16_t       sim_C1RXFUL1;
+volatile uint16_t       sim_C1RXFUL2;
+volatile uint16_t       sim_C1RXOVF1;
+volatile uint16_t       sim_C1RXOVF2;
+volatile uint16_t       sim_C1TXD;
+volatile uint16_t       sim_C1RXD;
+volatile uint16_t       sim_C1TRCON[4];
+/*
+ * \endcond
+ */
+
+/*
+ * The drivers' ISRs, weak so a test need only link the drivers it uses
+ */
+extern void _T1Interrupt(void)   __attribute__((weak));
+extern void _T2Interrupt(void)   __attribute__((weak));
+extern void _T3Interrupt(void)   __attribute__((weak));
+extern void _T4Interrupt(void)   __attribute__((weak));
+extern void _T5Interrupt(void)   __attribute__((weak));
+extern void _U1RXInterrupt(void) __attribute__((weak));
+extern void _U1TXInterrupt(void) __attribute__((weak));
+extern void _U2RXInterrupt(void) __attribute__((weak));
+extern void _U2TXInterrupt(void) __attribute__((weak));
+extern void _U3RXInterrupt(void) __attribute__((weak));
+extern void _U3TXInterrupt(void) __attribute__((weak));
+extern void _U4RXInterrupt(void) __attribute__((weak));
+extern void _U4TXInterrupt(void) __attribute__((weak));
+extern void _AD1Interrupt(void)  __attribute__((weak));
+extern void _CNInterrupt(void)   __attribute__((weak));
+extern void _C1Interrupt(void)   __attribute__((weak));
+extern void _DMA2Interrupt(void) __attribute__((weak));
+extern void _DMA3Interrupt(void) __attribute__((weak));
+extern void _DMA4Interrupt(void) __attribute__((weak));
+extern void _DMA5Interrupt(void) __attribute__((weak));
+extern void _DMA6Interrupt(void) __attribute__((weak));
+extern void _DMA7Interrupt(void) __attribute__((weak));
+
+/*
+ * \cond
+ * An interrupt source, its flag and enable bit and its priority field
+ */
+struct vector {
+	volatile uint16_t *ifs;
+	volatile uint16_t *iec;
+	uint8_t            bit;
+	volatile uint16_t *ipc;
+	uint8_t            shift;
+	void             (*isr)(void);
+};
+
+struct flag {
+	volatile uint16_t *ifs;
+	volatile uint16_t *iec;
+	uint8_t            bit;
+};
+/*
+ * \endcond
+ */
+
+#define VECTOR(ifs, iec, bit, ipc, shift, isr)  { &sim_##ifs.reg, &sim_##iec.reg, bit, &sim_##ipc.reg, shift, isr }
+
+/*
+ * In natural order, which decides between sources of the same priority
+ */
+static const struct vector vectors[] = {
+	VECTOR(IFS0, IEC0,  3, IPC0,  12, _T1Interrupt),
+	VECTOR(IFS0, IEC0,  7, IPC1,  12, _T2Interrupt),
+	VECTOR(IFS0, IEC0,  8, IPC2,   0, _T3Interrupt),
+	VECTOR(IFS0, IEC0, 11, IPC2,  12, _U1RXInterrupt),
+	VECTOR(IFS0, IEC0, 12, IPC3,   0, _U1TXInterrupt),
+	VECTOR(IFS0, IEC0, 13, IPC3,   4, _AD1Interrupt),
+	VECTOR(IFS1, IEC1,  3, IPC4,  12, _CNInterrupt),
+	VECTOR(IFS1, IEC1,  8, IPC6,   0, _DMA2Interrupt),
+	VECTOR(IFS1, IEC1, 11, IPC6,  12, _T4Interrupt),
+	VECTOR(IFS1, IEC1, 12, IPC7,   0, _T5Interrupt),
+	VECTOR(IFS1, IEC1, 14, IPC7,   8, _U2RXInterrupt),
+	VECTOR(IFS1, IEC1, 15, IPC7,  12, _U2TXInterrupt),
+	VECTOR(IFS2, IEC2,  3, IPC8,  12, _C1Interrupt),
+	VECTOR(IFS2, IEC2,  4, IPC9,   0, _DMA3Interrupt),
+	VECTOR(IFS2, IEC2, 14, IPC11,  8, _DMA4Interrupt),
+	VECTOR(IFS3, IEC3, 13, IPC15,  4, _DMA5Interrupt),
+	VECTOR(IFS4, IEC4,  4, IPC17,  0, _DMA6Interrupt),
+	VECTOR(IFS4, IEC4,  5, IPC17,  4, _DMA7Interrupt),
+	VECTOR(IFS5, IEC5,  2, IPC20,  8, _U3RXInterrupt),
+	VECTOR(IFS5, IEC5,  3, IPC20, 12, _U3TXInterrupt),
+	VECTOR(IFS5, IEC5,  9, IPC22,  4, _U4RXInterrupt),
+	VECTOR(IFS5, IEC5, 10, IPC22,  8, _U4TXInterrupt),
+};
+
+#define NUM_VECTORS  (sizeof(vectors) / sizeof(vectors[0]))
+
+static uint64_t cycles;
+static uint32_t interrupts;
+static uint32_t disi;
+static uint32_t fcy;
+static volatile uint8_t running;    // sfr_sim_run() depth, ISRs execute Nop()
+
+static void set_flag(const struct flag *flag)
+{
+	*flag->ifs |= (1 << flag->bit);
+}
+
+static uint8_t flag_enabled(const struct flag *flag)
+{
+	return((*flag->iec >> flag->bit) & 0x01);
+}
+
+static void dma_request(uint8_t irq);
+
+/*
+ * Timers
+ *
+ * \cond
+ */
+struct timer {
+	volatile sim_txcon_t *con;
+	volatile uint16_t    *tmr;
+	volatile uint16_t    *pr;
+	struct flag           flag;
+	uint32_t              residual;     // Cycles towards the next count
+};
+/*
+ * \endcond
+ */
+
+static struct timer timers[NUM_TIMERS] = {
+	{ &sim_T1CON, &sim_TMR1, &sim_PR1, { &sim_IFS0.reg, &sim_IEC0.reg,  3 }, 0 },
+	{ &sim_T2CON, &sim_TMR2, &sim_PR2, { &sim_IFS0.reg, &sim_IEC0.reg,  7 }, 0 },
+	{ &sim_T3CON, &sim_TMR3, &sim_PR3, { &sim_IFS0.reg, &sim_IEC0.reg,  8 }, 0 },
+	{ &sim_T4CON, &sim_TMR4, &sim_PR4, { &sim_IFS1.reg, &sim_IEC1.reg, 11 }, 0 },
+	{ &sim_T5CON, &sim_TMR5, &sim_PR5, { &sim_IFS1.reg, &sim_IEC1.reg, 12 }, 0 },
+};
+
+static const uint16_t prescale[] = { 1, 8, 64, 256 };
+
+/*
+ * Timers 2 & 4 drive Timers 3 & 5 as the upper half of a 32 bit timer when
+ * T32 is set, the flag raised is that of the upper timer.
+ */
+static uint8_t timer_paired(uint8_t index)
+{
+	return(((index == 1) || (index == 3)) && timers[index].con->T32);
+}
+
+static uint8_t timer_slave(uint8_t index)
+{
+	return(((index == 2) || (index == 4)) && timers[index - 1].con->T32);
+}
+
+static uint32_t timer_value(uint8_t index)
+{
+	if(timer_paired(index)) {
+		return(((uint32_t)*timers[index + 1].tmr << 16) | *timers[index].tmr);
+	}
+	return(*timers[index].tmr);
+}
+
+static uint32_t timer_period(uint8_t index)
+{
+	if(timer_paired(index)) {
+		return(((uint32_t)*timers[index + 1].pr << 16) | *timers[index].pr);
+	}
+	return(*timers[index].pr);
+}
+
+static const struct flag *timer_flag(uint8_t index)
+{
+	return(timer_paired(index) ? &timers[index + 1].flag : &timers[index].flag);
+}
+
+/*
+ * Counts until the timer next matches its period register. A timer above
+ * its period counts on round through zero.
+ */
+static uint32_t timer_to_match(uint8_t index)
+{
+	uint32_t to_match;
+
+	to_match = timer_period(index) - timer_value(index);
+	if(!timer_paired(index)) to_match &= 0xffff;
+	return(to_match);
+}
+
+static uint8_t timer_running(uint8_t index)
+{
+	return(timers[index].con->TON && !timers[index].con->TCS && !timer_slave(index));
+}
+
+static void timer_advance(uint8_t index, uint32_t step)
+{
+	struct timer *timer = &timers[index];
+	uint32_t      counts;
+	uint32_t      to_match;
+	uint64_t      value;
+	uint16_t      divide;
+
+	if(!timer_running(index)) return;
+
+	divide = prescale[timer->con->TCKPS];
+	timer->residual += step;
+	counts = timer->residual / divide;
+	timer->residual %= divide;
+	if(counts == 0) return;
+
+	to_match = timer_to_match(index);
+	if(counts <= to_match) {
+		value = timer_value(index) + counts;
+	} else {
+		counts -= to_match + 1;
+		value = counts % ((uint64_t)timer_period(index) + 1);
+		set_flag(timer_flag(index));
+	}
+
+	*timer->tmr = (uint16_t)value;
+	if(timer_paired(index)) {
+		*timers[index + 1].tmr = (uint16_t)(value >> 16);
+	}
+}
+
+static uint32_t timer_next_event(uint8_t index)
+{
+	uint64_t next;
+
+	if(!timer_running(index) || !flag_enabled(timer_flag(index))) return(NO_EVENT);
+
+	next = ((uint64_t)timer_to_match(index) + 1) * prescale[timers[index].con->TCKPS] - timers[index].residual;
+	return((next > NO_EVENT) ? NO_EVENT : (uint32_t)next);
+}
+
+/*
+ * UARTs
+ *
+ * \cond
+ */
+struct uart {
+	struct flag        rx_flag;
+	struct flag        tx_flag;
+	uint8_t            rx_irq;          // Interrupt number, a DMA IRQSEL
+	uint8_t            tx_irq;
+	uint16_t           tx_fifo[UART_FIFO_SIZE];
+	uint8_t            tx_head;
+	uint8_t            tx_count;
+	uint16_t           tsr;
+	uint8_t            tsr_busy;
+	uint32_t           tsr_remaining;
+	uint16_t           rx_fifo[UART_FIFO_SIZE];
+	uint8_t            rx_head;
+	uint8_t            rx_count;
+	uint16_t           rxreg;
+	uint16_t           discard;
+	uint16_t           line[SFR_SIM_UART_LINE_SIZE];
+	uint16_t           line_head;
+	uint16_t           line_count;
+	uint32_t           line_remaining;
+	uint8_t            utxen;
+	uint32_t           overruns;
+	sfr_sim_uart_tx_t  hook;
+};
+/*
+ * \endcond
+ */
+
+static struct uart uarts[NUM_UARTS] = {
+	{ .rx_flag = { &sim_IFS0.reg, &sim_IEC0.reg, 11 }, .tx_flag = { &sim_IFS0.reg, &sim_IEC0.reg, 12 }, .rx_irq = 0x0b, .tx_irq = 0x0c },
+	{ .rx_flag = { &sim_IFS1.reg, &sim_IEC1.reg, 14 }, .tx_flag = { &sim_IFS1.reg, &sim_IEC1.reg, 15 }, .rx_irq = 0x1e, .tx_irq = 0x1f },
+	{ .rx_flag = { &sim_IFS5.reg, &sim_IEC5.reg,  2 }, .tx_flag = { &sim_IFS5.reg, &sim_IEC5.reg,  3 }, .rx_irq = 0x52, .tx_irq = 0x53 },
+	{ .rx_flag = { &sim_IFS5.reg, &sim_IEC5.reg,  9 }, .tx_flag = { &sim_IFS5.reg, &sim_IEC5.reg, 10 }, .rx_irq = 0x59, .tx_irq = 0x5a },
+};
+
+/*
+ * A UART interrupt event sets the flag, which only reaches the CPU if it's
+ * enabled, and is also a request to any DMA Channel which selects it.
+ */
+static void uart_rx_event(uint8_t index)
+{
+	set_flag(&uarts[index].rx_flag);
+	dma_request(uarts[index].rx_irq);
+}
+
+static void uart_tx_event(uint8_t index)
+{
+	set_flag(&uarts[index].tx_flag);
+	dma_request(uarts[index].tx_irq);
+}
+
+static uint32_t uart_frame_cycles(uint8_t index)
+{
+	volatile sim_uxmode_t *mode = &sim_UMODE[index];
+	uint32_t               bit_cycles;
+	uint8_t                bits;
+
+	bit_cycles = (mode->BRGH ? 4UL : 16UL) * ((uint32_t)sim_UBRG[index] + 1);
+
+	bits = 1 + 8 + (mode->STSEL ? 2 : 1);      // Start, data and stop bits
+	if(mode->PDSEL == 0b11) {
+		bits++;                            // Ninth data bit
+	} else if(mode->PDSEL != 0b00) {
+		bits++;                            // Parity bit
+	}
+	return(bit_cycles * bits);
+}
+
+static uint16_t uart_data_mask(uint8_t index)
+{
+	return((sim_UMODE[index].PDSEL == 0b11) ? 0x1ff : 0xff);
+}
+
+static void uart_receive(uint8_t index, uint16_t ch)
+{
+	struct uart          *uart = &uarts[index];
+	volatile sim_uxsta_t *sta  = &sim_USTA[index];
+
+	/*
+	 * Reception stops while the overrun error is set
+	 */
+	if(sta->OERR) {
+		uart->overruns++;
+		return;
+	}
+
+	ch &= uart_data_mask(index);
+	if((sim_UMODE[index].PDSEL == 0b11) && sta->ADDEN && !(ch & 0x100)) {
+		return;
+	}
+
+	if(uart->rx_count == UART_FIFO_SIZE) {
+		sta->OERR = 1;
+		uart->overruns++;
+		return;
+	}
+
+	uart->rx_fifo[(uart->rx_head + uart->rx_count) % UART_FIFO_SIZE] = ch;
+	uart->rx_count++;
+	sta->URXDA = 1;
+
+	switch(sta->URXISEL) {
+	case 0b10:
+		if(uart->rx_count == UART_FIFO_SIZE - 1) uart_rx_event(index);
+		break;
+	case 0b11:
+		if(uart->rx_count == UART_FIFO_SIZE) uart_rx_event(index);
+		break;
+	default:
+		uart_rx_event(index);
+		break;
+	}
+}
+
+/*
+ * A slot which UxTXREG was never written to, the driver only took its
+ * address for a DMA Channel's DMAxPAD, is dropped rather than transmitted.
+ * The marker is neither nine bit data nor a sign extended char.
+ */
+static uint8_t uart_load_tsr(uint8_t index)
+{
+	struct uart          *uart = &uarts[index];
+	volatile sim_uxsta_t *sta  = &sim_USTA[index];
+
+	uart->tsr = uart->tx_fifo[uart->tx_head];
+	uart->tx_head = (uart->tx_head + 1) % UART_FIFO_SIZE;
+	uart->tx_count--;
+	sta->UTXBF = 0;
+
+	if(uart->tsr == UART_UNWRITTEN) {
+		if(uart->tx_count == 0) sta->TRMT = 1;
+		return(0);
+	}
+
+	uart->tsr_busy = 1;
+	uart->tsr_remaining = uart_frame_cycles(index);
+	sta->TRMT = 0;
+
+	if(!sta->UTXISEL1 && !sta->UTXISEL0) {
+		uart_tx_event(index);
+	} else if(sta->UTXISEL1 && !sta->UTXISEL0 && (uart->tx_count == 0)) {
+		uart_tx_event(index);
+	}
+	return(1);
+}
+
+static void uart_shifted_out(uint8_t index)
+{
+	struct uart          *uart = &uarts[index];
+	volatile sim_uxsta_t *sta  = &sim_USTA[index];
+	uint16_t              ch;
+
+	uart->tsr_busy = 0;
+	ch = uart->tsr & uart_data_mask(index);
+
+	if(uart->hook) uart->hook(index, ch);
+	if(sim_UMODE[index].LPBACK) uart_receive(index, ch);
+
+	if(uart->tx_count == 0) {
+		sta->TRMT = 1;
+		if(!sta->UTXISEL1 && sta->UTXISEL0) {
+			uart_tx_event(index);
+		}
+	}
+}
+
+static void uart_advance(uint8_t index, uint32_t step)
+{
+	struct uart          *uart = &uarts[index];
+	volatile sim_uxsta_t *sta  = &sim_USTA[index];
+	uint32_t              left;
+	uint32_t              n;
+
+	if(!sim_UMODE[index].UARTEN) {
+		uart->tx_count = 0;
+		uart->tsr_busy = 0;
+		uart->rx_count = 0;
+		uart->utxen = 0;
+		sta->URXDA = 0;
+		sta->UTXBF = 0;
+		sta->TRMT = 1;
+		return;
+	}
+
+	/*
+	 * Enabling the transmitter raises the transmit interrupt
+	 */
+	if(sta->UTXEN && !uart->utxen) {
+		uart_tx_event(index);
+	}
+	uart->utxen = sta->UTXEN;
+
+	left = step;
+	while(left && sta->UTXEN) {
+		if(!uart->tsr_busy) {
+			if(uart->tx_count == 0) break;
+			if(!uart_load_tsr(index)) continue;
+		}
+		n = (left < uart->tsr_remaining) ? left : uart->tsr_remaining;
+		uart->tsr_remaining -= n;
+		left -= n;
+		if(uart->tsr_remaining == 0) uart_shifted_out(index);
+	}
+
+	left = step;
+	while(left && uart->line_count) {
+		n = (left < uart->line_remaining) ? left : uart->line_remaining;
+		uart->line_remaining -= n;
+		left -= n;
+		if(uart->line_remaining == 0) {
+			uart_receive(index, uart->line[uart->line_head]);
+			uart->line_head = (uart->line_head + 1) % SFR_SIM_UART_LINE_SIZE;
+			uart->line_count--;
+			uart->line_remaining = uart_frame_cycles(index);
+		}
+	}
+}
+
+static uint32_t uart_next_event(uint8_t index)
+{
+	struct uart *uart = &uarts[index];
+	uint32_t     next = NO_EVENT;
+
+	if(!sim_UMODE[index].UARTEN) return(NO_EVENT);
+
+	if(sim_USTA[index].UTXEN != uart->utxen) {
+		next = 1;
+	} else if(sim_USTA[index].UTXEN) {
+		if(uart->tsr_busy) {
+			next = uart->tsr_remaining;
+		} else if(uart->tx_count) {
+			next = 1;
+		}
+	}
+	if(uart->line_count && (uart->line_remaining < next)) {
+		next = uart->line_remaining;
+	}
+	return(next);
+}
+
+volatile uint16_t *sfr_sim_uart_txreg(uint8_t index)
+{
+	struct uart *uart = &uarts[index];
+	uint16_t    *slot;
+
+	if(uart->tx_count == UART_FIFO_SIZE) {
+		return(&uart->discard);
+	}
+	slot = &uart->tx_fifo[(uart->tx_head + uart->tx_count) % UART_FIFO_SIZE];
+	*slot = UART_UNWRITTEN;
+	uart->tx_count++;
+	sim_USTA[index].UTXBF = (uart->tx_count == UART_FIFO_SIZE);
+	sim_USTA[index].TRMT = 0;
+	return(slot);
+}
+
+volatile uint16_t *sfr_sim_uart_rxreg(uint8_t index)
+{
+	struct uart *uart = &uarts[index];
+
+	if(uart->rx_count) {
+		uart->rxreg = uart->rx_fifo[uart->rx_head];
+		uart->rx_head = (uart->rx_head + 1) % UART_FIFO_SIZE;
+		uart->rx_count--;
+	}
+	sim_USTA[index].URXDA = (uart->rx_count != 0);
+	return(&uart->rxreg);
+}
+
+void sfr_sim_uart_tx_hook(uint8_t index, sfr_sim_uart_tx_t hook)
+{
+	uarts[index].hook = hook;
+}
+
+int16_t sfr_sim_uart_rx(uint8_t index, uint16_t ch)
+{
+	struct uart *uart = &uarts[index];
+
+	if(uart->line_count == SFR_SIM_UART_LINE_SIZE) return(-1);
+
+	if(uart->line_count == 0) {
+		uart->line_remaining = uart_frame_cycles(index);
+	}
+	uart->line[(uart->line_head + uart->line_count) % SFR_SIM_UART_LINE_SIZE] = ch;
+	uart->line_count++;
+	return(0);
+}
+
+uint32_t sfr_sim_uart_overruns(uint8_t index)
+{
+	return(uarts[index].overruns);
+}
+
+/*
+ * DMA Channels
+ *
+ * Only transfers between data RAM and the UARTs, requested by the UART
+ * interrupt events or forced by software, are modelled. The ECAN module
+ * reaches its buffers directly through Channels 0 & 1's start address. The
+ * peripheral is that of the channel's IRQSEL, DMAxPAD is not used.
+ *
+ * \cond
+ */
+struct dma {
+	struct flag  flag;
+	uint16_t     count;            // Transfers made in to the block
+	uint8_t      ping_pong;        // Transferring to/from DMAxSTB
+};
+/*
+ * \endcond
+ */
+
+static struct dma dmas[NUM_DMA_CHANNELS] = {
+	{ .flag = { &sim_IFS0.reg, &sim_IEC0.reg,  4 } },
+	{ .flag = { &sim_IFS0.reg, &sim_IEC0.reg, 14 } },
+	{ .flag = { &sim_IFS1.reg, &sim_IEC1.reg,  8 } },
+	{ .flag = { &sim_IFS2.reg, &sim_IEC2.reg,  4 } },
+	{ .flag = { &sim_IFS2.reg, &sim_IEC2.reg, 14 } },
+	{ .flag = { &sim_IFS3.reg, &sim_IEC3.reg, 13 } },
+	{ .flag = { &sim_IFS4.reg, &sim_IEC4.reg,  4 } },
+	{ .flag = { &sim_IFS4.reg, &sim_IEC4.reg,  5 } },
+};
+
+#define DMA_MODE_ONE_SHOT    0x01
+#define DMA_MODE_PING_PONG   0x02
+
+static void dma_transfer(uint8_t channel)
+{
+	volatile sim_dma_t *dma = &sim_DMA[channel];
+	struct dma         *state = &dmas[channel];
+	uintptr_t           address;
+	uint16_t            value;
+	uint8_t             uart;
+
+	for(uart = 0; uart < NUM_UARTS; uart++) {
+		if((dma->req.IRQSEL == uarts[uart].rx_irq) || (dma->req.IRQSEL == uarts[uart].tx_irq)) break;
+	}
+	if(uart == NUM_UARTS) return;
+
+	if(state->ping_pong) {
+		address = ((uintptr_t)dma->stbh << 16) | dma->stbl;
+	} else {
+		address = ((uintptr_t)dma->stah << 16) | dma->stal;
+	}
+	if(dma->con.AMODE == 0b00) {
+		address += state->count * (dma->con.SIZE ? 1 : 2);
+	}
+
+	if(dma->con.DIR) {
+		value = dma->con.SIZE ? *(uint8_t *)address : *(uint16_t *)address;
+		*sfr_sim_uart_txreg(uart) = value;
+	} else {
+		value = *sfr_sim_uart_rxreg(uart);
+		if(dma->con.SIZE) {
+			*(uint8_t *)address = (uint8_t)value;
+		} else {
+			*(uint16_t *)address = value;
+		}
+	}
+
+	state->count++;
+	if(state->count > dma->cnt) {
+		state->count = 0;
+		set_flag(&state->flag);
+		if(dma->con.MODE & DMA_MODE_PING_PONG) state->ping_pong ^= 1;
+		if(dma->con.MODE & DMA_MODE_ONE_SHOT) dma->con.CHEN = 0;
+	}
+}
+
+static void dma_request(uint8_t irq)
+{
+	uint8_t channel;
+
+	for(channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
+		if(sim_DMA[channel].con.CHEN && (sim_DMA[channel].req.IRQSEL == irq)) {
+			dma_transfer(channel);
+		}
+	}
+}
+
+/*
+ * Setting FORCE makes a single transfer, as if requested by the peripheral.
+ * A channel being disabled restarts its block.
+ */
+static void dma_advance(void)
+{
+	uint8_t channel;
+
+	for(channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
+		if(!sim_DMA[channel].con.CHEN) {
+			dmas[channel].count = 0;
+			dmas[channel].ping_pong = 0;
+			sim_DMA[channel].req.FORCE = 0;
+		} else if(sim_DMA[channel].req.FORCE) {
+			sim_DMA[channel].req.FORCE = 0;
+			dma_transfer(channel);
+		}
+	}
+}
+
+static uint32_t dma_next_event(void)
+{
+	uint8_t channel;
+
+	for(channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
+		if(sim_DMA[channel].con.CHEN && sim_DMA[channel].req.FORCE) return(1);
+	}
+	return(NO_EVENT);
+}
+
+/*
+ * ECAN 1
+ *
+ * \cond
+ */
+#define CAN_NORMAL        0b000
+#define CAN_LOOPBACK      0b010
+#define CAN_LISTEN_ONLY   0b011
+#define CAN_LISTEN_ALL    0b111
+
+#define TX_REQUEST        0x08
+#define TX_PRIORITY       0x03
+
+struct can_msg {
+	uint32_t  can_id;
+	uint8_t   dlc;
+	uint8_t   data[8];
+};
+
+struct can {
+	struct can_msg    bus[SFR_SIM_CAN_BUS_SIZE];
+	uint8_t           bus_head;
+	uint8_t           bus_count;
+	uint32_t          rx_remaining;
+	int8_t            tx_buffer;       // Buffer being transmitted, or -1
+	uint32_t          tx_remaining;
+	uint32_t          overflows;
+	sfr_sim_can_tx_t  hook;
+};
+/*
+ * \endcond
+ */
+
+static struct can can;
+
+/*
+ * The module finds its buffers in DMA RAM through the DMA channel's start
+ * address, which the driver sets from a 24 bit address.
+ */
+static volatile uint16_t *can_buffer(uint8_t channel, uint8_t buffer)
+{
+	uintptr_t address;
+
+	address = ((uintptr_t)sim_DMA[channel].stah << 16) | sim_DMA[channel].stal;
+	if(!sim_DMA[channel].con.CHEN || (address == 0)) return(NULL);
+
+	return((volatile uint16_t *)address + (buffer * CAN_BUFFER_WORDS));
+}
+
+static uint8_t can_fifo_size(void)
+{
+	static const uint8_t sizes[] = { 4, 6, 8, 12, 16, 24, 32, 32 };
+
+	return(sizes[C1FCTRLbits.DMABS]);
+}
+
+static uint32_t can_bit_cycles(void)
+{
+	uint32_t tq;
+
+	tq = 1 + (C1CFG2bits.PRSEG + 1) + (C1CFG2bits.SEG1PH + 1) + (C1CFG2bits.SEG2PH + 1);
+
+	/*
+	 * Tq is 2 * (BRP + 1) periods of the CAN clock, which is the
+	 * peripheral clock when CANCKS is set.
+	 */
+	return((C1CTRL1bits.CANCKS ? 2UL : 1UL) * (C1CFG1bits.BRP + 1) * tq);
+}
+
+/*
+ * Frame length on the bus, including an allowance for bit stuffing and the
+ * interframe space
+ */
+static uint32_t can_frame_cycles(const struct can_msg *msg)
+{
+	uint32_t bits;
+
+	bits = (msg->can_id & SFR_SIM_CAN_EFF_FLAG) ? 67 : 47;
+	if(!(msg->can_id & SFR_SIM_CAN_RTR_FLAG)) bits += 8 * msg->dlc;
+	return(bits * can_bit_cycles());
+}
+
+static uint8_t can_receiving(void)
+{
+	uint8_t mode = C1CTRL1bits.OPMODE;
+
+	return((mode == CAN_NORMAL) || (mode == CAN_LISTEN_ONLY) || (mode == CAN_LISTEN_ALL) || (mode == CAN_LOOPBACK));
+}
+
+static void can_update_isr(void)
+{
+	if(C1INTF & C1INTE & 0xff) {
+		IFS2bits.C1IF = 1;
+	} else {
+		C1VECbits.ICODE = 0x40;
+	}
+}
+
+static volatile uint16_t *full_regs[2] = { &sim_C1RXFUL1, &sim_C1RXFUL2 };
+static volatile uint16_t *ovf_regs[2]  = { &sim_C1RXOVF1, &sim_C1RXOVF2 };
+
+static uint8_t can_full(uint8_t buffer)
+{
+	return((*full_regs[buffer / 16] >> (buffer % 16)) & 0x01);
+}
+
+static void can_file(const struct can_msg *msg)
+{
+	volatile uint16_t *buf;
+	uint8_t            buffer;
+	uint8_t            next;
+	uint8_t            pending;
+	uint8_t            loop;
+	uint32_t           id;
+
+	buffer = C1FIFObits.FBP;
+	buf = can_buffer(1, buffer);
+	if(buf == NULL) return;
+
+	if(can_full(buffer)) {
+		*ovf_regs[buffer / 16] |= (1 << (buffer % 16));
+		C1INTFbits.RBOVIF = 1;
+		can.overflows++;
+		can_update_isr();
+		return;
+	}
+
+	id = msg->can_id & 0x1fffffff;
+	if(msg->can_id & SFR_SIM_CAN_EFF_FLAG) {
+		buf[0] = ((uint16_t)((id >> 18) & 0x7ff) << 2) | 0x03;          // SRR & IDE
+		buf[1] = (uint16_t)((id >> 6) & 0x0fff);
+		buf[2] = ((uint16_t)(id & 0x3f) << 10) | (msg->dlc & 0x0f);
+		if(msg->can_id & SFR_SIM_CAN_RTR_FLAG) buf[2] |= 0x0200;
+	} else {
+		buf[0] = (uint16_t)((id & 0x7ff) << 2);
+		if(msg->can_id & SFR_SIM_CAN_RTR_FLAG) buf[0] |= 0x02;          // SRR is RTR
+		buf[1] = 0;
+		buf[2] = msg->dlc & 0x0f;
+	}
+	for(loop = 0; loop < 4; loop++) {
+		buf[3 + loop] = msg->data[loop * 2] | ((uint16_t)msg->data[(loop * 2) + 1] << 8);
+	}
+	buf[7] = 0;
+
+	*full_regs[buffer / 16] |= (1 << (buffer % 16));
+
+	next = buffer + 1;
+	if(next >= can_fifo_size()) next = C1FCTRLbits.FSA;
+	C1FIFObits.FBP = next;
+
+	/*
+	 * FIFO almost full when only one buffer is left empty
+	 */
+	pending = 0;
+	for(loop = C1FCTRLbits.FSA; loop < can_fifo_size(); loop++) {
+		if(can_full(loop)) pending++;
+	}
+	if(pending >= (can_fifo_size() - C1FCTRLbits.FSA - 1)) {
+		C1INTFbits.FIFOIF = 1;
+	}
+
+	C1INTFbits.RBIF = 1;
+	C1VECbits.ICODE = buffer;
+	can_update_isr();
+}
+
+static void can_tx_done(void)
+{
+	volatile uint16_t *buf;
+	volatile uint8_t  *control = (volatile uint8_t *)sim_C1TRCON;
+	struct can_msg     msg;
+	uint8_t            loop;
+
+	buf = can_buffer(0, can.tx_buffer);
+	if(buf != NULL) {
+		if(buf[0] & 0x01) {
+			msg.can_id = SFR_SIM_CAN_EFF_FLAG
+			           | ((uint32_t)((buf[0] >> 2) & 0x7ff) << 18)
+			           | ((uint32_t)(buf[1] & 0x0fff) << 6)
+			           | ((buf[2] >> 10) & 0x3f);
+			if(buf[2] & 0x0200) msg.can_id |= SFR_SIM_CAN_RTR_FLAG;
+		} else {
+			msg.can_id = (buf[0] >> 2) & 0x7ff;
+			if(buf[0] & 0x02) msg.can_id |= SFR_SIM_CAN_RTR_FLAG;
+		}
+		msg.dlc = buf[2] & 0x0f;
+		if(msg.dlc > 8) msg.dlc = 8;
+		for(loop = 0; loop < 4; loop++) {
+			msg.data[loop * 2]       = buf[3 + loop] & 0xff;
+			msg.data[(loop * 2) + 1] = buf[3 + loop] >> 8;
+		}
+
+		if(can.hook) can.hook(msg.can_id, msg.dlc, msg.data);
+		if(C1CTRL1bits.OPMODE == CAN_LOOPBACK) can_file(&msg);
+	}
+
+	control[can.tx_buffer] &= ~TX_REQUEST;
+	can.tx_buffer = -1;
+
+	C1INTFbits.TBIF = 1;
+	can_update_isr();
+}
+
+/*
+ * Highest priority requested buffer, the highest numbered of equals
+ */
+static int8_t can_tx_select(void)
+{
+	volatile uint8_t *control = (volatile uint8_t *)sim_C1TRCON;
+	int8_t            found = -1;
+	uint8_t           loop;
+
+	for(loop = 0; loop < NUM_CAN_TX; loop++) {
+		if(control[loop] & TX_REQUEST) {
+			if((found < 0) || ((control[loop] & TX_PRIORITY) >= (control[found] & TX_PRIORITY))) {
+				found = loop;
+			}
+		}
+	}
+	return(found);
+}
+
+static void can_advance(uint32_t step)
+{
+	struct can_msg *msg;
+	volatile uint16_t *buf;
+	uint32_t        left;
+	uint32_t        n;
+
+	/*
+	 * Mode changes are immediate
+	 */
+	C1CTRL1bits.OPMODE = C1CTRL1bits.REQOP;
+
+	left = step;
+	while(left) {
+		if(can.tx_buffer < 0) {
+			if((C1CTRL1bits.OPMODE != CAN_NORMAL) && (C1CTRL1bits.OPMODE != CAN_LOOPBACK)) break;
+			can.tx_buffer = can_tx_select();
+			if(can.tx_buffer < 0) break;
+			buf = can_buffer(0, can.tx_buffer);
+			if(buf == NULL) break;
+			can.tx_remaining = ((buf[0] & 0x01) ? 67 : 47) + (8 * (buf[2] & 0x0f));
+			can.tx_remaining *= can_bit_cycles();
+		}
+		n = (left < can.tx_remaining) ? left : can.tx_remaining;
+		can.tx_remaining -= n;
+		left -= n;
+		if(can.tx_remaining == 0) can_tx_done();
+	}
+
+	left = step;
+	while(left && can.bus_count) {
+		n = (left < can.rx_remaining) ? left : can.rx_remaining;
+		can.rx_remaining -= n;
+		left -= n;
+		if(can.rx_remaining == 0) {
+			msg = &can.bus[can.bus_head];
+			if(can_receiving() && (C1CTRL1bits.OPMODE != CAN_LOOPBACK)) can_file(msg);
+			can.bus_head = (can.bus_head + 1) % SFR_SIM_CAN_BUS_SIZE;
+			can.bus_count--;
+			if(can.bus_count) can.rx_remaining = can_frame_cycles(&can.bus[can.bus_head]);
+		}
+	}
+}
+
+static uint32_t can_next_event(void)
+{
+	uint32_t next = NO_EVENT;
+	uint8_t  mode = C1CTRL1bits.OPMODE;
+
+	if(mode != C1CTRL1bits.REQOP) return(1);
+
+	if(can.tx_buffer >= 0) {
+		next = can.tx_remaining;
+	} else if(((mode == CAN_NORMAL) || (mode == CAN_LOOPBACK)) && (can_tx_select() >= 0)) {
+		next = 1;
+	}
+	if(can.bus_count && (can.rx_remaining < next)) {
+		next = can.rx_remaining;
+	}
+	return(next);
+}
+
+volatile sim_C1FIFO_t *sfr_sim_can_fifo(void)
+{
+	uint8_t buffer;
+
+	buffer = sim_C1FIFO.FNRB;
+	while((buffer != sim_C1FIFO.FBP) && !can_full(buffer)) {
+		buffer++;
+		if(buffer >= can_fifo_size()) buffer = sim_C1FCTRL.FSA;
+		sim_C1FIFO.FNRB = buffer;
+	}
+	return(&sim_C1FIFO);
+}
+
+void sfr_sim_can_tx_hook(sfr_sim_can_tx_t hook)
+{
+	can.hook = hook;
+}
+
+int16_t sfr_sim_can_rx(uint32_t can_id, uint8_t dlc, const uint8_t *data)
+{
+	struct can_msg *msg;
+
+	if(can.bus_count == SFR_SIM_CAN_BUS_SIZE) return(-1);
+	if(dlc > 8) dlc = 8;
+
+	msg = &can.bus[(can.bus_head + can.bus_count) % SFR_SIM_CAN_BUS_SIZE];
+	msg->can_id = can_id;
+	msg->dlc = dlc;
+	memset(msg->data, 0x00, sizeof(msg->data));
+	if(data) memcpy(msg->data, data, dlc);
+
+	if(can.bus_count == 0) can.rx_remaining = can_frame_cycles(msg);
+	can.bus_count++;
+	return(0);
+}
+
+uint32_t sfr_sim_can_overflows(void)
+{
+	return(can.overflows);
+}
+
+/*
+ * ADC 1
+ *
+ * \cond
+ */
+struct adc {
+	uint16_t  inputs[ADC_CHANNELS];
+	uint8_t   adon;
+	uint8_t   converting;
+	uint32_t  remaining;
+	uint8_t   buffer;
+	uint8_t   scan;
+};
+/*
+ * \endcond
+ */
+
+static struct adc adc;
+
+static uint32_t adc_conversion_cycles(void)
+{
+	uint32_t tad;
+
+	/*
+	 * The internal RC clock gives a Tad of 250nS
+	 */
+	if(AD1CON3bits.ADRC) {
+		tad = fcy / 4000000;
+		if(tad == 0) tad = 1;
+	} else {
+		tad = AD1CON3bits.ADCS + 1;
+	}
+	return(tad * (AD1CON3bits.SAMC + (AD1CON1bits.AD12B ? 14 : 12)));
+}
+
+static uint8_t adc_next_channel(void)
+{
+	uint32_t selected;
+	uint8_t  loop;
+
+	if(!AD1CON2bits.CSCNA) return(AD1CHS0bits.CH0SA);
+
+	selected = ((uint32_t)AD1CSSH << 16) | AD1CSSL;
+	if(selected == 0) return(AD1CHS0bits.CH0SA);
+
+	for(loop = 0; loop < ADC_CHANNELS; loop++) {
+		adc.scan = (adc.scan + 1) % ADC_CHANNELS;
+		if(selected & (1UL << adc.scan)) break;
+	}
+	return(adc.scan);
+}
+
+static void adc_convert(void)
+{
+	uint16_t mask = AD1CON1bits.AD12B ? 0x0fff : 0x03ff;
+
+	sim_ADC1BUF[adc.buffer] = adc.inputs[adc_next_channel()] & mask;
+	adc.buffer++;
+	AD1CON1bits.DONE = 1;
+	if(!AD1CON1bits.ASAM) AD1CON1bits.SAMP = 0;
+
+	if(adc.buffer > AD1CON2bits.SMPI) {
+		adc.buffer = 0;
+		IFS0bits.AD1IF = 1;
+	}
+}
+
+static void adc_advance(uint32_t step)
+{
+	uint32_t left;
+
+	if(!AD1CON1bits.ADON) {
+		adc.adon = 0;
+		adc.converting = 0;
+		return;
+	}
+
+	/*
+	 * Turning the ADC on restarts the buffer and the scan
+	 */
+	if(!adc.adon) {
+		adc.adon = 1;
+		adc.buffer = 0;
+		adc.scan = ADC_CHANNELS - 1;
+	}
+
+	left = step;
+	while(left) {
+		if(!adc.converting) {
+			if(!AD1CON1bits.ASAM && !AD1CON1bits.SAMP) break;
+			adc.converting = 1;
+			adc.remaining = adc_conversion_cycles();
+		}
+		if(left < adc.remaining) {
+			adc.remaining -= left;
+			break;
+		}
+		left -= adc.remaining;
+		adc.converting = 0;
+		adc_convert();
+	}
+}
+
+static uint32_t adc_next_event(void)
+{
+	if(!AD1CON1bits.ADON) return(NO_EVENT);
+	if(!adc.adon) return(1);
+	if(adc.converting) return(adc.remaining);
+	if(AD1CON1bits.ASAM || AD1CON1bits.SAMP) return(1);
+	return(NO_EVENT);
+}
+
+void sfr_sim_adc_input(uint8_t channel, uint16_t value)
+{
+	if(channel < ADC_CHANNELS) adc.inputs[channel] = value;
+}
+
+/*
+ * I/O Ports & Change Notification
+ *
+ * \cond
+ */
+struct port {
+	volatile uint16_t *tris;
+	volatile uint16_t *port;
+	volatile uint16_t *lat;
+	volatile uint16_t *cnen;
+	uint16_t           inputs;
+};
+/*
+ * \endcond
+ */
+
+#define PORT(x)  { &sim_TRIS##x.reg, &sim_PORT##x.reg, &sim_LAT##x.reg, &sim_CNEN##x.reg, 0 }
+
+static struct port ports[SFR_SIM_NUM_PORTS] = {
+	PORT(B), PORT(C), PORT(D), PORT(E), PORT(F), PORT(G)
+};
+
+/*
+ * Pins configured as outputs read back their latch, inputs the level
+ * driven from outside.
+ */
+static void ports_update(void)
+{
+	struct port *port;
+	uint16_t     value;
+	uint8_t      loop;
+
+	for(loop = 0; loop < SFR_SIM_NUM_PORTS; loop++) {
+		port = &ports[loop];
+		value = (port->inputs & *port->tris) | (*port->lat & ~*port->tris);
+		if((value ^ *port->port) & *port->cnen) {
+			IFS1bits.CNIF = 1;
+		}
+		*port->port = value;
+	}
+}
+
+void sfr_sim_pin_input(enum sfr_sim_port index, uint8_t bit, uint8_t level)
+{
+	if((index >= SFR_SIM_NUM_PORTS) || (bit > 15)) return;
+
+	if(level) {
+		ports[index].inputs |= (1 << bit);
+	} else {
+		ports[index].inputs &= ~(1 << bit);
+	}
+	ports_update();
+}
+
+/*
+ * Interrupt controller
+ */
+static void dispatch(void)
+{
+	const struct vector *vector;
+	const struct vector *found;
+	uint8_t              ipl;
+	uint8_t              priority;
+	uint8_t              loop;
+
+	while(INTCON2bits.GIE && (disi == 0)) {
+		found = NULL;
+		ipl = SRbits.IPL;
+
+		for(loop = 0; loop < NUM_VECTORS; loop++) {
+			vector = &vectors[loop];
+			if(((*vector->ifs & *vector->iec) >> vector->bit) & 0x01) {
+				priority = (*vector->ipc >> vector->shift) & 0x07;
+				if(priority > ipl) {
+					ipl = priority;
+					found = vector;
+				}
+			}
+		}
+		if((found == NULL) || (found->isr == NULL)) return;
+
+		priority = SRbits.IPL;
+		SRbits.IPL = ipl;
+		interrupts++;
+		found->isr();
+		SRbits.IPL = priority;
+	}
+}
+
+static uint32_t next_event(void)
+{
+	uint32_t next = NO_EVENT;
+	uint32_t event;
+	uint8_t  loop;
+
+	for(loop = 0; loop < NUM_TIMERS; loop++) {
+		event = timer_next_event(loop);
+		if(event < next) next = event;
+	}
+	for(loop = 0; loop < NUM_UARTS; loop++) {
+		event = uart_next_event(loop);
+		if(event < next) next = event;
+	}
+	event = dma_next_event();
+	if(event < next) next = event;
+	event = can_next_event();
+	if(event < next) next = event;
+	event = adc_next_event();
+	if(event < next) next = event;
+	if(disi && (disi < next)) next = disi;
+
+	return(next);
+}
+
+void sfr_sim_run(uint32_t run)
+{
+	uint32_t step;
+	uint8_t  loop;
+
+	running++;
+	while(run) {
+		step = next_event();
+		if(step > run) step = run;
+		if(step == 0) step = 1;
+
+		cycles += step;
+		if(disi) {
+			disi = (disi > step) ? disi - step : 0;
+			INTCON2bits.DISI = (disi != 0);
+		}
+
+		for(loop = 0; loop < NUM_TIMERS; loop++) {
+			timer_advance(loop, step);
+		}
+		for(loop = 0; loop < NUM_UARTS; loop++) {
+			uart_advance(loop, step);
+		}
+		dma_advance();
+		can_advance(step);
+		adc_advance(step);
+		ports_update();
+
+		run -= step;
+		dispatch();
+	}
+
+	if(ACLKCON3bits.ENAPLL) ACLKCON3bits.APLLCK = 1;
+	running--;
+}
+
+uint8_t sfr_sim_busy(void)
+{
+	return(running != 0);
+}
+
+void sfr_sim_instruction(void)
+{
+	sfr_sim_run(1);
+}
+
+void sfr_sim_disi(uint16_t count)
+{
+	disi = count + 1;
+	INTCON2bits.DISI = 1;
+}
+
+void sfr_sim_write_oscconh(uint8_t value)
+{
+	OSCCONbits.NOSC = value & 0x07;
+}
+
+/*
+ * A clock switch, and PLL lock, are immediate
+ */
+void sfr_sim_write_oscconl(uint8_t value)
+{
+	OSCCON = (OSCCON & 0xff00) | value;
+	if(OSCCONbits.OSWEN) {
+		OSCCONbits.COSC  = OSCCONbits.NOSC;
+		OSCCONbits.LOCK  = 1;
+		OSCCONbits.OSWEN = 0;
+	}
+}
+
+uint64_t sfr_sim_cycles(void)
+{
+	return(cycles);
+}
+
+uint32_t sfr_sim_interrupts(void)
+{
+	return(interrupts);
+}
+
+void sfr_sim_reset(uint32_t clock)
+{
+	uint8_t loop;
+
+	fcy = clock;
+	cycles = 0;
+	interrupts = 0;
+	disi = 0;
+
+	SR = 0x0000;
+	INTCON1 = 0x0000;
+	INTCON2 = 0x8000;                // GIE
+
+	IFS0 = IFS1 = IFS2 = IFS3 = IFS4 = IFS5 = 0x0000;
+	IEC0 = IEC1 = IEC2 = IEC3 = IEC4 = IEC5 = 0x0000;
+	IPC0 = IPC1 = IPC2 = IPC3 = IPC4 = IPC6 = IPC7 = IPC8 = 0x4444;
+	IPC9 = IPC11 = IPC15 = IPC17 = IPC20 = IPC22 = 0x4444;
+
+	OSCCON = 0x0200;                 // COSC Primary oscillator
+	CLKDIV = 0x3040;
+	PLLFBD = 0x0030;
+	ACLKCON3 = 0x2401;
+	ACLKDIV3 = 0x0007;
+
+	for(loop = 0; loop < NUM_TIMERS; loop++) {
+		timers[loop].con->reg = 0x0000;
+		*timers[loop].tmr = 0x0000;
+		*timers[loop].pr = 0xffff;
+		timers[loop].residual = 0;
+	}
+
+	for(loop = 0; loop < NUM_UARTS; loop++) {
+		sim_UMODE[loop].reg = 0x0000;
+		sim_USTA[loop].reg = 0x0110;     // TRMT & RIDLE
+		sim_UBRG[loop] = 0x0000;
+		uarts[loop].tx_head = uarts[loop].tx_count = 0;
+		uarts[loop].rx_head = uarts[loop].rx_count = 0;
+		uarts[loop].tsr_busy = 0;
+		uarts[loop].line_head = uarts[loop].line_count = 0;
+		uarts[loop].utxen = 0;
+		uarts[loop].overruns = 0;
+	}
+
+	AD1CON1 = AD1CON2 = AD1CON3 = AD1CON4 = 0x0000;
+	AD1CHS0 = AD1CSSL = AD1CSSH = 0x0000;
+	memset((void *)sim_ADC1BUF, 0x00, sizeof(sim_ADC1BUF));
+	memset(&adc, 0x00, sizeof(adc));
+
+	for(loop = 0; loop < SFR_SIM_NUM_PORTS; loop++) {
+		*ports[loop].tris = 0xffff;
+		*ports[loop].port = 0x0000;
+		*ports[loop].lat = 0x0000;
+		*ports[loop].cnen = 0x0000;
+		ports[loop].inputs = 0x0000;
+	}
+	ANSELB = ANSELC = ANSELD = ANSELE = ANSELF = ANSELG = 0xffff;
+
+	memset((void *)sim_DMA, 0x00, sizeof(sim_DMA));
+	for(loop = 0; loop < NUM_DMA_CHANNELS; loop++) {
+		dmas[loop].count = 0;
+		dmas[loop].ping_pong = 0;
+	}
+
+	C1CTRL1 = 0x0480;                // Configuration mode
+	C1CTRL2 = 0x0000;
+	C1VEC = 0x0040;
+	C1FCTRL = 0x0000;
+	sim_C1FIFO.reg = 0x0000;
+	C1INTF = C1INTE = C1EC = 0x0000;
+	C1RXFUL1 = C1RXFUL2 = C1RXOVF1 = C1RXOVF2 = 0x0000;
+	for(loop = 0; loop < 4; loop++) {
+		sim_C1TRCON[loop] = 0x0000;
+	}
+	can.bus_head = can.bus_count = 0;
+	can.tx_buffer = -1;
+	can.overflows = 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file libesoup/processors/dsPIC33/sim/sfr_sim.h
+ *
+ * @author John Whitmore
+ *
+ * @brief Host simulation of the dsPIC33EP256MU806 peripherals
+ *
+ * Copyright 2017-2020 electronicSoup Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the version 2 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ *
+ * The simulation lets the real dsPIC33 drivers, uart.c, hw_timers.c,
+ * l2_dsPIC33EP256MU806.c, adc.c and change_notification.c, be built with gcc
+ * and run on Linux against the registers declared in the simulated xc.h.
+ *
+ * Simulated time is counted in instruction cycles and only moves on when the
+ * test calls sfr_sim_run(), or when driver code executes Nop() or ClrWdt().
+ * As time moves on the peripheral models update their registers:
+ *
+ *   Timers 1 to 5  count with their prescaler, 32 bit pairs included, and set
+ *                  their interrupt flag on a period match.
+ *   UARTs 1 to 4   shift characters out of a four deep transmit FIFO and in
+ *                  to a four deep receive FIFO at the rate set by UxBRG,
+ *                  including overrun, 9 bit address detect and loopback.
+ *   ECAN 1         transmits requested buffers and files received frames in
+ *                  the DMA buffer FIFO at the configured bit rate.
+ *   DMA 0 to 7     move words or bytes between data RAM and a UART on each
+ *                  of its interrupt events, or when forced, in one shot or
+ *                  continuous, ping-pong, modes.
+ *   ADC 1          converts the sampled or scanned channels from values set
+ *                  with sfr_sim_adc_input().
+ *   Ports B to G   raise the Change Notification flag when an enabled input
+ *                  pin set with sfr_sim_pin_input() changes.
+ *
+ * After each step the highest priority pending, enabled interrupt above the
+ * CPU's priority is taken by calling the driver's ISR, for example
+ * _U1RXInterrupt(), as long as INTCON2bits.GIE is set and no DISI is active.
+ *
+ * Some drivers test for XC16 and the device before including libesoup_config.h
+ * so, as with the XC16 compiler, both must be defined on the command line:
+ *
+ *     gcc -DXC16 -D__dsPIC33EP256MU806__ -Ilibesoup/processors/dsPIC33/sim ...
+ *
+ * The ECAN driver hands DMA RAM to the module as a 24 bit address so a test
+ * using CAN must be linked with -no-pie to keep its data at a low address.
+ */
+#ifndef _SFR_SIM_H
+#define _SFR_SIM_H
+
+#include <stdint.h>
+
+/**
+ * @brief Size of the queue of characters waiting on each UART's RX line
+ */
+#ifndef SFR_SIM_UART_LINE_SIZE
+#define SFR_SIM_UART_LINE_SIZE   512
+#endif
+
+/**
+ * @brief Size of the queue of frames waiting on the CAN Bus
+ */
+#ifndef SFR_SIM_CAN_BUS_SIZE
+#define SFR_SIM_CAN_BUS_SIZE     64
+#endif
+
+#define SFR_SIM_CAN_EFF_FLAG     0x80000000UL   ///< Extended frame, as linux/can.h
+#define SFR_SIM_CAN_RTR_FLAG     0x40000000UL   ///< Remote frame, as linux/can.h
+
+/**
+ * @brief I/O Ports for sfr_sim_pin_input()
+ */
+enum sfr_sim_port {
+	SFR_SIM_PORT_B,
+	SFR_SIM_PORT_C,
+	SFR_SIM_PORT_D,
+	SFR_SIM_PORT_E,
+	SFR_SIM_PORT_F,
+	SFR_SIM_PORT_G,
+	SFR_SIM_NUM_PORTS
+};
+
+/**
+ * @brief Called with each character a UART finishes transmitting
+ */
+typedef void (*sfr_sim_uart_tx_t)(uint8_t uart, uint16_t ch);
+
+/**
+ * @brief Called with each frame the ECAN module finishes transmitting
+ */
+typedef void (*sfr_sim_can_tx_t)(uint32_t can_id, uint8_t dlc, const uint8_t *data);
+
+/**
+ * @brief Put every register in its Power On Reset state
+ *
+ * @param fcy  Instruction clock frequency, only used to time the ADC's
+ *             internal RC clock
+ */
+extern void     sfr_sim_reset(uint32_t fcy);
+
+/**
+ * @brief Advance the simulation, taking any interrupts which become pending
+ */
+extern void     sfr_sim_run(uint32_t cycles);
+
+/**
+ * @brief Whether sfr_sim_run() is already running, for a test which also
+ *        drives the simulation from a signal handler, standing in for the
+ *        interrupts, to skip the tick rather than re-enter it.
+ */
+extern uint8_t  sfr_sim_busy(void);
+
+/**
+ * @brief Instruction cycles simulated since sfr_sim_reset()
+ */
+extern uint64_t sfr_sim_cycles(void);
+
+/**
+ * @brief Number of ISRs called since sfr_sim_reset()
+ */
+extern uint32_t sfr_sim_interrupts(void);
+
+/**
+ * @brief Set the function receiving a UART's transmitted characters
+ */
+extern void     sfr_sim_uart_tx_hook(uint8_t uart, sfr_sim_uart_tx_t hook);
+
+/**
+ * @brief Queue a character on a UART's RX line
+ *
+ * The character arrives in the receive FIFO one frame time after the
+ * previous one. Nine bit characters carry the address bit in bit 8.
+ *
+ * @return 0 or -1 if the line's queue is full
+ */
+extern int16_t  sfr_sim_uart_rx(uint8_t uart, uint16_t ch);
+
+/**
+ * @brief Characters lost to receive FIFO overrun
+ */
+extern uint32_t sfr_sim_uart_overruns(uint8_t uart);
+
+/**
+ * @brief Set the function receiving the ECAN module's transmitted frames
+ */
+extern void     sfr_sim_can_tx_hook(sfr_sim_can_tx_t hook);
+
+/**
+ * @brief Queue a frame on the CAN Bus for the ECAN module to receive
+ *
+ * @return 0 or -1 if the bus queue is full
+ */
+extern int16_t  sfr_sim_can_rx(uint32_t can_id, uint8_t dlc, const uint8_t *data);
+
+/**
+ * @brief Frames lost to receive FIFO overflow
+ */
+extern uint32_t sfr_sim_can_overflows(void);
+
+/**
+ * @brief Set the value the ADC converts for an analog input, AN0 to AN31
+ */
+extern void     sfr_sim_adc_input(uint8_t channel, uint16_t value);
+
+/**
+ * @brief Drive an input pin from outside the uC
+ */
+extern void     sfr_sim_pin_input(enum sfr_sim_port port, uint8_t bit, uint8_t level);
+
+#endif // _SFR_SIM_H
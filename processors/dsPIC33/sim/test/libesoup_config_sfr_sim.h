@@ -0,0 +1,44 @@
+/*
+ * libesoup_config.h libesoup/processors/dsPIC33/sim/test/libesoup_config_sfr_sim.h
+ *
+ * cinnamonBun dsPIC33EP256MU806 configuration for running the real drivers
+ * against the SFR simulation on the host. Copy to a build directory as
+ * libesoup_config.h, see main_sfr_sim.c
+ */
+#ifndef _LIBESOUP_CONFIG_H
+#define _LIBESOUP_CONFIG_H
+
+/*
+ * The simulated xc.h, found through -Ilibesoup/processors/dsPIC33/sim
+ */
+#include <xc.h>
+
+#define SYS_TEST_SFR_SIM
+
+#define SYS_CLOCK_FREQ 60000000
+
+#define SYS_HW_TIMERS
+#define SYS_SW_TIMERS
+#define SYS_NUMBER_OF_SW_TIMERS    8
+#define SYS_SW_TIMER_TICK_ms       5
+
+#define SYS_UART1
+#define SYS_UART_TX_BUFFER_SIZE    64
+
+#define SYS_ADC
+#define SYS_ADC_MAX_CH             4
+#define SYS_ADC_MONITOR
+#define SYS_ADC_PERIOD_UNITS       mSeconds
+#define SYS_ADC_PERIOD_DURATION    10
+
+#define SYS_CHANGE_NOTIFICATION
+#define SYS_CHANGE_NOTIFICATION_MAX_PINS 4
+
+#define LOG_D(...)
+#define LOG_I(...)
+#define LOG_W(...)
+#define LOG_E(...)
+
+#include "libesoup/boards/cinnamonBun/dsPIC33/cb-dsPIC33EP256MU806.h"
+
+#endif // _LIBESOUP_CONFIG_H
@@ -0,0 +1,229 @@
+/*
+ * libesoup/processors/dsPIC33/sim/test/main_sfr_sim.c
+ *
+ * Host test running libesoup_init() and the real dsPIC33EP256MU806 drivers
+ * against the SFR simulation: a repeating Hardware timer, a Software timer,
+ * UART transmit and receive, a monitored ADC channel and a Change Notification.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir sim && cp libesoup/processors/dsPIC33/sim/test/libesoup_config_sfr_sim.h sim/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Isim -I. \
+ *         libesoup/processors/dsPIC33/sim/test/main_sfr_sim.c libesoup/processors/dsPIC33/sim/sfr_sim.c \
+ *         libesoup/core.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c libesoup/boards/cinnamonBun/dsPIC33/board.c \
+ *         libesoup/timers/hw_timers.c libesoup/timers/sw_timers.c libesoup/comms/uart/uart.c \
+ *         libesoup/gpio/gpio.c libesoup/gpio/peripheral.c libesoup/gpio/adc/adc.c \
+ *         libesoup/gpio/change_notification.c -o sim/sfr_sim
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_SFR_SIM
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/gpio/gpio.h"
+#include "libesoup/gpio/adc/adc.h"
+#include "libesoup/gpio/change_notification.h"
+#include "libesoup/timers/hw_timers.h"
+#include "libesoup/timers/sw_timers.h"
+#include "libesoup/comms/uart/uart.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+static uint16_t hw_expiries;
+static uint16_t sw_expiries;
+static char     tx_line[32];
+static uint8_t  tx_count;
+static char     rx_line[32];
+static uint8_t  rx_count;
+static uint16_t adc_value;
+static uint8_t  changes;
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static void hw_expiry(timer_id timer, union sigval data)
+{
+	hw_expiries++;
+}
+
+static void sw_expiry(timer_id timer, union sigval data)
+{
+	sw_expiries++;
+}
+
+static void uart_line(uint8_t uart, uint16_t ch)
+{
+	if(tx_count < sizeof(tx_line) - 1) tx_line[tx_count++] = (char)ch;
+}
+
+static void process_rx_char(uint8_t uart_id, uint8_t ch)
+{
+	if(rx_count < sizeof(rx_line) - 1) rx_line[rx_count++] = (char)ch;
+}
+
+static void adc_handler(enum gpio_pin pin, uint16_t value)
+{
+	adc_value = value;
+}
+
+static void change_handler(enum gpio_pin pin)
+{
+	changes++;
+}
+
+/*
+ * Simulate for a number of milliseconds, running the main loop in between
+ */
+static void run_ms(uint16_t duration)
+{
+	uint16_t loop;
+
+	for(loop = 0; loop < duration; loop++) {
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+	}
+}
+
+static void test_hw_timer(void)
+{
+	struct timer_req request;
+	timer_id         timer;
+
+	request.period.units    = mSeconds;
+	request.period.duration = 10;
+	request.type            = repeat_expiry;
+	request.exp_fn          = hw_expiry;
+	request.data.sival_int  = 0;
+
+	timer = hw_timer_start(&request);
+	CHECK(timer >= 0, "hw_timer_start() %d", timer);
+
+	run_ms(1000);
+	hw_timer_cancel(&timer);
+
+	CHECK((hw_expiries >= 99) && (hw_expiries <= 101), "HW timer expired %u times in 1S", hw_expiries);
+}
+
+static void test_sw_timer(void)
+{
+	struct timer_req request;
+	result_t         rc;
+
+	request.period.units    = mSeconds;
+	request.period.duration = 50;
+	request.type            = repeat_expiry;
+	request.exp_fn          = sw_expiry;
+	request.data.sival_int  = 0;
+
+	rc = sw_timer_start(&request);
+	CHECK(rc >= 0, "sw_timer_start() %d", rc);
+
+	run_ms(1000);
+
+	CHECK((sw_expiries >= 19) && (sw_expiries <= 21), "SW timer expired %u times in 1S", sw_expiries);
+}
+
+static void test_uart(void)
+{
+	struct uart_data udata;
+	const char      *msg = "Hello";
+	result_t         rc;
+	uint8_t          loop;
+
+	udata.tx_pin          = RG8;
+	udata.rx_pin          = RG6;
+	udata.baud            = 115200;
+	udata.tx_finished     = NULL;
+	udata.process_rx_char = process_rx_char;
+	uart_calculate_mode(&udata.uart_mode, UART_8_DATABITS, UART_PARITY_NONE, UART_ONE_STOP_BIT, UART_IDLE_HIGH);
+
+	rc = uart_reserve(&udata);
+	CHECK(rc >= 0, "uart_reserve() %d", rc);
+	sfr_sim_uart_tx_hook(udata.channel, uart_line);
+
+	rc = uart_tx_buffer(&udata, (uint8_t *)msg, strlen(msg));
+	CHECK(rc >= 0, "uart_tx_buffer() %d", rc);
+
+	for(loop = 0; loop < strlen(msg); loop++) {
+		sfr_sim_uart_rx(udata.channel, (uint16_t)msg[loop]);
+	}
+
+	/*
+	 * 5 characters at 115200 Baud take under a milliSecond
+	 */
+	run_ms(2);
+
+	CHECK(strcmp(tx_line, msg) == 0, "UART transmitted \"%s\"", tx_line);
+	CHECK(strcmp(rx_line, msg) == 0, "UART received \"%s\"", rx_line);
+	CHECK(sfr_sim_uart_overruns(udata.channel) == 0, "UART overran");
+
+	uart_release(&udata);
+}
+
+static void test_adc(void)
+{
+	result_t rc;
+
+	sfr_sim_adc_input(0, 0x1234);
+
+	rc = adc_monitor_channel(RB0, 0, adc_handler);
+	CHECK(rc >= 0, "adc_monitor_channel() %d", rc);
+
+	run_ms(2 * SYS_ADC_PERIOD_DURATION);
+
+	CHECK(adc_value == 0x0234, "ADC sampled 0x%x", adc_value);
+}
+
+static void test_change_notification(void)
+{
+	result_t rc;
+
+	sfr_sim_pin_input(SFR_SIM_PORT_B, 1, 0);
+
+	rc = gpio_set(RB1, GPIO_MODE_DIGITAL_INPUT, 0);
+	CHECK(rc >= 0, "gpio_set() %d", rc);
+
+	rc = change_notifier_register(RB1, change_handler);
+	CHECK(rc >= 0, "change_notifier_register() %d", rc);
+
+	sfr_sim_pin_input(SFR_SIM_PORT_B, 1, 1);
+	run_ms(1);
+	sfr_sim_pin_input(SFR_SIM_PORT_B, 1, 0);
+	run_ms(1);
+
+	CHECK(changes == 2, "Change Notifier called %u times", changes);
+}
+
+int main(void)
+{
+	result_t rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	test_hw_timer();
+	test_sw_timer();
+	test_uart();
+	test_adc();
+	test_change_notification();
+
+	printf("%llu cycles simulated, %u interrupts\n",
+	       (unsigned long long)sfr_sim_cycles(), sfr_sim_interrupts());
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_SFR_SIM
@@ -0,0 +1,838 @@
+/**
+ * @file libesoup/processors/dsPIC33/sim/xc.h
+ *
+ * @author John Whitmore
+ *
+ * @brief Host simulation of the dsPIC33EP256MU806 Special Function Registers
+ *
+ * Copyright 2017-2020 electronicSoup Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the version 2 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ *
+ * This file stands in for the XC16 compiler's <xc.h> when the dsPIC33 drivers
+ * are built with gcc on Linux. Put this directory first in the include path:
+ *
+ *     gcc -Ilibesoup/processors/dsPIC33/sim -I. ...
+ *
+ * and the unmodified driver sources find the SFRs they use declared here as
+ * ordinary memory. The behaviour of the peripherals behind the registers, and
+ * the calling of the drivers' Interrupt Service Routines, is modelled in
+ * sfr_sim.c, see sfr_sim.h for the API used by a host test to drive it.
+ *
+ * Only the registers used by the libesoup drivers are declared. Each register
+ * is a union of its 16 bit value and its bit fields, so both U1STA and
+ * U1STAbits.URXDA work as they do under XC16. Registers which have side
+ * effects when read or written, such as UxTXREG, are macros calling into the
+ * simulation.
+ */
+#ifndef _SIM_XC_H
+#define _SIM_XC_H
+
+#include <stdint.h>
+
+#ifndef __dsPIC33EP256MU806__
+#define __dsPIC33EP256MU806__  1
+#endif
+
+#ifndef XC16
+#define XC16                   1
+#endif
+
+#ifndef __XC16
+#define __XC16                 1
+#endif
+
+/**
+ * @brief Defined for builds against the simulated SFRs
+ */
+#define ES_SFR_SIM
+
+/*
+ * XC16 keywords and attributes which mean nothing to gcc on the host. The
+ * interrupt attribute has a different meaning on x86 so ISRs are simply kept.
+ */
+#define __eds__
+#define _ISR             __attribute__((__used__))
+#define __interrupt__    __used__
+#define __no_auto_psv__  __used__
+#define __auto_psv__     __used__
+#define eds              __used__
+#define space(x)         __used__
+
+/*
+ * Compiler builtins. Each instruction executed advances the simulation one
+ * instruction cycle so that busy waits on a register do complete.
+ */
+extern void     sfr_sim_instruction(void);
+extern void     sfr_sim_disi(uint16_t cycles);
+extern void     sfr_sim_write_oscconh(uint8_t value);
+extern void     sfr_sim_write_oscconl(uint8_t value);
+
+#define Nop()                       sfr_sim_instruction()
+#define ClrWdt()                    sfr_sim_instruction()
+#define asm(x)                      sfr_sim_instruction()
+#define __builtin_disi(x)           sfr_sim_disi(x)
+#define __builtin_write_OSCCONH(x)  sfr_sim_write_oscconh(x)
+#define __builtin_write_OSCCONL(x)  sfr_sim_write_oscconl(x)
+#define __builtin_write_RTCWEN()    sfr_sim_instruction()
+
+/*
+ * Bit field helper for the I/O Port registers which name their bits after
+ * the port, for example TRISB0 to TRISB15.
+ */
+#define SIM_BITS16(p)                                                          \
+	uint16_t p##0:1;  uint16_t p##1:1;  uint16_t p##2:1;  uint16_t p##3:1;  \
+	uint16_t p##4:1;  uint16_t p##5:1;  uint16_t p##6:1;  uint16_t p##7:1;  \
+	uint16_t p##8:1;  uint16_t p##9:1;  uint16_t p##10:1; uint16_t p##11:1; \
+	uint16_t p##12:1; uint16_t p##13:1; uint16_t p##14:1; uint16_t p##15:1;
+
+/*
+ * Declare a register which is only ever accessed as a whole.
+ */
+#define SIM_SFR(name)                                                          \
+	extern volatile uint16_t sim_##name;
+
+/*
+ * Declare a register with bit fields, the union type is sim_<name>_t
+ */
+#define SIM_SFR_BITS(name, fields)                                             \
+	typedef union { uint16_t reg; struct { fields }; } sim_##name##_t;     \
+	extern volatile sim_##name##_t sim_##name;
+
+/*
+ * CPU and Interrupt Controller
+ */
+SIM_SFR_BITS(SR,       uint16_t C:1; uint16_t Z:1; uint16_t OV:1; uint16_t N:1;
+                       uint16_t RA:1; uint16_t IPL:3; uint16_t :8;)
+SIM_SFR_BITS(INTCON1,  uint16_t :15; uint16_t NSTDIS:1;)
+SIM_SFR_BITS(INTCON2,  uint16_t INT0EP:1; uint16_t INT1EP:1; uint16_t INT2EP:1;
+                       uint16_t :11; uint16_t DISI:1; uint16_t GIE:1;)
+
+#define SR        sim_SR.reg
+#define SRbits    sim_SR
+#define INTCON1     sim_INTCON1.reg
+#define INTCON1bits sim_INTCON1
+#define INTCON2     sim_INTCON2.reg
+#define INTCON2bits sim_INTCON2
+
+SIM_SFR_BITS(IFS0, uint16_t INT0IF:1; uint16_t IC1IF:1; uint16_t OC1IF:1; uint16_t T1IF:1;
+                   uint16_t DMA0IF:1; uint16_t IC2IF:1; uint16_t OC2IF:1; uint16_t T2IF:1;
+                   uint16_t T3IF:1; uint16_t SPI1EIF:1; uint16_t SPI1IF:1; uint16_t U1RXIF:1;
+                   uint16_t U1TXIF:1; uint16_t AD1IF:1; uint16_t DMA1IF:1; uint16_t NVMIF:1;)
+SIM_SFR_BITS(IFS1, uint16_t SI2C1IF:1; uint16_t MI2C1IF:1; uint16_t CMIF:1; uint16_t CNIF:1;
+                   uint16_t INT1IF:1; uint16_t AD2IF:1; uint16_t IC7IF:1; uint16_t IC8IF:1;
+                   uint16_t DMA2IF:1; uint16_t OC3IF:1; uint16_t OC4IF:1; uint16_t T4IF:1;
+                   uint16_t T5IF:1; uint16_t INT2IF:1; uint16_t U2RXIF:1; uint16_t U2TXIF:1;)
+SIM_SFR_BITS(IFS2, uint16_t SPI2EIF:1; uint16_t SPI2IF:1; uint16_t C1RXIF:1; uint16_t C1IF:1;
+                   uint16_t DMA3IF:1; uint16_t IC3IF:1; uint16_t IC4IF:1; uint16_t IC5IF:1;
+                   uint16_t IC6IF:1; uint16_t OC5IF:1; uint16_t OC6IF:1; uint16_t OC7IF:1;
+                   uint16_t OC8IF:1; uint16_t PMPIF:1; uint16_t DMA4IF:1; uint16_t T6IF:1;)
+SIM_SFR_BITS(IFS3, uint16_t T7IF:1; uint16_t SI2C2IF:1; uint16_t MI2C2IF:1; uint16_t T8IF:1;
+                   uint16_t T9IF:1; uint16_t INT3IF:1; uint16_t INT4IF:1; uint16_t C2RXIF:1;
+                   uint16_t C2IF:1; uint16_t :4; uint16_t DMA5IF:1; uint16_t RTCIF:1; uint16_t :1;)
+SIM_SFR_BITS(IFS4, uint16_t :4; uint16_t DMA6IF:1; uint16_t DMA7IF:1; uint16_t :10;)
+SIM_SFR_BITS(IFS5, uint16_t :1; uint16_t U3EIF:1; uint16_t U3RXIF:1; uint16_t U3TXIF:1;
+                   uint16_t :4; uint16_t U4EIF:1; uint16_t U4RXIF:1; uint16_t U4TXIF:1;
+                   uint16_t :5;)
+
+SIM_SFR_BITS(IEC0, uint16_t INT0IE:1; uint16_t IC1IE:1; uint16_t OC1IE:1; uint16_t T1IE:1;
+                   uint16_t DMA0IE:1; uint16_t IC2IE:1; uint16_t OC2IE:1; uint16_t T2IE:1;
+                   uint16_t T3IE:1; uint16_t SPI1EIE:1; uint16_t SPI1IE:1; uint16_t U1RXIE:1;
+                   uint16_t U1TXIE:1; uint16_t AD1IE:1; uint16_t DMA1IE:1; uint16_t NVMIE:1;)
+SIM_SFR_BITS(IEC1, uint16_t SI2C1IE:1; uint16_t MI2C1IE:1; uint16_t CMIE:1; uint16_t CNIE:1;
+                   uint16_t INT1IE:1; uint16_t AD2IE:1; uint16_t IC7IE:1; uint16_t IC8IE:1;
+                   uint16_t DMA2IE:1; uint16_t OC3IE:1; uint16_t OC4IE:1; uint16_t T4IE:1;
+                   uint16_t T5IE:1; uint16_t INT2IE:1; uint16_t U2RXIE:1; uint16_t U2TXIE:1;)
+SIM_SFR_BITS(IEC2, uint16_t SPI2EIE:1; uint16_t SPI2IE:1; uint16_t C1RXIE:1; uint16_t C1IE:1;
+                   uint16_t DMA3IE:1; uint16_t IC3IE:1; uint16_t IC4IE:1; uint16_t IC5IE:1;
+                   uint16_t IC6IE:1; uint16_t OC5IE:1; uint16_t OC6IE:1; uint16_t OC7IE:1;
+                   uint16_t OC8IE:1; uint16_t PMPIE:1; uint16_t DMA4IE:1; uint16_t T6IE:1;)
+SIM_SFR_BITS(IEC3, uint16_t T7IE:1; uint16_t SI2C2IE:1; uint16_t MI2C2IE:1; uint16_t T8IE:1;
+                   uint16_t T9IE:1; uint16_t INT3IE:1; uint16_t INT4IE:1; uint16_t C2RXIE:1;
+                   uint16_t C2IE:1; uint16_t :4; uint16_t DMA5IE:1; uint16_t RTCIE:1; uint16_t :1;)
+SIM_SFR_BITS(IEC4, uint16_t :4; uint16_t DMA6IE:1; uint16_t DMA7IE:1; uint16_t :10;)
+SIM_SFR_BITS(IEC5, uint16_t :1; uint16_t U3EIE:1; uint16_t U3RXIE:1; uint16_t U3TXIE:1;
+                   uint16_t :4; uint16_t U4EIE:1; uint16_t U4RXIE:1; uint16_t U4TXIE:1;
+                   uint16_t :5;)
+
+#define IFS0      sim_IFS0.reg
+#define IFS0bits  sim_IFS0
+#define IFS1      sim_IFS1.reg
+#define IFS1bits  sim_IFS1
+#define IFS2      sim_IFS2.reg
+#define IFS2bits  sim_IFS2
+#define IFS3      sim_IFS3.reg
+#define IFS3bits  sim_IFS3
+#define IFS4      sim_IFS4.reg
+#define IFS4bits  sim_IFS4
+#define IFS5      sim_IFS5.reg
+#define IFS5bits  sim_IFS5
+#define IEC0      sim_IEC0.reg
+#define IEC0bits  sim_IEC0
+#define IEC1      sim_IEC1.reg
+#define IEC1bits  sim_IEC1
+#define IEC2      sim_IEC2.reg
+#define IEC2bits  sim_IEC2
+#define IEC3      sim_IEC3.reg
+#define IEC3bits  sim_IEC3
+#define IEC4      sim_IEC4.reg
+#define IEC4bits  sim_IEC4
+#define IEC5      sim_IEC5.reg
+#define IEC5bits  sim_IEC5
+
+/*
+ * Interrupt priorities, each source has a 3 bit field in a nibble
+ */
+SIM_SFR_BITS(IPC0,  uint16_t INT0IP:3; uint16_t :1; uint16_t IC1IP:3; uint16_t :1;
+                    uint16_t OC1IP:3; uint16_t :1; uint16_t T1IP:3; uint16_t :1;)
+SIM_SFR_BITS(IPC1,  uint16_t DMA0IP:3; uint16_t :1; uint16_t IC2IP:3; uint16_t :1;
+                    uint16_t OC2IP:3; uint16_t :1; uint16_t T2IP:3; uint16_t :1;)
+SIM_SFR_BITS(IPC2,  uint16_t T3IP:3; uint16_t :1; uint16_t SPI1EIP:3; uint16_t :1;
+                    uint16_t SPI1IP:3; uint16_t :1; uint16_t U1RXIP:3; uint16_t :1;)
+SIM_SFR_BITS(IPC3,  uint16_t U1TXIP:3; uint16_t :1; uint16_t AD1IP:3; uint16_t :1;
+                    uint16_t DMA1IP:3; uint16_t :1; uint16_t NVMIP:3; uint16_t :1;)
+SIM_SFR_BITS(IPC4,  uint16_t SI2C1IP:3; uint16_t :1; uint16_t MI2C1IP:3; uint16_t :1;
+                    uint16_t CMIP:3; uint16_t :1; uint16_t CNIP:3; uint16_t :1;)
+SIM_SFR_BITS(IPC6,  uint16_t DMA2IP:3; uint16_t :1; uint16_t OC3IP:3; uint16_t :1;
+                    uint16_t OC4IP:3; uint16_t :1; uint16_t T4IP:3; uint16_t :1;)
+SIM_SFR_BITS(IPC7,  uint16_t T5IP:3; uint16_t :1; uint16_t INT2IP:3; uint16_t :1;
+                    uint16_t U2RXIP:3; uint16_t :1; uint16_t U2TXIP:3; uint16_t :1;)
+SIM_SFR_BITS(IPC8,  uint16_t SPI2EIP:3; uint16_t :1; uint16_t SPI2IP:3; uint16_t :1;
+                    uint16_t C1RXIP:3; uint16_t :1; uint16_t C1IP:3; uint16_t :1;)
+SIM_SFR_BITS(IPC9,  uint16_t DMA3IP:3; uint16_t :1; uint16_t IC3IP:3; uint16_t :1;
+                    uint16_t IC4IP:3; uint16_t :1; uint16_t IC5IP:3; uint16_t :1;)
+SIM_SFR_BITS(IPC11, uint16_t :8; uint16_t DMA4IP:3; uint16_t :5;)
+SIM_SFR_BITS(IPC15, uint16_t :4; uint16_t DMA5IP:3; uint16_t :1; uint16_t RTCIP:3; uint16_t :5;)
+SIM_SFR_BITS(IPC17, uint16_t DMA6IP:3; uint16_t :1; uint16_t DMA7IP:3; uint16_t :9;)
+SIM_SFR_BITS(IPC20, uint16_t :4; uint16_t U3EIP:3; uint16_t :1;
+                    uint16_t U3RXIP:3; uint16_t :1; uint16_t U3TXIP:3; uint16_t :1;)
+SIM_SFR_BITS(IPC22, uint16_t U4EIP:3; uint16_t :1; uint16_t U4RXIP:3; uint16_t :1;
+                    uint16_t U4TXIP:3; uint16_t :5;)
+
+#define IPC0       sim_IPC0.reg
+#define IPC0bits   sim_IPC0
+#define IPC1       sim_IPC1.reg
+#define IPC1bits   sim_IPC1
+#define IPC2       sim_IPC2.reg
+#define IPC2bits   sim_IPC2
+#define IPC3       sim_IPC3.reg
+#define IPC3bits   sim_IPC3
+#define IPC4       sim_IPC4.reg
+#define IPC4bits   sim_IPC4
+#define IPC6       sim_IPC6.reg
+#define IPC6bits   sim_IPC6
+#define IPC7       sim_IPC7.reg
+#define IPC7bits   sim_IPC7
+#define IPC8       sim_IPC8.reg
+#define IPC8bits   sim_IPC8
+#define IPC9       sim_IPC9.reg
+#define IPC9bits   sim_IPC9
+#define IPC11      sim_IPC11.reg
+#define IPC11bits  sim_IPC11
+#define IPC15      sim_IPC15.reg
+#define IPC15bits  sim_IPC15
+#define IPC17      sim_IPC17.reg
+#define IPC17bits  sim_IPC17
+#define IPC20      sim_IPC20.reg
+#define IPC20bits  sim_IPC20
+#define IPC22      sim_IPC22.reg
+#define IPC22bits  sim_IPC22
+
+/*
+ * Oscillator
+ */
+SIM_SFR_BITS(OSCCON,  uint16_t OSWEN:1; uint16_t LPOSCEN:1; uint16_t :1; uint16_t CF:1;
+                      uint16_t :1; uint16_t LOCK:1; uint16_t IOLOCK:1; uint16_t CLKLOCK:1;
+                      uint16_t NOSC:3; uint16_t :1; uint16_t COSC:3; uint16_t :1;)
+SIM_SFR_BITS(CLKDIV,  uint16_t PLLPRE:5; uint16_t :1; uint16_t PLLPOST:2;
+                      uint16_t FRCDIV:3; uint16_t DOZEN:1; uint16_t DOZE:3; uint16_t ROI:1;)
+SIM_SFR_BITS(PLLFBD,  uint16_t PLLDIV:9; uint16_t :7;)
+SIM_SFR_BITS(ACLKCON3, uint16_t APLLPOST:3; uint16_t :2; uint16_t APLLPRE:3; uint16_t :1;
+                       uint16_t FRCSEL:1; uint16_t :1; uint16_t ASRCSEL:1; uint16_t AOSCMD:2;
+                       uint16_t SELACLK:1; uint16_t APLLCK:1; uint16_t ENAPLL:1;)
+SIM_SFR_BITS(ACLKDIV3, uint16_t APLLDIV:3; uint16_t :13;)
+
+#define OSCCON        sim_OSCCON.reg
+#define OSCCONbits    sim_OSCCON
+#define CLKDIV        sim_CLKDIV.reg
+#define CLKDIVbits    sim_CLKDIV
+#define PLLFBD        sim_PLLFBD.reg
+#define PLLFBDbits    sim_PLLFBD
+#define ACLKCON3      sim_ACLKCON3.reg
+#define ACLKCON3bits  sim_ACLKCON3
+#define ACLKDIV3      sim_ACLKDIV3.reg
+#define ACLKDIV3bits  sim_ACLKDIV3
+
+/*
+ * Timers. Timer 1 is a Type A timer, 2 & 4 are Type B and 3 & 5 Type C
+ * so T2 & T3 and T4 & T5 can be paired as 32 bit timers.
+ */
+#define SIM_TXCON_FIELDS                                                       \
+	struct { uint16_t :1; uint16_t TCS:1; uint16_t TSYNC:1; uint16_t T32:1; \
+	         uint16_t TCKPS:2; uint16_t TGATE:1; uint16_t :6;               \
+	         uint16_t TSIDL:1; uint16_t :1; uint16_t TON:1; };              \
+	struct { uint16_t :4; uint16_t TCKPS0:1; uint16_t TCKPS1:1; uint16_t :10; };
+
+typedef union { uint16_t reg; SIM_TXCON_FIELDS } sim_txcon_t;
+
+extern volatile sim_txcon_t sim_T1CON;
+extern volatile sim_txcon_t sim_T2CON;
+extern volatile sim_txcon_t sim_T3CON;
+extern volatile sim_txcon_t sim_T4CON;
+extern volatile sim_txcon_t sim_T5CON;
+
+SIM_SFR(TMR1)
+SIM_SFR(TMR2)
+SIM_SFR(TMR3)
+SIM_SFR(TMR4)
+SIM_SFR(TMR5)
+SIM_SFR(PR1)
+SIM_SFR(PR2)
+SIM_SFR(PR3)
+SIM_SFR(PR4)
+SIM_SFR(PR5)
+
+#define T1CON      sim_T1CON.reg
+#define T1CONbits  sim_T1CON
+#define T2CON      sim_T2CON.reg
+#define T2CONbits  sim_T2CON
+#define T3CON      sim_T3CON.reg
+#define T3CONbits  sim_T3CON
+#define T4CON      sim_T4CON.reg
+#define T4CONbits  sim_T4CON
+#define T5CON      sim_T5CON.reg
+#define T5CONbits  sim_T5CON
+#define TMR1       sim_TMR1
+#define TMR2       sim_TMR2
+#define TMR3       sim_TMR3
+#define TMR4       sim_TMR4
+#define TMR5       sim_TMR5
+#define PR1        sim_PR1
+#define PR2        sim_PR2
+#define PR3        sim_PR3
+#define PR4        sim_PR4
+#define PR5        sim_PR5
+
+/*
+ * UARTs. Writing UxTXREG pushes into the transmit FIFO and reading UxRXREG
+ * pops the receive FIFO, so both are calls into the simulation.
+ */
+typedef union {
+	uint16_t reg;
+	struct { uint16_t STSEL:1; uint16_t PDSEL:2; uint16_t BRGH:1; uint16_t URXINV:1;
+	         uint16_t ABAUD:1; uint16_t LPBACK:1; uint16_t WAKE:1; uint16_t UEN:2;
+	         uint16_t :1; uint16_t RTSMD:1; uint16_t IREN:1; uint16_t USIDL:1;
+	         uint16_t :1; uint16_t UARTEN:1; };
+	struct { uint16_t :1; uint16_t PDSEL0:1; uint16_t PDSEL1:1; uint16_t :5;
+	         uint16_t UEN0:1; uint16_t UEN1:1; uint16_t :6; };
+} sim_uxmode_t;
+
+typedef union {
+	uint16_t reg;
+	struct { uint16_t URXDA:1; uint16_t OERR:1; uint16_t FERR:1; uint16_t PERR:1;
+	         uint16_t RIDLE:1; uint16_t ADDEN:1; uint16_t URXISEL:2; uint16_t TRMT:1;
+	         uint16_t UTXBF:1; uint16_t UTXEN:1; uint16_t UTXBRK:1; uint16_t :1;
+	         uint16_t UTXISEL0:1; uint16_t UTXINV:1; uint16_t UTXISEL1:1; };
+	struct { uint16_t :6; uint16_t URXISEL0:1; uint16_t URXISEL1:1; uint16_t :8; };
+} sim_uxsta_t;
+
+extern volatile sim_uxmode_t sim_UMODE[4];
+extern volatile sim_uxsta_t  sim_USTA[4];
+extern volatile uint16_t     sim_UBRG[4];
+
+extern volatile uint16_t    *sfr_sim_uart_txreg(uint8_t uart);
+extern volatile uint16_t    *sfr_sim_uart_rxreg(uint8_t uart);
+
+#define U1MODE      sim_UMODE[0].reg
+#define U1MODEbits  sim_UMODE[0]
+#define U1STA       sim_USTA[0].reg
+#define U1STAbits   sim_USTA[0]
+#define U1BRG       sim_UBRG[0]
+#define U1TXREG     (*sfr_sim_uart_txreg(0))
+#define U1RXREG     (*sfr_sim_uart_rxreg(0))
+#define U2MODE      sim_UMODE[1].reg
+#define U2MODEbits  sim_UMODE[1]
+#define U2STA       sim_USTA[1].reg
+#define U2STAbits   sim_USTA[1]
+#define U2BRG       sim_UBRG[1]
+#define U2TXREG     (*sfr_sim_uart_txreg(1))
+#define U2RXREG     (*sfr_sim_uart_rxreg(1))
+#define U3MODE      sim_UMODE[2].reg
+#define U3MODEbits  sim_UMODE[2]
+#define U3STA       sim_USTA[2].reg
+#define U3STAbits   sim_USTA[2]
+#define U3BRG       sim_UBRG[2]
+#define U3TXREG     (*sfr_sim_uart_txreg(2))
+#define U3RXREG     (*sfr_sim_uart_rxreg(2))
+#define U4MODE      sim_UMODE[3].reg
+#define U4MODEbits  sim_UMODE[3]
+#define U4STA       sim_USTA[3].reg
+#define U4STAbits   sim_USTA[3]
+#define U4BRG       sim_UBRG[3]
+#define U4TXREG     (*sfr_sim_uart_txreg(3))
+#define U4RXREG     (*sfr_sim_uart_rxreg(3))
+
+/*
+ * ADC 1. The sixteen result buffers are contiguous, as drivers walk them
+ * with a pointer from ADC1BUF0.
+ */
+SIM_SFR_BITS(AD1CON1, uint16_t DONE:1; uint16_t SAMP:1; uint16_t ASAM:1; uint16_t SIMSAM:1;
+                      uint16_t SSRCG:1; uint16_t SSRC:3; uint16_t FORM:2; uint16_t AD12B:1;
+                      uint16_t :1; uint16_t ADDMABM:1; uint16_t ADSIDL:1; uint16_t :1;
+                      uint16_t ADON:1;)
+SIM_SFR_BITS(AD1CON2, uint16_t ALTS:1; uint16_t BUFM:1; uint16_t SMPI:5; uint16_t BUFS:1;
+                      uint16_t CHPS:2; uint16_t CSCNA:1; uint16_t :2; uint16_t VCFG:3;)
+SIM_SFR_BITS(AD1CON3, uint16_t ADCS:8; uint16_t SAMC:5; uint16_t :2; uint16_t ADRC:1;)
+SIM_SFR_BITS(AD1CON4, uint16_t DMABL:3; uint16_t :5; uint16_t ADDMAEN:1; uint16_t :7;)
+SIM_SFR_BITS(AD1CHS0, uint16_t CH0SA:5; uint16_t :2; uint16_t CH0NA:1;
+                      uint16_t CH0SB:5; uint16_t :2; uint16_t CH0NB:1;)
+SIM_SFR_BITS(AD1CSSL, SIM_BITS16(CSS))
+SIM_SFR_BITS(AD1CSSH, uint16_t CSS16:1; uint16_t CSS17:1; uint16_t CSS18:1; uint16_t CSS19:1;
+                      uint16_t CSS20:1; uint16_t CSS21:1; uint16_t CSS22:1; uint16_t CSS23:1;
+                      uint16_t CSS24:1; uint16_t CSS25:1; uint16_t CSS26:1; uint16_t CSS27:1;
+                      uint16_t CSS28:1; uint16_t CSS29:1; uint16_t CSS30:1; uint16_t CSS31:1;)
+
+extern volatile uint16_t sim_ADC1BUF[16];
+
+#define AD1CON1      sim_AD1CON1.reg
+#define AD1CON1bits  sim_AD1CON1
+#define AD1CON2      sim_AD1CON2.reg
+#define AD1CON2bits  sim_AD1CON2
+#define AD1CON3      sim_AD1CON3.reg
+#define AD1CON3bits  sim_AD1CON3
+#define AD1CON4      sim_AD1CON4.reg
+#define AD1CON4bits  sim_AD1CON4
+#define AD1CHS0      sim_AD1CHS0.reg
+#define AD1CHS0bits  sim_AD1CHS0
+#define AD1CSSL      sim_AD1CSSL.reg
+#define AD1CSSLbits  sim_AD1CSSL
+#define AD1CSSH      sim_AD1CSSH.reg
+#define AD1CSSHbits  sim_AD1CSSH
+#define ADC1BUF0     sim_ADC1BUF[0]
+#define ADC1BUF1     sim_ADC1BUF[1]
+#define ADC1BUF2     sim_ADC1BUF[2]
+#define ADC1BUF3     sim_ADC1BUF[3]
+#define ADC1BUF4     sim_ADC1BUF[4]
+#define ADC1BUF5     sim_ADC1BUF[5]
+#define ADC1BUF6     sim_ADC1BUF[6]
+#define ADC1BUF7     sim_ADC1BUF[7]
+#define ADC1BUF8     sim_ADC1BUF[8]
+#define ADC1BUF9     sim_ADC1BUF[9]
+#define ADC1BUFA     sim_ADC1BUF[10]
+#define ADC1BUFB     sim_ADC1BUF[11]
+#define ADC1BUFC     sim_ADC1BUF[12]
+#define ADC1BUFD     sim_ADC1BUF[13]
+#define ADC1BUFE     sim_ADC1BUF[14]
+#define ADC1BUFF     sim_ADC1BUF[15]
+
+/*
+ * I/O Ports B to G, indexed 0 to 5 in the simulation's arrays.
+ */
+#define SIM_PORT_REGS(x)                                                       \
+	SIM_SFR_BITS(TRIS##x,  SIM_BITS16(TRIS##x))                            \
+	SIM_SFR_BITS(PORT##x,  SIM_BITS16(R##x))                               \
+	SIM_SFR_BITS(LAT##x,   SIM_BITS16(LAT##x))                             \
+	SIM_SFR_BITS(ODC##x,   SIM_BITS16(ODC##x))                             \
+	SIM_SFR_BITS(ANSEL##x, SIM_BITS16(ANS##x))                             \
+	SIM_SFR_BITS(CNEN##x,  SIM_BITS16(CNIE##x))                            \
+	SIM_SFR_BITS(CNPU##x,  SIM_BITS16(CNPU##x))                            \
+	SIM_SFR_BITS(CNPD##x,  SIM_BITS16(CNPD##x))
+
+SIM_PORT_REGS(B)
+SIM_PORT_REGS(C)
+SIM_PORT_REGS(D)
+SIM_PORT_REGS(E)
+SIM_PORT_REGS(F)
+SIM_PORT_REGS(G)
+
+#define TRISB       sim_TRISB.reg
+#define TRISBbits   sim_TRISB
+#define PORTB       sim_PORTB.reg
+#define PORTBbits   sim_PORTB
+#define LATB        sim_LATB.reg
+#define LATBbits    sim_LATB
+#define ODCB        sim_ODCB.reg
+#define ODCBbits    sim_ODCB
+#define ANSELB      sim_ANSELB.reg
+#define ANSELBbits  sim_ANSELB
+#define CNENB       sim_CNENB.reg
+#define CNENBbits   sim_CNENB
+#define CNPUB       sim_CNPUB.reg
+#define CNPUBbits   sim_CNPUB
+#define CNPDB       sim_CNPDB.reg
+#define CNPDBbits   sim_CNPDB
+
+#define TRISC       sim_TRISC.reg
+#define TRISCbits   sim_TRISC
+#define PORTC       sim_PORTC.reg
+#define PORTCbits   sim_PORTC
+#define LATC        sim_LATC.reg
+#define LATCbits    sim_LATC
+#define ODCC        sim_ODCC.reg
+#define ODCCbits    sim_ODCC
+#define ANSELC      sim_ANSELC.reg
+#define ANSELCbits  sim_ANSELC
+#define CNENC       sim_CNENC.reg
+#define CNENCbits   sim_CNENC
+#define CNPUC       sim_CNPUC.reg
+#define CNPUCbits   sim_CNPUC
+#define CNPDC       sim_CNPDC.reg
+#define CNPDCbits   sim_CNPDC
+
+#define TRISD       sim_TRISD.reg
+#define TRISDbits   sim_TRISD
+#define PORTD       sim_PORTD.reg
+#define PORTDbits   sim_PORTD
+#define LATD        sim_LATD.reg
+#define LATDbits    sim_LATD
+#define ODCD        sim_ODCD.reg
+#define ODCDbits    sim_ODCD
+#define ANSELD      sim_ANSELD.reg
+#define ANSELDbits  sim_ANSELD
+#define CNEND       sim_CNEND.reg
+#define CNENDbits   sim_CNEND
+#define CNPUD       sim_CNPUD.reg
+#define CNPUDbits   sim_CNPUD
+#define CNPDD       sim_CNPDD.reg
+#define CNPDDbits   sim_CNPDD
+
+#define TRISE       sim_TRISE.reg
+#define TRISEbits   sim_TRISE
+#define PORTE       sim_PORTE.reg
+#define PORTEbits   sim_PORTE
+#define LATE        sim_LATE.reg
+#define LATEbits    sim_LATE
+#define ODCE        sim_ODCE.reg
+#define ODCEbits    sim_ODCE
+#define ANSELE      sim_ANSELE.reg
+#define ANSELEbits  sim_ANSELE
+#define CNENE       sim_CNENE.reg
+#define CNENEbits   sim_CNENE
+#define CNPUE       sim_CNPUE.reg
+#define CNPUEbits   sim_CNPUE
+#define CNPDE       sim_CNPDE.reg
+#define CNPDEbits   sim_CNPDE
+
+#define TRISF       sim_TRISF.reg
+#define TRISFbits   sim_TRISF
+#define PORTF       sim_PORTF.reg
+#define PORTFbits   sim_PORTF
+#define LATF        sim_LATF.reg
+#define LATFbits    sim_LATF
+#define ODCF        sim_ODCF.reg
+#define ODCFbits    sim_ODCF
+#define ANSELF      sim_ANSELF.reg
+#define ANSELFbits  sim_ANSELF
+#define CNENF       sim_CNENF.reg
+#define CNENFbits   sim_CNENF
+#define CNPUF       sim_CNPUF.reg
+#define CNPUFbits   sim_CNPUF
+#define CNPDF       sim_CNPDF.reg
+#define CNPDFbits   sim_CNPDF
+
+#define TRISG       sim_TRISG.reg
+#define TRISGbits   sim_TRISG
+#define PORTG       sim_PORTG.reg
+#define PORTGbits   sim_PORTG
+#define LATG        sim_LATG.reg
+#define LATGbits    sim_LATG
+#define ODCG        sim_ODCG.reg
+#define ODCGbits    sim_ODCG
+#define ANSELG      sim_ANSELG.reg
+#define ANSELGbits  sim_ANSELG
+#define CNENG       sim_CNENG.reg
+#define CNENGbits   sim_CNENG
+#define CNPUG       sim_CNPUG.reg
+#define CNPUGbits   sim_CNPUG
+#define CNPDG       sim_CNPDG.reg
+#define CNPDGbits   sim_CNPDG
+
+/*
+ * Peripheral Pin Select. Only the mappings used by the drivers are named,
+ * every input mapping register has two 7 bit fields and every output mapping
+ * register two 6 bit fields.
+ */
+SIM_SFR_BITS(RPINR18, uint16_t U1RXR:7; uint16_t :1; uint16_t U1CTSR:7; uint16_t :1;)
+SIM_SFR_BITS(RPINR19, uint16_t U2RXR:7; uint16_t :1; uint16_t U2CTSR:7; uint16_t :1;)
+SIM_SFR_BITS(RPINR26, uint16_t C1RXR:7; uint16_t :1; uint16_t C2RXR:7; uint16_t :1;)
+SIM_SFR_BITS(RPINR27, uint16_t U3RXR:7; uint16_t :1; uint16_t U3CTSR:7; uint16_t :1;)
+SIM_SFR_BITS(RPINR28, uint16_t U4RXR:7; uint16_t :1; uint16_t U4CTSR:7; uint16_t :1;)
+
+SIM_SFR_BITS(RPOR0,  uint16_t RP64R:6; uint16_t :2; uint16_t RP65R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR1,  uint16_t RP66R:6; uint16_t :2; uint16_t RP67R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR2,  uint16_t RP68R:6; uint16_t :2; uint16_t RP69R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR3,  uint16_t RP70R:6; uint16_t :2; uint16_t RP71R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR4,  uint16_t RP79R:6; uint16_t :2; uint16_t RP80R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR5,  uint16_t RP82R:6; uint16_t :2; uint16_t RP84R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR6,  uint16_t RP85R:6; uint16_t :2; uint16_t RP87R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR7,  uint16_t RP96R:6; uint16_t :2; uint16_t RP97R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR8,  uint16_t RP98R:6; uint16_t :2; uint16_t RP99R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR9,  uint16_t RP100R:6; uint16_t :2; uint16_t RP101R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR10, uint16_t RP102R:6; uint16_t :2; uint16_t RP104R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR11, uint16_t RP108R:6; uint16_t :2; uint16_t RP109R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR12, uint16_t RP112R:6; uint16_t :2; uint16_t RP113R:6; uint16_t :2;)
+SIM_SFR_BITS(RPOR13, uint16_t RP118R:6; uint16_t :2; uint16_t :6; uint16_t :2;)
+SIM_SFR_BITS(RPOR14, uint16_t RP120R:6; uint16_t :2; uint16_t :6; uint16_t :2;)
+
+#define RPINR18      sim_RPINR18.reg
+#define RPINR18bits  sim_RPINR18
+#define RPINR19      sim_RPINR19.reg
+#define RPINR19bits  sim_RPINR19
+#define RPINR26      sim_RPINR26.reg
+#define RPINR26bits  sim_RPINR26
+#define RPINR27      sim_RPINR27.reg
+#define RPINR27bits  sim_RPINR27
+#define RPINR28      sim_RPINR28.reg
+#define RPINR28bits  sim_RPINR28
+#define RPOR0        sim_RPOR0.reg
+#define RPOR0bits    sim_RPOR0
+#define RPOR1        sim_RPOR1.reg
+#define RPOR1bits    sim_RPOR1
+#define RPOR2        sim_RPOR2.reg
+#define RPOR2bits    sim_RPOR2
+#define RPOR3        sim_RPOR3.reg
+#define RPOR3bits    sim_RPOR3
+#define RPOR4        sim_RPOR4.reg
+#define RPOR4bits    sim_RPOR4
+#define RPOR5        sim_RPOR5.reg
+#define RPOR5bits    sim_RPOR5
+#define RPOR6        sim_RPOR6.reg
+#define RPOR6bits    sim_RPOR6
+#define RPOR7        sim_RPOR7.reg
+#define RPOR7bits    sim_RPOR7
+#define RPOR8        sim_RPOR8.reg
+#define RPOR8bits    sim_RPOR8
+#define RPOR9        sim_RPOR9.reg
+#define RPOR9bits    sim_RPOR9
+#define RPOR10       sim_RPOR10.reg
+#define RPOR10bits   sim_RPOR10
+#define RPOR11       sim_RPOR11.reg
+#define RPOR11bits   sim_RPOR11
+#define RPOR12       sim_RPOR12.reg
+#define RPOR12bits   sim_RPOR12
+#define RPOR13       sim_RPOR13.reg
+#define RPOR13bits   sim_RPOR13
+#define RPOR14       sim_RPOR14.reg
+#define RPOR14bits   sim_RPOR14
+
+/*
+ * DMA Channels 0 to 7. ECAN 1 uses Channels 0 & 1 and the UARTs, with
+ * SYS_UART_DMA, Channels 2 to 7. As on the device the registers of a channel
+ * are contiguous, and each channel's follow on from the last's, so drivers
+ * may address a channel through a pointer from DMA0CON.
+ */
+typedef union {
+	uint16_t reg;
+	struct { uint16_t MODE:2; uint16_t :2; uint16_t AMODE:2; uint16_t :5;
+	         uint16_t NULLW:1; uint16_t HALF:1; uint16_t DIR:1; uint16_t SIZE:1;
+	         uint16_t CHEN:1; };
+} sim_dmacon_t;
+
+typedef union {
+	uint16_t reg;
+	struct { uint16_t IRQSEL:8; uint16_t :7; uint16_t FORCE:1; };
+} sim_dmareq_t;
+
+typedef struct {
+	sim_dmacon_t  con;
+	sim_dmareq_t  req;
+	uint16_t      stal;
+	uint16_t      stah;
+	uint16_t      stbl;
+	uint16_t      stbh;
+	uint16_t      pad;
+	uint16_t      cnt;
+} sim_dma_t;
+
+extern volatile sim_dma_t sim_DMA[8];
+
+#define DMA0CON      sim_DMA[0].con.reg
+#define DMA0CONbits  sim_DMA[0].con
+#define DMA0REQ      sim_DMA[0].req.reg
+#define DMA0REQbits  sim_DMA[0].req
+#define DMA0STAL     sim_DMA[0].stal
+#define DMA0STAH     sim_DMA[0].stah
+#define DMA0STBL     sim_DMA[0].stbl
+#define DMA0STBH     sim_DMA[0].stbh
+#define DMA0PAD      sim_DMA[0].pad
+#define DMA0CNT      sim_DMA[0].cnt
+#define DMA1CON      sim_DMA[1].con.reg
+#define DMA1CONbits  sim_DMA[1].con
+#define DMA1REQ      sim_DMA[1].req.reg
+#define DMA1REQbits  sim_DMA[1].req
+#define DMA1STAL     sim_DMA[1].stal
+#define DMA1STAH     sim_DMA[1].stah
+#define DMA1STBL     sim_DMA[1].stbl
+#define DMA1STBH     sim_DMA[1].stbh
+#define DMA1PAD      sim_DMA[1].pad
+#define DMA1CNT      sim_DMA[1].cnt
+#define DMA2CON      sim_DMA[2].con.reg
+#define DMA2CONbits  sim_DMA[2].con
+#define DMA2REQ      sim_DMA[2].req.reg
+#define DMA2REQbits  sim_DMA[2].req
+#define DMA2STAL     sim_DMA[2].stal
+#define DMA2STAH     sim_DMA[2].stah
+#define DMA2STBL     sim_DMA[2].stbl
+#define DMA2STBH     sim_DMA[2].stbh
+#define DMA2PAD      sim_DMA[2].pad
+#define DMA2CNT      sim_DMA[2].cnt
+#define DMA3CON      sim_DMA[3].con.reg
+#define DMA3CONbits  sim_DMA[3].con
+#define DMA3REQ      sim_DMA[3].req.reg
+#define DMA3REQbits  sim_DMA[3].req
+#define DMA3STAL     sim_DMA[3].stal
+#define DMA3STAH     sim_DMA[3].stah
+#define DMA3STBL     sim_DMA[3].stbl
+#define DMA3STBH     sim_DMA[3].stbh
+#define DMA3PAD      sim_DMA[3].pad
+#define DMA3CNT      sim_DMA[3].cnt
+#define DMA4CON      sim_DMA[4].con.reg
+#define DMA4CONbits  sim_DMA[4].con
+#define DMA4REQ      sim_DMA[4].req.reg
+#define DMA4REQbits  sim_DMA[4].req
+#define DMA4STAL     sim_DMA[4].stal
+#define DMA4STAH     sim_DMA[4].stah
+#define DMA4STBL     sim_DMA[4].stbl
+#define DMA4STBH     sim_DMA[4].stbh
+#define DMA4PAD      sim_DMA[4].pad
+#define DMA4CNT      sim_DMA[4].cnt
+#define DMA5CON      sim_DMA[5].con.reg
+#define DMA5CONbits  sim_DMA[5].con
+#define DMA5REQ      sim_DMA[5].req.reg
+#define DMA5REQbits  sim_DMA[5].req
+#define DMA5STAL     sim_DMA[5].stal
+#define DMA5STAH     sim_DMA[5].stah
+#define DMA5STBL     sim_DMA[5].stbl
+#define DMA5STBH     sim_DMA[5].stbh
+#define DMA5PAD      sim_DMA[5].pad
+#define DMA5CNT      sim_DMA[5].cnt
+#define DMA6CON      sim_DMA[6].con.reg
+#define DMA6CONbits  sim_DMA[6].con
+#define DMA6REQ      sim_DMA[6].req.reg
+#define DMA6REQbits  sim_DMA[6].req
+#define DMA6STAL     sim_DMA[6].stal
+#define DMA6STAH     sim_DMA[6].stah
+#define DMA6STBL     sim_DMA[6].stbl
+#define DMA6STBH     sim_DMA[6].stbh
+#define DMA6PAD      sim_DMA[6].pad
+#define DMA6CNT      sim_DMA[6].cnt
+#define DMA7CON      sim_DMA[7].con.reg
+#define DMA7CONbits  sim_DMA[7].con
+#define DMA7REQ      sim_DMA[7].req.reg
+#define DMA7REQbits  sim_DMA[7].req
+#define DMA7STAL     sim_DMA[7].stal
+#define DMA7STAH     sim_DMA[7].stah
+#define DMA7STBL     sim_DMA[7].stbl
+#define DMA7STBH     sim_DMA[7].stbh
+#define DMA7PAD      sim_DMA[7].pad
+#define DMA7CNT      sim_DMA[7].cnt
+
+/*
+ * ECAN 1. The Window bit is ignored, registers behind both windows are
+ * always visible. The eight TX/RX buffer control bytes are contiguous as the
+ * driver addresses them through a pointer to C1TR01CON.
+ */
+SIM_SFR_BITS(C1CTRL1, uint16_t WIN:1; uint16_t :2; uint16_t CANCAP:1; uint16_t :1;
+                      uint16_t OPMODE:3; uint16_t REQOP:3; uint16_t CANCKS:1;
+                      uint16_t ABAT:1; uint16_t CSIDL:1; uint16_t :2;)
+SIM_SFR_BITS(C1CTRL2, uint16_t DNCNT:5; uint16_t :11;)
+SIM_SFR_BITS(C1VEC,   uint16_t ICODE:7; uint16_t :1; uint16_t FILHIT:5; uint16_t :3;)
+SIM_SFR_BITS(C1FCTRL, uint16_t FSA:5; uint16_t :8; uint16_t DMABS:3;)
+SIM_SFR_BITS(C1FIFO,  uint16_t FNRB:6; uint16_t :2; uint16_t FBP:6; uint16_t :2;)
+SIM_SFR_BITS(C1INTF,  uint16_t TBIF:1; uint16_t RBIF:1; uint16_t RBOVIF:1; uint16_t FIFOIF:1;
+                      uint16_t :1; uint16_t ERRIF:1; uint16_t WAKIF:1; uint16_t IVRIF:1;
+                      uint16_t EWARN:1; uint16_t RXWAR:1; uint16_t TXWAR:1; uint16_t RXBP:1;
+                      uint16_t TXBP:1; uint16_t TXBO:1; uint16_t :2;)
+SIM_SFR_BITS(C1INTE,  uint16_t TBIE:1; uint16_t RBIE:1; uint16_t RBOVIE:1; uint16_t FIFOIE:1;
+                      uint16_t :1; uint16_t ERRIE:1; uint16_t WAKIE:1; uint16_t IVRIE:1;
+                      uint16_t :8;)
+SIM_SFR_BITS(C1EC,    uint16_t RERRCNT:8; uint16_t TERRCNT:8;)
+SIM_SFR_BITS(C1CFG1,  uint16_t BRP:6; uint16_t SJW:2; uint16_t :8;)
+SIM_SFR_BITS(C1CFG2,  uint16_t PRSEG:3; uint16_t SEG1PH:3; uint16_t SAM:1; uint16_t SEG2PHTS:1;
+                      uint16_t SEG2PH:3; uint16_t :3; uint16_t WAKFIL:1; uint16_t :1;)
+
+SIM_SFR(C1BUFPNT1)
+SIM_SFR(C1BUFPNT2)
+SIM_SFR(C1BUFPNT3)
+SIM_SFR(C1BUFPNT4)
+SIM_SFR(C1FMSKSEL1)
+SIM_SFR(C1FMSKSEL2)
+SIM_SFR(C1RXM0SID)
+SIM_SFR(C1RXM0EID)
+SIM_SFR(C1RXM1SID)
+SIM_SFR(C1RXM1EID)
+SIM_SFR(C1RXM2SID)
+SIM_SFR(C1RXM2EID)
+SIM_SFR(C1FEN1)
+SIM_SFR(C1RXFUL1)
+SIM_SFR(C1RXFUL2)
+SIM_SFR(C1RXOVF1)
+SIM_SFR(C1RXOVF2)
+SIM_SFR(C1TXD)
+SIM_SFR(C1RXD)
+
+extern volatile uint16_t sim_C1TRCON[4];
+
+/*
+ * The FIFO's next read buffer moves on once the CPU has emptied it, so the
+ * register is brought up to date as it's read.
+ */
+extern volatile sim_C1FIFO_t *sfr_sim_can_fifo(void);
+
+#define C1CTRL1      sim_C1CTRL1.reg
+#define C1CTRL1bits  sim_C1CTRL1
+#define C1CTRL2      sim_C1CTRL2.reg
+#define C1CTRL2bits  sim_C1CTRL2
+#define C1VEC        sim_C1VEC.reg
+#define C1VECbits    sim_C1VEC
+#define C1FCTRL      sim_C1FCTRL.reg
+#define C1FCTRLbits  sim_C1FCTRL
+#define C1FIFO       (sfr_sim_can_fifo()->reg)
+#define C1FIFObits   (*sfr_sim_can_fifo())
+#define C1INTF       sim_C1INTF.reg
+#define C1INTFbits   sim_C1INTF
+#define C1INTE       sim_C1INTE.reg
+#define C1INTEbits   sim_C1INTE
+#define C1EC         sim_C1EC.reg
+#define C1ECbits     sim_C1EC
+#define C1CFG1       sim_C1CFG1.reg
+#define C1CFG1bits   sim_C1CFG1
+#define C1CFG2       sim_C1CFG2.reg
+#define C1CFG2bits   sim_C1CFG2
+#define C1BUFPNT1    sim_C1BUFPNT1
+#define C1BUFPNT2    sim_C1BUFPNT2
+#define C1BUFPNT3    sim_C1BUFPNT3
+#define C1BUFPNT4    sim_C1BUFPNT4
+#define C1FMSKSEL1   sim_C1FMSKSEL1
+#define C1FMSKSEL2   sim_C1FMSKSEL2
+#define C1RXM0SID    sim_C1RXM0SID
+#define C1RXM0EID    sim_C1RXM0EID
+#define C1RXM1SID    sim_C1RXM1SID
+#define C1RXM1EID    sim_C1RXM1EID
+#define C1RXM2SID    sim_C1RXM2SID
+#define C1RXM2EID    sim_C1RXM2EID
+#define C1FEN1       sim_C1FEN1
+#define C1RXFUL1     sim_C1RXFUL1
+#define C1RXFUL2     sim_C1RXFUL2
+#define C1RXOVF1     sim_C1RXOVF1
+#define C1RXOVF2     sim_C1RXOVF2
+#define C1TXD        sim_C1TXD
+#define C1RXD        sim_C1RXD
+#define C1TR01CON    sim_C1TRCON[0]
+#define C1TR23CON    sim_C1TRCON[1]
+#define C1TR45CON    sim_C1TRCON[2]
+#define C1TR67CON    sim_C1TRCON[3]
+
+#endif // _SIM_XC_H
@@ -1 +1,35 @@
 extern void cpu_init(void);
+
+#if defined(ES_LINUX)
+/**
+ * @brief UART Settings.
+ *
+ * Each channel is a serial device or pty, given by the uart_data's device.
+ */
+enum uart_channel {
+#ifdef SYS_UART1
+        UART_1,
+#endif
+#ifdef SYS_UART2
+        UART_2,
+#endif
+#ifdef SYS_UART3
+        UART_3,
+#endif
+#ifdef SYS_UART4
+        UART_4,
+#endif
+        NUM_UART_CHANNELS
+};
+
+/**
+ * @brief GPIO Pins.
+ *
+ * Linux has no pins to map, a uart_data's tx_pin or rx_pin is either
+ * LINUX_UART_PIN, to use that direction of the device, or INVALID_GPIO_PIN.
+ */
+enum gpio_pin {
+	LINUX_UART_PIN   = 0x00,     ///< The transmit or receive line of a serial device
+	INVALID_GPIO_PIN = 0xff,     ///< Dummy Value used to represent no GPIO Pin
+};
+#endif // ES_LINUX
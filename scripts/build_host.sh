@@ -0,0 +1,148 @@
+#! /bin/bash
+#
+# Build libesoup natively on Linux, without MPLAB-X, and run the protocol
+# benchmark suite.
+#
+# The protocol stacks are built with gcc for the dsPIC33EP256MU806 and run
+# against the SFR simulation in processors/dsPIC33/sim, so the real drivers
+# for the Timers, UARTs and ECAN sit underneath them.
+#
+# Usage: libesoup/scripts/build_host.sh [options]
+#
+#   -b <dir>       Build directory, default host_build
+#   -c <config>    libesoup_config.h to build with, default the benchmark's
+#   -s <file>      Save the benchmark results to <file> as a new baseline
+#   -r <file>      Compare the benchmark results against baseline <file>
+#   -t <percent>   ns/op increase over the baseline counted as a regression,
+#                  default 25
+#   -n             Only build the library, don't build or run the benchmark
+#
+# Run from the directory containing libesoup, or from libesoup/scripts. The
+# exit status is non zero if the build fails, the benchmark fails its checks
+# or a result regresses against the baseline.
+
+LIBESOUP=$(cd "$(dirname "$0")/.." && pwd)
+TOP=$(dirname "$LIBESOUP")
+
+BUILD_DIR=host_build
+CONFIG=$LIBESOUP/comms/test/libesoup_config_protocol_bench.h
+SAVE=
+BASELINE=
+TOLERANCE=25
+BENCH=1
+
+while getopts "b:c:s:r:t:n" opt; do
+    case $opt in
+    b) BUILD_DIR=$OPTARG ;;
+    c) CONFIG=$OPTARG ;;
+    s) SAVE=$OPTARG ;;
+    r) BASELINE=$OPTARG ;;
+    t) TOLERANCE=$OPTARG ;;
+    n) BENCH= ;;
+    *) exit 2 ;;
+    esac
+done
+
+CC=${CC:-gcc}
+CFLAGS="-O2 -g -Wall -Wno-attributes -Wno-unknown-pragmas -Wno-builtin-declaration-mismatch"
+#
+# The drivers test for the compiler and device before including
+# libesoup_config.h so both are defined here, as XC16 would. The ECAN DMA
+# buffer has to be at a low address, so no position independent code.
+#
+CPPFLAGS="-DXC16 -D__dsPIC33EP256MU806__ -I$LIBESOUP/processors/dsPIC33/sim -I$BUILD_DIR -I$TOP"
+LDFLAGS="-no-pie"
+
+#
+# Portable modules first, then the drivers and the simulation under them.
+#
+SOURCES="
+    core.c
+    errno.c
+    jobs/jobs.c
+    status/status.c
+    timers/sw_timers.c
+    comms/can/can.c
+    comms/can/frame_dispatch.c
+    comms/can/l3_iso15765-2.c
+    comms/can/l3_iso11783-3.c
+    comms/modbus/modbus.c
+    comms/modbus/master_states/awaiting_response.c
+    comms/modbus/master_states/idle.c
+    comms/modbus/master_states/starting.c
+    comms/modbus/master_states/transmitting.c
+    comms/modbus/master_states/turnaround_delay.c
+    comms/modbus/slave_states/idle.c
+    comms/modbus/slave_states/processing_request.c
+    comms/modbus/slave_states/receiving.c
+    comms/modbus/slave_states/transmitting.c
+    logger/serial_log.c
+    timers/hw_timers.c
+    comms/uart/uart.c
+    comms/can/l2_dsPIC33EP256MU806.c
+    gpio/gpio.c
+    gpio/peripheral.c
+    processors/dsPIC33/dsPIC33EP256MU806.c
+    boards/cinnamonBun/dsPIC33/board.c
+    processors/dsPIC33/sim/sfr_sim.c
+"
+
+mkdir -p "$BUILD_DIR/obj"
+cp "$CONFIG" "$BUILD_DIR/libesoup_config.h"
+
+OBJECTS=
+for src in $SOURCES; do
+    obj=$BUILD_DIR/obj/$(echo "$src" | tr '/' '_' | sed 's/\.c$/.o/')
+    $CC $CFLAGS $CPPFLAGS -c "$LIBESOUP/$src" -o "$obj"
+    if [ $? -ne 0 ]; then
+        echo "Compile of $src failed!"
+        exit 1
+    fi
+    OBJECTS="$OBJECTS $obj"
+done
+
+rm -f "$BUILD_DIR/libesoup.a"
+ar rcs "$BUILD_DIR/libesoup.a" $OBJECTS || exit 1
+echo "Built $BUILD_DIR/libesoup.a"
+
+if [ -z "$BENCH" ]; then
+    exit 0
+fi
+
+$CC $CFLAGS $CPPFLAGS $LDFLAGS "$LIBESOUP/comms/test/main_protocol_bench.c" \
+    "$BUILD_DIR/libesoup.a" -o "$BUILD_DIR/protocol_bench"
+if [ $? -ne 0 ]; then
+    echo "Benchmark link failed!"
+    exit 1
+fi
+
+"$BUILD_DIR/protocol_bench" | tee "$BUILD_DIR/results.txt"
+if [ ${PIPESTATUS[0]} -ne 0 ]; then
+    echo "Benchmark failed!"
+    exit 1
+fi
+
+if [ -n "$SAVE" ]; then
+    grep -v -e '^benchmark' -e '^PASSED' "$BUILD_DIR/results.txt" > "$SAVE"
+    echo "Saved baseline $SAVE"
+fi
+
+if [ -n "$BASELINE" ]; then
+    #
+    # Compare ns/op, the second column, of each benchmark in both runs.
+    #
+    awk -v tolerance="$TOLERANCE" '
+        NR == FNR { base[$1] = $2; next }
+        ($1 in base) && (base[$1] > 0) {
+            change = ($2 - base[$1]) * 100 / base[$1]
+            status = (change > tolerance) ? "REGRESSED" : "ok"
+            printf("%-20s %12.1f -> %12.1f %+7.1f%% %s\n", $1, base[$1], $2, change, status)
+            if (change > tolerance) failed = 1
+        }
+        END { exit failed }
+    ' "$BASELINE" "$BUILD_DIR/results.txt"
+    if [ $? -ne 0 ]; then
+        echo "Performance regression against $BASELINE!"
+        exit 1
+    fi
+fi
@@ -0,0 +1,203 @@
+#! /usr/bin/env python3
+#
+# Decode the binary serial log stream of a build with SYS_SERIAL_LOGGING_BINARY
+# back in to the text the log calls would have printed.
+#
+# The record layout is described in libesoup/logger/serial_log.h. Format and
+# TAG strings are found by address in the ELF file of the build which sent the
+# log, so it must be the same build. Anything in the stream which isn't a
+# record, such as serial_printf() text, is passed through unchanged.
+#
+# Usage: es_log_decode.py [-t <mS per tick>] <elf file> [log file]
+#
+# The log is read from the file, or stdin, for example from the serial port:
+#
+#     stty -F /dev/ttyUSB0 115200 raw
+#     libesoup/scripts/es_log_decode.py -t 5 firmware.elf < /dev/ttyUSB0
+#
+import re
+import struct
+import sys
+
+ES_LOG_SYNC = 0xA5
+ES_LOG_WIDE = 0x20
+
+LEVELS = ["E-", "W-", "I-", "D-"]
+
+SHT_NOBITS = 8
+
+FORMAT = re.compile(rb"%([-0 #+]*[0-9]*)(l?)([cdsuxX%])")
+
+
+class Elf:
+    """
+    The sections of an ELF file which hold data, by address
+    """
+    def __init__(self, filename):
+        with open(filename, "rb") as elf:
+            self.data = elf.read()
+
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % filename)
+
+        wide = self.data[4] == 2
+        endian = "<" if self.data[5] == 1 else ">"
+
+        if wide:
+            shoff, = struct.unpack_from(endian + "Q", self.data, 0x28)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x3A)
+            header = endian + "IIQQQQIIQQ"
+        else:
+            shoff, = struct.unpack_from(endian + "I", self.data, 0x20)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x2E)
+            header = endian + "IIIIIIIIII"
+
+        self.sections = []
+        for index in range(shnum):
+            (name, kind, flags, addr, offset, size,
+             link, info, align, entsize) = struct.unpack_from(header, self.data, shoff + index * shentsize)
+            if kind != SHT_NOBITS and addr and size:
+                self.sections.append((addr, offset, size))
+
+    def string(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.find(b"\0", start, offset + size)
+                if end < 0:
+                    end = offset + size
+                return self.data[start:end]
+        return None
+
+
+def format_args(fmt, args, elf):
+    """
+    printf() the subset of conversions es_printf() knows, with values as
+    es_printf() prints them, unsigned.
+    """
+    values = iter(args)
+
+    def convert(match):
+        flags, length, kind = match.groups()
+        if kind == b"%":
+            return b"%"
+        value = next(values, None)
+        if value is None:
+            return b"<missing>"
+        if kind == b"s":
+            string = elf.string(value)
+            return string if string is not None else b"<0x%x>" % value
+        if kind == b"c":
+            return bytes([value & 0xff])
+        if kind == b"d":
+            kind = b"u"
+        return (b"%" + flags + kind) % value
+
+    return FORMAT.sub(convert, fmt)
+
+
+def arg_sizes(fmt, int_size):
+    sizes = []
+    for match in FORMAT.finditer(fmt):
+        flags, length, kind = match.groups()
+        if kind == b"%":
+            continue
+        sizes.append(4 if length == b"l" else int_size)
+    return sizes
+
+
+def decode(data, elf, tick_ms, out):
+    """
+    Decode what can be of the data, returning the bytes of any record not
+    yet complete.
+    """
+    index = 0
+
+    while index < len(data):
+        if data[index] != ES_LOG_SYNC:
+            end = data.find(bytes([ES_LOG_SYNC]), index)
+            if end < 0:
+                end = len(data)
+            out.write(data[index:end])
+            index = end
+            continue
+
+        if index + 2 > len(data):
+            break
+        control = data[index + 1]
+        level = control >> 6
+        count = control & 0x0f
+        int_size = 4 if control & ES_LOG_WIDE else 2
+        id_format = "<I" if int_size == 4 else "<H"
+
+        header = 2 + 2 * int_size + 2
+        if index + header > len(data):
+            break
+        tag_id, = struct.unpack_from(id_format, data, index + 2)
+        fmt_id, = struct.unpack_from(id_format, data, index + 2 + int_size)
+        ticks, = struct.unpack_from("<H", data, index + 2 + 2 * int_size)
+
+        fmt = elf.string(fmt_id)
+        tag = elf.string(tag_id)
+        sizes = arg_sizes(fmt, int_size) if fmt is not None else None
+        if tag is None or sizes is None or len(sizes) != count:
+            #
+            # Not a record of this build, or a corrupt one, so skip the
+            # sync byte and look for the next.
+            #
+            out.write(b"<bad record 0x%x 0x%x>\n" % (tag_id, fmt_id))
+            index += 1
+            continue
+
+        if index + header + sum(sizes) > len(data):
+            break
+
+        args = []
+        offset = index + header
+        for size in sizes:
+            args.append(int.from_bytes(data[offset:offset + size], "little"))
+            offset += size
+
+        if tick_ms:
+            out.write(b"[%8u mS] " % (ticks * tick_ms))
+        else:
+            out.write(b"[%5u] " % ticks)
+        out.write(LEVELS[level].encode() + tag + b":" + format_args(fmt, args, elf))
+        index = offset
+
+    out.flush()
+    return data[index:]
+
+
+def decode_stream(stream, elf, tick_ms, out):
+    pending = b""
+    while True:
+        chunk = stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+        if not chunk:
+            break
+        pending = decode(pending + chunk, elf, tick_ms, out)
+    if pending:
+        out.write(b"<incomplete record>\n")
+
+
+def main(argv):
+    tick_ms = 0
+    if len(argv) > 2 and argv[1] == "-t":
+        tick_ms = int(argv[2])
+        argv = argv[:1] + argv[3:]
+
+    if len(argv) not in (2, 3):
+        sys.stderr.write("Usage: %s [-t <mS per tick>] <elf file> [log file]\n" % argv[0])
+        return 2
+
+    elf = Elf(argv[1])
+    if len(argv) == 3:
+        with open(argv[2], "rb") as stream:
+            decode_stream(stream, elf, tick_ms, sys.stdout.buffer)
+    else:
+        decode_stream(sys.stdin.buffer, elf, tick_ms, sys.stdout.buffer)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,49 @@
+/*
+ * libesoup_config.h libesoup/test/libesoup_config_async_init.h
+ *
+ * cinnamonBun dsPIC33EP256MU806 configuration for testing the background
+ * initialisation stages, SYS_ASYNC_INIT, on the host against the SFR
+ * simulation. Copy to a build directory as libesoup_config.h, see
+ * main_async_init.c
+ */
+#ifndef _LIBESOUP_CONFIG_H
+#define _LIBESOUP_CONFIG_H
+
+/*
+ * The simulated xc.h, found through -Ilibesoup/processors/dsPIC33/sim
+ */
+#include <xc.h>
+
+#define SYS_TEST_ASYNC_INIT
+
+#define SYS_CLOCK_FREQ 60000000
+
+#define SYS_HW_TIMERS
+#define SYS_SW_TIMERS
+#define SYS_NUMBER_OF_SW_TIMERS    4
+#define SYS_SW_TIMER_TICK_ms       5
+
+#define SYS_ASYNC_INIT
+#define SYS_NUMBER_OF_INIT_STAGES  4
+
+#define SYS_SPI1
+#define SYS_SD_CARD
+
+#define SD_CARD_DETECT  RD0
+#define SD_CARD_WRITE_P RD1
+#define SD_CARD_SCK     RD3
+#define SD_CARD_MOSI    RD4
+#define SD_CARD_SS      RD5
+#define SD_CARD_MISO    RD2
+
+#define SYS_SPIN_FV1
+#define SYS_SPIN_FV1_TRIGGER  RB2
+
+#define LOG_D(...)
+#define LOG_I(...)
+#define LOG_W(...)
+#define LOG_E(...)
+
+#include "libesoup/boards/cinnamonBun/dsPIC33/cb-dsPIC33EP256MU806.h"
+
+#endif // _LIBESOUP_CONFIG_H
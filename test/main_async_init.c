@@ -0,0 +1,262 @@
+/*
+ * libesoup/test/main_async_init.c
+ *
+ * Host test of the background initialisation stages, SYS_ASYNC_INIT, against
+ * the SFR simulation with a simulated SD Card on the SPI bus. Checks that
+ * libesoup_init() returns straight away, leaving the SD Card, the Spin FV-1
+ * and a stage the application added beforehand to finish from the main loop,
+ * that no main loop is held up for long while they do, and that each stage's
+ * completion callback and the report function are called once with the
+ * stage's result and duration.
+ *
+ * Build on Linux from the directory containing libesoup:
+ *
+ *     mkdir ainit && cp libesoup/test/libesoup_config_async_init.h ainit/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Iainit -I. \
+ *         libesoup/test/main_async_init.c libesoup/core.c \
+ *         libesoup/comms/spi/devices/sd_card.c libesoup/devices/SpinFV1/spin_fv1.c \
+ *         libesoup/processors/dsPIC33/sim/sfr_sim.c libesoup/processors/dsPIC33/dsPIC33EP256MU806.c \
+ *         libesoup/boards/cinnamonBun/dsPIC33/board.c libesoup/timers/hw_timers.c \
+ *         libesoup/timers/sw_timers.c libesoup/timers/delay.c libesoup/gpio/gpio.c \
+ *         libesoup/gpio/peripheral.c -o ainit/async_init
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_ASYNC_INIT
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/timers/sw_timers.h"
+#include "libesoup/comms/spi/spi.h"
+#include "libesoup/comms/spi/devices/sd_card.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+/*
+ * The simulated card answers ACMD41 busy this many times, each retry being
+ * 100mS later
+ */
+#define CARD_BUSY         3
+
+/*
+ * Stages, in the order they're added
+ */
+#define STAGE_INIT        0
+#define STAGE_APP         1
+#define STAGE_SD_CARD     2
+#define STAGE_SPIN        3
+#define STAGES            4
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+/*
+ * Simulated SD Card, in SPI mode. A command's R1 response is returned on
+ * the second byte clocked after it, then the card goes back to 0xff.
+ */
+static uint8_t   cmd[6];
+static uint8_t   cmd_len;
+static int16_t   response = -1;
+static uint8_t   response_delay;
+static uint8_t   acmd41_busy = CARD_BUSY;
+static uint16_t  commands;
+
+result_t spi_init(void)
+{
+	return(SUCCESS);
+}
+
+result_t spi_reserve(struct spi_device *device)
+{
+	device->chan_id = SPI_1;
+	return(SUCCESS);
+}
+
+result_t spi_write_byte(struct spi_device *device, uint8_t write)
+{
+	uint8_t  rx = 0xff;
+
+	if(response >= 0) {
+		if(response_delay) {
+			response_delay--;
+		} else {
+			rx = (uint8_t)response;
+			response = -1;
+		}
+		return(rx);
+	}
+
+	if((cmd_len == 0) && ((write & 0xc0) != 0x40)) return(rx);
+
+	cmd[cmd_len++] = write;
+	if(cmd_len == sizeof(cmd)) {
+		cmd_len = 0;
+		commands++;
+		response_delay = 1;
+		switch(cmd[0] & 0x3f) {
+		case 41:
+			if(acmd41_busy) {
+				acmd41_busy--;
+				response = 0x01;
+			} else {
+				response = 0x00;
+			}
+			break;
+		case 16:
+			response = 0x00;
+			break;
+		default:
+			response = 0x01;
+			break;
+		}
+	}
+	return(rx);
+}
+
+result_t spi_read_byte(struct spi_device *device)
+{
+	return(spi_write_byte(device, 0xff));
+}
+
+/*
+ * Stage added by the application, finished 20mS later by a SW timer
+ */
+static int16_t   app_stage;
+static uint16_t  app_done_calls;
+
+static void app_expiry(timer_id timer, union sigval data)
+{
+	libesoup_init_stage_done((uint8_t)app_stage, SUCCESS);
+}
+
+static result_t app_start(void)
+{
+	struct timer_req request;
+	timer_id         timer;
+
+	request.period.units    = mSeconds;
+	request.period.duration = 20;
+	request.type            = single_shot_expiry;
+	request.exp_fn          = app_expiry;
+	request.data.sival_int  = 0;
+
+	timer = sw_timer_start(&request);
+	if(timer < 0) return(timer);
+	return(1);
+}
+
+static void app_done(uint8_t stage, result_t rc, uint32_t duration_us)
+{
+	CHECK(stage == app_stage, "App callback for stage %u", stage);
+	app_done_calls++;
+}
+
+/*
+ * Every stage as reported
+ */
+static uint16_t  reports[STAGES];
+static result_t  report_rc[STAGES];
+static uint32_t  report_us[STAGES];
+static uint16_t  report_count;
+
+static void report(uint8_t stage, result_t rc, uint32_t duration_us)
+{
+	CHECK(stage < STAGES, "Report of stage %u", stage);
+	if(stage >= STAGES) return;
+	if(stage == app_stage) {
+		CHECK(app_done_calls == 1, "Stage reported before its own callback");
+	}
+	reports[stage]++;
+	report_rc[stage] = rc;
+	report_us[stage] = duration_us;
+	report_count++;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t  start;
+	uint64_t  cycles;
+	uint64_t  longest = 0;
+	uint16_t  ms;
+	uint8_t   loop;
+	result_t  rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+
+	/*
+	 * Set up before libesoup_init()
+	 */
+	libesoup_init_report(report);
+	app_stage = libesoup_init_stage_add(app_start, app_done);
+	CHECK(app_stage == STAGE_APP, "App stage %d", app_stage);
+
+	start = sfr_sim_cycles();
+	rc = libesoup_init();
+	cycles = sfr_sim_cycles() - start;
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+	/*
+	 * Most of that is the oscillator switch and PLL lock in cpu_init(),
+	 * stage 0 times the rest, but nowhere near the SD Card's 300mS
+	 */
+	CHECK(cycles < 25 * CYCLES_PER_mS, "libesoup_init() took %lu uS", (unsigned long)(cycles / (CYCLES_PER_mS / 1000)));
+
+	CHECK(!libesoup_init_complete(), "Init complete on return from libesoup_init()");
+	CHECK(!sd_card_ready(), "SD Card ready on return from libesoup_init()");
+	CHECK(commands == 0, "%u SD Card commands sent by libesoup_init()", commands);
+	rc = sd_card_init();
+	CHECK(rc == -ERR_NOT_READY, "sd_card_init() during the stage %d", rc);
+
+	/*
+	 * Run the main loop until everything's up, timing each pass
+	 */
+	for(ms = 0; (ms < 2000) && !libesoup_init_complete(); ms++) {
+		sfr_sim_run(CYCLES_PER_mS);
+		start = sfr_sim_cycles();
+		libesoup_tasks();
+		cycles = sfr_sim_cycles() - start;
+		if(cycles > longest) longest = cycles;
+	}
+	sfr_sim_run(CYCLES_PER_mS);
+	libesoup_tasks();
+
+	CHECK(libesoup_init_complete(), "Init not complete after %u mS", ms);
+	CHECK(ms >= CARD_BUSY * 100, "Init complete after only %u mS", ms);
+	CHECK(longest < 2 * CYCLES_PER_mS, "Longest main loop %lu uS", (unsigned long)(longest / (CYCLES_PER_mS / 1000)));
+
+	CHECK(app_done_calls == 1, "App callback called %u times", app_done_calls);
+	CHECK(report_count == STAGES, "%u stages reported", report_count);
+	for(loop = 0; loop < STAGES; loop++) {
+		CHECK(reports[loop] == 1, "Stage %u reported %u times", loop, reports[loop]);
+		CHECK(report_rc[loop] == SUCCESS, "Stage %u result %d", loop, report_rc[loop]);
+		CHECK(report_us[loop] == libesoup_init_stage_duration(loop), "Stage %u reported %lu uS, duration %lu uS",
+		      loop, (unsigned long)report_us[loop], (unsigned long)libesoup_init_stage_duration(loop));
+	}
+
+	/*
+	 * Durations cover each stage's timers, a SW timer tick either way
+	 */
+	CHECK(report_us[STAGE_INIT] < 1000, "libesoup_init() stage %lu uS", (unsigned long)report_us[STAGE_INIT]);
+	CHECK((report_us[STAGE_APP] >= 15000) && (report_us[STAGE_APP] <= 30000), "App stage %lu uS", (unsigned long)report_us[STAGE_APP]);
+	CHECK((report_us[STAGE_SD_CARD] >= CARD_BUSY * 100000UL) && (report_us[STAGE_SD_CARD] <= (CARD_BUSY * 100000UL) + 30000), "SD Card stage %lu uS", (unsigned long)report_us[STAGE_SD_CARD]);
+	CHECK((report_us[STAGE_SPIN] >= 1000) && (report_us[STAGE_SPIN] <= 15000), "Spin FV-1 stage %lu uS", (unsigned long)report_us[STAGE_SPIN]);
+
+	CHECK(sd_card_ready(), "SD Card not ready");
+	rc = sd_card_init();
+	CHECK(rc == SUCCESS, "sd_card_init() after the stage %d", rc);
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_ASYNC_INIT
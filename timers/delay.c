@@ -76,10 +76,8 @@ result_t delay(struct period *period)
 	RC_CHECK
 
         while(!delay_over) {
-#if defined(XC16)
-                __asm__ ("CLRWDT");
-#elif defined(__XC8)
-		asm("CLRWDT");
+#if defined(XC16) || defined(__XC8)
+		CLEAR_WDT
 #else
 #error "Need a nop of watchdog macro for compiler"
 #endif
@@ -91,6 +91,7 @@ extern uint32_t	uc_calculate(struct period *period, uint16_t *clk_divisor);
 struct hw_timer_data {
 	uint8_t          status;
 	struct timer_req request;
+	uint32_t         ticks;
 	uint16_t         repeats;
 	uint16_t         remainder;
 };
@@ -257,6 +258,7 @@ void hw_timer_init(void)
 		timers[timer].request.period.duration = 0;
 		timers[timer].request.exp_fn = NULL;
 		timers[timer].request.data.sival_int = 0;
+		timers[timer].ticks = 0;
 		timers[timer].repeats = 0;
 		timers[timer].remainder = 0;
 	}
@@ -548,6 +550,110 @@ result_t hw_timer_stop(timer_id timer, struct period *period)
 	return(timer);
 }
 
+/*
+ * Read how far a running timer has got, without disturbing it. The timer is
+ * loaded with "repeats" full 16 bit periods followed by the "remainder" so
+ * what's still to run is those plus whatever's left in the current period.
+ */
+#if defined(__PIC24FJ256GB106__) || defined(__PIC24FJ64GB106__) || defined(__dsPIC33EP256MU806__) || defined(__dsPIC33EP128GS702__) || defined(__dsPIC33EP256GP502__)
+result_t hw_timer_elapsed(timer_id timer, struct period *period)
+{
+	uint32_t remaining;
+	uint32_t elapsed;
+	uint16_t count;
+	uint16_t pr;
+
+	if ((timer >= NUMBER_HW_TIMERS) || (timers[timer].status != TIMER_RUNNING) || (timers[timer].request.type == stopwatch)) {
+		LOG_E("Timer passed to hw_timer_elapsed() is NOT running\n\r");
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	switch (timer) {
+	case TIMER_1:
+		count = TMR1;
+		pr    = PR1;
+		break;
+	case TIMER_2:
+		count = TMR2;
+		pr    = PR2;
+		break;
+	case TIMER_3:
+		count = TMR3;
+		pr    = PR3;
+		break;
+	case TIMER_4:
+		count = TMR4;
+		pr    = PR4;
+		break;
+	case TIMER_5:
+		count = TMR5;
+		pr    = PR5;
+		break;
+	default:
+		LOG_E("Unknown Timer\n\r");
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	remaining = ((uint32_t)timers[timer].repeats << 16) + timers[timer].remainder;
+	if (pr > count) remaining += (pr - count);
+
+	elapsed = (remaining < timers[timer].ticks) ? (timers[timer].ticks - remaining) : 0;
+
+	/*
+	 * ticks was calculated as a multiple of the requested duration so
+	 * scale back to the units the timer was started with.
+	 */
+	period->units    = timers[timer].request.period.units;
+	period->duration = (uint16_t)(elapsed / (timers[timer].ticks / timers[timer].request.period.duration));
+	return(SUCCESS);
+}
+
+/*
+ * Read the raw count of a running stopwatch, the number of timer clock ticks
+ * since it was started. The 16 bit counter overflows into "repeats" in the
+ * ISR so repeats is read either side of the counter in case it overflows
+ * in between.
+ */
+result_t hw_timer_stopwatch_ticks(timer_id timer, uint32_t *ticks)
+{
+	uint16_t repeats;
+	uint16_t count;
+
+	if ((timer >= NUMBER_HW_TIMERS) || (timers[timer].status != TIMER_RUNNING) || (timers[timer].request.type != stopwatch)) {
+		LOG_E("Timer passed to hw_timer_stopwatch_ticks() is NOT a stopwatch\n\r");
+		return(-ERR_BAD_INPUT_PARAMETER);
+	}
+
+	do {
+		repeats = *(volatile uint16_t *)&timers[timer].repeats;
+
+		switch (timer) {
+		case TIMER_1:
+			count = TMR1;
+			break;
+		case TIMER_2:
+			count = TMR2;
+			break;
+		case TIMER_3:
+			count = TMR3;
+			break;
+		case TIMER_4:
+			count = TMR4;
+			break;
+		case TIMER_5:
+			count = TMR5;
+			break;
+		default:
+			LOG_E("Unknown Timer\n\r");
+			return(-ERR_BAD_INPUT_PARAMETER);
+		}
+	} while(repeats != *(volatile uint16_t *)&timers[timer].repeats);
+
+	*ticks = ((uint32_t)repeats << 16) | count;
+	return(SUCCESS);
+}
+#endif
+
 timer_id hw_timer_cancel(timer_id *timer)
 {
         if(*timer < NUMBER_HW_TIMERS) {
@@ -700,6 +806,7 @@ static timer_id start_timer(timer_id timer, struct timer_req *request)
 		timers[timer].request.exp_fn           = request->exp_fn;
 		timers[timer].request.data             = request->data;
 
+		timers[timer].ticks                    = ticks;
 		timers[timer].repeats                  = (uint16_t)((ticks >> 16) & 0xffff);
 		timers[timer].remainder                = (uint16_t)(ticks & 0xffff);
 
@@ -101,6 +101,36 @@ extern timer_id hw_timer_restart(timer_id timer, struct timer_req *request);
 
 extern result_t hw_timer_stop(timer_id timer, struct period *period);
 
+/**
+ * @ingroup Timers
+ * @brief Function to read the time elapsed on a running hardware timer.
+ *
+ * @param timer   Identifier of the running timer @ref timer_id
+ * @param period  Returned elapsed time, in the units the timer was started with
+ * @return Status of the operation:
+ *             - SUCCESS
+ *             - ERR_BAD_INPUT_PARAMETER
+ *
+ * Unlike @ref hw_timer_stop() the timer is left running.
+ */
+extern result_t hw_timer_elapsed(timer_id timer, struct period *period);
+
+/**
+ * @ingroup Timers
+ * @brief Function to read the raw count of a running stopwatch timer.
+ *
+ * @param timer   Identifier of a running stopwatch @ref timer_id
+ * @param ticks   Returned count of timer clock ticks since the stopwatch started
+ * @return Status of the operation:
+ *             - SUCCESS
+ *             - ERR_BAD_INPUT_PARAMETER
+ *
+ * A stopwatch started in uSeconds counts instruction cycles, so the count
+ * wraps after 2^32 cycles. Intended for measuring short intervals by
+ * subtracting two readings.
+ */
+extern result_t hw_timer_stopwatch_ticks(timer_id timer, uint32_t *ticks);
+
 /**
  * @ingroup Timers
  * @brief Function to cancel a hardware timer running in the system.
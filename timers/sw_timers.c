@@ -60,6 +60,12 @@ static const char *TAG = "SW_TIMERS";
 #include "libesoup/errno.h"
 #include "libesoup/timers/hw_timers.h"
 #include "libesoup/timers/sw_timers.h"
+#ifdef SYS_SW_TIMER_DEFERRED
+#include "libesoup/jobs/jobs.h"
+#endif
+#ifdef SYS_SW_TIMER_WHEEL
+#include "libesoup/timers/timer_wheel.h"
+#endif
 
 #ifdef ES_LINUX
 #include <stdlib.h>
@@ -82,6 +88,18 @@ static const char *TAG = "SW_TIMERS";
 #error libesoup_config.h file should define SYS_SW_TIMER_TICK_ms (see libesoup/examples/libesoup_config.h)
 #endif
 
+#if defined(SYS_SW_TIMER_WHEEL) && defined(SYS_SW_TIMER_TICKLESS)
+#error libesoup_config.h should only define one of SYS_SW_TIMER_WHEEL or SYS_SW_TIMER_TICKLESS
+#endif
+
+#if defined(SYS_SW_TIMER_DEFERRED) && !defined(SYS_JOBS)
+#error libesoup_config.h should define SYS_JOBS (SYS_SW_TIMER_DEFERRED posts expiries to the jobs queue)
+#endif
+
+#if defined(SYS_SW_TIMER_CATCH_UP) && defined(SYS_SW_TIMER_TICKLESS)
+#error SYS_SW_TIMER_TICKLESS already processes all elapsed ticks, SYS_SW_TIMER_CATCH_UP not required
+#endif
+
 #if defined (__18F2680) || defined(__18F4585)
 /*
  * Calculate the 16 bit value that will give us an ISR for the system tick
@@ -98,10 +116,67 @@ volatile boolean timer_ticked = FALSE;
 
 static uint8_t   hw_timer_paused = FALSE;
 static timer_id  hw_timer = BAD_TIMER_ID;
+
+#ifndef SYS_SW_TIMER_TICKLESS
+/*
+ * Ticks taken by timer_tick() which it has not yet processed
+ */
+static uint16_t  batch_ticks = 0;
+#endif
+
+#ifdef SYS_SW_TIMER_CATCH_UP
+/*
+ * In catch up mode the ISR counts ticks rather than simply flagging one, so
+ * that a late call to timer_tick() doesn't lose any.
+ *
+ * timer_ticks_pending - Ticks counted by the ISR not yet taken by timer_tick()
+ * max_lag             - Most ticks timer_tick() has been behind the HW Timer
+ */
+static volatile uint16_t timer_ticks_pending = 0;
+static uint16_t  max_lag = 0;
+#endif // SYS_SW_TIMER_CATCH_UP
+
+#ifdef SYS_SW_TIMER_TICKLESS
+/*
+ * In tickless mode the HW timer is a single shot timer loaded with the time
+ * to the earliest expiry. timer_counter is only brought up to date when that
+ * fires, or when the HW Timer has to be reloaded for a new earlier expiry.
+ *
+ * programmed_ticks - Ticks the HW Timer was loaded for
+ * offset_ms        - Part of a tick which had already passed when loaded
+ */
+static uint16_t  programmed_ticks = 0;
+static uint16_t  offset_ms = 0;
+static timer_id  deadline_head = BAD_TIMER_ID;
+
+/*
+ * Longest period which fits in the 16 bit mSecond HW timer duration.
+ */
+#define TICKLESS_MAX_TICKS  ((0xFFFF / SYS_SW_TIMER_TICK_ms) - 1)
+#endif // SYS_SW_TIMER_TICKLESS
 #endif // XC16 || __XC8
 
 static	struct timer_req hw_timer_req;
 
+#ifdef SYS_SW_TIMER_DEFERRED
+/*
+ * \cond
+ * Copy of an expiry posted to the jobs queue. The timer may be cancelled
+ * before the job is executed but its table entry isn't reused until then.
+ */
+struct posted_expiry {
+	boolean           pending;
+	boolean           release;  // Entry released whilst job pending
+	boolean           cancelled;// Timer cancelled whilst job pending
+	timer_id          timer;
+	expiry_function   exp_fn;
+	union sigval      data;
+};
+/*
+ * \endcond
+ */
+#endif // SYS_SW_TIMER_DEFERRED
+
 /*
  * \cond
  * Local data structure for a Software Timer
@@ -111,6 +186,14 @@ typedef struct {
 	boolean           active;
 	uint16_t          expiry_count;
 	struct timer_req  request;
+#ifdef SYS_SW_TIMER_TICKLESS
+	boolean           queued;
+	timer_id          next;
+#endif
+#ifdef SYS_SW_TIMER_DEFERRED
+	boolean           deferred;
+	struct posted_expiry posted;
+#endif
 } sw_timer_t;
 /*
  * \endcond
@@ -131,11 +214,49 @@ typedef struct {
 #endif // XC16 || __XC8
 sw_timer_t timers[SYS_NUMBER_OF_SW_TIMERS];
 
+#ifdef SYS_SW_TIMER_WHEEL
+/*
+ * With the timing wheel the inactive timers are kept on a stack so that
+ * sw_timer_start() doesn't have to search the table for a free entry.
+ */
+static timer_id free_timers[SYS_NUMBER_OF_SW_TIMERS];
+static uint16_t free_count;
+#endif // SYS_SW_TIMER_WHEEL
+
 /*
  * Local static functions
  */
 static uint16_t calculate_ticks(struct timer_req *request);
 static void calculate_expiry_count(timer_id timer, uint16_t ticks);
+#if defined(XC16) || defined(__XC8)
+#ifndef SYS_SW_TIMER_TICKLESS
+static uint16_t take_ticks(void);
+#endif
+#if !defined(SYS_SW_TIMER_WHEEL) && !defined(SYS_SW_TIMER_TICKLESS)
+static uint16_t next_expiry(uint16_t remaining);
+static uint16_t expire_timers(void);
+#endif
+#endif // XC16 || __XC8
+static timer_id allocate_timer(void);
+static void release_timer(timer_id timer);
+static timer_id start_timer(struct timer_req *request, boolean deferred);
+#if defined(XC16) || defined(__XC8)
+static void call_expiry(timer_id timer);
+#endif
+#ifdef SYS_SW_TIMER_DEFERRED
+static void deferred_expiry(void *data);
+#endif
+#ifdef SYS_SW_TIMER_WHEEL
+static void wheel_reset(void);
+static void wheel_free(timer_id timer);
+#endif
+#ifdef SYS_SW_TIMER_TICKLESS
+static void     deadline_insert(timer_id timer);
+static void     deadline_remove(timer_id timer);
+static uint16_t tickless_now(void);
+static void     tickless_resync(void);
+static void     tickless_program(void);
+#endif
 
 /*
  * Timer_1 ISR. To keep ISR short it simply restarts TIMER_1 and sets
@@ -146,6 +267,9 @@ static void calculate_expiry_count(timer_id timer, uint16_t ticks);
 //#if defined(XC16)
 static void hw_expiry_function(timer_id timer, union sigval data)
 {
+#ifdef SYS_SW_TIMER_CATCH_UP
+	if(timer_ticks_pending < 0xFFFF) timer_ticks_pending++;
+#endif
 	timer_ticked = TRUE;
 }
 //#endif // XC16
@@ -169,7 +293,20 @@ void sw_timer_init(void)
 		timers[loop].active = FALSE;
 		timers[loop].expiry_count = 0;
 		timers[loop].request.exp_fn = NULL;
+#ifdef SYS_SW_TIMER_DEFERRED
+		timers[loop].deferred = FALSE;
+		timers[loop].posted.pending = FALSE;
+		timers[loop].posted.release = FALSE;
+		timers[loop].posted.cancelled = FALSE;
+#endif
+#ifdef SYS_SW_TIMER_TICKLESS
+		timers[loop].queued = FALSE;
+		timers[loop].next = BAD_TIMER_ID;
+#endif
 	}
+#ifdef SYS_SW_TIMER_WHEEL
+	wheel_reset();
+#endif // SYS_SW_TIMER_WHEEL
 
 //#if defined(__PIC24FJ256GB106__) || defined(__PIC24FJ64GB106__) || defined(__dsPIC33EP256MU806__)
 	hw_timer = BAD_TIMER_ID;
@@ -180,8 +317,20 @@ void sw_timer_init(void)
 	hw_timer_req.exp_fn = hw_expiry_function;
 	hw_timer_req.data = data;
 
+#ifdef SYS_SW_TIMER_TICKLESS
+	/*
+	 * Nothing to wait for yet, tickless_program() either leaves the HW
+	 * timer off or loads the longest period if the tick count is used.
+	 */
+	hw_timer_req.type = single_shot_expiry;
+	deadline_head = BAD_TIMER_ID;
+	programmed_ticks = 0;
+	offset_ms = 0;
+	tickless_program();
+#else
 	hw_timer = hw_timer_start(&hw_timer_req);
 	hw_timer_paused = FALSE;
+#endif // SYS_SW_TIMER_TICKLESS
 //#endif //__PIC24FJ256GB106__
 #if 0
 #if defined( __18F2680) || defined(__18F4585)
@@ -208,6 +357,110 @@ void sw_timer_init(void)
 #endif
 }
 
+#if (defined(XC16) || defined(__XC8)) && !defined(SYS_SW_TIMER_TICKLESS)
+/*
+ * Collect the ticks which have passed since timer_tick() was last called.
+ * Without SYS_SW_TIMER_CATCH_UP that is always one, however late the call.
+ */
+static uint16_t take_ticks(void)
+{
+#ifdef SYS_SW_TIMER_CATCH_UP
+	uint16_t ticks;
+
+	INTERRUPTS_DISABLED
+	ticks = timer_ticks_pending;
+	timer_ticks_pending = 0;
+	timer_ticked = FALSE;
+	INTERRUPTS_ENABLED
+
+	if(ticks > (max_lag + 1)) {
+		max_lag = ticks - 1;
+		LOG_D("Timer lag %d ticks\n\r", max_lag);
+	}
+	return(ticks);
+#else
+	timer_ticked = FALSE;
+	return(1);
+#endif // SYS_SW_TIMER_CATCH_UP
+}
+#endif
+
+#if defined(XC16) || defined(__XC8)
+/*
+ * Call the expiry function of an expired timer, or for a deferred timer post
+ * it to the jobs queue. If a deferred timer expires again before its last
+ * expiry has been executed the two are merged into a single call.
+ */
+static void call_expiry(timer_id timer)
+{
+#ifdef SYS_SW_TIMER_DEFERRED
+	struct posted_expiry *posted;
+
+	if(timers[timer].deferred) {
+		posted = &timers[timer].posted;
+		if(posted->pending) {
+			LOG_W("Timer %d expiry still queued\n\r", timer);
+			return;
+		}
+		posted->timer  = timer;
+		posted->exp_fn = timers[timer].request.exp_fn;
+		posted->data   = timers[timer].request.data;
+		posted->cancelled = FALSE;
+		posted->pending = TRUE;
+		if(jobs_add(deferred_expiry, (void *)posted) == 0) {
+			return;
+		}
+		/*
+		 * Jobs queue is full so don't lose the expiry
+		 */
+		LOG_E("Failed to defer timer %d\n\r", timer);
+		posted->pending = FALSE;
+	}
+#endif // SYS_SW_TIMER_DEFERRED
+	timers[timer].request.exp_fn(timer, timers[timer].request.data);
+}
+#endif // XC16 || __XC8
+
+#ifdef SYS_SW_TIMER_DEFERRED
+/*
+ * Job executing an expiry posted by call_expiry(). If the timer was cancelled
+ * after the expiry was posted the expiry function isn't called. An entry
+ * released whilst the job was pending is only freed once the expiry function
+ * has returned, so the timer_id it was passed can't have been reused.
+ */
+static void deferred_expiry(void *data)
+{
+	struct posted_expiry *posted = (struct posted_expiry *)data;
+	timer_id              timer;
+	expiry_function       function;
+	union sigval          sig_data;
+	boolean               cancelled;
+
+	timer    = posted->timer;
+	function = posted->exp_fn;
+	sig_data = posted->data;
+
+	INTERRUPTS_DISABLED
+	cancelled = posted->cancelled;
+	posted->cancelled = FALSE;
+	posted->pending = FALSE;
+	INTERRUPTS_ENABLED
+
+	if(!cancelled) {
+		function(timer, sig_data);
+	}
+
+#ifdef SYS_SW_TIMER_WHEEL
+	INTERRUPTS_DISABLED
+	if(posted->release) {
+		posted->release = FALSE;
+		free_timers[free_count++] = timer;
+	}
+	INTERRUPTS_ENABLED
+#endif
+}
+#endif // SYS_SW_TIMER_DEFERRED
+
 /*
  * void timer_tick(void)
  *
@@ -218,18 +471,174 @@ void sw_timer_init(void)
  * This function is not required by ES_LINUX systems
  */
 #if defined(XC16) || defined(__XC8)
+#ifdef SYS_SW_TIMER_WHEEL
 void timer_tick(void)
+{
+	uint16_t        ticks;
+	uint16_t        timer;
+
+	batch_ticks = take_ticks();
+
+	/*
+	 * The wheel has to be turned one tick at a time, but only the timers
+	 * which expire on each tick are visited.
+	 */
+	while(batch_ticks) {
+		batch_ticks--;
+		timer_counter++;
+		if(timer_counter == 0) LOG_D("TC Ovr\n\r");
+
+		INTERRUPTS_DISABLED
+		timer_wheel_advance(timer_counter);
+		timer = timer_wheel_expired(timer_counter);
+		INTERRUPTS_ENABLED
+
+		while(timer != TIMER_WHEEL_NONE) {
+			call_expiry(timer);
+
+			/*
+			 * The expiry function may have cancelled the timer, or
+			 * even cancelled it and started a new timer in the same
+			 * entry, in which case it's already back in the wheel.
+			 */
+			INTERRUPTS_DISABLED
+			if(timers[timer].active && !timer_wheel_linked(timer)) {
+				if(timers[timer].request.type == repeat_expiry) {
+					ticks = calculate_ticks(&timers[timer].request);
+					calculate_expiry_count(timer, ticks);
+				} else {
+					release_timer(timer);
+				}
+			}
+			timer = timer_wheel_expired(timer_counter);
+			INTERRUPTS_ENABLED
+		}
+	}
+#ifndef SYS_SW_TIMER_TICKS_COUNT
+	if((free_count == SYS_NUMBER_OF_SW_TIMERS) && !hw_timer_paused) {
+		hw_timer_paused = TRUE;
+		hw_timer_pause(hw_timer);
+	}
+#endif
+}
+#elif defined(SYS_SW_TIMER_TICKLESS)
+void timer_tick(void)
+{
+	uint16_t        ticks;
+	timer_id        timer;
+
+	/*
+	 * The single shot HW Timer has expired, so has been released, and
+	 * exactly the programmed number of ticks have passed.
+	 */
+	INTERRUPTS_DISABLED
+	timer_ticked = FALSE;
+	hw_timer = BAD_TIMER_ID;
+	timer_counter += programmed_ticks;
+	programmed_ticks = 0;
+	offset_ms = 0;
+	INTERRUPTS_ENABLED
+
+	/*
+	 * Expire everything at the head of the deadline list which is due.
+	 */
+	while((deadline_head != BAD_TIMER_ID) && ((int16_t)(timers[deadline_head].expiry_count - timer_counter) <= 0)) {
+		timer = deadline_head;
+		INTERRUPTS_DISABLED
+		deadline_remove(timer);
+		INTERRUPTS_ENABLED
+
+		call_expiry(timer);
+
+		/*
+		 * The expiry function may have cancelled, or cancelled and
+		 * restarted, the timer.
+		 */
+		INTERRUPTS_DISABLED
+		if(timers[timer].active && !timers[timer].queued) {
+			if(timers[timer].request.type == repeat_expiry) {
+				ticks = calculate_ticks(&timers[timer].request);
+				calculate_expiry_count(timer, ticks);
+			} else {
+				release_timer(timer);
+			}
+		}
+		INTERRUPTS_ENABLED
+	}
+
+	tickless_program();
+}
+#else
+void timer_tick(void)
+{
+	uint16_t        step;
+	uint16_t        active_timers;
+
+	active_timers = 0;
+	batch_ticks = take_ticks();
+
+	/*
+	 * Rather than scanning the table for every tick which has passed jump
+	 * the count straight to the next tick on which a timer expires, so
+	 * that expiries are processed in order. When on time this is always
+	 * the single tick which has passed.
+	 */
+	while(batch_ticks) {
+		step = next_expiry(batch_ticks);
+		batch_ticks -= step;
+		timer_counter += step;
+		if(timer_counter < step) LOG_D("TC Ovr\n\r");
+
+		active_timers = expire_timers();
+	}
+#ifndef SYS_SW_TIMER_TICKS_COUNT
+	/*
+	 * Only deactivate the Hardware timer tick if no application SW is
+	 * using the count of ticks.
+	 */
+	if(!active_timers && !hw_timer_paused) {
+		/*
+		 * No active timers in the system so might as well pause the
+		 * HW Timer.
+		 */
+		hw_timer_paused = TRUE;
+		hw_timer_pause(hw_timer);
+	}
+#endif
+}
+
+/*
+ * Find how many ticks, up to the given maximum, until the next timer expires.
+ */
+static uint16_t next_expiry(uint16_t remaining)
+{
+	uint8_t   loop;
+	uint16_t  offset;
+
+	if(remaining == 1) return(1);
+
+	for(loop=0; loop < SYS_NUMBER_OF_SW_TIMERS; loop++) {
+		if (timers[loop].active) {
+			offset = timers[loop].expiry_count - timer_counter;
+			if((offset != 0) && (offset < remaining)) {
+				remaining = offset;
+			}
+		}
+	}
+	return(remaining);
+}
+
+/*
+ * Call the expiry function of every timer which expires on the current tick
+ * count. Returns the number of active timers found.
+ */
+static uint16_t expire_timers(void)
 {
 	uint16_t        ticks;
 	uint16_t        active_timers;
 	uint8_t         loop;
-	expiry_function function;
-	union sigval    data;
 
 	active_timers = 0;
-	timer_ticked = FALSE;
-	timer_counter++;
-	if(timer_counter == 0) LOG_D("TC Ovr\n\r");
 
 	/*
 	 * Check for expired timers
@@ -244,9 +653,7 @@ void timer_tick(void)
 				 * timer expired so call expiry function.
 				 */
 //                                LOG_D("Expiry timer %d\n\r", loop);
-				function = timers[loop].request.exp_fn;
-				data = timers[loop].request.data;
-				function(loop, data);
+				call_expiry(loop);
 
 				if(timers[loop].request.type == single_shot_expiry) {
 					timers[loop].active = FALSE;
@@ -259,30 +666,33 @@ void timer_tick(void)
 			}
 		}
 	}
-#ifndef SYS_SW_TIMER_TICKS_COUNT
-	/*
-	 * Only deactivate the Hardware timer tick if no application SW is
-	 * using the count of ticks.
-	 */
-	if(!active_timers && !hw_timer_paused) {
-		/*
-		 * No active timers in the system so might as well pause the
-		 * HW Timer.
-		 */
-		hw_timer_paused = TRUE;
-		hw_timer_pause(hw_timer);
-	}
-#endif
+	return(active_timers);
 }
+#endif // SYS_SW_TIMER_WHEEL
 #endif // XC16 || __XC8
 
 #ifdef SYS_SW_TIMER_TICKS_COUNT
 uint16_t current_system_ticks(void)
 {
+#ifdef SYS_SW_TIMER_TICKLESS
+	/*
+	 * timer_counter is only updated when the HW Timer is reloaded so add
+	 * on what the running HW Timer has counted since.
+	 */
+	return(tickless_now());
+#else
 	return(timer_counter);
+#endif
 }
 #endif // SYS_SW_TIMER_TICKS_COUNT
 
+#ifdef SYS_SW_TIMER_CATCH_UP
+uint16_t sw_timer_max_lag(void)
+{
+	return(max_lag);
+}
+#endif // SYS_SW_TIMER_CATCH_UP
+
 /*
  * result_t sw_timer_start(uint16_t ticks,
  *                      expiry_function function,
@@ -317,6 +727,24 @@ uint16_t current_system_ticks(void)
  *
  */
 timer_id sw_timer_start(struct timer_req *request)
+{
+	return(start_timer(request, FALSE));
+}
+
+#ifdef SYS_SW_TIMER_DEFERRED
+/*
+ * timer_id sw_timer_start_deferred(struct timer_req *request)
+ *
+ * As sw_timer_start() but on expiry the expiry function is posted to the
+ * jobs queue rather than being called from timer_tick().
+ */
+timer_id sw_timer_start_deferred(struct timer_req *request)
+{
+	return(start_timer(request, TRUE));
+}
+#endif // SYS_SW_TIMER_DEFERRED
+
+static timer_id start_timer(struct timer_req *request, boolean deferred)
 {
 	uint16_t  ticks;
 #if defined(XC16) || defined(__XC8)
@@ -327,32 +755,61 @@ timer_id sw_timer_start(struct timer_req *request)
 	/*
 	 * Find the First empty timer
 	 */
-	for(loop=0; loop < SYS_NUMBER_OF_SW_TIMERS; loop++) {
-		if (!timers[loop].active) {
-//                        LOG_D("Using SW timer %d\n\r", loop);
-			/*
-			 * Found an inactive timer so assign to this expiry
-			 */
-			timers[loop].active                  = TRUE;
-			calculate_expiry_count(loop, ticks);
-			timers[loop].request.data            = request->data;
-			timers[loop].request.period.duration = request->period.duration;
-			timers[loop].request.exp_fn          = request->exp_fn;
-			timers[loop].request.type            = request->type;
-			timers[loop].request.period.units    = request->period.units;
+	loop = allocate_timer();
+	if (loop != BAD_TIMER_ID) {
+//                LOG_D("Using SW timer %d\n\r", loop);
+		/*
+		 * Found an inactive timer so assign to this expiry
+		 */
+		timers[loop].request.data            = request->data;
+		timers[loop].request.period.duration = request->period.duration;
+		timers[loop].request.exp_fn          = request->exp_fn;
+		timers[loop].request.type            = request->type;
+		timers[loop].request.period.units    = request->period.units;
+#ifdef SYS_SW_TIMER_DEFERRED
+		timers[loop].deferred                = deferred;
+#endif
+#ifdef SYS_SW_TIMER_TICKLESS
+		/*
+		 * Expiry is relative to the live tick count. If this timer is
+		 * now the earliest the HW timer has to be reloaded, unless it
+		 * has already fired in which case timer_tick() will reload it.
+		 */
+		timers[loop].active                  = TRUE;
+		timers[loop].expiry_count            = tickless_now() + ((ticks == 0) ? 1 : ticks);
+		INTERRUPTS_DISABLED
+		deadline_insert(loop);
+		INTERRUPTS_ENABLED
 
-			/*
-			 * If our hw_timer isn't running restart it:
-			 */
-			if(hw_timer_paused) {
-				if((hw_timer = hw_timer_restart(hw_timer, &hw_timer_req)) < 0) {
-					LOG_E("Failed to restart HW timer\n\r");
-					return(-ERR_GENERAL_ERROR);
-				}
-				hw_timer_paused = FALSE;
+		if((deadline_head == loop) && !timer_ticked) {
+			tickless_resync();
+			tickless_program();
+		}
+#else
+		INTERRUPTS_DISABLED
+#ifdef SYS_SW_TIMER_CATCH_UP
+		/*
+		 * timer_counter may be behind the HW Timer, the duration is
+		 * from now rather than from the last processed tick.
+		 */
+		ticks += timer_ticks_pending + batch_ticks;
+#endif
+		timers[loop].active                  = TRUE;
+		calculate_expiry_count(loop, ticks);
+		INTERRUPTS_ENABLED
+
+		/*
+		 * If our hw_timer isn't running restart it:
+		 */
+		if(hw_timer_paused) {
+			if((hw_timer = hw_timer_restart(hw_timer, &hw_timer_req)) < 0) {
+				LOG_E("Failed to restart HW timer\n\r");
+				return(-ERR_GENERAL_ERROR);
 			}
-			return(loop);
+			hw_timer_paused = FALSE;
 		}
+#endif // SYS_SW_TIMER_TICKLESS
+		return(loop);
 	}
 	LOG_E("start_timer() ERR_NO_RESOURCES\n\r");
 	return(-ERR_NO_RESOURCES);
@@ -411,9 +868,12 @@ result_t sw_timer_cancel(timer_id *timer)
                 return(-ERR_BAD_INPUT_PARAMETER);
 	} else if (timers[*timer].active) {
 		LOG_D("Cancel timer %d\n\r", *timer);
-                timers[*timer].active = FALSE;
-                timers[*timer].expiry_count = 0;
-                timers[*timer].request.exp_fn = NULL;
+#ifdef SYS_SW_TIMER_DEFERRED
+		if(timers[*timer].posted.pending) {
+			timers[*timer].posted.cancelled = TRUE;
+		}
+#endif
+		release_timer(*timer);
 		*timer = BAD_TIMER_ID;
 		INTERRUPTS_ENABLED
 		return(0);
@@ -449,8 +909,22 @@ result_t sw_timer_cancel_all(void)
 	LOG_D("sw_timer_cancel_all()\n\r");
 	INTERRUPTS_DISABLED
 	for (loop = 0; loop < SYS_NUMBER_OF_SW_TIMERS; loop++) {
+#ifdef SYS_SW_TIMER_DEFERRED
+		if(timers[loop].posted.pending) {
+			timers[loop].posted.cancelled = TRUE;
+		}
+#endif
 		timers[loop].active = FALSE;
+#ifdef SYS_SW_TIMER_TICKLESS
+		timers[loop].queued = FALSE;
+#endif
 	}
+#ifdef SYS_SW_TIMER_TICKLESS
+	deadline_head = BAD_TIMER_ID;
+#endif
+#ifdef SYS_SW_TIMER_WHEEL
+	wheel_reset();
+#endif // SYS_SW_TIMER_WHEEL
 	INTERRUPTS_ENABLED
 	return (0);
 }
@@ -469,11 +943,229 @@ static uint16_t calculate_ticks(struct timer_req *request)
 
 static void calculate_expiry_count(timer_id timer, uint16_t ticks)
 {
-	if( (0xFFFF - timer_counter) > ticks) {
-		timers[timer].expiry_count = timer_counter + ticks;
+#ifdef SYS_SW_TIMER_WHEEL
+	/*
+	 * A timer filed for the current tick would not be seen until the
+	 * counter wraps, so the minimum is the next tick.
+	 */
+	if(ticks == 0) ticks = 1;
+	timers[timer].expiry_count = timer_counter + ticks;
+	timer_wheel_insert(timer, timers[timer].expiry_count, timer_counter);
+#elif defined(SYS_SW_TIMER_TICKLESS)
+	if(ticks == 0) ticks = 1;
+	timers[timer].expiry_count = timer_counter + ticks;
+	deadline_insert(timer);
+#else
+	/*
+	 * Wraps with timer_counter, which passes 0xFFFF to 0 in a single tick
+	 */
+	timers[timer].expiry_count = timer_counter + ticks;
+#endif // SYS_SW_TIMER_WHEEL
+}
+
+#ifdef SYS_SW_TIMER_WHEEL
+/*
+ * Empty the wheel and put every timer back on the free stack, lowest index
+ * on top so timers are handed out in the same order as the table scan.
+ */
+static void wheel_reset(void)
+{
+	uint16_t loop;
+
+	timer_wheel_init();
+	free_count = 0;
+	for(loop = SYS_NUMBER_OF_SW_TIMERS; loop > 0; loop--) {
+		wheel_free((timer_id)(loop - 1));
+	}
+}
+
+/*
+ * Push a timer onto the free stack.
+ */
+static void wheel_free(timer_id timer)
+{
+#ifdef SYS_SW_TIMER_DEFERRED
+	/*
+	 * Entry is freed by deferred_expiry() once the queued job has run.
+	 */
+	if(timers[timer].posted.pending) {
+		timers[timer].posted.release = TRUE;
+		return;
+	}
+#endif
+	free_timers[free_count++] = timer;
+}
+#endif // SYS_SW_TIMER_WHEEL
+
+/*
+ * Find an inactive entry in the table of timers. Returns BAD_TIMER_ID if all
+ * the system's timers are in use.
+ */
+static timer_id allocate_timer(void)
+{
+#ifdef SYS_SW_TIMER_WHEEL
+	timer_id timer = BAD_TIMER_ID;
+
+	INTERRUPTS_DISABLED
+	if(free_count) {
+		timer = free_timers[--free_count];
+	}
+	INTERRUPTS_ENABLED
+	return(timer);
+#else
+	timer_id loop;
+
+	for(loop=0; loop < SYS_NUMBER_OF_SW_TIMERS; loop++) {
+#ifdef SYS_SW_TIMER_DEFERRED
+		if (timers[loop].posted.pending) continue;
+#endif
+		if (!timers[loop].active) {
+			return(loop);
+		}
+	}
+	return(BAD_TIMER_ID);
+#endif // SYS_SW_TIMER_WHEEL
+}
+
+/*
+ * Return an active timer to the pool of inactive timers. Called with
+ * interrupts disabled.
+ */
+static void release_timer(timer_id timer)
+{
+	timers[timer].active = FALSE;
+	timers[timer].expiry_count = 0;
+	timers[timer].request.exp_fn = NULL;
+#ifdef SYS_SW_TIMER_WHEEL
+	timer_wheel_remove(timer);
+	wheel_free(timer);
+#endif // SYS_SW_TIMER_WHEEL
+#ifdef SYS_SW_TIMER_TICKLESS
+	/*
+	 * If this was the earliest timer the HW Timer is left to run out,
+	 * timer_tick() will find nothing due and reload it.
+	 */
+	deadline_remove(timer);
+#endif // SYS_SW_TIMER_TICKLESS
+}
+
+#ifdef SYS_SW_TIMER_TICKLESS
+/*
+ * Insert a timer into the list of active timers, which is kept in order of
+ * expiry. Expiries are compared as offsets from the last processed tick
+ * count so the 16 bit wrap doesn't upset the ordering. Called with
+ * interrupts disabled.
+ */
+static void deadline_insert(timer_id timer)
+{
+	timer_id *link;
+	uint16_t  offset;
+
+	offset = timers[timer].expiry_count - timer_counter;
+
+	link = &deadline_head;
+	while((*link != BAD_TIMER_ID) && ((uint16_t)(timers[*link].expiry_count - timer_counter) <= offset)) {
+		link = &timers[*link].next;
+	}
+	timers[timer].next = *link;
+	timers[timer].queued = TRUE;
+	*link = timer;
+}
+
+static void deadline_remove(timer_id timer)
+{
+	timer_id *link;
+
+	if(!timers[timer].queued) return;
+
+	link = &deadline_head;
+	while(*link != BAD_TIMER_ID) {
+		if(*link == timer) {
+			*link = timers[timer].next;
+			break;
+		}
+		link = &timers[*link].next;
+	}
+	timers[timer].queued = FALSE;
+	timers[timer].next = BAD_TIMER_ID;
+}
+
+/*
+ * The current tick count, including the time counted by the running HW Timer.
+ */
+static uint16_t tickless_now(void)
+{
+	struct period elapsed;
+
+	if(timer_ticked) {
+		return(timer_counter + programmed_ticks);
+	}
+	if((hw_timer == BAD_TIMER_ID) || (hw_timer_elapsed(hw_timer, &elapsed) < 0)) {
+		return(timer_counter);
+	}
+	return(timer_counter + ((offset_ms + elapsed.duration) / SYS_SW_TIMER_TICK_ms));
+}
+
+/*
+ * Stop the running HW Timer and fold the time it's counted into
+ * timer_counter. The part of a tick left over is carried in offset_ms so
+ * that reloading the HW Timer doesn't lose time.
+ */
+static void tickless_resync(void)
+{
+	struct period elapsed;
+	uint16_t      ms;
+
+	if(hw_timer == BAD_TIMER_ID) return;
+
+	if(hw_timer_elapsed(hw_timer, &elapsed) == SUCCESS) {
+		ms = offset_ms + elapsed.duration;
+		timer_counter += ms / SYS_SW_TIMER_TICK_ms;
+		offset_ms = ms % SYS_SW_TIMER_TICK_ms;
+	}
+	hw_timer_cancel(&hw_timer);
+	programmed_ticks = 0;
+}
+
+/*
+ * Load the single shot HW Timer for the earliest expiry. With nothing to
+ * wait for the HW Timer is left off, unless the application is reading the
+ * tick count in which case it's loaded for the longest period possible.
+ */
+static void tickless_program(void)
+{
+	uint16_t ticks;
+
+	if(deadline_head == BAD_TIMER_ID) {
+#ifdef SYS_SW_TIMER_TICKS_COUNT
+		ticks = TICKLESS_MAX_TICKS;
+#else
+		if(hw_timer != BAD_TIMER_ID) {
+			hw_timer_cancel(&hw_timer);
+		}
+		hw_timer_paused = TRUE;
+		programmed_ticks = 0;
+		return;
+#endif
 	} else {
-		timers[timer].expiry_count = ticks - (0xFFFF - timer_counter);
+		ticks = timers[deadline_head].expiry_count - timer_counter;
+		if((ticks == 0) || (ticks > 0x8000)) {
+			ticks = 1;
+		} else if(ticks > TICKLESS_MAX_TICKS) {
+			ticks = TICKLESS_MAX_TICKS;
+		}
 	}
+
+	programmed_ticks = ticks;
+	hw_timer_req.period.duration = (ticks * SYS_SW_TIMER_TICK_ms) - offset_ms;
+	if((hw_timer = hw_timer_restart(hw_timer, &hw_timer_req)) < 0) {
+		LOG_E("Failed to restart HW timer\n\r");
+		hw_timer = BAD_TIMER_ID;
+		programmed_ticks = 0;
+		return;
+	}
+	hw_timer_paused = FALSE;
 }
+#endif // SYS_SW_TIMER_TICKLESS
 
 #endif // #ifdef SYS_SW_TIMERS
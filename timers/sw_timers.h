@@ -56,6 +56,19 @@ extern volatile boolean timer_ticked;
 #ifdef SYS_SW_TIMER_TICKS_COUNT
 extern uint16_t current_system_ticks(void);
 #endif // SYS_SW_TIMER_TICKS_COUNT
+
+#ifdef SYS_SW_TIMER_CATCH_UP
+/**
+ * @ingroup Timers
+ * @brief Maximum number of ticks the main loop has fallen behind the HW Timer
+ *
+ * With SYS_SW_TIMER_CATCH_UP defined a late call to timer_tick() processes
+ * every tick which has passed, rather than just one. This returns the most
+ * ticks which have been processed late, zero if the main loop has always kept
+ * up with the system tick.
+ */
+extern uint16_t sw_timer_max_lag(void);
+#endif // SYS_SW_TIMER_CATCH_UP
 /**
  * @ingroup Timers
  * @brief Start a Software based timer.
@@ -65,6 +78,24 @@ extern uint16_t current_system_ticks(void);
  */
 extern timer_id sw_timer_start(struct timer_req *request);
 
+#ifdef SYS_SW_TIMER_DEFERRED
+/**
+ * @ingroup Timers
+ * @brief Start a Software based timer whose expiry function is run as a job.
+ *
+ * @param *request  Structure containing all details of timer to be created \ref timer_req
+ * @return timer_id of the started timer if successfull, negative on error.
+ *
+ * Rather than being called from the timer tick processing, with every other
+ * timer expiring on that tick waiting for it to return, the expiry function
+ * is posted to the jobs queue (libesoup/jobs/jobs.h). Use for long running
+ * expiry functions. If a repeating timer expires again before the job has
+ * executed the expiries are merged. Cancelling a timer whose expiry is still
+ * queued drops that expiry, the expiry function isn't called.
+ */
+extern timer_id sw_timer_start_deferred(struct timer_req *request);
+#endif // SYS_SW_TIMER_DEFERRED
+
 /**
  * @ingroup Timers
  * @brief Function to cancel a hardware timer running in the system.
@@ -0,0 +1,153 @@
+/*
+ * libesoup/timers/test/main_sw_timer_cancel.c
+ *
+ * Host test of cancelling deferred SW Timers, SYS_SW_TIMER_DEFERRED, against
+ * the SFR simulation. Checks that once sw_timer_cancel() or
+ * sw_timer_cancel_all() returns a timer's expiry already queued on the jobs
+ * queue isn't called, and that the timers are free to be started again.
+ *
+ * Build on Linux from the directory containing libesoup, once with the
+ * table of timers:
+ *
+ *     mkdir swtc && cp libesoup/timers/test/libesoup_config_sw_timer_cancel.h swtc/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Iswtc -I. \
+ *         libesoup/timers/test/main_sw_timer_cancel.c libesoup/timers/sw_timers.c \
+ *         libesoup/timers/timer_wheel.c libesoup/timers/hw_timers.c libesoup/jobs/jobs.c \
+ *         libesoup/core.c libesoup/processors/dsPIC33/sim/sfr_sim.c \
+ *         libesoup/processors/dsPIC33/dsPIC33EP256MU806.c libesoup/boards/cinnamonBun/dsPIC33/board.c \
+ *         libesoup/gpio/gpio.c libesoup/gpio/peripheral.c -o swtc/sw_timer_cancel
+ *
+ * and with -DSYS_SW_TIMER_WHEEL added, with the timing wheel.
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_SW_TIMER_CANCEL
+
+#include <stdio.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/timers/sw_timers.h"
+#include "libesoup/jobs/jobs.h"
+
+#define CYCLES_PER_mS     (SYS_CLOCK_FREQ / 1000)
+
+#define TIMERS            2
+
+extern void timer_tick(void);
+
+static uint16_t failures;
+
+#define CHECK(test, ...)                                                       \
+	if(!(test)) {                                                          \
+		printf("FAIL %s:%d ", __FILE__, __LINE__);                     \
+		printf(__VA_ARGS__);                                           \
+		printf("\n");                                                  \
+		failures++;                                                    \
+	}
+
+static uint16_t  calls[TIMERS];
+
+static void expiry(timer_id timer, union sigval data)
+{
+	calls[data.sival_int]++;
+}
+
+static void start(timer_id *timers)
+{
+	struct timer_req request;
+	uint8_t          loop;
+
+	for(loop = 0; loop < TIMERS; loop++) {
+		request.period.units    = mSeconds;
+		request.period.duration = 10;
+		request.type            = repeat_expiry;
+		request.exp_fn          = expiry;
+		request.data.sival_int  = loop;
+
+		timers[loop] = sw_timer_start_deferred(&request);
+		CHECK(timers[loop] >= 0, "sw_timer_start_deferred() %d", timers[loop]);
+		calls[loop] = 0;
+	}
+}
+
+/*
+ * Run the SW Timers, but not the jobs queue, until each timer's expiry has
+ * been queued
+ */
+static void queue_expiries(void)
+{
+	uint8_t mS;
+
+	for(mS = 0; mS < 12; mS++) {
+		sfr_sim_run(CYCLES_PER_mS);
+		if(timer_ticked) timer_tick();
+	}
+	CHECK((calls[0] == 0) && (calls[1] == 0), "Expiry called from the tick");
+}
+
+/*
+ * Run everything for a while, the main loop and the jobs queue
+ */
+static void run_mS(uint16_t mS)
+{
+	while(mS--) {
+		sfr_sim_run(CYCLES_PER_mS);
+		libesoup_tasks();
+		jobs_execute();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	timer_id  timers[TIMERS];
+	result_t  rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+	rc = libesoup_init();
+	CHECK(rc >= 0, "libesoup_init() %d", rc);
+
+	/*
+	 * One of the two cancelled with its expiry queued
+	 */
+	start(timers);
+	queue_expiries();
+	rc = sw_timer_cancel(&timers[0]);
+	CHECK(rc == 0, "sw_timer_cancel() %d", rc);
+	jobs_execute();
+	CHECK(calls[0] == 0, "Cancelled timer's queued expiry called %u times", calls[0]);
+	CHECK(calls[1] == 1, "Running timer's queued expiry called %u times", calls[1]);
+	rc = sw_timer_cancel(&timers[1]);
+	CHECK(rc == 0, "sw_timer_cancel() %d", rc);
+	jobs_execute();
+
+	/*
+	 * Both cancelled together with their expiries queued
+	 */
+	start(timers);
+	queue_expiries();
+	rc = sw_timer_cancel_all();
+	CHECK(rc == 0, "sw_timer_cancel_all() %d", rc);
+	jobs_execute();
+	CHECK((calls[0] == 0) && (calls[1] == 0), "Queued expiries called %u and %u times after sw_timer_cancel_all()", calls[0], calls[1]);
+	run_mS(30);
+	CHECK((calls[0] == 0) && (calls[1] == 0), "Expiries called %u and %u times after sw_timer_cancel_all()", calls[0], calls[1]);
+
+	/*
+	 * and their entries can be used again
+	 */
+	start(timers);
+	run_mS(25);
+	CHECK((calls[0] >= 1) && (calls[1] >= 1), "Restarted timers expired %u and %u times", calls[0], calls[1]);
+
+#ifdef SYS_SW_TIMER_WHEEL
+	printf("Wheel ");
+#else
+	printf("Table ");
+#endif
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_SW_TIMER_CANCEL
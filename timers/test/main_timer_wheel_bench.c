@@ -0,0 +1,141 @@
+/*
+ * libesoup/timers/test/main_timer_wheel_bench.c
+ *
+ * Host benchmark of the real SW Timer tick, timer_tick() in sw_timers.c, for
+ * 16, 64 and 255 running repeat timers. Built once with the linear table
+ * scan and once with the hierarchical timing wheel, SYS_SW_TIMER_WHEEL, so
+ * the two sets of results are compared between the two builds. The table
+ * is scanned with a uint8_t index so 255 timers is its limit.
+ *
+ * timer_tick() is called directly, each call taking a single tick, rather
+ * than running the simulation so that only the tick is timed. Each build
+ * checks every timer expired as often as its period says it should have.
+ *
+ * Build on Linux from the directory containing libesoup, once with the
+ * table of timers:
+ *
+ *     mkdir bench && cp libesoup/timers/test/libesoup_config_timer_wheel_bench.h bench/libesoup_config.h
+ *     gcc -O2 -no-pie -Wno-attributes -Wno-unknown-pragmas -DXC16 -D__dsPIC33EP256MU806__ \
+ *         -Ilibesoup/processors/dsPIC33/sim -Ibench -I. \
+ *         libesoup/timers/test/main_timer_wheel_bench.c libesoup/timers/sw_timers.c \
+ *         libesoup/timers/timer_wheel.c libesoup/timers/hw_timers.c \
+ *         libesoup/core.c libesoup/processors/dsPIC33/sim/sfr_sim.c \
+ *         libesoup/processors/dsPIC33/dsPIC33EP256MU806.c libesoup/boards/cinnamonBun/dsPIC33/board.c \
+ *         libesoup/gpio/gpio.c libesoup/gpio/peripheral.c -o bench/timer_wheel_bench
+ *
+ * and with -DSYS_SW_TIMER_WHEEL added, with the timing wheel.
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_TEST_TIMER_WHEEL_BENCH
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "libesoup/processors/dsPIC33/sim/sfr_sim.h"
+#include "libesoup/errno.h"
+#include "libesoup/timers/sw_timers.h"
+
+#define BENCH_TICKS   1000000UL
+
+#ifdef SYS_SW_TIMER_WHEEL
+#define BENCH_MODE    "wheel"
+#else
+#define BENCH_MODE    "table"
+#endif
+
+extern void timer_tick(void);
+
+static uint32_t expiries;
+
+static void expiry(timer_id timer, union sigval data)
+{
+	expiries++;
+}
+
+/*
+ * Start count repeat timers with random periods of 1 to 2000 ticks, returns
+ * the number of expiries expected in BENCH_TICKS ticks or an error.
+ */
+static int32_t start(uint16_t count)
+{
+	struct timer_req request;
+	uint16_t         loop;
+	uint16_t         period;
+	int32_t          expected = 0;
+	result_t         rc;
+
+	srand(1);
+	for(loop = 0; loop < count; loop++) {
+		period = (uint16_t)(1 + (rand() % 2000));
+
+		request.period.units    = mSeconds;
+		request.period.duration = period * SYS_SW_TIMER_TICK_ms;
+		request.type            = repeat_expiry;
+		request.exp_fn          = expiry;
+		request.data.sival_int  = loop;
+
+		rc = sw_timer_start(&request);
+		if(rc < 0) return(rc);
+
+		expected += BENCH_TICKS / period;
+	}
+	return(expected);
+}
+
+static double run(void)
+{
+	struct timespec begin;
+	struct timespec end;
+	uint32_t        loop;
+
+	expiries = 0;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(loop = 0; loop < BENCH_TICKS; loop++) {
+		timer_tick();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return(((end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec)) / BENCH_TICKS);
+}
+
+int main(int argc, char **argv)
+{
+	static const uint16_t counts[] = { 16, 64, 255 };
+	uint8_t               loop;
+	int32_t               expected;
+	double                ns;
+	uint16_t              failures = 0;
+	result_t              rc;
+
+	sfr_sim_reset(SYS_CLOCK_FREQ);
+	rc = libesoup_init();
+	if(rc < 0) {
+		printf("libesoup_init() %d\nFAILED\n", rc);
+		return(1);
+	}
+
+	printf("timers  %s ns/tick  expiries\n", BENCH_MODE);
+	for(loop = 0; loop < sizeof(counts) / sizeof(counts[0]); loop++) {
+		expected = start(counts[loop]);
+		if(expected < 0) {
+			printf("sw_timer_start() %d\nFAILED\n", expected);
+			return(1);
+		}
+		ns = run();
+		sw_timer_cancel_all();
+
+		printf("%6u  %13.1f  %8u", counts[loop], ns, expiries);
+		if(expiries != (uint32_t)expected) {
+			printf(" expected %d", expected);
+			failures++;
+		}
+		printf("\n");
+	}
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return(failures ? 1 : 0);
+}
+
+#endif // SYS_TEST_TIMER_WHEEL_BENCH
@@ -20,8 +20,8 @@
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  *
  */
-#ifndef _TIME_H
-#define _TIME_H
+#ifndef _ES_TIME_H
+#define _ES_TIME_H
 
 /**
  * @defgroup Timers Timers
@@ -134,4 +134,4 @@ struct timer_req {
  * @}
  */
 
-#endif  // _TIME_H
+#endif  // _ES_TIME_H
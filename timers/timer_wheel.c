@@ -0,0 +1,210 @@
+/**
+ * @file libesoup/timers/timer_wheel.c
+ *
+ * @author John Whitmore
+ *
+ * @brief Hierarchical timing wheel used by the Software Timers
+ *
+ * Copyright 2017-2020 electronicSoup Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the version 2 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ *
+ * The 16 bit tick count is split into three wheels:
+ *
+ *     bits 15..12  Level 2 - 16 buckets of 4096 ticks
+ *     bits 11..6   Level 1 - 64 buckets of 64 ticks
+ *     bits  5..0   Level 0 - 64 buckets of 1 tick
+ *
+ * A timer is filed in the lowest level which can hold its remaining duration.
+ * Every 64 ticks the Level 1 bucket for the coming 64 ticks is emptied down
+ * into Level 0, and every 4096 ticks the Level 2 bucket is emptied into the
+ * lower levels. So on any tick the Level 0 bucket for that tick holds exactly
+ * the timers which have expired.
+ *
+ * Each bucket is a doubly linked list of timer indexes so a timer can be
+ * removed, when cancelled, without searching.
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_SW_TIMER_WHEEL
+
+#include "libesoup/timers/timer_wheel.h"
+
+#define L0_BITS       6
+#define L1_BITS       6
+#define L2_BITS       4
+
+#define L0_SIZE       (1 << L0_BITS)
+#define L1_SIZE       (1 << L1_BITS)
+#define L2_SIZE       (1 << L2_BITS)
+
+#define L0_MASK       (L0_SIZE - 1)
+#define L1_MASK       (L1_SIZE - 1)
+#define L2_MASK       (L2_SIZE - 1)
+
+#define L1_SHIFT      (L0_BITS)
+#define L2_SHIFT      (L0_BITS + L1_BITS)
+
+#define L1_BASE       (L0_SIZE)
+#define L2_BASE       (L0_SIZE + L1_SIZE)
+
+#define NUM_BUCKETS   (L0_SIZE + L1_SIZE + L2_SIZE)
+
+#define UNLINKED      0xff
+
+#if (L0_BITS + L1_BITS + L2_BITS) != 16
+#error Timer wheel levels must cover the 16 bit tick count
+#endif
+
+/*
+ * \cond
+ * Wheel entry for each Software timer in the system.
+ */
+struct wheel_node {
+	uint16_t  next;
+	uint16_t  prev;
+	uint16_t  expiry;
+	uint8_t   bucket;
+};
+/*
+ * \endcond
+ */
+
+static uint16_t          buckets[NUM_BUCKETS];
+static struct wheel_node nodes[SYS_NUMBER_OF_SW_TIMERS];
+
+/*
+ * Find the bucket a timer belongs in given the current tick count.
+ */
+static uint8_t bucket_for(uint16_t expiry, uint16_t now)
+{
+	uint16_t delta = expiry - now;
+
+	if(delta < L0_SIZE) {
+		return(expiry & L0_MASK);
+	} else if(delta < (1 << L2_SHIFT)) {
+		return(L1_BASE + ((expiry >> L1_SHIFT) & L1_MASK));
+	}
+	return(L2_BASE + ((expiry >> L2_SHIFT) & L2_MASK));
+}
+
+static void wheel_link(uint16_t timer, uint8_t bucket)
+{
+	nodes[timer].bucket = bucket;
+	nodes[timer].prev   = TIMER_WHEEL_NONE;
+	nodes[timer].next   = buckets[bucket];
+
+	if(buckets[bucket] != TIMER_WHEEL_NONE) {
+		nodes[buckets[bucket]].prev = timer;
+	}
+	buckets[bucket] = timer;
+}
+
+static void wheel_unlink(uint16_t timer)
+{
+	if(nodes[timer].prev != TIMER_WHEEL_NONE) {
+		nodes[nodes[timer].prev].next = nodes[timer].next;
+	} else {
+		buckets[nodes[timer].bucket] = nodes[timer].next;
+	}
+
+	if(nodes[timer].next != TIMER_WHEEL_NONE) {
+		nodes[nodes[timer].next].prev = nodes[timer].prev;
+	}
+	nodes[timer].bucket = UNLINKED;
+}
+
+/*
+ * Empty a higher level bucket back into the wheel. Every timer in the bucket
+ * is now closer to expiry so will drop down to a lower level.
+ */
+static void cascade(uint8_t bucket, uint16_t now)
+{
+	uint16_t timer;
+	uint16_t next;
+
+	timer = buckets[bucket];
+	buckets[bucket] = TIMER_WHEEL_NONE;
+
+	while(timer != TIMER_WHEEL_NONE) {
+		next = nodes[timer].next;
+		wheel_link(timer, bucket_for(nodes[timer].expiry, now));
+		timer = next;
+	}
+}
+
+void timer_wheel_init(void)
+{
+	uint16_t loop;
+
+	for(loop = 0; loop < NUM_BUCKETS; loop++) {
+		buckets[loop] = TIMER_WHEEL_NONE;
+	}
+
+	for(loop = 0; loop < SYS_NUMBER_OF_SW_TIMERS; loop++) {
+		nodes[loop].next   = TIMER_WHEEL_NONE;
+		nodes[loop].prev   = TIMER_WHEEL_NONE;
+		nodes[loop].expiry = 0;
+		nodes[loop].bucket = UNLINKED;
+	}
+}
+
+void timer_wheel_insert(uint16_t timer, uint16_t expiry, uint16_t now)
+{
+	if(nodes[timer].bucket != UNLINKED) {
+		wheel_unlink(timer);
+	}
+	nodes[timer].expiry = expiry;
+	wheel_link(timer, bucket_for(expiry, now));
+}
+
+void timer_wheel_remove(uint16_t timer)
+{
+	if(nodes[timer].bucket != UNLINKED) {
+		wheel_unlink(timer);
+	}
+}
+
+uint8_t timer_wheel_linked(uint16_t timer)
+{
+	return(nodes[timer].bucket != UNLINKED);
+}
+
+void timer_wheel_advance(uint16_t now)
+{
+	if((now & L0_MASK) == 0) {
+		/*
+		 * Always cascade the higher level first, on the tick the
+		 * whole wheel turns over both levels are emptied.
+		 */
+		if((now & ((1 << L2_SHIFT) - 1)) == 0) {
+			cascade(L2_BASE + ((now >> L2_SHIFT) & L2_MASK), now);
+		}
+		cascade(L1_BASE + ((now >> L1_SHIFT) & L1_MASK), now);
+	}
+}
+
+uint16_t timer_wheel_expired(uint16_t now)
+{
+	uint16_t timer;
+
+	timer = buckets[now & L0_MASK];
+	if(timer != TIMER_WHEEL_NONE) {
+		wheel_unlink(timer);
+	}
+	return(timer);
+}
+
+#endif // SYS_SW_TIMER_WHEEL
@@ -0,0 +1,103 @@
+/**
+ * @file libesoup/timers/timer_wheel.h
+ *
+ * @author John Whitmore
+ *
+ * @brief Hierarchical timing wheel used by the Software Timers
+ *
+ * Copyright 2017-2020 electronicSoup Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the version 2 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ *
+ * The wheel is only included in a build if libesoup_config.h defines
+ * SYS_SW_TIMER_WHEEL. It replaces the linear scan of the Software timer table
+ * in timer_tick() so that starting, cancelling and expiring a timer are all
+ * constant time operations, regardless of SYS_NUMBER_OF_SW_TIMERS.
+ *
+ * The wheel knows nothing about timer requests or expiry functions, it simply
+ * files timer indexes, 0 to SYS_NUMBER_OF_SW_TIMERS - 1, by their 16 bit expiry
+ * tick count. That keeps it free of uC specifics so that it builds under
+ * ES_LINUX as well.
+ */
+#ifndef _TIMER_WHEEL_H
+#define _TIMER_WHEEL_H
+
+#include "libesoup_config.h"
+
+#ifdef SYS_SW_TIMER_WHEEL
+
+#include <stdint.h>
+
+#ifndef SYS_NUMBER_OF_SW_TIMERS
+#error libesoup_config.h file should define SYS_NUMBER_OF_SW_TIMERS (see libesoup/examples/libesoup_config.h)
+#endif
+
+/**
+ * @ingroup Timers
+ * @brief Returned by timer_wheel_expired() when no more timers have expired
+ */
+#define TIMER_WHEEL_NONE   0xffff
+
+/**
+ * @ingroup Timers
+ * @brief Empty all the wheel's buckets.
+ */
+extern void     timer_wheel_init(void);
+
+/**
+ * @ingroup Timers
+ * @brief File a timer in the wheel.
+ *
+ * @param timer   Index of the timer in the Software timer table
+ * @param expiry  Tick count at which the timer expires
+ * @param now     Current tick count of the system
+ *
+ * The difference between expiry and now must be at least one tick, a timer
+ * filed for the current tick will only be found after the counter wraps.
+ */
+extern void     timer_wheel_insert(uint16_t timer, uint16_t expiry, uint16_t now);
+
+/**
+ * @ingroup Timers
+ * @brief Remove a timer from the wheel. No action if the timer is not filed.
+ */
+extern void     timer_wheel_remove(uint16_t timer);
+
+/**
+ * @ingroup Timers
+ * @brief Test if a timer is currently filed in the wheel.
+ */
+extern uint8_t  timer_wheel_linked(uint16_t timer);
+
+/**
+ * @ingroup Timers
+ * @brief Move the wheel on to the given tick count.
+ *
+ * Must be called once for every increment of the system tick count, before
+ * collecting expired timers with timer_wheel_expired().
+ */
+extern void     timer_wheel_advance(uint16_t now);
+
+/**
+ * @ingroup Timers
+ * @brief Remove and return the next timer expiring on the given tick.
+ *
+ * @return Index of an expired timer or TIMER_WHEEL_NONE
+ */
+extern uint16_t timer_wheel_expired(uint16_t now);
+
+#endif // SYS_SW_TIMER_WHEEL
+
+#endif // _TIMER_WHEEL_H
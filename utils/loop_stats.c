@@ -0,0 +1,259 @@
+/**
+ *
+ * @file libesoup/utils/loop_stats.c
+ *
+ * @author John Whitmore
+ *
+ * @brief Instrumentation of the main loop and the jobs queues.
+ *
+ * Copyright 2017-2020 electronicSoup Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the version 2 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ *
+ * A Hardware timer is run as a stopwatch in uSeconds, which counts instruction
+ * cycles, and the main loop and jobs are timed against it. Cycle counts are
+ * converted to uSeconds when recorded so that the statistics don't depend on
+ * the clock frequency.
+ */
+#include "libesoup_config.h"
+
+#ifdef SYS_LOOP_STATS
+
+#ifdef SYS_SERIAL_LOGGING
+#define DEBUG_FILE
+static const char *TAG = "LOOP_STATS";
+#include "libesoup/logger/serial_log.h"
+#endif
+
+#include "libesoup/errno.h"
+#include "libesoup/timers/hw_timers.h"
+#include "libesoup/utils/loop_stats.h"
+#ifdef SYS_CAN_ISO15765
+#include "libesoup/comms/can/can.h"
+#endif
+
+#ifndef SYS_HW_TIMERS
+#error libesoup_config.h file should define SYS_HW_TIMERS (SYS_LOOP_STATS uses a Hardware timer)
+#endif
+
+/*
+ * Shortest loop period counted in the first histogram bucket is
+ * 2^LOOP_STATS_MIN_SHIFT uSeconds
+ */
+#define LOOP_STATS_MIN_SHIFT   3
+
+/*
+ * Weight of the newest sample in the moving average, 1/2^AVG_SHIFT
+ */
+#define AVG_SHIFT              3
+
+static timer_id          stats_timer = BAD_TIMER_ID;
+static uint32_t          cycles_per_us;
+static struct loop_stats stats;
+
+static boolean           loop_started;
+static uint32_t          loop_start;
+static uint32_t          second_start;
+static uint16_t          second_jobs;
+
+result_t loop_stats_init(void)
+{
+	struct timer_req request;
+	result_t         rc;
+
+	cycles_per_us = sys_clock_freq / 1000000;
+	if(cycles_per_us == 0) cycles_per_us = 1;
+
+	request.type = stopwatch;
+	request.period.units = uSeconds;
+	request.period.duration = 0;
+	request.exp_fn = NULL;
+
+	stats_timer = hw_timer_start(&request);
+	if(stats_timer < 0) {
+		LOG_E("No HW Timer for stats\n\r");
+		rc = stats_timer;
+		stats_timer = BAD_TIMER_ID;
+		return(rc);
+	}
+
+	loop_stats_reset();
+	return(SUCCESS);
+}
+
+void loop_stats_reset(void)
+{
+	uint8_t loop;
+
+	stats.loops = 0;
+	stats.timer_ticks = 0;
+	stats.jobs = 0;
+	stats.jobs_per_second = 0;
+	stats.jobs_high_water = 0;
+	stats.job_max_us = 0;
+	stats.job_avg_us = 0;
+	stats.loop_max_us = 0;
+	for(loop = 0; loop < LOOP_STATS_BUCKETS; loop++) {
+		stats.loop_period[loop] = 0;
+	}
+
+	loop_started = FALSE;
+	second_start = loop_stats_clock();
+	second_jobs = 0;
+}
+
+void loop_stats_get(struct loop_stats *copy)
+{
+	*copy = stats;
+}
+
+uint32_t loop_stats_clock(void)
+{
+	uint32_t ticks = 0;
+
+	if(stats_timer != BAD_TIMER_ID) {
+		hw_timer_stopwatch_ticks(stats_timer, &ticks);
+	}
+	return(ticks);
+}
+
+void loop_stats_loop(void)
+{
+	uint32_t now;
+	uint32_t period_us;
+	uint8_t  bucket;
+
+	now = loop_stats_clock();
+	stats.loops++;
+
+	if(loop_started) {
+		period_us = (now - loop_start) / cycles_per_us;
+		if(period_us > stats.loop_max_us) stats.loop_max_us = period_us;
+
+		period_us >>= LOOP_STATS_MIN_SHIFT;
+		bucket = 0;
+		while(period_us && (bucket < (LOOP_STATS_BUCKETS - 1))) {
+			period_us >>= 1;
+			bucket++;
+		}
+		if(stats.loop_period[bucket] < 0xffff) stats.loop_period[bucket]++;
+	}
+	loop_started = TRUE;
+	loop_start = now;
+
+	if(((now - second_start) / cycles_per_us) >= 1000000) {
+		stats.jobs_per_second = second_jobs;
+		second_jobs = 0;
+		second_start = now;
+	}
+}
+
+void loop_stats_timer_tick(void)
+{
+	stats.timer_ticks++;
+}
+
+void loop_stats_job(uint32_t start)
+{
+	uint32_t duration_us;
+
+	duration_us = (loop_stats_clock() - start) / cycles_per_us;
+
+	stats.jobs++;
+	if(second_jobs < 0xffff) second_jobs++;
+	if(duration_us > stats.job_max_us) stats.job_max_us = duration_us;
+
+	if(stats.jobs == 1) {
+		stats.job_avg_us = duration_us;
+	} else {
+		stats.job_avg_us = stats.job_avg_us - (stats.job_avg_us >> AVG_SHIFT) + (duration_us >> AVG_SHIFT);
+	}
+}
+
+/*
+ * May be called from an ISR but a lost update only loses a high water mark
+ * which the next job queued will probably set again.
+ */
+void loop_stats_queued(uint16_t depth)
+{
+	if(depth > stats.jobs_high_water) stats.jobs_high_water = depth;
+}
+
+#if defined(SYS_SERIAL_LOGGING) && defined(XC16)
+result_t loop_stats_serial_dump(void)
+{
+	struct loop_stats copy;
+	uint8_t           loop;
+
+	loop_stats_get(&copy);
+
+	serial_printf("Loops %ld timer ticks %ld\n\r", copy.loops, copy.timer_ticks);
+	serial_printf("Jobs %ld, %d per Second, high water %d\n\r", copy.jobs, copy.jobs_per_second, copy.jobs_high_water);
+	serial_printf("Job uS max %ld avg %ld\n\r", copy.job_max_us, copy.job_avg_us);
+	serial_printf("Loop uS max %ld\n\r", copy.loop_max_us);
+	for(loop = 0; loop < LOOP_STATS_BUCKETS; loop++) {
+		serial_printf("Loop < %ld uS : %d\n\r", (uint32_t)1 << (loop + LOOP_STATS_MIN_SHIFT), copy.loop_period[loop]);
+	}
+	return(SUCCESS);
+}
+#endif // SYS_SERIAL_LOGGING && XC16
+
+#ifdef SYS_CAN_ISO15765
+static uint8_t *put16(uint8_t *ptr, uint16_t value)
+{
+	*ptr++ = (uint8_t)value;
+	*ptr++ = (uint8_t)(value >> 8);
+	return(ptr);
+}
+
+static uint8_t *put32(uint8_t *ptr, uint32_t value)
+{
+	ptr = put16(ptr, (uint16_t)value);
+	return(put16(ptr, (uint16_t)(value >> 16)));
+}
+
+result_t loop_stats_iso15765_dump(uint8_t address)
+{
+	struct loop_stats copy;
+	iso15765_msg_t    msg;
+	uint8_t           data[(6 * 4) + (2 * 2) + (LOOP_STATS_BUCKETS * 2)];
+	uint8_t          *ptr;
+	uint8_t           loop;
+
+	loop_stats_get(&copy);
+
+	ptr = data;
+	ptr = put32(ptr, copy.loops);
+	ptr = put32(ptr, copy.timer_ticks);
+	ptr = put32(ptr, copy.jobs);
+	ptr = put16(ptr, copy.jobs_per_second);
+	ptr = put16(ptr, copy.jobs_high_water);
+	ptr = put32(ptr, copy.job_max_us);
+	ptr = put32(ptr, copy.job_avg_us);
+	ptr = put32(ptr, copy.loop_max_us);
+	for(loop = 0; loop < LOOP_STATS_BUCKETS; loop++) {
+		ptr = put16(ptr, copy.loop_period[loop]);
+	}
+
+	msg.address = address;
+	msg.protocol = CAN_ISO15765_LOOP_STATS_PROTOCOL_ID;
+	msg.size = (uint16_t)(ptr - data);
+	msg.data = data;
+
+	return(iso15765_tx_msg(&msg));
+}
+#endif // SYS_CAN_ISO15765
+
+#endif // SYS_LOOP_STATS
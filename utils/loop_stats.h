@@ -0,0 +1,116 @@
+/**
+ *
+ * @file libesoup/utils/loop_stats.h
+ *
+ * @author John Whitmore
+ *
+ * @brief Instrumentation of the main loop and the jobs queues.
+ *
+ * Copyright 2017-2020 electronicSoup Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the version 2 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************************
+ *
+ * Only included in a build if libesoup_config.h defines SYS_LOOP_STATS. Times
+ * are measured with a Hardware timer running as a stopwatch so the switch
+ * uses up one of the uC's Hardware timers.
+ */
+#ifndef _LOOP_STATS_H
+#define _LOOP_STATS_H
+
+#include "libesoup_config.h"
+
+#ifdef SYS_LOOP_STATS
+
+#include "libesoup/errno.h"
+
+/**
+ * @brief Number of buckets in the main loop period histogram.
+ *
+ * Bucket 0 counts loops of less than 8 uS, each following bucket doubles the
+ * limit and the last bucket counts everything longer than 64 mS.
+ */
+#define LOOP_STATS_BUCKETS     14
+
+/**
+ * @brief Snapshot of the system statistics returned by loop_stats_get()
+ */
+struct loop_stats {
+	uint32_t loops;                /**< Calls to libesoup_tasks() */
+	uint32_t timer_ticks;          /**< Calls to timer_tick() */
+	uint32_t jobs;                 /**< Jobs executed */
+	uint16_t jobs_per_second;      /**< Jobs executed in the last full second */
+	uint16_t jobs_high_water;      /**< Most jobs ever queued at one priority */
+	uint32_t job_max_us;           /**< Longest job execution time */
+	uint32_t job_avg_us;           /**< Moving average of job execution time */
+	uint32_t loop_max_us;          /**< Longest main loop period */
+	uint16_t loop_period[LOOP_STATS_BUCKETS]; /**< Histogram of loop periods */
+};
+
+/**
+ * @brief Start the stopwatch and clear all the statistics.
+ *
+ * Called from libesoup_init()
+ */
+extern result_t loop_stats_init(void);
+
+/**
+ * @brief Clear all the statistics
+ */
+extern void     loop_stats_reset(void);
+
+/**
+ * @brief Copy the current statistics.
+ */
+extern void     loop_stats_get(struct loop_stats *stats);
+
+/**
+ * @brief Read the stopwatch, for timing with loop_stats_job()
+ */
+extern uint32_t loop_stats_clock(void);
+
+/*
+ * Hooks called by libesoup, not by application code.
+ *
+ * loop_stats_loop()       - Start of every libesoup_tasks()
+ * loop_stats_timer_tick() - Every call to timer_tick()
+ * loop_stats_job()        - Job, started at loop_stats_clock() start, done
+ * loop_stats_queued()     - A jobs queue now holds depth jobs, may be an ISR
+ */
+extern void     loop_stats_loop(void);
+extern void     loop_stats_timer_tick(void);
+extern void     loop_stats_job(uint32_t start);
+extern void     loop_stats_queued(uint16_t depth);
+
+#if defined(SYS_SERIAL_LOGGING) && defined(XC16)
+/**
+ * @brief Print the statistics to the serial logging port.
+ */
+extern result_t loop_stats_serial_dump(void);
+#endif
+
+#ifdef SYS_CAN_ISO15765
+/**
+ * @brief Send the statistics to a node on the CAN Bus.
+ *
+ * @param address ISO15765 address of the node
+ *
+ * Sent as an ISO15765 message of protocol CAN_ISO15765_LOOP_STATS_PROTOCOL_ID,
+ * the fields of struct loop_stats in order, each Little Endian.
+ */
+extern result_t loop_stats_iso15765_dump(uint8_t address);
+#endif // SYS_CAN_ISO15765
+
+#endif // SYS_LOOP_STATS
+#endif // _LOOP_STATS_H